@@ -27,9 +27,6 @@
 /* Get prototype. */
 #include "challenge.h"
 
-/* Get gc_nonce. */
-#include <gc.h>
-
 /*
  * From draft-ietf-sasl-crammd5-02.txt:
  *
@@ -50,8 +47,8 @@
  *
  */
 
-/* The sequence of X in TEMPLATE must be twice as long as NONCELEN. */
-#define NONCELEN 10
+/* The sequence of X in TEMPLATE must be twice as long as
+   CRAM_MD5_NONCE_LEN. */
 #define TEMPLATE "<XXXXXXXXXXXXXXXXXXXX.0@localhost>"
 
 /* The probabilities for each digit are skewed (0-5 is more likely to
@@ -60,26 +57,19 @@
 		    '0' + ((c) & 0x0F) - 10 :	\
 		    '0' + ((c) & 0x0F))
 
-int
-cram_md5_challenge (char challenge[CRAM_MD5_CHALLENGE_LEN])
+void
+cram_md5_challenge (const char nonce[CRAM_MD5_NONCE_LEN],
+		    char challenge[CRAM_MD5_CHALLENGE_LEN])
 {
-  char nonce[NONCELEN];
   size_t i;
-  int rc;
 
   assert (strlen (TEMPLATE) == CRAM_MD5_CHALLENGE_LEN - 1);
 
   memcpy (challenge, TEMPLATE, CRAM_MD5_CHALLENGE_LEN);
 
-  rc = gc_nonce (nonce, sizeof (nonce));
-  if (rc != GC_OK)
-    return -1;
-
-  for (i = 0; i < sizeof (nonce); i++)
+  for (i = 0; i < CRAM_MD5_NONCE_LEN; i++)
     {
       challenge[1 + i] = DIGIT (nonce[i]);
       challenge[11 + i] = DIGIT (nonce[i] >> 4);
     }
-
-  return 0;
 }
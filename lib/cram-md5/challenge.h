@@ -24,11 +24,13 @@
 #define CHALLENGE_H
 
 #define CRAM_MD5_CHALLENGE_LEN 35
+#define CRAM_MD5_NONCE_LEN 10
 
-/* Store zero terminated CRAM-MD5 challenge in output buffer.  The
-   CHALLENGE buffer must be allocated by the caller, and must have
-   room for CRAM_MD5_CHALLENGE_LEN characters.  Returns 0 on success,
-   and -1 on randomness problems.  */
-extern int cram_md5_challenge (char challenge[CRAM_MD5_CHALLENGE_LEN]);
+/* Store zero terminated CRAM-MD5 challenge made from the random bytes
+   in NONCE in output buffer.  The CHALLENGE buffer must be allocated
+   by the caller, and must have room for CRAM_MD5_CHALLENGE_LEN
+   characters.  */
+extern void cram_md5_challenge (const char nonce[CRAM_MD5_NONCE_LEN],
+				char challenge[CRAM_MD5_CHALLENGE_LEN]);
 
 #endif /* CHALLENGE_H */
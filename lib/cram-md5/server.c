@@ -36,24 +36,33 @@
 /* Get cram_md5_challenge. */
 #include "challenge.h"
 
-/* Get cram_md5_digest. */
-#include "digest.h"
+/* Get gc_hmac_md5. */
+#include "gc.h"
+
+/* Get _gsasl_hex_to_bin, _gsasl_digest_eq. */
+#include "mechtools.h"
+
+/* Get _gsasl_session_nonce. */
+#include "noncepool.h"
 
 #define MD5LEN 16
 
 int
 _gsasl_cram_md5_server_start (Gsasl_session * sctx, void **mech_data)
 {
+  char nonce[CRAM_MD5_NONCE_LEN];
   char *challenge;
   int rc;
 
+  rc = _gsasl_session_nonce (sctx, nonce, CRAM_MD5_NONCE_LEN);
+  if (rc != GSASL_OK)
+    return GSASL_CRYPTO_ERROR;
+
   challenge = malloc (CRAM_MD5_CHALLENGE_LEN);
   if (challenge == NULL)
     return GSASL_MALLOC_ERROR;
 
-  rc = cram_md5_challenge (challenge);
-  if (rc)
-    return GSASL_CRYPTO_ERROR;
+  cram_md5_challenge (nonce, challenge);
 
   *mech_data = challenge;
 
@@ -67,7 +76,8 @@ _gsasl_cram_md5_server_step (Gsasl_session * sctx,
 			     char **output, size_t * output_len)
 {
   char *challenge = mech_data;
-  char hash[CRAM_MD5_DIGEST_LEN];
+  char hash[MD5LEN];
+  char response[MD5LEN];
   const char *password;
   char *username = NULL;
   int res = GSASL_OK;
@@ -107,12 +117,17 @@ _gsasl_cram_md5_server_step (Gsasl_session * sctx,
   if (res != GSASL_OK)
     return res;
 
-  cram_md5_digest (challenge, strlen (challenge),
-		   normkey, strlen (normkey), hash);
+  res = gc_hmac_md5 (normkey, strlen (normkey),
+		     challenge, strlen (challenge), hash);
 
   free (normkey);
 
-  if (memcmp (&input[input_len - MD5LEN * 2], hash, 2 * MD5LEN) == 0)
+  if (res != GC_OK)
+    return GSASL_CRYPTO_ERROR;
+
+  /* Compare the raw digests, the response is lowercase hex. */
+  if (_gsasl_hex_to_bin (&input[input_len - MD5LEN * 2], MD5LEN, response)
+      && _gsasl_digest_eq (response, hash, MD5LEN))
     res = GSASL_OK;
   else
     res = GSASL_AUTHENTICATION_ERROR;
@@ -43,6 +43,9 @@
 #include "digesthmac.h"
 #include "qop.h"
 
+/* Get _gsasl_digest_eq. */
+#include "mechtools.h"
+
 #define CNONCE_ENTROPY_BYTES 16
 
 struct _Gsasl_digest_md5_client_state
@@ -57,6 +60,9 @@ struct _Gsasl_digest_md5_client_state
   digest_md5_challenge challenge;
   digest_md5_response response;
   digest_md5_finish finish;
+  digest_md5_mac sendmac, readmac;
+  digest_md5_conf sendconf, readconf;
+  char frame[DIGEST_MD5_FRAME_LENGTH];
 };
 typedef struct _Gsasl_digest_md5_client_state _Gsasl_digest_md5_client_state;
 
@@ -130,7 +136,7 @@ _gsasl_digest_md5_client_step (Gsasl_session * sctx,
 	else
 	  gsasl_property_set (sctx, GSASL_REALM, NULL);
 
-	/* FIXME: cipher, maxbuf. */
+	/* FIXME: maxbuf. */
 
 	/* Create response token. */
 	state->response.utf8 = 1;
@@ -142,17 +148,37 @@ _gsasl_digest_md5_client_step (Gsasl_session * sctx,
 	  const char *qop = gsasl_property_get (sctx, GSASL_QOP);
 
 	  if (!qop)
-	    state->response.qop = GSASL_QOP_AUTH;
+	    state->response.qop = DIGEST_MD5_QOP_AUTH;
 	  else if (strcmp (qop, "qop-int") == 0)
-	    state->response.qop = GSASL_QOP_AUTH_INT;
+	    state->response.qop = DIGEST_MD5_QOP_AUTH_INT;
 	  else if (strcmp (qop, "qop-auth") == 0)
-	    state->response.qop = GSASL_QOP_AUTH;
+	    state->response.qop = DIGEST_MD5_QOP_AUTH;
+	  else if (strcmp (qop, "qop-conf") == 0)
+	    state->response.qop = DIGEST_MD5_QOP_AUTH_CONF;
 	  else
-	    /* We don't support confidentiality or unknown
-	       keywords. */
+	    /* We don't support unknown keywords. */
 	    return GSASL_AUTHENTICATION_ERROR;
 	}
 
+	/* Use the strongest of the offered ciphers we have. */
+	if (state->response.qop == DIGEST_MD5_QOP_AUTH_CONF)
+	  {
+	    int ciphers = state->challenge.ciphers & digest_md5_ciphers ();
+
+	    if (ciphers & DIGEST_MD5_CIPHER_RC4)
+	      state->response.cipher = DIGEST_MD5_CIPHER_RC4;
+	    else if (ciphers & DIGEST_MD5_CIPHER_3DES)
+	      state->response.cipher = DIGEST_MD5_CIPHER_3DES;
+	    else if (ciphers & DIGEST_MD5_CIPHER_RC4_56)
+	      state->response.cipher = DIGEST_MD5_CIPHER_RC4_56;
+	    else if (ciphers & DIGEST_MD5_CIPHER_DES)
+	      state->response.cipher = DIGEST_MD5_CIPHER_DES;
+	    else if (ciphers & DIGEST_MD5_CIPHER_RC4_40)
+	      state->response.cipher = DIGEST_MD5_CIPHER_RC4_40;
+	    else
+	      return GSASL_AUTHENTICATION_ERROR;
+	  }
+
 	state->response.nonce = strdup (state->challenge.nonce);
 	if (!state->response.nonce)
 	  return GSASL_MALLOC_ERROR;
@@ -232,6 +258,15 @@ _gsasl_digest_md5_client_step (Gsasl_session * sctx,
 			      state->kic, state->kis, state->kcc, state->kcs);
 	if (rc)
 	  return GSASL_CRYPTO_ERROR;
+	digest_md5_mac_init (&state->sendmac, state->kic);
+	digest_md5_mac_init (&state->readmac, state->kis);
+	if (state->response.qop & DIGEST_MD5_QOP_AUTH_CONF
+	    && (digest_md5_conf_init (&state->sendconf, state->response.cipher,
+				      state->kcc) < 0
+		|| digest_md5_conf_init (&state->readconf,
+					 state->response.cipher,
+					 state->kcs) < 0))
+	  return GSASL_CRYPTO_ERROR;
 
 	*output = digest_md5_print_response (&state->response);
 	if (!*output)
@@ -261,7 +296,8 @@ _gsasl_digest_md5_client_step (Gsasl_session * sctx,
 	if (res != GSASL_OK)
 	  break;
 
-	if (strcmp (state->finish.rspauth, check) == 0)
+	if (_gsasl_digest_eq (state->finish.rspauth, check,
+			      DIGEST_MD5_RESPONSE_LENGTH))
 	  res = GSASL_OK;
 	else
 	  res = GSASL_AUTHENTICATION_ERROR;
@@ -288,6 +324,8 @@ _gsasl_digest_md5_client_finish (Gsasl_session * sctx, void *mech_data)
   digest_md5_free_challenge (&state->challenge);
   digest_md5_free_response (&state->response);
   digest_md5_free_finish (&state->finish);
+  digest_md5_conf_done (&state->sendconf);
+  digest_md5_conf_done (&state->readconf);
 
   free (state);
 }
@@ -304,7 +342,8 @@ _gsasl_digest_md5_client_encode (Gsasl_session * sctx,
 
   res = digest_md5_encode (input, input_len, output, output_len,
 			   state->response.qop,
-			   state->sendseqnum, state->kic);
+			   state->sendseqnum, &state->sendmac,
+			   &state->sendconf);
   if (res)
     return res == -2 ? GSASL_NEEDS_MORE : GSASL_INTEGRITY_ERROR;
 
@@ -328,7 +367,8 @@ _gsasl_digest_md5_client_decode (Gsasl_session * sctx,
 
   res = digest_md5_decode (input, input_len, output, output_len,
 			   state->response.qop,
-			   state->readseqnum, state->kis);
+			   state->readseqnum, &state->readmac,
+			   &state->readconf);
   if (res)
     return res == -2 ? GSASL_NEEDS_MORE : GSASL_INTEGRITY_ERROR;
 
@@ -339,3 +379,71 @@ _gsasl_digest_md5_client_decode (Gsasl_session * sctx,
 
   return GSASL_OK;
 }
+
+int
+_gsasl_digest_md5_client_encodev (Gsasl_session * sctx,
+				  void *mech_data,
+				  const Gsasl_iov * input,
+				  size_t input_count,
+				  Gsasl_iov * output, size_t * output_count)
+{
+  _Gsasl_digest_md5_client_state *state = mech_data;
+  int res;
+
+  res = digest_md5_encodev (input, input_count, output, output_count,
+			    state->frame, state->response.qop,
+			    state->sendseqnum, &state->sendmac,
+			    &state->sendconf);
+  if (res)
+    return res == -2 ? GSASL_NEEDS_MORE : GSASL_INTEGRITY_ERROR;
+
+  if (state->sendseqnum == 4294967295UL)
+    state->sendseqnum = 0;
+  else
+    state->sendseqnum++;
+
+  return GSASL_OK;
+}
+
+int
+_gsasl_digest_md5_client_decodev (Gsasl_session * sctx,
+				  void *mech_data,
+				  const Gsasl_iov * input,
+				  size_t input_count,
+				  Gsasl_iov * output, size_t * output_count)
+{
+  _Gsasl_digest_md5_client_state *state = mech_data;
+  int res;
+
+  res = digest_md5_decodev (input, input_count, output, output_count,
+			    state->response.qop, state->readseqnum,
+			    &state->readmac, &state->readconf);
+  if (res)
+    return res == -2 ? GSASL_NEEDS_MORE : GSASL_INTEGRITY_ERROR;
+
+  if (state->readseqnum == 4294967295UL)
+    state->readseqnum = 0;
+  else
+    state->readseqnum++;
+
+  return GSASL_OK;
+}
+
+int
+_gsasl_digest_md5_client_layer (Gsasl_session * sctx,
+				void *mech_data,
+				size_t * sendmax, size_t * recvmax)
+{
+  _Gsasl_digest_md5_client_state *state = mech_data;
+
+  if (!state || !(state->response.qop & (DIGEST_MD5_QOP_AUTH_INT
+					 | DIGEST_MD5_QOP_AUTH_CONF)))
+    return 0;
+
+  *sendmax = digest_md5_payload_max (state->response.qop, &state->sendconf,
+				     state->challenge.servermaxbuf);
+  *recvmax = state->response.clientmaxbuf ? state->response.clientmaxbuf
+    : DIGEST_MD5_DEFAULT_MAXBUF;
+
+  return 1;
+}
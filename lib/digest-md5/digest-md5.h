@@ -49,6 +49,21 @@ extern int _gsasl_digest_md5_client_decode (Gsasl_session * sctx,
 					    size_t input_len,
 					    char **output,
 					    size_t * output_len);
+extern int _gsasl_digest_md5_client_encodev (Gsasl_session * sctx,
+					     void *mech_data,
+					     const Gsasl_iov * input,
+					     size_t input_count,
+					     Gsasl_iov * output,
+					     size_t * output_count);
+extern int _gsasl_digest_md5_client_decodev (Gsasl_session * sctx,
+					     void *mech_data,
+					     const Gsasl_iov * input,
+					     size_t input_count,
+					     Gsasl_iov * output,
+					     size_t * output_count);
+extern int _gsasl_digest_md5_client_layer (Gsasl_session * sctx,
+					   void *mech_data,
+					   size_t * sendmax, size_t * recvmax);
 
 extern int _gsasl_digest_md5_server_start (Gsasl_session * sctx,
 					   void **mech_data);
@@ -70,5 +85,20 @@ extern int _gsasl_digest_md5_server_decode (Gsasl_session * sctx,
 					    size_t input_len,
 					    char **output,
 					    size_t * output_len);
+extern int _gsasl_digest_md5_server_encodev (Gsasl_session * sctx,
+					     void *mech_data,
+					     const Gsasl_iov * input,
+					     size_t input_count,
+					     Gsasl_iov * output,
+					     size_t * output_count);
+extern int _gsasl_digest_md5_server_decodev (Gsasl_session * sctx,
+					     void *mech_data,
+					     const Gsasl_iov * input,
+					     size_t input_count,
+					     Gsasl_iov * output,
+					     size_t * output_count);
+extern int _gsasl_digest_md5_server_layer (Gsasl_session * sctx,
+					   void *mech_data,
+					   size_t * sendmax, size_t * recvmax);
 
 #endif /* DIGEST_MD5_H */
@@ -34,10 +34,15 @@ digest_md5_free_challenge (digest_md5_challenge * c)
 {
   size_t i;
 
-  for (i = 0; i < c->nrealms; i++)
-    free (c->realms[i]);
+  if (c->buf)
+    free (c->buf);
+  else
+    {
+      for (i = 0; i < c->nrealms; i++)
+	free (c->realms[i]);
+      free (c->nonce);
+    }
   free (c->realms);
-  free (c->nonce);
 
   memset (c, 0, sizeof (*c));
 }
@@ -45,12 +50,17 @@ digest_md5_free_challenge (digest_md5_challenge * c)
 void
 digest_md5_free_response (digest_md5_response * r)
 {
-  free (r->username);
-  free (r->realm);
-  free (r->nonce);
-  free (r->cnonce);
-  free (r->digesturi);
-  free (r->authzid);
+  if (r->buf)
+    free (r->buf);
+  else
+    {
+      free (r->username);
+      free (r->realm);
+      free (r->nonce);
+      free (r->cnonce);
+      free (r->digesturi);
+      free (r->authzid);
+    }
 
   memset (r, 0, sizeof (*r));
 }
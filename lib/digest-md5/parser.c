@@ -36,6 +36,12 @@
 /* Get validator. */
 #include "validate.h"
 
+/* Get digest_md5_directive, digest_md5_list_item. */
+#include "tokenize.h"
+
+/* Get digest_md5_free_challenge, digest_md5_free_response. */
+#include "free.h"
+
 #define DEFAULT_CHARSET "utf-8"
 #define DEFAULT_ALGORITHM "md5-sess"
 
@@ -115,15 +121,12 @@ parse_challenge (char *challenge, digest_md5_challenge * out)
   int disable_qop_auth_conf = 0;
   char *value;
 
-  memset (out, 0, sizeof (*out));
-
-  /* The size of a digest-challenge MUST be less than 2048 bytes. */
-  if (strlen (challenge) >= 2048)
-    return -1;
-
   while (*challenge != '\0')
-    switch (digest_md5_getsubopt (&challenge, digest_challenge_opts, &value))
+    switch (digest_md5_directive (&challenge, digest_challenge_opts, &value))
       {
+      case -2:
+	return -1;
+
       case CHALLENGE_REALM:
 	{
 	  char **tmp;
@@ -132,9 +135,7 @@ parse_challenge (char *challenge, digest_md5_challenge * out)
 	  if (!tmp)
 	    return -1;
 	  out->realms = tmp;
-	  out->realms[out->nrealms - 1] = strdup (value);
-	  if (!out->realms[out->nrealms - 1])
-	    return -1;
+	  out->realms[out->nrealms - 1] = value;
 	}
 	break;
 
@@ -144,9 +145,7 @@ parse_challenge (char *challenge, digest_md5_challenge * out)
 	   client should abort the authentication exchange. */
 	if (out->nonce)
 	  return -1;
-	out->nonce = strdup (value);
-	if (!out->nonce)
-	  return -1;
+	out->nonce = value;
 	break;
 
       case CHALLENGE_QOP:
@@ -155,12 +154,10 @@ parse_challenge (char *challenge, digest_md5_challenge * out)
 	if (out->qops)
 	  return -1;
 	{
-	  char *subsubopts;
-	  char *val;
+	  const char *subsubopts = value;
 
-	  subsubopts = value;
 	  while (*subsubopts != '\0')
-	    switch (digest_md5_getsubopt (&subsubopts, qop_opts, &val))
+	    switch (digest_md5_list_item (&subsubopts, qop_opts))
 	      {
 	      case QOP_AUTH:
 		out->qops |= DIGEST_MD5_QOP_AUTH;
@@ -242,12 +239,10 @@ parse_challenge (char *challenge, digest_md5_challenge * out)
 	if (out->ciphers)
 	  return -1;
 	{
-	  char *subsubopts;
-	  char *val;
+	  const char *subsubopts = value;
 
-	  subsubopts = value;
 	  while (*subsubopts != '\0')
-	    switch (digest_md5_getsubopt (&subsubopts, cipher_opts, &val))
+	    switch (digest_md5_list_item (&subsubopts, cipher_opts))
 	      {
 	      case CIPHER_DES:
 		out->ciphers |= DIGEST_MD5_CIPHER_DES;
@@ -351,23 +346,18 @@ parse_response (char *response, digest_md5_response * out)
 {
   char *value;
 
-  memset (out, 0, sizeof (*out));
-
-  /* The size of a digest-response MUST be less than 4096 bytes. */
-  if (strlen (response) >= 4096)
-    return -1;
-
   while (*response != '\0')
-    switch (digest_md5_getsubopt (&response, digest_response_opts, &value))
+    switch (digest_md5_directive (&response, digest_response_opts, &value))
       {
+      case -2:
+	return -1;
+
       case RESPONSE_USERNAME:
 	/* This directive is required and MUST be present exactly
 	   once; otherwise, authentication fails. */
 	if (out->username)
 	  return -1;
-	out->username = strdup (value);
-	if (!out->username)
-	  return -1;
+	out->username = value;
 	break;
 
       case RESPONSE_REALM:
@@ -377,9 +367,7 @@ parse_response (char *response, digest_md5_response * out)
 	   realms. */
 	if (out->realm)
 	  return -1;
-	out->realm = strdup (value);
-	if (!out->realm)
-	  return -1;
+	out->realm = value;
 	break;
 
       case RESPONSE_NONCE:
@@ -387,9 +375,7 @@ parse_response (char *response, digest_md5_response * out)
 	   once; otherwise, authentication fails. */
 	if (out->nonce)
 	  return -1;
-	out->nonce = strdup (value);
-	if (!out->nonce)
-	  return -1;
+	out->nonce = value;
 	break;
 
       case RESPONSE_CNONCE:
@@ -397,9 +383,7 @@ parse_response (char *response, digest_md5_response * out)
 	   otherwise, authentication fails. */
 	if (out->cnonce)
 	  return -1;
-	out->cnonce = strdup (value);
-	if (!out->cnonce)
-	  return -1;
+	out->cnonce = value;
 	break;
 
       case RESPONSE_NC:
@@ -436,9 +420,7 @@ parse_response (char *response, digest_md5_response * out)
 	if (out->digesturi)
 	  return -1;
 	/* FIXME: sub-parse. */
-	out->digesturi = strdup (value);
-	if (!out->digesturi)
-	  return -1;
+	out->digesturi = value;
 	break;
 
       case RESPONSE_RESPONSE:
@@ -501,9 +483,7 @@ parse_response (char *response, digest_md5_response * out)
 	/*  The authzid MUST NOT be an empty string. */
 	if (*value == '\0')
 	  return -1;
-	out->authzid = strdup (value);
-	if (!out->authzid)
-	  return -1;
+	out->authzid = value;
 	break;
 
       default:
@@ -535,15 +515,12 @@ parse_finish (char *finish, digest_md5_finish * out)
 {
   char *value;
 
-  memset (out, 0, sizeof (*out));
-
-  /* The size of a response-auth MUST be less than 2048 bytes. */
-  if (strlen (finish) >= 2048)
-    return -1;
-
   while (*finish != '\0')
-    switch (digest_md5_getsubopt (&finish, digest_responseauth_opts, &value))
+    switch (digest_md5_directive (&finish, digest_responseauth_opts, &value))
       {
+      case -2:
+	return -1;
+
       case RESPONSEAUTH_RSPAUTH:
 	if (*out->rspauth)
 	  return -1;
@@ -565,53 +542,91 @@ parse_finish (char *finish, digest_md5_finish * out)
   return 0;
 }
 
+/* Return the length of the message of LEN bytes at STR, or of the
+   zero terminated STR when LEN is 0, or 0 if it contains a zero or
+   is not shorter than MAX. */
+static size_t
+message_length (const char *str, size_t len, size_t max)
+{
+  if (len == 0)
+    len = strlen (str);
+  else if (memchr (str, '\0', len))
+    return 0;
+
+  return len < max ? len : 0;
+}
+
+/* The fields of OUT point into its copy of the message. */
 int
 digest_md5_parse_challenge (const char *challenge, size_t len,
 			    digest_md5_challenge * out)
 {
-  char *subopts = len ? strndup (challenge, len) : strdup (challenge);
-  int rc;
+  memset (out, 0, sizeof (*out));
 
-  if (!subopts)
+  /* The size of a digest-challenge MUST be less than 2048 bytes. */
+  len = message_length (challenge, len, 2048);
+  if (len == 0)
     return -1;
 
-  rc = parse_challenge (subopts, out);
+  out->buf = malloc (len + 1);
+  if (!out->buf)
+    return -1;
+  memcpy (out->buf, challenge, len);
+  out->buf[len] = '\0';
 
-  free (subopts);
+  if (parse_challenge (out->buf, out) < 0)
+    {
+      digest_md5_free_challenge (out);
+      return -1;
+    }
 
-  return rc;
+  return 0;
 }
 
+/* The fields of OUT point into its copy of the message. */
 int
 digest_md5_parse_response (const char *response, size_t len,
 			   digest_md5_response * out)
 {
-  char *subopts = len ? strndup (response, len) : strdup (response);
-  int rc;
+  memset (out, 0, sizeof (*out));
 
-  if (!subopts)
+  /* The size of a digest-response MUST be less than 4096 bytes. */
+  len = message_length (response, len, 4096);
+  if (len == 0)
     return -1;
 
-  rc = parse_response (subopts, out);
+  out->buf = malloc (len + 1);
+  if (!out->buf)
+    return -1;
+  memcpy (out->buf, response, len);
+  out->buf[len] = '\0';
 
-  free (subopts);
+  if (parse_response (out->buf, out) < 0)
+    {
+      digest_md5_free_response (out);
+      return -1;
+    }
 
-  return rc;
+  return 0;
 }
 
 int
 digest_md5_parse_finish (const char *finish, size_t len,
 			 digest_md5_finish * out)
 {
-  char *subopts = len ? strndup (finish, len) : strdup (finish);
-  int rc;
+  char buf[2048];
 
-  if (!subopts)
-    return -1;
+  memset (out, 0, sizeof (*out));
 
-  rc = parse_finish (subopts, out);
+  /* The size of a response-auth MUST be less than 2048 bytes.  The
+     values are copied into OUT, so the message is parsed on the
+     stack. */
+  len = message_length (finish, len, sizeof (buf));
+  if (len == 0)
+    return -1;
 
-  free (subopts);
+  memcpy (buf, finish, len);
+  buf[len] = '\0';
 
-  return rc;
+  return parse_finish (buf, out);
 }
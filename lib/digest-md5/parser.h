@@ -26,9 +26,6 @@
 /* Get token types. */
 #include "tokens.h"
 
-extern int digest_md5_getsubopt (char **optionp,
-				 const char *const *tokens, char **valuep);
-
 extern int digest_md5_parse_challenge (const char *challenge, size_t len,
 				       digest_md5_challenge * out);
 
@@ -27,230 +27,156 @@
 /* Get prototypes. */
 #include "printer.h"
 
-/* Get free. */
-#include <stdlib.h>
-
-/* Get asprintf. */
-#include <stdio.h>
+/* Get strcspn, strlen. */
+#include <string.h>
 
 /* Get token validator. */
 #include "validate.h"
 
-/* Append a key/value pair to a comma'd string list.  Additionally enclose
-   the value in quotes if requested. */
-static int
-comma_append (char **dst, const char *key, const char *value, int quotes)
+/* Get _gsasl_msgbuf_*. */
+#include "msgbuf.h"
+
+/* Start a key/value pair in a comma'd string list. */
+static void
+comma_key (struct _gsasl_msgbuf *out, const char *key)
 {
-  char *tmp;
-  int result;
-
-  if (*dst)
-    if (value)
-      if (quotes)
-	result = asprintf (&tmp, "%s, %s=\"%s\"", *dst, key, value);
-      else
-	result = asprintf (&tmp, "%s, %s=%s", *dst, key, value);
-    else
-      result = asprintf (&tmp, "%s, %s", *dst, key);
-  else if (value)
-    if (quotes)
-      result = asprintf (&tmp, "%s=\"%s\"", key, value);
-    else
-      result = asprintf (&tmp, "%s=%s", key, value);
-  else
-    result = asprintf (&tmp, "%s", key);
-
-  if (result < 0)
-    return result;
-
-  free (*dst);
-
-  *dst = tmp;
-
-  return result;
+  if (out->len > 0)
+    _gsasl_msgbuf_add (out, ", ", 2);
+  _gsasl_msgbuf_puts (out, key);
 }
 
-char *
-digest_md5_print_challenge (digest_md5_challenge * c)
+/* Append a key/value pair to a comma'd string list.  Additionally enclose
+   the value in quotes if requested, with a backslash before quotes and
+   backslashes in it. */
+static void
+comma_append (struct _gsasl_msgbuf *out, const char *key, const char *value,
+	      int quotes)
 {
-  char *out = NULL;
-  size_t i;
-
-  /* Below we assume the mandatory fields are present, verify that
-     first to avoid crashes. */
-  if (digest_md5_validate_challenge (c) != 0)
-    return NULL;
+  size_t len;
 
-  for (i = 0; i < c->nrealms; i++)
+  comma_key (out, key);
+  _gsasl_msgbuf_putc (out, '=');
+  if (!quotes)
     {
-      if (comma_append (&out, "realm", c->realms[i], 1) < 0)
-	{
-	  free (out);
-	  return NULL;
-	}
+      _gsasl_msgbuf_puts (out, value);
+      return;
     }
 
-  if (c->nonce)
-    if (comma_append (&out, "nonce", c->nonce, 1) < 0)
-      {
-	free (out);
-	return NULL;
-      }
-
-  if (c->qops)
+  _gsasl_msgbuf_putc (out, '"');
+  for (;;)
     {
-      char *tmp = NULL;
-
-      if (c->qops & DIGEST_MD5_QOP_AUTH)
-	if (comma_append (&tmp, "auth", NULL, 0) < 0)
-	  {
-	    free (tmp);
-	    free (out);
-	    return NULL;
-	  }
-
-      if (c->qops & DIGEST_MD5_QOP_AUTH_INT)
-	if (comma_append (&tmp, "auth-int", NULL, 0) < 0)
-	  {
-	    free (tmp);
-	    free (out);
-	    return NULL;
-	  }
-
-      if (c->qops & DIGEST_MD5_QOP_AUTH_CONF)
-	if (comma_append (&tmp, "auth-conf", NULL, 0) < 0)
-	  {
-	    free (tmp);
-	    free (out);
-	    return NULL;
-	  }
-
-      if (comma_append (&out, "qop", tmp, 1) < 0)
-	{
-	  free (tmp);
-	  free (out);
-	  return NULL;
-	}
-
-      free (tmp);
+      len = strcspn (value, "\"\\");
+      _gsasl_msgbuf_add (out, value, len);
+      if (value[len] == '\0')
+	break;
+      _gsasl_msgbuf_putc (out, '\\');
+      _gsasl_msgbuf_putc (out, value[len]);
+      value += len + 1;
     }
+  _gsasl_msgbuf_putc (out, '"');
+}
 
-  if (c->stale)
-    if (comma_append (&out, "stale", "true", 0) < 0)
+/* Append KEY with a quoted list of the NAMES whose bit is set in
+   FLAGS. */
+static void
+comma_append_list (struct _gsasl_msgbuf *out, const char *key, int flags,
+		   const int *bits, const char *const *names, size_t n)
+{
+  const char *sep = "";
+  size_t i;
+
+  comma_key (out, key);
+  _gsasl_msgbuf_add (out, "=\"", 2);
+  for (i = 0; i < n; i++)
+    if (flags & bits[i])
       {
-	free (out);
-	return NULL;
+	_gsasl_msgbuf_puts (out, sep);
+	_gsasl_msgbuf_puts (out, names[i]);
+	sep = ", ";
       }
+  _gsasl_msgbuf_putc (out, '"');
+}
 
-  if (c->servermaxbuf)
-    {
-      char *tmp;
+/* Append an unquoted number. */
+static void
+comma_append_number (struct _gsasl_msgbuf *out, const char *key,
+		     unsigned long n, unsigned base, size_t width)
+{
+  comma_key (out, key);
+  _gsasl_msgbuf_putc (out, '=');
+  _gsasl_msgbuf_number (out, n, base, width);
+}
+
+static void
+challenge (struct _gsasl_msgbuf *out, digest_md5_challenge * c)
+{
+  static const int qops[] = {
+    DIGEST_MD5_QOP_AUTH, DIGEST_MD5_QOP_AUTH_INT, DIGEST_MD5_QOP_AUTH_CONF
+  };
+  static const char *const qop_names[] = {
+    "auth", "auth-int", "auth-conf"
+  };
+  static const int ciphers[] = {
+    DIGEST_MD5_CIPHER_3DES, DIGEST_MD5_CIPHER_DES,
+    DIGEST_MD5_CIPHER_RC4_40, DIGEST_MD5_CIPHER_RC4,
+    DIGEST_MD5_CIPHER_RC4_56, DIGEST_MD5_CIPHER_AES_CBC
+  };
+  static const char *const cipher_names[] = {
+    "3des", "des", "rc4-40", "rc4", "rc4-56", "aes-cbc"
+  };
+  size_t i;
+
+  for (i = 0; i < c->nrealms; i++)
+    comma_append (out, "realm", c->realms[i], 1);
 
-      if (asprintf (&tmp, "%lu", c->servermaxbuf) < 0)
-	{
-	  free (out);
-	  return NULL;
-	}
+  if (c->nonce)
+    comma_append (out, "nonce", c->nonce, 1);
 
-      if (comma_append (&out, "maxbuf", tmp, 0) < 0)
-	{
-	  free (out);
-	  return NULL;
-	}
+  if (c->qops)
+    comma_append_list (out, "qop", c->qops, qops, qop_names,
+		       sizeof (qops) / sizeof (qops[0]));
 
-      free (tmp);
-    }
+  if (c->stale)
+    comma_append (out, "stale", "true", 0);
+
+  if (c->servermaxbuf)
+    comma_append_number (out, "maxbuf", c->servermaxbuf, 10, 0);
 
   if (c->utf8)
-    if (comma_append (&out, "charset", "utf-8", 0) < 0)
-      {
-	free (out);
-	return NULL;
-      }
+    comma_append (out, "charset", "utf-8", 0);
 
-  if (comma_append (&out, "algorithm", "md5-sess", 0) < 0)
-    {
-      free (out);
-      return NULL;
-    }
+  comma_append (out, "algorithm", "md5-sess", 0);
 
   if (c->ciphers)
-    {
-      char *tmp = NULL;
-
-      if (c->ciphers & DIGEST_MD5_CIPHER_3DES)
-	if (comma_append (&tmp, "3des", NULL, 0) < 0)
-	  {
-	    free (tmp);
-	    free (out);
-	    return NULL;
-	  }
-
-      if (c->ciphers & DIGEST_MD5_CIPHER_DES)
-	if (comma_append (&tmp, "des", NULL, 0) < 0)
-	  {
-	    free (tmp);
-	    free (out);
-	    return NULL;
-	  }
-
-      if (c->ciphers & DIGEST_MD5_CIPHER_RC4_40)
-	if (comma_append (&tmp, "rc4-40", NULL, 0) < 0)
-	  {
-	    free (tmp);
-	    free (out);
-	    return NULL;
-	  }
-
-      if (c->ciphers & DIGEST_MD5_CIPHER_RC4)
-	if (comma_append (&tmp, "rc4", NULL, 0) < 0)
-	  {
-	    free (tmp);
-	    free (out);
-	    return NULL;
-	  }
-
-      if (c->ciphers & DIGEST_MD5_CIPHER_RC4_56)
-	if (comma_append (&tmp, "rc4-56", NULL, 0) < 0)
-	  {
-	    free (tmp);
-	    free (out);
-	    return NULL;
-	  }
-
-      if (c->ciphers & DIGEST_MD5_CIPHER_AES_CBC)
-	if (comma_append (&tmp, "aes-cbc", NULL, 0) < 0)
-	  {
-	    free (tmp);
-	    free (out);
-	    return NULL;
-	  }
-
-      if (comma_append (&out, "cipher", tmp, 1) < 0)
-	{
-	  free (tmp);
-	  free (out);
-	  return NULL;
-	}
-
-      free (tmp);
-    }
-
-  return out;
+    comma_append_list (out, "cipher", c->ciphers, ciphers, cipher_names,
+		       sizeof (ciphers) / sizeof (ciphers[0]));
 }
 
 char *
-digest_md5_print_response (digest_md5_response * r)
+digest_md5_print_challenge (digest_md5_challenge * c)
 {
-  char *out = NULL;
-  const char *qop = NULL;
-  const char *cipher = NULL;
+  struct _gsasl_msgbuf out;
 
   /* Below we assume the mandatory fields are present, verify that
      first to avoid crashes. */
-  if (digest_md5_validate_response (r) != 0)
+  if (digest_md5_validate_challenge (c) != 0)
     return NULL;
 
+  /* Count the length, then print into a buffer of that size. */
+  _gsasl_msgbuf_init (&out, 0);
+  challenge (&out, c);
+  _gsasl_msgbuf_init (&out, out.len);
+  challenge (&out, c);
+
+  return _gsasl_msgbuf_finish (&out, NULL);
+}
+
+static void
+response (struct _gsasl_msgbuf *out, digest_md5_response * r)
+{
+  const char *qop = NULL;
+  const char *cipher = NULL;
+
   if (r->qop & DIGEST_MD5_QOP_AUTH_CONF)
     qop = "qop=auth-conf";
   else if (r->qop & DIGEST_MD5_QOP_AUTH_INT)
@@ -270,134 +196,76 @@ digest_md5_print_response (digest_md5_response * r)
     cipher = "cipher=rc4-56";
   else if (r->cipher & DIGEST_MD5_CIPHER_AES_CBC)
     cipher = "cipher=aes-cbc";
-  else if (r->cipher & DIGEST_MD5_CIPHER_3DES)
-    cipher = "cipher=3des";
 
   if (r->username)
-    if (comma_append (&out, "username", r->username, 1) < 0)
-      {
-	free (out);
-	return NULL;
-      }
+    comma_append (out, "username", r->username, 1);
 
   if (r->realm)
-    if (comma_append (&out, "realm", r->realm, 1) < 0)
-      {
-	free (out);
-	return NULL;
-      }
+    comma_append (out, "realm", r->realm, 1);
 
   if (r->nonce)
-    if (comma_append (&out, "nonce", r->nonce, 1) < 0)
-      {
-	free (out);
-	return NULL;
-      }
+    comma_append (out, "nonce", r->nonce, 1);
 
   if (r->cnonce)
-    if (comma_append (&out, "cnonce", r->cnonce, 1) < 0)
-      {
-	free (out);
-	return NULL;
-      }
+    comma_append (out, "cnonce", r->cnonce, 1);
 
   if (r->nc)
-    {
-      char *tmp;
-
-      if (asprintf (&tmp, "%08lx", r->nc) < 0)
-	{
-	  free (out);
-	  return NULL;
-	}
-
-      if (comma_append (&out, "nc", tmp, 0) < 0)
-	{
-	  free (tmp);
-	  free (out);
-	  return NULL;
-	}
-
-      free (tmp);
-    }
+    comma_append_number (out, "nc", r->nc, 16, 8);
 
   if (qop)
-    if (comma_append (&out, qop, NULL, 0) < 0)
-      {
-	free (out);
-	return NULL;
-      }
+    comma_key (out, qop);
 
   if (r->digesturi)
-    if (comma_append (&out, "digest-uri", r->digesturi, 1) < 0)
-      {
-	free (out);
-	return NULL;
-      }
+    comma_append (out, "digest-uri", r->digesturi, 1);
 
   if (r->response)
-    if (comma_append (&out, "response", r->response, 0) < 0)
-      {
-	free (out);
-	return NULL;
-      }
+    comma_append (out, "response", r->response, 0);
 
   if (r->clientmaxbuf)
-    {
-      char *tmp;
-
-      if (asprintf (&tmp, "%lu", r->clientmaxbuf) < 0)
-	{
-	  free (out);
-	  return NULL;
-	}
-
-      if (comma_append (&out, "maxbuf", tmp, 0) < 0)
-	{
-	  free (tmp);
-	  free (out);
-	  return NULL;
-	}
-
-      free (tmp);
-    }
+    comma_append_number (out, "maxbuf", r->clientmaxbuf, 10, 0);
 
   if (r->utf8)
-    if (comma_append (&out, "charset", "utf-8", 0) < 0)
-      {
-	free (out);
-	return NULL;
-      }
+    comma_append (out, "charset", "utf-8", 0);
 
   if (cipher)
-    if (comma_append (&out, cipher, NULL, 0) < 0)
-      {
-	free (out);
-	return NULL;
-      }
+    comma_key (out, cipher);
 
   if (r->authzid)
-    if (comma_append (&out, "authzid", r->authzid, 1) < 0)
-      {
-	free (out);
-	return NULL;
-      }
+    comma_append (out, "authzid", r->authzid, 1);
+}
+
+char *
+digest_md5_print_response (digest_md5_response * r)
+{
+  struct _gsasl_msgbuf out;
+
+  /* Below we assume the mandatory fields are present, verify that
+     first to avoid crashes. */
+  if (digest_md5_validate_response (r) != 0)
+    return NULL;
+
+  /* Count the length, then print into a buffer of that size. */
+  _gsasl_msgbuf_init (&out, 0);
+  response (&out, r);
+  _gsasl_msgbuf_init (&out, out.len);
+  response (&out, r);
 
-  return out;
+  return _gsasl_msgbuf_finish (&out, NULL);
 }
 
 char *
 digest_md5_print_finish (digest_md5_finish * finish)
 {
-  char *out;
+  struct _gsasl_msgbuf out;
 
   /* Below we assume the mandatory fields are present, verify that
      first to avoid crashes. */
   if (digest_md5_validate_finish (finish) != 0)
     return NULL;
 
-  if (asprintf (&out, "rspauth=%s", finish->rspauth) < 0)
-    return NULL;
+  _gsasl_msgbuf_init (&out, strlen ("rspauth=") + strlen (finish->rspauth));
+  _gsasl_msgbuf_puts (&out, "rspauth=");
+  _gsasl_msgbuf_puts (&out, finish->rspauth);
 
-  return out;
+  return _gsasl_msgbuf_finish (&out, NULL);
 }
@@ -28,10 +28,7 @@
 #include "qop.h"
 
 #include "tokens.h"
-#include "parser.h"
-
-#include <string.h>
-#include <stdlib.h>
+#include "tokenize.h"
 
 int
 digest_md5_qopstr2qops (const char *qopstr)
@@ -51,20 +48,13 @@ digest_md5_qopstr2qops (const char *qopstr)
     "qop-conf",
     NULL
   };
-  char *subsubopts;
-  char *val;
-  char *qopdup;
+  const char *subsubopts = qopstr;
 
   if (!qopstr)
     return 0;
 
-  qopdup = strdup (qopstr);
-  if (!qopdup)
-    return -1;
-
-  subsubopts = qopdup;
   while (*subsubopts != '\0')
-    switch (digest_md5_getsubopt (&subsubopts, qop_opts, &val))
+    switch (digest_md5_list_item (&subsubopts, qop_opts))
       {
       case QOP_AUTH:
 	qops |= DIGEST_MD5_QOP_AUTH;
@@ -83,8 +73,6 @@ digest_md5_qopstr2qops (const char *qopstr)
 	break;
       }
 
-  free (qopdup);
-
   return qops;
 }
 
@@ -44,6 +44,24 @@
 #include "validate.h"
 #include "qop.h"
 
+/* Get _gsasl_callback_pending. */
+#include "resume.h"
+
+/* Get _gsasl_property_prefetch. */
+#include "prefetch.h"
+
+/* Get _gsasl_session_nonce. */
+#include "noncepool.h"
+
+/* Get _gsasl_hex_p, _gsasl_hex_decode, _gsasl_digest_eq. */
+#include "mechtools.h"
+
+/* Get _gsasl_digest_md5_secret. */
+#include "digestkeys.h"
+
+/* Get _gsasl_digest_md5_cache_lookup, _gsasl_digest_md5_cache_store. */
+#include "digestcache.h"
+
 #define NONCE_ENTROPY_BYTES 16
 
 struct _Gsasl_digest_md5_server_state
@@ -58,6 +76,9 @@ struct _Gsasl_digest_md5_server_state
   digest_md5_challenge challenge;
   digest_md5_response response;
   digest_md5_finish finish;
+  digest_md5_mac sendmac, readmac;
+  digest_md5_conf sendconf, readconf;
+  char frame[DIGEST_MD5_FRAME_LENGTH];
 };
 typedef struct _Gsasl_digest_md5_server_state _Gsasl_digest_md5_server_state;
 
@@ -69,7 +90,7 @@ _gsasl_digest_md5_server_start (Gsasl_session * sctx, void **mech_data)
   char *p;
   int rc;
 
-  rc = gsasl_nonce (nonce, NONCE_ENTROPY_BYTES);
+  rc = _gsasl_session_nonce (sctx, nonce, NONCE_ENTROPY_BYTES);
   if (rc != GSASL_OK)
     return rc;
 
@@ -95,46 +116,58 @@ _gsasl_digest_md5_server_start (Gsasl_session * sctx, void **mech_data)
   return GSASL_OK;
 }
 
-static char
-_gsasl_digest_md5_hexdigit_to_char (char hexdigit)
+/* Compute the secret H({ username-value, ":", realm-value, ":",
+   passwd }) of the user into STATE, unless it is cached. */
+static int
+compute_secret (Gsasl_session * sctx, _Gsasl_digest_md5_server_state * state)
 {
-  /* The hex representation always contains lowercase alphabetic
-     characters.  See RFC 2831, 1.1. */
-
-  if (hexdigit >= '0' && hexdigit <= '9')
-    return hexdigit - '0';
-  if (hexdigit >= 'a' && hexdigit <= 'z')
-    return hexdigit - 'a' + 10;
-
-  return -1;
-}
+  static const Gsasl_property props[] = {
+    GSASL_DIGEST_MD5_HASHED_PASSWORD, GSASL_PASSWORD
+  };
+  const char *authid = gsasl_property_fast (sctx, GSASL_AUTHID);
+  const char *realm = gsasl_property_fast (sctx, GSASL_REALM);
+  bool latin1 = !state->response.utf8;
+  const char *passwd;
+  const char *hashed_passwd;
+  int rc;
 
-static char
-_gsasl_digest_md5_hex_to_char (char u, char l)
-{
-  return (char) (((unsigned char) _gsasl_digest_md5_hexdigit_to_char (u)) *
-		 16 + _gsasl_digest_md5_hexdigit_to_char (l));
-}
+  if (authid && _gsasl_digest_md5_cache_lookup (sctx, authid, realm, latin1,
+						state->secret))
+    return GSASL_OK;
 
-static int
-_gsasl_digest_md5_set_hashed_secret (char *secret, const char *hex_secret)
-{
-  /* Convert the hex string containing the secret to a byte array */
-  const char *p;
-  char *s;
+  _gsasl_property_prefetch (sctx, props, sizeof (props) / sizeof (props[0]));
+  hashed_passwd = gsasl_property_get (sctx, GSASL_DIGEST_MD5_HASHED_PASSWORD);
+  passwd = hashed_passwd ? NULL : gsasl_property_get (sctx, GSASL_PASSWORD);
 
-  if (!hex_secret)
-    return GSASL_AUTHENTICATION_ERROR;
+  /* A password set before the step must not stand in for a hashed
+     password that the application has yet to give. */
+  if (_gsasl_callback_pending (sctx))
+    return GSASL_CALLBACK_PENDING;
 
-  s = secret;
-  p = hex_secret;
-  while (*p)
+  if (hashed_passwd)
     {
-      *s = _gsasl_digest_md5_hex_to_char (p[0], p[1]);
-      s++;
+      if (strlen (hashed_passwd) != (DIGEST_MD5_LENGTH * 2)
+	  || !_gsasl_hex_p (hashed_passwd))
+	return GSASL_AUTHENTICATION_ERROR;
 
-      p += 2;
+      _gsasl_hex_decode (hashed_passwd, state->secret);
+    }
+  else if (passwd)
+    {
+      rc = _gsasl_digest_md5_secret (state->response.username,
+				     state->response.realm, passwd,
+				     state->secret);
+      if (rc != GSASL_OK)
+	return rc;
+
+      /* A hashed password is the application's to keep, only the
+	 hashing of passwords is saved. */
+      if (authid)
+	_gsasl_digest_md5_cache_store (sctx, authid, realm, latin1,
+				       state->secret);
     }
+  else
+    return GSASL_NO_PASSWORD;
 
   return GSASL_OK;
 }
@@ -155,10 +188,20 @@ _gsasl_digest_md5_server_step (Gsasl_session * sctx,
   switch (state->step)
     {
     case 0:
-      /* Set realm. */
       {
-	const char *c;
+	static const Gsasl_property props[] = { GSASL_REALM, GSASL_QOPS };
+	const char *c, *qopstr;
+
+	/* Ask for everything before changing state, in case the
+	   callback answers later and the step is run again. */
+	_gsasl_property_prefetch (sctx, props,
+				  sizeof (props) / sizeof (props[0]));
 	c = gsasl_property_get (sctx, GSASL_REALM);
+	qopstr = gsasl_property_get (sctx, GSASL_QOPS);
+	if (_gsasl_callback_pending (sctx))
+	  return GSASL_CALLBACK_PENDING;
+
+	/* Set realm. */
 	if (c)
 	  {
 	    state->challenge.nrealms = 1;
@@ -172,12 +215,8 @@ _gsasl_digest_md5_server_step (Gsasl_session * sctx,
 	    if (!state->challenge.realms[0])
 	      return GSASL_MALLOC_ERROR;
 	  }
-      }
-
-      /* Set QOP */
-      {
-	const char *qopstr = gsasl_property_get (sctx, GSASL_QOPS);
 
+	/* Set QOP */
 	if (qopstr)
 	  {
 	    int qops = digest_md5_qopstr2qops (qopstr);
@@ -185,16 +224,24 @@ _gsasl_digest_md5_server_step (Gsasl_session * sctx,
 	    if (qops == -1)
 	      return GSASL_MALLOC_ERROR;
 
-	    /* We don't support confidentiality right now. */
+	    /* Offer confidentiality with the ciphers we have. */
 	    if (qops & DIGEST_MD5_QOP_AUTH_CONF)
-	      return GSASL_AUTHENTICATION_ERROR;
+	      {
+		state->challenge.ciphers = digest_md5_ciphers ();
+		if (!state->challenge.ciphers)
+		  {
+		    qops &= ~DIGEST_MD5_QOP_AUTH_CONF;
+		    if (!qops)
+		      return GSASL_AUTHENTICATION_ERROR;
+		  }
+	      }
 
 	    if (qops)
 	      state->challenge.qops = qops;
 	  }
       }
 
-      /* FIXME: cipher, maxbuf, more realms. */
+      /* FIXME: maxbuf, more realms. */
 
       /* Create challenge. */
       *output = digest_md5_print_challenge (&state->challenge);
@@ -207,6 +254,8 @@ _gsasl_digest_md5_server_step (Gsasl_session * sctx,
       break;
 
     case 1:
+      /* A suspended step is run again. */
+      digest_md5_free_response (&state->response);
       if (digest_md5_parse_response (input, input_len, &state->response) < 0)
 	return GSASL_MECHANISM_PARSE_ERROR;
 
@@ -240,51 +289,11 @@ _gsasl_digest_md5_server_step (Gsasl_session * sctx,
 	}
       gsasl_property_set (sctx, GSASL_AUTHZID, state->response.authzid);
 
-      /* FIXME: cipher, maxbuf.  */
-
-      /* Compute secret. */
-      {
-	const char *passwd;
-	const char *hashed_passwd;
-
-	hashed_passwd =
-	  gsasl_property_get (sctx, GSASL_DIGEST_MD5_HASHED_PASSWORD);
-	if (hashed_passwd)
-	  {
-	    if (strlen (hashed_passwd) != (DIGEST_MD5_LENGTH * 2))
-	      return GSASL_AUTHENTICATION_ERROR;
-
-	    rc = _gsasl_digest_md5_set_hashed_secret (state->secret,
-						      hashed_passwd);
-	    if (rc != GSASL_OK)
-	      return rc;
-	  }
-	else if ((passwd = gsasl_property_get (sctx, GSASL_PASSWORD)) != NULL)
-	  {
-	    char *tmp, *tmp2;
-
-	    tmp2 = utf8tolatin1ifpossible (passwd);
-
-	    rc = asprintf (&tmp, "%s:%s:%s", state->response.username,
-			   state->response.realm ?
-			   state->response.realm : "", tmp2);
-	    free (tmp2);
-	    if (rc < 0)
-	      return GSASL_MALLOC_ERROR;
-
-	    rc = gsasl_md5 (tmp, strlen (tmp), &tmp2);
-	    free (tmp);
-	    if (rc != GSASL_OK)
-	      return rc;
+      /* FIXME: maxbuf.  */
 
-	    memcpy (state->secret, tmp2, DIGEST_MD5_LENGTH);
-	    free (tmp2);
-	  }
-	else
-	  {
-	    return GSASL_NO_PASSWORD;
-	  }
-      }
+      rc = compute_secret (sctx, state);
+      if (rc != GSASL_OK)
+	return rc;
 
       /* Check client response. */
       {
@@ -299,8 +308,18 @@ _gsasl_digest_md5_server_step (Gsasl_session * sctx,
 			      state->kic, state->kis, state->kcc, state->kcs);
 	if (rc)
 	  return GSASL_AUTHENTICATION_ERROR;
+	digest_md5_mac_init (&state->sendmac, state->kis);
+	digest_md5_mac_init (&state->readmac, state->kic);
+	if (state->response.qop & DIGEST_MD5_QOP_AUTH_CONF
+	    && (digest_md5_conf_init (&state->sendconf, state->response.cipher,
+				      state->kcs) < 0
+		|| digest_md5_conf_init (&state->readconf,
+					 state->response.cipher,
+					 state->kcc) < 0))
+	  return GSASL_AUTHENTICATION_ERROR;
 
-	if (strcmp (state->response.response, check) != 0)
+	if (!_gsasl_digest_eq (state->response.response, check,
+			       DIGEST_MD5_RESPONSE_LENGTH))
 	  return GSASL_AUTHENTICATION_ERROR;
       }
 
@@ -343,6 +362,8 @@ _gsasl_digest_md5_server_finish (Gsasl_session * sctx, void *mech_data)
   digest_md5_free_challenge (&state->challenge);
   digest_md5_free_response (&state->response);
   digest_md5_free_finish (&state->finish);
+  digest_md5_conf_done (&state->sendconf);
+  digest_md5_conf_done (&state->readconf);
 
   free (state);
 }
@@ -359,7 +380,7 @@ _gsasl_digest_md5_server_encode (Gsasl_session * sctx,
 
   res = digest_md5_encode (input, input_len, output, output_len,
 			   state->response.qop, state->sendseqnum,
-			   state->kis);
+			   &state->sendmac, &state->sendconf);
   if (res)
     return res == -2 ? GSASL_NEEDS_MORE : GSASL_INTEGRITY_ERROR;
 
@@ -383,7 +404,7 @@ _gsasl_digest_md5_server_decode (Gsasl_session * sctx,
 
   res = digest_md5_decode (input, input_len, output, output_len,
 			   state->response.qop, state->readseqnum,
-			   state->kic);
+			   &state->readmac, &state->readconf);
   if (res)
     return res == -2 ? GSASL_NEEDS_MORE : GSASL_INTEGRITY_ERROR;
 
@@ -394,3 +415,71 @@ _gsasl_digest_md5_server_decode (Gsasl_session * sctx,
 
   return GSASL_OK;
 }
+
+int
+_gsasl_digest_md5_server_encodev (Gsasl_session * sctx,
+				  void *mech_data,
+				  const Gsasl_iov * input,
+				  size_t input_count,
+				  Gsasl_iov * output, size_t * output_count)
+{
+  _Gsasl_digest_md5_server_state *state = mech_data;
+  int res;
+
+  res = digest_md5_encodev (input, input_count, output, output_count,
+			    state->frame, state->response.qop,
+			    state->sendseqnum, &state->sendmac,
+			    &state->sendconf);
+  if (res)
+    return res == -2 ? GSASL_NEEDS_MORE : GSASL_INTEGRITY_ERROR;
+
+  if (state->sendseqnum == 4294967295UL)
+    state->sendseqnum = 0;
+  else
+    state->sendseqnum++;
+
+  return GSASL_OK;
+}
+
+int
+_gsasl_digest_md5_server_decodev (Gsasl_session * sctx,
+				  void *mech_data,
+				  const Gsasl_iov * input,
+				  size_t input_count,
+				  Gsasl_iov * output, size_t * output_count)
+{
+  _Gsasl_digest_md5_server_state *state = mech_data;
+  int res;
+
+  res = digest_md5_decodev (input, input_count, output, output_count,
+			    state->response.qop, state->readseqnum,
+			    &state->readmac, &state->readconf);
+  if (res)
+    return res == -2 ? GSASL_NEEDS_MORE : GSASL_INTEGRITY_ERROR;
+
+  if (state->readseqnum == 4294967295UL)
+    state->readseqnum = 0;
+  else
+    state->readseqnum++;
+
+  return GSASL_OK;
+}
+
+int
+_gsasl_digest_md5_server_layer (Gsasl_session * sctx,
+				void *mech_data,
+				size_t * sendmax, size_t * recvmax)
+{
+  _Gsasl_digest_md5_server_state *state = mech_data;
+
+  if (!state || !(state->response.qop & (DIGEST_MD5_QOP_AUTH_INT
+					 | DIGEST_MD5_QOP_AUTH_CONF)))
+    return 0;
+
+  *sendmax = digest_md5_payload_max (state->response.qop, &state->sendconf,
+				     state->response.clientmaxbuf);
+  *recvmax = state->challenge.servermaxbuf ? state->challenge.servermaxbuf
+    : DIGEST_MD5_DEFAULT_MAXBUF;
+
+  return 1;
+}
@@ -33,8 +33,8 @@
 /* Get memcpy, strdup, strlen. */
 #include <string.h>
 
-/* Get gc_hmac_md5. */
-#include <gc.h>
+/* Get _gsasl_digest_eq. */
+#include "mechtools.h"
 
 #define MD5LEN 16
 #define SASL_INTEGRITY_PREFIX_LENGTH 4
@@ -43,154 +43,670 @@
 #define MAC_MSG_TYPE "\x00\x01"
 #define MAC_MSG_TYPE_LEN 2
 #define MAC_SEQNUM_LEN 4
+#define MAC_TRAILER_LEN (MAC_HMAC_LEN + MAC_MSG_TYPE_LEN + MAC_SEQNUM_LEN)
 
+#define C2I(buf) ((buf[3] & 0xFF) |		\
+		  ((buf[2] & 0xFF) << 8) |	\
+		  ((buf[1] & 0xFF) << 16) |	\
+		  ((buf[0] & 0xFF) << 24))
+
+static void
+put_uint32 (char *buf, unsigned long n)
+{
+  buf[0] = (n >> 24) & 0xFF;
+  buf[1] = (n >> 16) & 0xFF;
+  buf[2] = (n >> 8) & 0xFF;
+  buf[3] = n & 0xFF;
+}
+
+static size_t
+iov_length (const Gsasl_iov * iov, size_t n)
+{
+  size_t len = 0;
+
+  while (n--)
+    len += iov++->len;
+
+  return len;
+}
+
+/* Copy LEN bytes at OFFSET of the data in IOV to BUF. */
+static void
+iov_read (const Gsasl_iov * iov, size_t n, size_t offset,
+	  char *buf, size_t len)
+{
+  for (; n > 0 && len > 0; iov++, n--)
+    {
+      size_t l;
+
+      if (offset >= iov->len)
+	{
+	  offset -= iov->len;
+	  continue;
+	}
+
+      l = iov->len - offset < len ? iov->len - offset : len;
+      memcpy (buf, iov->base + offset, l);
+      buf += l;
+      len -= l;
+      offset = 0;
+    }
+}
+
+/* Describe LEN bytes at OFFSET of the data in IOV in OUT, and return
+   the number of segments used, which is at most N. */
+static size_t
+iov_slice (const Gsasl_iov * iov, size_t n, size_t offset, size_t len,
+	   Gsasl_iov * out)
+{
+  size_t count = 0;
+
+  for (; n > 0 && len > 0; iov++, n--)
+    {
+      size_t l;
+
+      if (offset >= iov->len)
+	{
+	  offset -= iov->len;
+	  continue;
+	}
+
+      l = iov->len - offset < len ? iov->len - offset : len;
+      out[count].base = iov->base + offset;
+      out[count].len = l;
+      count++;
+      len -= l;
+      offset = 0;
+    }
+
+  return count;
+}
+
+/* Prepare MAC for computing HMAC-MD5 under KEY.  The padded key
+   blocks are hashed here, once per session, instead of for every
+   message. */
+void
+digest_md5_mac_init (digest_md5_mac * mac, const char key[DIGEST_MD5_LENGTH])
+{
+  char block[64];
+  size_t i;
+
+  memset (block, 0x36, sizeof (block));
+  for (i = 0; i < DIGEST_MD5_LENGTH; i++)
+    block[i] ^= key[i];
+  md5_init_ctx (&mac->inner);
+  md5_process_block (block, sizeof (block), &mac->inner);
+
+  memset (block, 0x5c, sizeof (block));
+  for (i = 0; i < DIGEST_MD5_LENGTH; i++)
+    block[i] ^= key[i];
+  md5_init_ctx (&mac->outer);
+  md5_process_block (block, sizeof (block), &mac->outer);
+
+  memset (block, 0, sizeof (block));
+}
+
+/* Compute the HMAC-MD5 of the 4 byte SEQNUM followed by the data in
+   IOV, without gathering the data. */
+static void
+hmac_iov (const digest_md5_mac * mac, const char seqnum[MAC_SEQNUM_LEN],
+	  const Gsasl_iov * iov, size_t n, char hash[MD5LEN])
+{
+  struct md5_ctx ctx = mac->inner;
+  size_t i;
+
+  md5_process_bytes (seqnum, MAC_SEQNUM_LEN, &ctx);
+  for (i = 0; i < n; i++)
+    md5_process_bytes (iov[i].base, iov[i].len, &ctx);
+  md5_finish_ctx (&ctx, hash);
+
+  ctx = mac->outer;
+  md5_process_bytes (hash, MD5LEN, &ctx);
+  md5_finish_ctx (&ctx, hash);
+}
+
+/* Return the set of ciphers for the confidentiality layer that the
+   crypto library provides. */
 int
-digest_md5_encode (const char *input, size_t input_len,
-		   char **output, size_t * output_len,
-		   digest_md5_qop qop,
-		   unsigned long sendseqnum, char key[DIGEST_MD5_LENGTH])
+digest_md5_ciphers (void)
 {
-  int res;
+  static const struct
+  {
+    int ciphers;
+    Gc_cipher alg;
+    Gc_cipher_mode mode;
+  } algs[] =
+  {
+    {DIGEST_MD5_CIPHER_RC4 | DIGEST_MD5_CIPHER_RC4_40
+       | DIGEST_MD5_CIPHER_RC4_56, GC_ARCFOUR128, GC_STREAM},
+    {DIGEST_MD5_CIPHER_DES, GC_DES, GC_CBC},
+    {DIGEST_MD5_CIPHER_3DES, GC_3DES, GC_CBC}
+  };
+  gc_cipher_handle h;
+  int ciphers = 0;
+  size_t i;
 
-  if (qop & DIGEST_MD5_QOP_AUTH_CONF)
+  for (i = 0; i < sizeof (algs) / sizeof (algs[0]); i++)
+    if (gc_cipher_open (algs[i].alg, algs[i].mode, &h) == GC_OK)
+      {
+	gc_cipher_close (h);
+	ciphers |= algs[i].ciphers;
+      }
+
+  return ciphers;
+}
+
+/* Spread the 56 bits in the 7 bytes IN over the 8 bytes DES key OUT,
+   with odd parity, see RFC 2831 section 2.4. */
+static void
+des_key (const char *in, char *out)
+{
+  const unsigned char *p = (const unsigned char *) in;
+  size_t i;
+
+  out[0] = p[0];
+  for (i = 1; i < 7; i++)
+    out[i] = (p[i - 1] << (8 - i)) | (p[i] >> i);
+  out[7] = p[6] << 1;
+
+  for (i = 0; i < 8; i++)
     {
+      unsigned char c = out[i] & 0xFE;
+      unsigned char b = c ^ (c >> 4);
+
+      b ^= b >> 2;
+      b ^= b >> 1;
+      out[i] = c | (~b & 1);
+    }
+}
+
+/* Prepare CONF for encrypting with CIPHER under the 16 byte KEY,
+   i.e., Kcc or Kcs.  CONF is either zeroed or was prepared before,
+   in which case it is closed first.  Returns 0 on success. */
+int
+digest_md5_conf_init (digest_md5_conf * conf, digest_md5_cipher cipher,
+		      const char key[DIGEST_MD5_LENGTH])
+{
+  char k[24];
+  Gc_rc rc;
+
+  digest_md5_conf_done (conf);
+
+  switch (cipher)
+    {
+    case DIGEST_MD5_CIPHER_RC4:
+    case DIGEST_MD5_CIPHER_RC4_40:
+    case DIGEST_MD5_CIPHER_RC4_56:
+      /* The key derivation makes the difference, the cipher is keyed
+	 with all 16 bytes. */
+      rc = gc_cipher_open (GC_ARCFOUR128, GC_STREAM, &conf->handle);
+      if (rc == GC_OK)
+	rc = gc_cipher_setkey (conf->handle, DIGEST_MD5_LENGTH, key);
+      conf->blocksize = 1;
+      break;
+
+    case DIGEST_MD5_CIPHER_DES:
+      des_key (key, k);
+      rc = gc_cipher_open (GC_DES, GC_CBC, &conf->handle);
+      if (rc == GC_OK)
+	rc = gc_cipher_setkey (conf->handle, 8, k);
+      if (rc == GC_OK)
+	rc = gc_cipher_setiv (conf->handle, 8, key + 8);
+      conf->blocksize = 8;
+      break;
+
+    case DIGEST_MD5_CIPHER_3DES:
+      /* Two key EDE, K1 K2 K1. */
+      des_key (key, k);
+      des_key (key + 7, k + 8);
+      memcpy (k + 16, k, 8);
+      rc = gc_cipher_open (GC_3DES, GC_CBC, &conf->handle);
+      if (rc == GC_OK)
+	rc = gc_cipher_setkey (conf->handle, 24, k);
+      if (rc == GC_OK)
+	rc = gc_cipher_setiv (conf->handle, 8, key + 8);
+      conf->blocksize = 8;
+      break;
+
+    default:
       return -1;
     }
-  else if (qop & DIGEST_MD5_QOP_AUTH_INT)
+
+  memset (k, 0, sizeof (k));
+
+  if (rc != GC_OK)
+    {
+      digest_md5_conf_done (conf);
+      return -1;
+    }
+
+  return 0;
+}
+
+void
+digest_md5_conf_done (digest_md5_conf * conf)
+{
+  if (conf->handle)
+    gc_cipher_close (conf->handle);
+  conf->handle = NULL;
+  free (conf->buf);
+  conf->buf = NULL;
+  conf->bufsize = 0;
+}
+
+/* Return a buffer of at least SIZE bytes in CONF. */
+static char *
+conf_buffer (digest_md5_conf * conf, size_t size)
+{
+  if (size > conf->bufsize)
     {
-      char *seqnumin;
-      char hash[GC_MD5_DIGEST_SIZE];
-      size_t len;
+      char *p = realloc (conf->buf, size);
+
+      if (!p)
+	return NULL;
+      conf->buf = p;
+      conf->bufsize = size;
+    }
+
+  return conf->buf;
+}
+
+/* Return in *SIZE the length of the sealed message carrying LEN
+   bytes, i.e., {length, CIPHER (Kc, {msg, pad, HMAC}), type, seqnum}.
+   Returns -1 if it does not fit the length field. */
+static int
+sealed_size (const digest_md5_conf * conf, size_t len, size_t * size)
+{
+  size_t pad = conf->blocksize - (len + MAC_HMAC_LEN) % conf->blocksize;
+
+  if (conf->blocksize == 1)
+    pad = 0;
+  if (len > 0xFFFFFFFFUL - MAC_TRAILER_LEN - pad)
+    return -1;
+
+  *size = MAC_DATA_LEN + len + pad + MAC_TRAILER_LEN;
+
+  return 0;
+}
+
+/* Write the sealed message carrying the data in the N segments of
+   IOV to OUT, of the size given by sealed_size.  The data is copied
+   once and then encrypted where it is. */
+static int
+seal (digest_md5_conf * conf, const digest_md5_mac * mac,
+      unsigned long seqnum, const Gsasl_iov * iov, size_t n,
+      char *out, size_t size)
+{
+  size_t clen = size - MAC_DATA_LEN - MAC_MSG_TYPE_LEN - MAC_SEQNUM_LEN;
+  char *seq = out + size - MAC_SEQNUM_LEN;
+  char *p = out + MAC_DATA_LEN;
+  char hash[MD5LEN];
+  size_t pad;
+
+  put_uint32 (out, size - MAC_DATA_LEN);
+  put_uint32 (seq, seqnum);
+  memcpy (seq - MAC_MSG_TYPE_LEN, MAC_MSG_TYPE, MAC_MSG_TYPE_LEN);
+
+  hmac_iov (mac, seq, iov, n, hash);
+
+  for (; n > 0; iov++, n--)
+    {
+      memcpy (p, iov->base, iov->len);
+      p += iov->len;
+    }
+  pad = out + MAC_DATA_LEN + clen - MAC_HMAC_LEN - p;
+  memset (p, pad, pad);
+  memcpy (p + pad, hash, MAC_HMAC_LEN);
+
+  if (gc_cipher_encrypt_inline (conf->handle, clen, out + MAC_DATA_LEN)
+      != GC_OK)
+    return -1;
+
+  return 0;
+}
+
+/* Check the framing of the sealed message in the N segments of IOV,
+   and return the length of its encrypted part in *CLEN.  Returns -2
+   when the message is incomplete. */
+static int
+sealed_check (const digest_md5_conf * conf, unsigned long seqnum,
+	      const Gsasl_iov * iov, size_t n, size_t * clen)
+{
+  size_t input_len = iov_length (iov, n);
+  char prefix[SASL_INTEGRITY_PREFIX_LENGTH];
+  char trailer[MAC_MSG_TYPE_LEN + MAC_SEQNUM_LEN];
+  char seq[MAC_SEQNUM_LEN];
+  unsigned long len;
+
+  if (input_len < SASL_INTEGRITY_PREFIX_LENGTH)
+    return -2;
+
+  iov_read (iov, n, 0, prefix, sizeof (prefix));
+  len = C2I (prefix);
+
+  if (input_len < SASL_INTEGRITY_PREFIX_LENGTH + len)
+    return -2;
+  if (input_len != SASL_INTEGRITY_PREFIX_LENGTH + len
+      || len < MAC_TRAILER_LEN)
+    return -1;
+
+  len -= sizeof (trailer);
+  if (len % conf->blocksize)
+    return -1;
+
+  iov_read (iov, n, MAC_DATA_LEN + len, trailer, sizeof (trailer));
+  put_uint32 (seq, seqnum);
+  if (memcmp (trailer, MAC_MSG_TYPE, MAC_MSG_TYPE_LEN) != 0
+      || memcmp (trailer + MAC_MSG_TYPE_LEN, seq, MAC_SEQNUM_LEN) != 0)
+    return -1;
 
-      seqnumin = malloc (MAC_SEQNUM_LEN + input_len);
-      if (seqnumin == NULL)
+  *clen = len;
+
+  return 0;
+}
+
+/* Decrypt the CLEN bytes long encrypted part of the sealed message
+   in the N segments of IOV into OUT, verify it, and return the
+   length of the data at the start of OUT in *OUTLEN. */
+static int
+unseal (digest_md5_conf * conf, const digest_md5_mac * mac,
+	unsigned long seqnum, const Gsasl_iov * iov, size_t n,
+	size_t clen, char *out, size_t * outlen)
+{
+  char seq[MAC_SEQNUM_LEN];
+  char hash[MD5LEN];
+  Gsasl_iov msg;
+  size_t pad = 0, i;
+
+  iov_read (iov, n, MAC_DATA_LEN, out, clen);
+  if (gc_cipher_decrypt_inline (conf->handle, clen, out) != GC_OK)
+    return -1;
+
+  msg.base = out;
+  msg.len = clen - MAC_HMAC_LEN;
+
+  if (conf->blocksize > 1)
+    {
+      pad = (unsigned char) out[msg.len - 1];
+      if (pad < 1 || pad > conf->blocksize || pad > msg.len)
 	return -1;
+      for (i = 1; i < pad; i++)
+	if ((unsigned char) out[msg.len - 1 - i] != pad)
+	  return -1;
+      msg.len -= pad;
+    }
 
-      seqnumin[0] = (sendseqnum >> 24) & 0xFF;
-      seqnumin[1] = (sendseqnum >> 16) & 0xFF;
-      seqnumin[2] = (sendseqnum >> 8) & 0xFF;
-      seqnumin[3] = sendseqnum & 0xFF;
-      memcpy (seqnumin + MAC_SEQNUM_LEN, input, input_len);
+  put_uint32 (seq, seqnum);
+  hmac_iov (mac, seq, &msg, 1, hash);
+  if (!_gsasl_digest_eq (hash, out + clen - MAC_HMAC_LEN, MAC_HMAC_LEN))
+    return -1;
 
-      res = gc_hmac_md5 (key, MD5LEN,
-			 seqnumin, MAC_SEQNUM_LEN + input_len, hash);
-      free (seqnumin);
-      if (res)
+  *outlen = msg.len;
+
+  return 0;
+}
+
+/* Protect the INPUT_COUNT segments in INPUT and describe the message
+   to send in OUTPUT, which has room for INPUT_COUNT + 2 segments.
+   With integrity protection the length prefix and the MAC are
+   written to FRAME, the data itself is only referenced.  With
+   confidentiality the message is written to the buffer in CONF. */
+int
+digest_md5_encodev (const Gsasl_iov * input, size_t input_count,
+		    Gsasl_iov * output, size_t * output_count,
+		    char frame[DIGEST_MD5_FRAME_LENGTH],
+		    digest_md5_qop qop,
+		    unsigned long sendseqnum, const digest_md5_mac * mac,
+		    digest_md5_conf * conf)
+{
+  if (qop & DIGEST_MD5_QOP_AUTH_CONF)
+    {
+      size_t size;
+      char *out;
+
+      if (sealed_size (conf, iov_length (input, input_count), &size) < 0)
+	return -1;
+      out = conf_buffer (conf, size);
+      if (!out)
+	return -1;
+      if (seal (conf, mac, sendseqnum, input, input_count, out, size) < 0)
 	return -1;
 
-      *output_len = MAC_DATA_LEN + input_len + MAC_HMAC_LEN +
-	MAC_MSG_TYPE_LEN + MAC_SEQNUM_LEN;
-      *output = malloc (*output_len);
-      if (!*output)
+      output[0].base = out;
+      output[0].len = size;
+      *output_count = 1;
+    }
+  else if (qop & DIGEST_MD5_QOP_AUTH_INT)
+    {
+      char *trailer = frame + MAC_DATA_LEN;
+      char hash[MD5LEN];
+      size_t len = iov_length (input, input_count);
+      size_t n = 0, i;
+
+      if (len > 0xFFFFFFFFUL - MAC_TRAILER_LEN)
 	return -1;
 
-      len = MAC_DATA_LEN;
-      memcpy (*output + len, input, input_len);
-      len += input_len;
-      memcpy (*output + len, hash, MAC_HMAC_LEN);
-      len += MAC_HMAC_LEN;
-      memcpy (*output + len, MAC_MSG_TYPE, MAC_MSG_TYPE_LEN);
-      len += MAC_MSG_TYPE_LEN;
-      (*output + len)[0] = (sendseqnum >> 24) & 0xFF;
-      (*output + len)[1] = (sendseqnum >> 16) & 0xFF;
-      (*output + len)[2] = (sendseqnum >> 8) & 0xFF;
-      (*output + len)[3] = sendseqnum & 0xFF;
-      len += MAC_SEQNUM_LEN;
-      (*output)[0] = ((len - MAC_DATA_LEN) >> 24) & 0xFF;
-      (*output)[1] = ((len - MAC_DATA_LEN) >> 16) & 0xFF;
-      (*output)[2] = ((len - MAC_DATA_LEN) >> 8) & 0xFF;
-      (*output)[3] = (len - MAC_DATA_LEN) & 0xFF;
+      put_uint32 (frame, len + MAC_TRAILER_LEN);
+      put_uint32 (trailer + MAC_HMAC_LEN + MAC_MSG_TYPE_LEN, sendseqnum);
+      hmac_iov (mac, trailer + MAC_HMAC_LEN + MAC_MSG_TYPE_LEN,
+		input, input_count, hash);
+      memcpy (trailer, hash, MAC_HMAC_LEN);
+      memcpy (trailer + MAC_HMAC_LEN, MAC_MSG_TYPE, MAC_MSG_TYPE_LEN);
+
+      output[n].base = frame;
+      output[n++].len = MAC_DATA_LEN;
+      for (i = 0; i < input_count; i++)
+	if (input[i].len > 0)
+	  output[n++] = input[i];
+      output[n].base = trailer;
+      output[n++].len = MAC_TRAILER_LEN;
+      *output_count = n;
     }
   else
     {
-      *output_len = input_len;
-      *output = malloc (input_len);
-      if (!*output)
-	return -1;
-      memcpy (*output, input, input_len);
+      memcpy (output, input, input_count * sizeof (*input));
+      *output_count = input_count;
     }
 
   return 0;
 }
 
-#define C2I(buf) ((buf[3] & 0xFF) |		\
-		  ((buf[2] & 0xFF) << 8) |	\
-		  ((buf[1] & 0xFF) << 16) |	\
-		  ((buf[0] & 0xFF) << 24))
-
+/* Verify the message in the INPUT_COUNT segments of INPUT and
+   describe the data it carries in OUTPUT, which has room for
+   INPUT_COUNT segments.  With integrity protection the data is only
+   referenced, with confidentiality it is decrypted into the buffer
+   in CONF.  Returns -2 when the message is incomplete. */
 int
-digest_md5_decode (const char *input, size_t input_len,
-		   char **output, size_t * output_len,
-		   digest_md5_qop qop,
-		   unsigned long readseqnum, char key[DIGEST_MD5_LENGTH])
+digest_md5_decodev (const Gsasl_iov * input, size_t input_count,
+		    Gsasl_iov * output, size_t * output_count,
+		    digest_md5_qop qop,
+		    unsigned long readseqnum, const digest_md5_mac * mac,
+		    digest_md5_conf * conf)
 {
   if (qop & DIGEST_MD5_QOP_AUTH_CONF)
     {
-      return -1;
+      size_t clen, len;
+      char *out;
+      int res;
+
+      res = sealed_check (conf, readseqnum, input, input_count, &clen);
+      if (res)
+	return res;
+      out = conf_buffer (conf, clen);
+      if (!out)
+	return -1;
+      if (unseal (conf, mac, readseqnum, input, input_count,
+		  clen, out, &len) < 0)
+	return -1;
+
+      output[0].base = out;
+      output[0].len = len;
+      *output_count = 1;
     }
   else if (qop & DIGEST_MD5_QOP_AUTH_INT)
     {
-      char *seqnumin;
-      char hash[GC_MD5_DIGEST_SIZE];
+      size_t input_len = iov_length (input, input_count);
+      char prefix[SASL_INTEGRITY_PREFIX_LENGTH];
+      char trailer[MAC_TRAILER_LEN];
+      char seqnum[MAC_SEQNUM_LEN];
+      char hash[MD5LEN];
       unsigned long len;
-      char tmpbuf[SASL_INTEGRITY_PREFIX_LENGTH];
-      int res;
+      size_t n;
 
       if (input_len < SASL_INTEGRITY_PREFIX_LENGTH)
 	return -2;
 
-      len = C2I (input);
+      iov_read (input, input_count, 0, prefix, sizeof (prefix));
+      len = C2I (prefix);
 
       if (input_len < SASL_INTEGRITY_PREFIX_LENGTH + len)
 	return -2;
+      if (input_len != SASL_INTEGRITY_PREFIX_LENGTH + len
+	  || len < MAC_TRAILER_LEN)
+	return -1;
+
+      len -= MAC_TRAILER_LEN;
 
-      len -= MAC_HMAC_LEN + MAC_MSG_TYPE_LEN + MAC_SEQNUM_LEN;
+      iov_read (input, input_count, MAC_DATA_LEN + len,
+		trailer, sizeof (trailer));
+      n = iov_slice (input, input_count, MAC_DATA_LEN, len, output);
 
-      seqnumin = malloc (SASL_INTEGRITY_PREFIX_LENGTH + len);
-      if (seqnumin == NULL)
+      put_uint32 (seqnum, readseqnum);
+      hmac_iov (mac, seqnum, output, n, hash);
+
+      if (!_gsasl_digest_eq (hash, trailer, MAC_HMAC_LEN)
+	  || memcmp (MAC_MSG_TYPE, trailer + MAC_HMAC_LEN,
+		     MAC_MSG_TYPE_LEN) != 0
+	  || memcmp (seqnum, trailer + MAC_HMAC_LEN + MAC_MSG_TYPE_LEN,
+		     MAC_SEQNUM_LEN) != 0)
 	return -1;
 
-      tmpbuf[0] = (readseqnum >> 24) & 0xFF;
-      tmpbuf[1] = (readseqnum >> 16) & 0xFF;
-      tmpbuf[2] = (readseqnum >> 8) & 0xFF;
-      tmpbuf[3] = readseqnum & 0xFF;
+      *output_count = n;
+    }
+  else
+    {
+      memcpy (output, input, input_count * sizeof (*input));
+      *output_count = input_count;
+    }
 
-      memcpy (seqnumin, tmpbuf, SASL_INTEGRITY_PREFIX_LENGTH);
-      memcpy (seqnumin + SASL_INTEGRITY_PREFIX_LENGTH,
-	      input + MAC_DATA_LEN, len);
+  return 0;
+}
 
-      res = gc_hmac_md5 (key, MD5LEN, seqnumin, MAC_SEQNUM_LEN + len, hash);
-      free (seqnumin);
-      if (res)
-	return -1;
+/* Copy the data described by the N segments in IOV to a newly
+   allocated buffer. */
+static int
+gather (const Gsasl_iov * iov, size_t n, char **output, size_t * output_len)
+{
+  size_t len = iov_length (iov, n);
+  char *p;
 
-      if (memcmp
-	  (hash,
-	   input + input_len - MAC_SEQNUM_LEN - MAC_MSG_TYPE_LEN -
-	   MAC_HMAC_LEN, MAC_HMAC_LEN) == 0
-	  && memcmp (MAC_MSG_TYPE,
-		     input + input_len - MAC_SEQNUM_LEN - MAC_MSG_TYPE_LEN,
-		     MAC_MSG_TYPE_LEN) == 0
-	  && memcmp (tmpbuf, input + input_len - MAC_SEQNUM_LEN,
-		     MAC_SEQNUM_LEN) == 0)
-	{
-	  *output_len = len;
-	  *output = malloc (*output_len);
-	  if (!*output)
-	    return -1;
-	  memcpy (*output, input + MAC_DATA_LEN, len);
-	}
-      else
+  *output = malloc (len ? len : 1);
+  if (!*output)
+    return -1;
+
+  for (p = *output; n > 0; iov++, n--)
+    {
+      memcpy (p, iov->base, iov->len);
+      p += iov->len;
+    }
+  *output_len = len;
+
+  return 0;
+}
+
+int
+digest_md5_encode (const char *input, size_t input_len,
+		   char **output, size_t * output_len,
+		   digest_md5_qop qop,
+		   unsigned long sendseqnum, const digest_md5_mac * mac,
+		   digest_md5_conf * conf)
+{
+  char frame[DIGEST_MD5_FRAME_LENGTH];
+  Gsasl_iov in, out[3];
+  size_t n;
+  int res;
+
+  in.base = input;
+  in.len = input_len;
+
+  /* Seal straight into the output buffer. */
+  if (qop & DIGEST_MD5_QOP_AUTH_CONF)
+    {
+      if (sealed_size (conf, input_len, output_len) < 0)
+	return -1;
+      *output = malloc (*output_len);
+      if (!*output)
 	return -1;
+      res = seal (conf, mac, sendseqnum, &in, 1, *output, *output_len);
+      if (res)
+	free (*output);
+      return res;
     }
-  else
+
+  res = digest_md5_encodev (&in, 1, out, &n, frame, qop, sendseqnum, mac,
+			    conf);
+  if (res)
+    return res;
+
+  return gather (out, n, output, output_len);
+}
+
+int
+digest_md5_decode (const char *input, size_t input_len,
+		   char **output, size_t * output_len,
+		   digest_md5_qop qop,
+		   unsigned long readseqnum, const digest_md5_mac * mac,
+		   digest_md5_conf * conf)
+{
+  Gsasl_iov in, out;
+  size_t n, clen;
+  int res;
+
+  in.base = input;
+  in.len = input_len;
+
+  /* Decrypt straight into the output buffer. */
+  if (qop & DIGEST_MD5_QOP_AUTH_CONF)
     {
-      *output_len = input_len;
-      *output = malloc (input_len);
+      res = sealed_check (conf, readseqnum, &in, 1, &clen);
+      if (res)
+	return res;
+      *output = malloc (clen);
       if (!*output)
 	return -1;
-      memcpy (*output, input, input_len);
+      res = unseal (conf, mac, readseqnum, &in, 1, clen, *output,
+		    output_len);
+      if (res)
+	free (*output);
+      return res;
     }
 
-  return 0;
+  res = digest_md5_decodev (&in, 1, &out, &n, qop, readseqnum, mac, conf);
+  if (res)
+    return res;
+
+  return gather (&out, n, output, output_len);
+}
+
+/* Return the largest payload that fits in one protected message when
+   the peer accepts at most MAXBUF bytes, not counting the length
+   prefix.  A MAXBUF of 0 means the peer did not say. */
+size_t
+digest_md5_payload_max (digest_md5_qop qop, const digest_md5_conf * conf,
+			unsigned long maxbuf)
+{
+  size_t overhead = 0;
+
+  if (maxbuf == 0)
+    maxbuf = DIGEST_MD5_DEFAULT_MAXBUF;
+
+  if (qop & DIGEST_MD5_QOP_AUTH_CONF)
+    overhead = MAC_TRAILER_LEN + conf->blocksize;
+  else if (qop & DIGEST_MD5_QOP_AUTH_INT)
+    overhead = MAC_TRAILER_LEN;
+
+  if (maxbuf <= overhead)
+    return 1;
+
+  return maxbuf - overhead;
 }
@@ -23,19 +23,83 @@
 #ifndef DIGEST_MD5_SESSION_H
 #define DIGEST_MD5_SESSION_H
 
+/* Get Gsasl_iov. */
+#include <gsasl.h>
+
 /* Get token types. */
 #include "tokens.h"
 
+/* Get struct md5_ctx. */
+#include "md5.h"
+
+/* Get gc_cipher_handle. */
+#include "gc.h"
+
+/* Room needed for the framing around one protected message. */
+#define DIGEST_MD5_FRAME_LENGTH 20
+
+/* Size of the receive buffer assumed when maxbuf is not given. */
+#define DIGEST_MD5_DEFAULT_MAXBUF 65536
+
+/* HMAC-MD5 key for the integrity layer, kept as the MD5 states after
+   hashing the inner and outer padded key blocks. */
+typedef struct digest_md5_mac
+{
+  struct md5_ctx inner;
+  struct md5_ctx outer;
+} digest_md5_mac;
+
+extern void digest_md5_mac_init (digest_md5_mac * mac,
+				 const char key[DIGEST_MD5_LENGTH]);
+
+/* Cipher of the confidentiality layer in one direction.  BUF holds
+   the last message produced by digest_md5_encodev or
+   digest_md5_decodev. */
+typedef struct digest_md5_conf
+{
+  gc_cipher_handle handle;
+  size_t blocksize;
+  char *buf;
+  size_t bufsize;
+} digest_md5_conf;
+
+extern int digest_md5_ciphers (void);
+extern int digest_md5_conf_init (digest_md5_conf * conf,
+				 digest_md5_cipher cipher,
+				 const char key[DIGEST_MD5_LENGTH]);
+extern void digest_md5_conf_done (digest_md5_conf * conf);
+
+extern int digest_md5_encodev (const Gsasl_iov * input, size_t input_count,
+			       Gsasl_iov * output, size_t * output_count,
+			       char frame[DIGEST_MD5_FRAME_LENGTH],
+			       digest_md5_qop qop,
+			       unsigned long sendseqnum,
+			       const digest_md5_mac * mac,
+			       digest_md5_conf * conf);
+
+extern int digest_md5_decodev (const Gsasl_iov * input, size_t input_count,
+			       Gsasl_iov * output, size_t * output_count,
+			       digest_md5_qop qop,
+			       unsigned long readseqnum,
+			       const digest_md5_mac * mac,
+			       digest_md5_conf * conf);
+
 extern int digest_md5_encode (const char *input, size_t input_len,
 			      char **output, size_t * output_len,
 			      digest_md5_qop qop,
 			      unsigned long sendseqnum,
-			      char key[DIGEST_MD5_LENGTH]);
+			      const digest_md5_mac * mac,
+			      digest_md5_conf * conf);
 
 extern int digest_md5_decode (const char *input, size_t input_len,
 			      char **output, size_t * output_len,
 			      digest_md5_qop qop,
 			      unsigned long readseqnum,
-			      char key[DIGEST_MD5_LENGTH]);
+			      const digest_md5_mac * mac,
+			      digest_md5_conf * conf);
+
+extern size_t digest_md5_payload_max (digest_md5_qop qop,
+				      const digest_md5_conf * conf,
+				      unsigned long maxbuf);
 
 #endif /* DIGEST_MD5_SESSION_H */
@@ -23,13 +23,137 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
 
 #include "parser.h"
 #include "printer.h"
+#include "free.h"
 #include "digesthmac.h"
 
 #include "gc.h"
 
+#define MUTATIONS 20000
+#define LOOPS 100000
+
+/* Responses as sent by deployed clients. */
+static const char *responses[] = {
+  /* RFC 2831 section 4. */
+  "charset=utf-8,username=\"chris\",realm=\"elwood.innosoft.com\","
+    "nonce=\"OA6MG9tEQGm2hh\",nc=00000001,cnonce=\"OA6MHXh6VqTrRk\","
+    "digest-uri=\"imap/elwood.innosoft.com\","
+    "response=d388dad90d4bbd760a152321f2143af7,qop=auth",
+  /* Cyrus SASL, with an authorization identity and a buffer size. */
+  "username=\"test\",realm=\"example.org\",authzid=\"admin\","
+    "nonce=\"lK3RqW1xcb7yQn2+8pjwYB5TkJ8kfv0Y\","
+    "cnonce=\"XvqOKrpVAkFiRSyhTEfH7q/2vOQqZJ1h\",nc=00000001,qop=auth-conf,"
+    "cipher=rc4,maxbuf=65536,digest-uri=\"imap/mail.example.org\","
+    "response=2d3d3b1e7f44a86c3e6f2c2b0f7e3b5c",
+  /* Java SASL, with quoted cipher and white space. */
+  "charset=utf-8, username=\"test\", realm=\"example.com\", "
+    "nonce=\"q3bk0T7cHb1y4B0iY+dF3ypEJrm2z6m0pCXqs3fD\", nc=00000001, "
+    "cnonce=\"DkAjvSu3DrFzjU6AKk4QpgHmrH5N2y1G6PYDcbzq\", "
+    "digest-uri=\"ldap/ldap.example.com\", maxbuf=65536, "
+    "response=7a7b0c2d8f1e4c3b2a1908f7e6d5c4b3, qop=auth-int",
+  /* Escaped characters in a user name. */
+  "username=\"Ch\\\"ri\\\\s\",nonce=\"42\",cnonce=\"4711\",nc=00000001,"
+    "digest-uri=\"smtp/localhost\","
+    "response=01234567890123456789012345678901"
+};
+
+/* Check that the strings of a parsed response of LEN bytes point into
+   its own copy of the message. */
+static void
+check_response (const digest_md5_response * r, size_t len)
+{
+  const char *fields[6];
+  size_t i;
+
+  fields[0] = r->username;
+  fields[1] = r->realm;
+  fields[2] = r->nonce;
+  fields[3] = r->cnonce;
+  fields[4] = r->digesturi;
+  fields[5] = r->authzid;
+
+  for (i = 0; i < sizeof (fields) / sizeof (fields[0]); i++)
+    if (fields[i] && (fields[i] < r->buf || fields[i] > r->buf + len
+		      || fields[i] + strlen (fields[i]) > r->buf + len))
+      {
+	printf ("field %lu out of message\n", (unsigned long) i);
+	abort ();
+      }
+}
+
+static unsigned long seed = 4711;
+
+static size_t
+rnd (size_t n)
+{
+  seed = seed * 1103515245 + 12345;
+  return (seed >> 16) % n;
+}
+
+/* Parse damaged copies of the response TOKEN, which must not crash or
+   go outside of the message. */
+static void
+fuzz (const char *token)
+{
+  size_t len = strlen (token);
+  size_t i, pos, n;
+  char buf[512], *msg;
+  digest_md5_response r;
+
+  for (i = 0; i < MUTATIONS; i++)
+    {
+      static const char special[] = ",=\"\\ \0";
+
+      memcpy (buf, token, len);
+      switch (rnd (4))
+	{
+	case 0:
+	  n = 1 + rnd (len);
+	  break;
+
+	case 1:
+	  pos = rnd (len);
+	  buf[pos] = special[rnd (sizeof (special))];
+	  n = len;
+	  break;
+
+	case 2:
+	  pos = rnd (len);
+	  buf[pos] = rnd (256);
+	  n = len;
+	  break;
+
+	default:
+	  pos = rnd (len + 1);
+	  memmove (buf + pos + 1, buf + pos, len - pos);
+	  buf[pos] = special[rnd (sizeof (special))];
+	  n = len + 1;
+	  break;
+	}
+
+      /* Exactly as long as the message, so reading past it shows up
+         under memory checkers. */
+      msg = malloc (n);
+      if (!msg)
+	abort ();
+      memcpy (msg, buf, n);
+      if (digest_md5_parse_response (msg, n, &r) == 0)
+	{
+	  if (memchr (msg, '\0', n))
+	    {
+	      printf ("accepted NUL in `%s'\n", token);
+	      abort ();
+	    }
+	  check_response (&r, n);
+	  digest_md5_free_response (&r);
+	}
+      free (msg);
+    }
+}
+
 int
 main (int argc, char *argv[])
 {
@@ -40,6 +164,8 @@ main (int argc, char *argv[])
   char buf16[16];
   int rc;
   char *tmp;
+  size_t i;
+  clock_t start;
 
   {
     const char *token = "nonce=4711, foo=bar, algorithm=md5-sess";
@@ -56,6 +182,7 @@ main (int argc, char *argv[])
       abort ();
     printf ("printed `%s' PASS\n", tmp);
     free (tmp);
+    digest_md5_free_challenge (&c);
   }
 
   {
@@ -94,6 +221,7 @@ main (int argc, char *argv[])
       abort ();
     printf ("printed `%s' PASS\n", tmp);
     free (tmp);
+    digest_md5_free_challenge (&c);
   }
 
   {
@@ -121,6 +249,7 @@ main (int argc, char *argv[])
       abort ();
     printf ("printed `%s' PASS\n", tmp);
     free (tmp);
+    digest_md5_free_challenge (&c);
   }
 
   /* Response */
@@ -151,6 +280,57 @@ main (int argc, char *argv[])
       abort ();
     printf ("printed `%s' PASS\n", tmp);
     free (tmp);
+    digest_md5_free_response (&r);
+  }
+
+  for (i = 0; i < sizeof (responses) / sizeof (responses[0]); i++)
+    {
+      const char *token = responses[i];
+
+      printf ("response `%s': ", token);
+      rc = digest_md5_parse_response (token, strlen (token), &r);
+      if (rc != 0)
+	abort ();
+      check_response (&r, strlen (token));
+      printf ("username `%s': ", r.username);
+      tmp = digest_md5_print_response (&r);
+      if (!tmp)
+	abort ();
+      digest_md5_free_response (&r);
+      /* Printing and parsing again gives the same message. */
+      if (digest_md5_parse_response (tmp, 0, &r) != 0)
+	abort ();
+      free (tmp);
+      digest_md5_free_response (&r);
+      printf ("PASS\n");
+
+      fuzz (token);
+    }
+
+  {
+    const char *token = responses[sizeof (responses) / sizeof (responses[0])
+				  - 1];
+
+    rc = digest_md5_parse_response (token, 0, &r);
+    if (rc != 0 || strcmp (r.username, "Ch\"ri\\s") != 0)
+      abort ();
+    digest_md5_free_response (&r);
+  }
+
+  {
+    static const char *tokens[] = {
+      "username", "username=\"jas", "username=\"jas\\",
+      "username=\"j\"as\", nonce=42", "username=jas nonce=42"
+    };
+
+    for (i = 0; i < sizeof (tokens) / sizeof (tokens[0]); i++)
+      {
+	printf ("response `%s': ", tokens[i]);
+	rc = digest_md5_parse_response (tokens[i], 0, &r);
+	if (rc == 0)
+	  abort ();
+	printf ("PASS\n");
+      }
   }
 
   /* Auth-response, finish. */
@@ -206,5 +386,19 @@ main (int argc, char *argv[])
     abort ();
   printf ("digest: `%s': PASS\n", buf32);
 
+  /* Time parsing the responses of clients. */
+  start = clock ();
+  for (i = 0; i < LOOPS; i++)
+    {
+      const char *token = responses[i % (sizeof (responses)
+					 / sizeof (responses[0]))];
+
+      if (digest_md5_parse_response (token, 0, &r) != 0)
+	abort ();
+      digest_md5_free_response (&r);
+    }
+  printf ("%.0f ns/response\n",
+	  (double) (clock () - start) / CLOCKS_PER_SEC * 1e9 / LOOPS);
+
   return 0;
 }
@@ -0,0 +1,167 @@
+/* test-session.c --- Self tests of DIGEST-MD5 security layers.
+ * Copyright (C) 2012 Simon Josefsson
+ *
+ * This file is part of GNU SASL Library.
+ *
+ * GNU SASL Library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; either version 2.1 of
+ * the License, or (at your option) any later version.
+ *
+ * GNU SASL Library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with GNU SASL Library; if not, write to the Free
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "session.h"
+
+/* The layers compare MACs with _gsasl_digest_eq, which lives in the
+   library proper. */
+#include "../src/mechtools.c"
+
+#define KI "\x00\x01\x02\x03\x04\x05\x06\x07" \
+  "\x08\x09\x0a\x0b\x0c\x0d\x0e\x0f"
+#define KC "\x10\x11\x12\x13\x14\x15\x16\x17" \
+  "\x18\x19\x1a\x1b\x1c\x1d\x1e\x1f"
+
+static const char *messages[] = { "Hello, world", "attack at dawn" };
+
+/* Two messages protected in turn with the integrity key KI and the
+   confidentiality key KC, computed independently of this code. */
+static const struct
+{
+  const char *name;
+  digest_md5_qop qop;
+  digest_md5_cipher cipher;
+  const char *out[2];
+  size_t outlen[2];
+} vectors[] = {
+  {"auth-int", DIGEST_MD5_QOP_AUTH_INT, 0,
+   {"\x00\x00\x00\x1c\x48\x65\x6c\x6c\x6f\x2c\x20\x77\x6f\x72\x6c\x64"
+    "\xac\x21\x13\x2d\x9f\x3f\xda\xc6\x98\xf3\x00\x01\x00\x00\x00\x00",
+    "\x00\x00\x00\x1e\x61\x74\x74\x61\x63\x6b\x20\x61\x74\x20\x64\x61"
+    "\x77\x6e\x17\xe7\xd5\xf9\xdf\x25\xf4\x91\x84\x8d\x00\x01\x00\x00"
+    "\x00\x01"},
+   {32, 34}},
+  {"rc4", DIGEST_MD5_QOP_AUTH_CONF, DIGEST_MD5_CIPHER_RC4,
+   {"\x00\x00\x00\x1c\x03\xd5\x6c\xa0\x92\x2c\x3b\x85\x58\xcc\x89\xb3"
+    "\x20\x1a\xef\x8f\x2d\x79\x71\xf2\xc3\x1f\x00\x01\x00\x00\x00\x00",
+    "\x00\x00\x00\x1e\xba\x90\xa8\x83\x69\xe8\x17\x5a\xcf\x19\xa7\xba"
+    "\x45\x34\x0d\xfe\x4c\xa9\xf8\x67\x39\xf4\x22\x2b\x00\x01\x00\x00"
+    "\x00\x01"},
+   {32, 34}},
+  {"des", DIGEST_MD5_QOP_AUTH_CONF, DIGEST_MD5_CIPHER_DES,
+   {"\x00\x00\x00\x1e\xf1\x1a\x8d\x04\x4b\x7e\xa9\x3a\x02\xb3\x40\x61"
+    "\x12\xcf\xf1\x43\xf9\x2e\xe7\xc9\xe0\x40\x80\x07\x00\x01\x00\x00"
+    "\x00\x00",
+    "\x00\x00\x00\x26\x5b\xb8\xb6\xb0\xff\xf4\x1d\x9e\x7f\xc4\xad\x3b"
+    "\xac\x6f\x31\x6b\x60\x4d\xf7\x7d\x40\x76\xdc\xc1\xff\x0e\x7c\x82"
+    "\x1f\x65\xfc\x39\x00\x01\x00\x00\x00\x01"},
+   {34, 42}},
+  {"3des", DIGEST_MD5_QOP_AUTH_CONF, DIGEST_MD5_CIPHER_3DES,
+   {"\x00\x00\x00\x1e\xc5\x9a\x9c\x1a\x0d\x0d\x74\x20\x54\xff\xe0\x80"
+    "\xc3\x00\x4c\xa6\xe4\x67\xa7\xba\x11\x5c\x87\x20\x00\x01\x00\x00"
+    "\x00\x00",
+    "\x00\x00\x00\x26\x7c\xd0\xbf\xed\x76\xc5\xec\xd6\x30\xf0\x9b\x75"
+    "\x84\x14\x58\x38\x45\x3d\xe4\xcd\x01\xcc\xa6\xf1\x30\x7d\x98\x54"
+    "\x3d\xcb\xf1\x0f\x00\x01\x00\x00\x00\x01"},
+   {34, 42}}
+};
+
+int
+main (int argc, char *argv[])
+{
+  digest_md5_mac mac;
+  digest_md5_conf enc, dec;
+  char *out;
+  size_t outlen, i, j;
+  int ciphers;
+
+  if (gc_init () != GC_OK)
+    abort ();
+
+  ciphers = digest_md5_ciphers ();
+  printf ("ciphers: %x\n", ciphers);
+
+  /* RC4 is there with both libgcrypt and the gnulib crypto, DES only
+     with libgcrypt. */
+  if (!(ciphers & DIGEST_MD5_CIPHER_RC4))
+    abort ();
+
+  digest_md5_mac_init (&mac, KI);
+
+  for (i = 0; i < sizeof (vectors) / sizeof (vectors[0]); i++)
+    {
+      if (vectors[i].cipher && !(vectors[i].cipher & ciphers))
+	{
+	  printf ("%s: SKIP\n", vectors[i].name);
+	  continue;
+	}
+
+      memset (&enc, 0, sizeof (enc));
+      memset (&dec, 0, sizeof (dec));
+      if (vectors[i].cipher
+	  && (digest_md5_conf_init (&enc, vectors[i].cipher, KC) != 0
+	      || digest_md5_conf_init (&dec, vectors[i].cipher, KC) != 0))
+	abort ();
+
+      /* The cipher state carries over from the first message. */
+      for (j = 0; j < 2; j++)
+	{
+	  if (digest_md5_encode (messages[j], strlen (messages[j]),
+				 &out, &outlen, vectors[i].qop, j,
+				 &mac, &enc) != 0)
+	    abort ();
+	  if (outlen != vectors[i].outlen[j]
+	      || memcmp (out, vectors[i].out[j], outlen) != 0)
+	    {
+	      printf ("%s: seal %lu FAILURE\n", vectors[i].name,
+		      (unsigned long) j);
+	      abort ();
+	    }
+	  free (out);
+
+	  if (digest_md5_decode (vectors[i].out[j], vectors[i].outlen[j],
+				 &out, &outlen, vectors[i].qop, j,
+				 &mac, &dec) != 0)
+	    {
+	      printf ("%s: unseal %lu FAILURE\n", vectors[i].name,
+		      (unsigned long) j);
+	      abort ();
+	    }
+	  if (outlen != strlen (messages[j])
+	      || memcmp (out, messages[j], outlen) != 0)
+	    abort ();
+	  free (out);
+	}
+
+      /* A message under the wrong sequence number is rejected. */
+      if (digest_md5_decode (vectors[i].out[0], vectors[i].outlen[0],
+			     &out, &outlen, vectors[i].qop, 1,
+			     &mac, &dec) == 0)
+	abort ();
+
+      if (vectors[i].cipher)
+	{
+	  digest_md5_conf_done (&enc);
+	  digest_md5_conf_done (&dec);
+	}
+
+      printf ("%s: PASS\n", vectors[i].name);
+    }
+
+  gc_done ();
+
+  return 0;
+}
@@ -0,0 +1,153 @@
+/* tokenize.c --- Split DIGEST-MD5 messages into directives.
+ * Copyright (C) 2012 Simon Josefsson
+ *
+ * This file is part of GNU SASL Library.
+ *
+ * GNU SASL Library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; either version 2.1 of
+ * the License, or (at your option) any later version.
+ *
+ * GNU SASL Library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with GNU SASL Library; if not, write to the Free
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+/* Get prototypes. */
+#include "tokenize.h"
+
+/* Get memmove, strcspn, strncmp. */
+#include <string.h>
+
+/* Nothing is allocated here.  Directive values are unquoted
+   in place, and the pointers returned point into the message. */
+
+/* Whether C is linear white space. */
+#define LWS(c) ((c) == ' ' || (c) == '\t' || (c) == '\r' || (c) == '\n')
+
+/* The characters that end an unquoted value, and a name. */
+#define VALUE_END ",\" \t\r\n"
+#define NAME_END "=" VALUE_END
+
+/* Return the index of the LEN bytes at NAME in the NULL terminated
+   array NAMES, or -1. */
+static int
+lookup (const char *name, size_t len, const char *const *names)
+{
+  int i;
+
+  for (i = 0; names[i] != NULL; i++)
+    if (names[i][0] == name[0] && strncmp (names[i], name, len) == 0
+	&& names[i][len] == '\0')
+      return i;
+
+  return -1;
+}
+
+/* Parse the next directive 'name=value' or 'name="value"' of the
+   comma separated list in the zero terminated string *STR, and
+   advance *STR to the directive after it.  The message is changed:
+   the value is unquoted and zero terminated in place, and *VALUE
+   points to it.  Empty list elements and white space around them are
+   skipped, so *STR is at the terminating zero after the last
+   directive.
+
+   Returns the index of the directive name in the NULL terminated
+   array NAMES, -1 for other names, and -2 on syntax errors. */
+int
+digest_md5_directive (char **str, const char *const *names, char **value)
+{
+  char *p = *str, *name, *out;
+  size_t len;
+
+  while (LWS (*p) || *p == ',')
+    p++;
+
+  name = p;
+  len = strcspn (p, NAME_END);
+  p += len;
+
+  while (LWS (*p))
+    p++;
+  if (len == 0 || *p != '=')
+    return -2;
+  p++;
+  while (LWS (*p))
+    p++;
+
+  if (*p == '"')
+    {
+      /* A quoted-string, where a backslash quotes the character
+         after it.  The text between backslashes is moved down over
+         them. */
+      *value = out = ++p;
+      for (;;)
+	{
+	  size_t n = strcspn (p, "\"\\");
+
+	  if (out != p)
+	    memmove (out, p, n);
+	  out += n;
+	  p += n;
+	  if (*p == '"')
+	    break;
+	  if (*p == '\0' || *++p == '\0')
+	    return -2;
+	  *out++ = *p++;
+	}
+      p++;
+    }
+  else
+    {
+      *value = p;
+      p += strcspn (p, VALUE_END);
+      out = p;
+    }
+
+  while (LWS (*p))
+    p++;
+  if (*p != '\0' && *p != ',')
+    return -2;
+  while (LWS (*p) || *p == ',')
+    p++;
+
+  *out = '\0';
+  *str = p;
+
+  return lookup (name, len, names);
+}
+
+/* Match the next item of the comma separated list in the zero
+   terminated string *STR against the NULL terminated array NAMES, and
+   advance *STR past it and the white space and commas that follow.
+   The list is not changed.  Returns the index of the item in NAMES,
+   or -1 for other items. */
+int
+digest_md5_list_item (const char **str, const char *const *names)
+{
+  const char *p = *str, *item;
+
+  while (LWS (*p) || *p == ',')
+    p++;
+
+  item = p;
+  while (*p != '\0' && *p != ',' && !LWS (*p))
+    p++;
+
+  *str = p;
+  while (LWS (**str) || **str == ',')
+    (*str)++;
+
+  return p > item ? lookup (item, p - item, names) : -1;
+}
@@ -89,6 +89,9 @@ struct digest_md5_challenge
   unsigned long servermaxbuf;
   int utf8;
   int ciphers;
+  /* When parsed, the copy of the message the strings point into,
+     otherwise NULL and the strings are allocated one by one. */
+  char *buf;
 };
 typedef struct digest_md5_challenge digest_md5_challenge;
 
@@ -137,6 +140,8 @@ struct digest_md5_response
   digest_md5_cipher cipher;
   char *authzid;
   char response[DIGEST_MD5_RESPONSE_LENGTH + 1];
+  /* As for the challenge. */
+  char *buf;
 };
 typedef struct digest_md5_response digest_md5_response;
 
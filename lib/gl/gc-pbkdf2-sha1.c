@@ -20,15 +20,71 @@
 
 #include "gc.h"
 
-#include <stdlib.h>
+#include <stdint.h>
 #include <string.h>
 
+#include "sha1.h"
+
+/* HMAC-SHA1 with the key already absorbed: the SHA-1 states after
+   processing the inner (ipad) and outer (opad) key blocks.  Every
+   PRF invocation in PBKDF2 uses the same key, so this is computed
+   once instead of once per iteration.  */
+struct pbkdf2_hmac
+{
+  struct sha1_ctx inner;
+  struct sha1_ctx outer;
+};
+
+static void
+pbkdf2_hmac_init (struct pbkdf2_hmac *h, const char *P, size_t Plen)
+{
+  char key[64];
+  char block[64];
+  size_t i;
+
+  memset (key, 0, sizeof key);
+  if (Plen > sizeof key)
+    sha1_buffer (P, Plen, key);
+  else
+    memcpy (key, P, Plen);
+
+  for (i = 0; i < sizeof block; i++)
+    block[i] = key[i] ^ 0x36;
+  sha1_init_ctx (&h->inner);
+  sha1_process_bytes (block, sizeof block, &h->inner);
+
+  for (i = 0; i < sizeof block; i++)
+    block[i] = key[i] ^ 0x5c;
+  sha1_init_ctx (&h->outer);
+  sha1_process_bytes (block, sizeof block, &h->outer);
+
+  memset (key, 0, sizeof key);
+  memset (block, 0, sizeof block);
+}
+
+/* Load the chaining variables of FROM into TO.  Only A..E matter for
+   sha1_process_block, so avoid copying the whole context.  */
+static inline void
+pbkdf2_load (struct sha1_ctx *to, const struct sha1_ctx *from)
+{
+  to->A = from->A;
+  to->B = from->B;
+  to->C = from->C;
+  to->D = from->D;
+  to->E = from->E;
+}
+
 /* Implement PKCS#5 PBKDF2 as per RFC 2898.  The PRF to use is hard
    coded to be HMAC-SHA1.  Inputs are the password P of length PLEN,
    the salt S of length SLEN, the iteration counter C (> 0), and the
    desired derived output length DKLEN.  Output buffer is DK which
    must have room for at least DKLEN octets.  The output buffer will
-   be filled with the derived data.  */
+   be filled with the derived data.
+
+   For iterations after the first, the HMAC input is a previous
+   20-byte digest, so both the inner and outer hash consist of one
+   pre-padded block on top of the key states.  Each iteration thus
+   costs two SHA-1 compressions and no allocation.  */
 Gc_rc
 gc_pbkdf2_sha1 (const char *P, size_t Plen,
                 const char *S, size_t Slen,
@@ -36,16 +92,18 @@ gc_pbkdf2_sha1 (const char *P, size_t Plen,
                 char *DK, size_t dkLen)
 {
   unsigned int hLen = 20;
-  char U[20];
+  struct pbkdf2_hmac h;
+  struct sha1_ctx ctx;
+  /* 64-byte SHA-1 block, word aligned for sha1_process_block.  */
+  uint32_t block[16];
+  char *U = (char *) block;
   char T[20];
+  char ibuf[4];
   unsigned int u;
   unsigned int l;
   unsigned int r;
   unsigned int i;
   unsigned int k;
-  int rc;
-  char *tmp;
-  size_t tmplen = Slen + 4;
 
   if (c == 0)
     return GC_PKCS5_INVALID_ITERATION_COUNT;
@@ -59,35 +117,43 @@ gc_pbkdf2_sha1 (const char *P, size_t Plen,
   l = (unsigned int)(((dkLen - 1) / hLen) + 1);
   r = (unsigned int)(dkLen - (l - 1) * hLen);
 
-  tmp = malloc (tmplen);
-  if (tmp == NULL)
-    return GC_MALLOC_ERROR;
+  pbkdf2_hmac_init (&h, P, Plen);
 
-  memcpy (tmp, S, Slen);
+  /* Padding for a 64 + 20 byte message: 0x80 terminator, zeros, and
+     the big-endian bit length 672 in the last two bytes.  The first
+     20 bytes are filled in by sha1_read_ctx for every hash.  */
+  memset (block, 0, sizeof block);
+  U[hLen] = (char) 0x80;
+  U[62] = (char) ((64 + 20) * 8 >> 8);
+  U[63] = (char) ((64 + 20) * 8 & 0xff);
 
   for (i = 1; i <= l; i++)
     {
-      memset (T, 0, hLen);
-
-      for (u = 1; u <= c; u++)
+      ibuf[0] = (i & 0xff000000) >> 24;
+      ibuf[1] = (i & 0x00ff0000) >> 16;
+      ibuf[2] = (i & 0x0000ff00) >> 8;
+      ibuf[3] = (i & 0x000000ff) >> 0;
+
+      /* U_1 = PRF (P, S || INT (i)).  */
+      ctx = h.inner;
+      sha1_process_bytes (S, Slen, &ctx);
+      sha1_process_bytes (ibuf, 4, &ctx);
+      sha1_finish_ctx (&ctx, U);
+      pbkdf2_load (&ctx, &h.outer);
+      sha1_process_block (block, sizeof block, &ctx);
+      sha1_read_ctx (&ctx, U);
+
+      memcpy (T, U, hLen);
+
+      /* U_u = PRF (P, U_{u-1}).  */
+      for (u = 2; u <= c; u++)
         {
-          if (u == 1)
-            {
-              tmp[Slen + 0] = (i & 0xff000000) >> 24;
-              tmp[Slen + 1] = (i & 0x00ff0000) >> 16;
-              tmp[Slen + 2] = (i & 0x0000ff00) >> 8;
-              tmp[Slen + 3] = (i & 0x000000ff) >> 0;
-
-              rc = gc_hmac_sha1 (P, Plen, tmp, tmplen, U);
-            }
-          else
-            rc = gc_hmac_sha1 (P, Plen, U, hLen, U);
-
-          if (rc != GC_OK)
-            {
-              free (tmp);
-              return rc;
-            }
+          pbkdf2_load (&ctx, &h.inner);
+          sha1_process_block (block, sizeof block, &ctx);
+          sha1_read_ctx (&ctx, U);
+          pbkdf2_load (&ctx, &h.outer);
+          sha1_process_block (block, sizeof block, &ctx);
+          sha1_read_ctx (&ctx, U);
 
           for (k = 0; k < hLen; k++)
             T[k] ^= U[k];
@@ -96,7 +162,10 @@ gc_pbkdf2_sha1 (const char *P, size_t Plen,
       memcpy (DK + (i - 1) * hLen, T, i == l ? r : hLen);
     }
 
-  free (tmp);
+  memset (&h, 0, sizeof h);
+  memset (&ctx, 0, sizeof ctx);
+  memset (block, 0, sizeof block);
+  memset (T, 0, sizeof T);
 
   return GC_OK;
 }
@@ -0,0 +1,10 @@
+# gc-arcfour.m4 serial 2
+dnl Copyright (C) 2005, 2007, 2009-2012 Free Software Foundation, Inc.
+dnl This file is free software; the Free Software Foundation
+dnl gives unlimited permission to copy and/or distribute it,
+dnl with or without modifications, as long as this notice is preserved.
+
+AC_DEFUN([gl_GC_ARCFOUR],
+[
+  AC_REQUIRE([gl_GC])
+])
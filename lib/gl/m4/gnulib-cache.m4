@@ -27,7 +27,7 @@
 
 
 # Specification in the form of a command-line invocation:
-#   gnulib-tool --import --dir=. --local-dir=gl/override --lib=libgl --source-base=gl --m4-base=gl/m4 --doc-base=doc --tests-base=gltests --aux-dir=build-aux --with-tests --avoid=vc-list-files-tests --lgpl=2 --no-conditional-dependencies --libtool --macro-prefix=gl --no-vc-files base64 c-ctype crypto/gc crypto/gc-hmac-md5 crypto/gc-hmac-sha1 crypto/gc-md5 crypto/gc-pbkdf2-sha1 crypto/gc-random crypto/gc-sha1 getline gettext gss-extra lib-msvc-compat lib-symbol-versions lib-symbol-visibility maintainer-makefile memmem memxor minmax strndup strnlen strverscmp vasprintf
+#   gnulib-tool --import --dir=. --local-dir=gl/override --lib=libgl --source-base=gl --m4-base=gl/m4 --doc-base=doc --tests-base=gltests --aux-dir=build-aux --with-tests --avoid=vc-list-files-tests --lgpl=2 --no-conditional-dependencies --libtool --macro-prefix=gl --no-vc-files base64 c-ctype crypto/gc crypto/gc-arcfour crypto/gc-hmac-md5 crypto/gc-hmac-sha1 crypto/gc-md5 crypto/gc-pbkdf2-sha1 crypto/gc-random crypto/gc-sha1 getline gettext gss-extra lib-msvc-compat lib-symbol-versions lib-symbol-visibility maintainer-makefile memmem memxor minmax strndup strnlen strverscmp vasprintf
 
 # Specification in the form of a few gnulib-tool.m4 macro invocations:
 gl_LOCAL_DIR([gl/override])
@@ -35,6 +35,7 @@ gl_MODULES([
   base64
   c-ctype
   crypto/gc
+  crypto/gc-arcfour
   crypto/gc-hmac-md5
   crypto/gc-hmac-sha1
   crypto/gc-md5
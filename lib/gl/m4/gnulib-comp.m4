@@ -44,7 +44,10 @@ AC_DEFUN([gl_EARLY],
   # Code from module base64-tests:
   # Code from module c-ctype:
   # Code from module c-ctype-tests:
+  # Code from module crypto/arcfour:
   # Code from module crypto/gc:
+  # Code from module crypto/gc-arcfour:
+  # Code from module crypto/gc-arcfour-tests:
   # Code from module crypto/gc-hmac-md5:
   # Code from module crypto/gc-hmac-md5-tests:
   # Code from module crypto/gc-hmac-sha1:
@@ -180,6 +183,8 @@ AC_DEFUN([gl_INIT],
     gl_ltlibdeps="$gl_ltlibdeps $LTLIBGCRYPT"
     gl_libdeps="$gl_libdeps $LIBGCRYPT"
   fi
+  gl_GC_ARCFOUR
+  gl_MODULE_INDICATOR([gc-arcfour])
   gl_GC_HMAC_MD5
   gl_MODULE_INDICATOR([gc-hmac-md5])
   gl_GC_HMAC_SHA1
@@ -469,6 +474,8 @@ AC_DEFUN([gl_FILE_LIST], [
   build-aux/useless-if-before-free
   build-aux/vc-list-files
   lib/alloca.in.h
+  lib/arcfour.c
+  lib/arcfour.h
   lib/asnprintf.c
   lib/asprintf.c
   lib/base64.c
@@ -538,6 +545,7 @@ AC_DEFUN([gl_FILE_LIST], [
   m4/fdopen.m4
   m4/float_h.m4
   m4/fpieee.m4
+  m4/gc-arcfour.m4
   m4/gc-hmac-md5.m4
   m4/gc-hmac-sha1.m4
   m4/gc-md5.m4
@@ -627,6 +635,7 @@ AC_DEFUN([gl_FILE_LIST], [
   tests/test-fputc.c
   tests/test-fread.c
   tests/test-fwrite.c
+  tests/test-gc-arcfour.c
   tests/test-gc-hmac-md5.c
   tests/test-gc-hmac-sha1.c
   tests/test-gc-md5.c
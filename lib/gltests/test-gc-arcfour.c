@@ -0,0 +1,75 @@
+/*
+ * Copyright (C) 2005, 2010-2012 Free Software Foundation, Inc.
+ * Written by Simon Josefsson
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, see <http://www.gnu.org/licenses/>.  */
+
+#include <config.h>
+
+#include <stdio.h>
+#include <string.h>
+#include "gc.h"
+
+int
+main (int argc, char *argv[])
+{
+  Gc_rc rc;
+
+  rc = gc_init ();
+  if (rc != GC_OK)
+    {
+      printf ("gc_init() failed\n");
+      return 1;
+    }
+
+  {
+    char key[] = { 0x01, 0x23, 0x45, 0x67, 0x89, 0xab, 0xcd, 0xef };
+    char plain[] = { 0x01, 0x23, 0x45, 0x67, 0x89, 0xab, 0xcd, 0xef };
+    char cipher[] = { 0x75, 0xb7, 0x87, 0x80, 0x99, 0xe0, 0xc5, 0x96 };
+    char scratch[sizeof (plain)];
+    gc_cipher_handle ctx;
+    size_t i;
+
+    rc = gc_cipher_open (GC_ARCFOUR128, GC_STREAM, &ctx);
+    if (rc != GC_OK)
+      return 1;
+
+    rc = gc_cipher_setkey (ctx, sizeof (key), key);
+    if (rc != GC_OK)
+      return 1;
+
+    memcpy (scratch, plain, sizeof (plain));
+    rc = gc_cipher_encrypt_inline (ctx, sizeof (plain), scratch);
+    if (rc != GC_OK)
+      return 1;
+
+    if (memcmp (scratch, cipher, sizeof (plain)) != 0)
+      {
+        printf ("expected:\n");
+        for (i = 0; i < sizeof (plain); i++)
+          printf ("%02x ", cipher[i] & 0xFF);
+        printf ("\ncomputed:\n");
+        for (i = 0; i < sizeof (plain); i++)
+          printf ("%02x ", scratch[i] & 0xFF);
+        printf ("\n");
+        return 1;
+      }
+
+    gc_cipher_close (ctx);
+  }
+
+  gc_done ();
+
+  return 0;
+}
@@ -36,6 +36,7 @@ extern int _gsasl_gs2_client_step (Gsasl_session * sctx,
 				   char **output, size_t * output_len);
 extern void _gsasl_gs2_client_finish (Gsasl_session * sctx, void *mech_data);
 
+extern int _gsasl_gs2_server_probe (Gsasl_session * sctx);
 extern int _gsasl_gs2_server_start (Gsasl_session * sctx, void **mech_data);
 extern int _gsasl_gs2_server_step (Gsasl_session * sctx,
 				   void *mech_data,
@@ -112,6 +112,28 @@ gs2_get_cred (Gsasl_session * sctx, _Gsasl_gs2_server_state * state)
   return GSASL_OK;
 }
 
+/* Check that an acceptor credential for the mechanism is available,
+   like _gsasl_gs2_server_start does, but without allocating any
+   session state. */
+int
+_gsasl_gs2_server_probe (Gsasl_session * sctx)
+{
+  _Gsasl_gs2_server_state state;
+  OM_uint32 min_stat;
+  int res;
+
+  res = gs2_get_oid (sctx, &state.mech_oid);
+  if (res != GSASL_OK)
+    return res;
+
+  state.cred = GSS_C_NO_CREDENTIAL;
+  res = gs2_get_cred (sctx, &state);
+  if (state.cred != GSS_C_NO_CREDENTIAL)
+    gss_release_cred (&min_stat, &state.cred);
+
+  return res;
+}
+
 /* Initialize GS2 state into MECH_DATA.  Return GSASL_OK if GS2 is
    ready and initialization succeeded, or an error code. */
 int
@@ -49,6 +49,7 @@ struct _Gsasl_gssapi_client_state
   gss_name_t service;
   gss_ctx_id_t context;
   gss_qop_t qop;
+  gss_buffer_desc wrapped;
 };
 typedef struct _Gsasl_gssapi_client_state _Gsasl_gssapi_client_state;
 
@@ -63,6 +64,8 @@ _gsasl_gssapi_client_start (Gsasl_session * sctx, void **mech_data)
 
   state->context = GSS_C_NO_CONTEXT;
   state->service = GSS_C_NO_NAME;
+  state->wrapped.length = 0;
+  state->wrapped.value = NULL;
   state->step = 0;
   state->qop = GSASL_QOP_AUTH;	/* FIXME: Should be GSASL_QOP_AUTH_CONF. */
 
@@ -268,6 +271,8 @@ _gsasl_gssapi_client_finish (Gsasl_session * sctx, void *mech_data)
   if (state->context != GSS_C_NO_CONTEXT)
     maj_stat = gss_delete_sec_context (&min_stat, &state->context,
 				       GSS_C_NO_BUFFER);
+  if (state->wrapped.value != NULL)
+    maj_stat = gss_release_buffer (&min_stat, &state->wrapped);
 
   free (state);
 }
@@ -299,7 +304,7 @@ _gsasl_gssapi_client_encode (Gsasl_session * sctx,
       if (GSS_ERROR (maj_stat))
 	return GSASL_GSSAPI_WRAP_ERROR;
       *output_len = output_message_buffer.length;
-      *output = malloc (input_len);
+      *output = malloc (output_message_buffer.length);
       if (!*output)
 	{
 	  maj_stat = gss_release_buffer (&min_stat, &output_message_buffer);
@@ -352,7 +357,7 @@ _gsasl_gssapi_client_decode (Gsasl_session * sctx,
       if (GSS_ERROR (maj_stat))
 	return GSASL_GSSAPI_UNWRAP_ERROR;
       *output_len = output_message_buffer.length;
-      *output = malloc (input_len);
+      *output = malloc (output_message_buffer.length);
       if (!*output)
 	{
 	  maj_stat = gss_release_buffer (&min_stat, &output_message_buffer);
@@ -379,3 +384,96 @@ _gsasl_gssapi_client_decode (Gsasl_session * sctx,
 
   return GSASL_OK;
 }
+
+/* Wrap (if WRAP is true) or unwrap the INPUT_COUNT segments in INPUT
+   into a single OUTPUT segment, which stays valid until the next call
+   or until the session is finished.  GSS-API works on contiguous
+   buffers, so segmented input is gathered first. */
+static int
+codev (_Gsasl_gssapi_client_state * state, int wrap,
+       const Gsasl_iov * input, size_t input_count,
+       Gsasl_iov * output, size_t * output_count)
+{
+  OM_uint32 min_stat, maj_stat;
+  gss_buffer_desc in;
+  char *tmp = NULL;
+  size_t i;
+
+  if (!(state && state->step == 3 &&
+	state->qop & (GSASL_QOP_AUTH_INT | GSASL_QOP_AUTH_CONF)))
+    {
+      memcpy (output, input, input_count * sizeof (*input));
+      *output_count = input_count;
+      return GSASL_OK;
+    }
+
+  if (state->wrapped.value != NULL)
+    {
+      maj_stat = gss_release_buffer (&min_stat, &state->wrapped);
+      if (GSS_ERROR (maj_stat))
+	return GSASL_GSSAPI_RELEASE_BUFFER_ERROR;
+      state->wrapped.length = 0;
+      state->wrapped.value = NULL;
+    }
+
+  if (input_count == 1)
+    {
+      in.length = input[0].len;
+      in.value = (void *) input[0].base;
+    }
+  else
+    {
+      char *p;
+
+      for (in.length = 0, i = 0; i < input_count; i++)
+	in.length += input[i].len;
+      tmp = malloc (in.length ? in.length : 1);
+      if (!tmp)
+	return GSASL_MALLOC_ERROR;
+      for (p = tmp, i = 0; i < input_count; i++)
+	{
+	  memcpy (p, input[i].base, input[i].len);
+	  p += input[i].len;
+	}
+      in.value = tmp;
+    }
+
+  if (wrap)
+    maj_stat = gss_wrap (&min_stat, state->context,
+			 state->qop & GSASL_QOP_AUTH_CONF ? 1 : 0,
+			 GSS_C_QOP_DEFAULT, &in, NULL, &state->wrapped);
+  else
+    maj_stat = gss_unwrap (&min_stat, state->context,
+			   &in, &state->wrapped, NULL, NULL);
+  free (tmp);
+  if (GSS_ERROR (maj_stat))
+    {
+      state->wrapped.length = 0;
+      state->wrapped.value = NULL;
+      return wrap ? GSASL_GSSAPI_WRAP_ERROR : GSASL_GSSAPI_UNWRAP_ERROR;
+    }
+
+  output[0].base = state->wrapped.value;
+  output[0].len = state->wrapped.length;
+  *output_count = 1;
+
+  return GSASL_OK;
+}
+
+int
+_gsasl_gssapi_client_encodev (Gsasl_session * sctx,
+			      void *mech_data,
+			      const Gsasl_iov * input, size_t input_count,
+			      Gsasl_iov * output, size_t * output_count)
+{
+  return codev (mech_data, 1, input, input_count, output, output_count);
+}
+
+int
+_gsasl_gssapi_client_decodev (Gsasl_session * sctx,
+			      void *mech_data,
+			      const Gsasl_iov * input, size_t input_count,
+			      Gsasl_iov * output, size_t * output_count)
+{
+  return codev (mech_data, 0, input, input_count, output, output_count);
+}
@@ -52,6 +52,52 @@ struct _Gsasl_gssapi_server_state
 };
 typedef struct _Gsasl_gssapi_server_state _Gsasl_gssapi_server_state;
 
+/* Check that an acceptor credential for the service is available,
+   like _gsasl_gssapi_server_start does, but without allocating any
+   session state. */
+int
+_gsasl_gssapi_server_probe (Gsasl_session * sctx)
+{
+  OM_uint32 maj_stat, min_stat;
+  gss_name_t server;
+  gss_cred_id_t cred;
+  gss_buffer_desc bufdesc;
+  const char *service;
+  const char *hostname;
+
+  service = gsasl_property_get (sctx, GSASL_SERVICE);
+  if (!service)
+    return GSASL_NO_SERVICE;
+
+  hostname = gsasl_property_get (sctx, GSASL_HOSTNAME);
+  if (!hostname)
+    return GSASL_NO_HOSTNAME;
+
+  bufdesc.length = strlen (service) + strlen ("@") + strlen (hostname) + 1;
+  bufdesc.value = malloc (bufdesc.length);
+  if (bufdesc.value == NULL)
+    return GSASL_MALLOC_ERROR;
+
+  sprintf (bufdesc.value, "%s@%s", service, hostname);
+
+  maj_stat = gss_import_name (&min_stat, &bufdesc, GSS_C_NT_HOSTBASED_SERVICE,
+			      &server);
+  free (bufdesc.value);
+  if (GSS_ERROR (maj_stat))
+    return GSASL_GSSAPI_IMPORT_NAME_ERROR;
+
+  maj_stat = gss_acquire_cred (&min_stat, server, 0,
+			       GSS_C_NULL_OID_SET, GSS_C_ACCEPT,
+			       &cred, NULL, NULL);
+  gss_release_name (&min_stat, &server);
+  if (GSS_ERROR (maj_stat))
+    return GSASL_GSSAPI_ACQUIRE_CRED_ERROR;
+
+  gss_release_cred (&min_stat, &cred);
+
+  return GSASL_OK;
+}
+
 int
 _gsasl_gssapi_server_start (Gsasl_session * sctx, void **mech_data)
 {
@@ -45,7 +45,20 @@ extern int _gsasl_gssapi_client_decode (Gsasl_session * sctx,
 					void *mech_data,
 					const char *input, size_t input_len,
 					char **output, size_t * output_len);
+extern int _gsasl_gssapi_client_encodev (Gsasl_session * sctx,
+					 void *mech_data,
+					 const Gsasl_iov * input,
+					 size_t input_count,
+					 Gsasl_iov * output,
+					 size_t * output_count);
+extern int _gsasl_gssapi_client_decodev (Gsasl_session * sctx,
+					 void *mech_data,
+					 const Gsasl_iov * input,
+					 size_t input_count,
+					 Gsasl_iov * output,
+					 size_t * output_count);
 
+extern int _gsasl_gssapi_server_probe (Gsasl_session * sctx);
 extern int _gsasl_gssapi_server_start (Gsasl_session * sctx,
 				       void **mech_data);
 extern int _gsasl_gssapi_server_step (Gsasl_session * sctx,
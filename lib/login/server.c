@@ -33,6 +33,9 @@
 /* Get specification. */
 #include "login.h"
 
+/* Get _gsasl_callback_pending. */
+#include "resume.h"
+
 struct _Gsasl_login_server_state
 {
   int step;
@@ -102,6 +105,8 @@ _gsasl_login_server_step (Gsasl_session * sctx,
       if (input_len == 0)
 	return GSASL_MECHANISM_PARSE_ERROR;
 
+      /* A suspended step is run again. */
+      free (state->password);
       state->password = malloc (input_len + 1);
       if (state->password == NULL)
 	return GSASL_MALLOC_ERROR;
@@ -132,6 +137,9 @@ _gsasl_login_server_step (Gsasl_session * sctx,
 	    res = GSASL_AUTHENTICATION_ERROR;
 	}
 
+      if (_gsasl_callback_pending (sctx))
+	return GSASL_CALLBACK_PENDING;
+
       *output_len = 0;
       *output = NULL;
       state->step++;
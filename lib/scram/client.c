@@ -41,6 +41,7 @@
 #include "printer.h"
 #include "gc.h"
 #include "memxor.h"
+#include "mechtools.h"
 
 #define CNONCE_ENTROPY_BYTES 18
 
@@ -49,14 +50,17 @@ struct scram_client_state
   int plus;
   int step;
   char *cfmb;			/* client first message bare */
-  char *serversignature;
+  char serversignature[20];
   char *authmessage;
   char *cbtlsunique;
   size_t cbtlsuniquelen;
+  /* The fields of cf point to these. */
+  char *cnonce;
+  char *username;		/* escaped */
+  char *authzid;		/* escaped */
+  char *cbind;			/* B64("cbind-input") */
+  char proof[29];		/* B64(ClientProof) */
   struct scram_client_first cf;
-  struct scram_server_first sf;
-  struct scram_client_final cl;
-  struct scram_server_final sl;
 };
 
 static int
@@ -80,18 +84,18 @@ scram_start (Gsasl_session * sctx, void **mech_data, int plus)
       return rc;
     }
 
-  rc = gsasl_base64_to (buf, CNONCE_ENTROPY_BYTES,
-			&state->cf.client_nonce, NULL);
+  rc = gsasl_base64_to (buf, CNONCE_ENTROPY_BYTES, &state->cnonce, NULL);
   if (rc != GSASL_OK)
     {
       free (state);
       return rc;
     }
+  scram_span_set (&state->cf.client_nonce, state->cnonce);
 
   p = gsasl_property_get (sctx, GSASL_CB_TLS_UNIQUE);
   if (state->plus && !p)
     {
-      free (state->cf.client_nonce);
+      free (state->cnonce);
       free (state);
       return GSASL_NO_CB_TLS_UNIQUE;
     }
@@ -101,7 +105,7 @@ scram_start (Gsasl_session * sctx, void **mech_data, int plus)
 			      &state->cbtlsuniquelen);
       if (rc != GSASL_OK)
 	{
-	  free (state->cf.client_nonce);
+	  free (state->cnonce);
 	  free (state);
 	  return rc;
 	}
@@ -124,46 +128,6 @@ _gsasl_scram_sha1_plus_client_start (Gsasl_session * sctx, void **mech_data)
   return scram_start (sctx, mech_data, 1);
 }
 
-static char
-hexdigit_to_char (char hexdigit)
-{
-  if (hexdigit >= '0' && hexdigit <= '9')
-    return hexdigit - '0';
-  if (hexdigit >= 'a' && hexdigit <= 'f')
-    return hexdigit - 'a' + 10;
-  return 0;
-}
-
-static char
-hex_to_char (char u, char l)
-{
-  return (char) (((unsigned char) hexdigit_to_char (u)) * 16
-		 + hexdigit_to_char (l));
-}
-
-static void
-sha1_hex_to_byte (char *saltedpassword, const char *p)
-{
-  while (*p)
-    {
-      *saltedpassword = hex_to_char (p[0], p[1]);
-      p += 2;
-      saltedpassword++;
-    }
-}
-
-static bool
-hex_p (const char *hexstr)
-{
-  static const char hexalpha[] = "0123456789abcdef";
-
-  for (; *hexstr; hexstr++)
-    if (strchr (hexalpha, *hexstr) == NULL)
-      return false;
-
-  return true;
-}
-
 int
 _gsasl_scram_sha1_client_step (Gsasl_session * sctx,
 			       void *mech_data,
@@ -182,11 +146,12 @@ _gsasl_scram_sha1_client_step (Gsasl_session * sctx,
     case 0:
       {
 	const char *p;
+	char *prep;
 
 	if (state->plus)
 	  {
 	    state->cf.cbflag = 'p';
-	    state->cf.cbname = strdup ("tls-unique");
+	    scram_span_set (&state->cf.cbname, "tls-unique");
 	  }
 	else
 	  {
@@ -200,14 +165,24 @@ _gsasl_scram_sha1_client_step (Gsasl_session * sctx,
 	if (!p)
 	  return GSASL_NO_AUTHID;
 
-	rc = gsasl_saslprep (p, GSASL_ALLOW_UNASSIGNED,
-			     &state->cf.username, NULL);
+	rc = gsasl_saslprep (p, GSASL_ALLOW_UNASSIGNED, &prep, NULL);
 	if (rc != GSASL_OK)
 	  return rc;
 
+	state->username = scram_escape (prep);
+	gsasl_free (prep);
+	if (!state->username)
+	  return GSASL_MALLOC_ERROR;
+	scram_span_set (&state->cf.username, state->username);
+
 	p = gsasl_property_get (sctx, GSASL_AUTHZID);
 	if (p)
-	  state->cf.authzid = strdup (p);
+	  {
+	    state->authzid = scram_escape (p);
+	    if (!state->authzid)
+	      return GSASL_MALLOC_ERROR;
+	    scram_span_set (&state->cf.authzid, state->authzid);
+	  }
 
 	rc = scram_print_client_first (&state->cf, output);
 	if (rc == -2)
@@ -242,11 +217,11 @@ _gsasl_scram_sha1_client_step (Gsasl_session * sctx,
 	    memcpy (cbind_input, *output, p - *output);
 	    memcpy (cbind_input + (p - *output), state->cbtlsunique,
 		    state->cbtlsuniquelen);
-	    rc = gsasl_base64_to (cbind_input, len, &state->cl.cbind, NULL);
+	    rc = gsasl_base64_to (cbind_input, len, &state->cbind, NULL);
 	    free (cbind_input);
 	  }
 	else
-	  rc = gsasl_base64_to (*output, p - *output, &state->cl.cbind, NULL);
+	  rc = gsasl_base64_to (*output, p - *output, &state->cbind, NULL);
 	if (rc != 0)
 	  return rc;
 
@@ -258,31 +233,36 @@ _gsasl_scram_sha1_client_step (Gsasl_session * sctx,
 
     case 1:
       {
-	if (scram_parse_server_first (input, input_len, &state->sf) < 0)
+	struct scram_server_first sf;
+	struct scram_client_final cl;
+
+	/* The fields of sf, and the nonce of cl, point into the
+	   input. */
+	if (scram_parse_server_first (input, input_len, &sf) < 0)
 	  return GSASL_MECHANISM_PARSE_ERROR;
 
-	if (strlen (state->sf.nonce) < strlen (state->cf.client_nonce) ||
-	    memcmp (state->cf.client_nonce, state->sf.nonce,
-		    strlen (state->cf.client_nonce)) != 0)
+	if (sf.nonce.len < state->cf.client_nonce.len ||
+	    memcmp (state->cf.client_nonce.ptr, sf.nonce.ptr,
+		    state->cf.client_nonce.len) != 0)
 	  return GSASL_AUTHENTICATION_ERROR;
 
-	state->cl.nonce = strdup (state->sf.nonce);
-	if (!state->cl.nonce)
-	  return GSASL_MALLOC_ERROR;
+	scram_span_set (&cl.cbind, state->cbind);
+	cl.nonce = sf.nonce;
 
 	/* Save salt/iter as properties, so that client callback can
 	   access them. */
 	{
 	  char *str = NULL;
 	  int n;
-	  n = asprintf (&str, "%lu", (unsigned long) state->sf.iter);
+	  n = asprintf (&str, "%lu", (unsigned long) sf.iter);
 	  if (n < 0 || str == NULL)
 	    return GSASL_MALLOC_ERROR;
 	  gsasl_property_set (sctx, GSASL_SCRAM_ITER, str);
 	  free (str);
 	}
 
-	gsasl_property_set (sctx, GSASL_SCRAM_SALT, state->sf.salt);
+	gsasl_property_set_raw (sctx, GSASL_SCRAM_SALT,
+				sf.salt.ptr, sf.salt.len);
 
 	/* Generate ClientProof. */
 	{
@@ -292,11 +272,12 @@ _gsasl_scram_sha1_client_step (Gsasl_session * sctx,
 	  char *clientsignature;
 	  char clientproof[20];
 	  const char *p;
+	  size_t len;
 
 	  /* Get SaltedPassword. */
 	  p = gsasl_property_get (sctx, GSASL_SCRAM_SALTED_PASSWORD);
-	  if (p && strlen (p) == 40 && hex_p (p))
-	    sha1_hex_to_byte (saltedpassword, p);
+	  if (p && strlen (p) == 40 && _gsasl_hex_p (p))
+	    _gsasl_hex_decode (p, saltedpassword);
 	  else if ((p = gsasl_property_get (sctx, GSASL_PASSWORD)) != NULL)
 	    {
 	      Gc_rc err;
@@ -308,7 +289,7 @@ _gsasl_scram_sha1_client_step (Gsasl_session * sctx,
 	      if (rc != GSASL_OK)
 		return rc;
 
-	      rc = gsasl_base64_from (state->sf.salt, strlen (state->sf.salt),
+	      rc = gsasl_base64_from (sf.salt.ptr, sf.salt.len,
 				      &salt, &saltlen);
 	      if (rc != 0)
 		{
@@ -319,7 +300,7 @@ _gsasl_scram_sha1_client_step (Gsasl_session * sctx,
 	      /* SaltedPassword := Hi(password, salt) */
 	      err = gc_pbkdf2_sha1 (preppasswd, strlen (preppasswd),
 				    salt, saltlen,
-				    state->sf.iter, saltedpassword, 20);
+				    sf.iter, saltedpassword, 20);
 	      gsasl_free (preppasswd);
 	      gsasl_free (salt);
 	      if (err != GC_OK)
@@ -333,11 +314,10 @@ _gsasl_scram_sha1_client_step (Gsasl_session * sctx,
 	    char *cfmwp;
 	    int n;
 
-	    state->cl.proof = strdup ("p");
-	    rc = scram_print_client_final (&state->cl, &cfmwp);
+	    scram_span_set (&cl.proof, "p");
+	    rc = scram_print_client_final (&cl, &cfmwp);
 	    if (rc != 0)
 	      return GSASL_MALLOC_ERROR;
-	    free (state->cl.proof);
 
 	    /* Compute AuthMessage */
 	    n = asprintf (&state->authmessage, "%s,%.*s,%.*s",
@@ -383,41 +363,33 @@ _gsasl_scram_sha1_client_step (Gsasl_session * sctx,
 	  free (clientkey);
 	  free (clientsignature);
 
-	  rc = gsasl_base64_to (clientproof, 20, &state->cl.proof, NULL);
+	  len = sizeof (state->proof);
+	  rc = gsasl_base64_to_buffer (clientproof, 20, state->proof, &len);
 	  if (rc != 0)
 	    return rc;
+	  scram_span_set (&cl.proof, state->proof);
 
 	  /* Generate ServerSignature, for comparison in next step. */
 	  {
-	    char *serverkey;
-	    char *serversignature;
+	    char serverkey[20];
 
 	    /* ServerKey := HMAC(SaltedPassword, "Server Key") */
 #define SERVER_KEY "Server Key"
-	    rc = gsasl_hmac_sha1 (saltedpassword, 20,
-				  SERVER_KEY, strlen (SERVER_KEY),
-				  &serverkey);
-	    if (rc != 0)
-	      return rc;
+	    if (gc_hmac_sha1 (saltedpassword, 20,
+			      SERVER_KEY, strlen (SERVER_KEY),
+			      serverkey) != GC_OK)
+	      return GSASL_CRYPTO_ERROR;
 
 	    /* ServerSignature := HMAC(ServerKey, AuthMessage) */
-	    rc = gsasl_hmac_sha1 (serverkey, 20,
-				  state->authmessage,
-				  strlen (state->authmessage),
-				  &serversignature);
-	    gsasl_free (serverkey);
-	    if (rc != 0)
-	      return rc;
-
-	    rc = gsasl_base64_to (serversignature, 20,
-				  &state->serversignature, NULL);
-	    gsasl_free (serversignature);
-	    if (rc != 0)
-	      return rc;
+	    if (gc_hmac_sha1 (serverkey, 20,
+			      state->authmessage,
+			      strlen (state->authmessage),
+			      state->serversignature) != GC_OK)
+	      return GSASL_CRYPTO_ERROR;
 	  }
 	}
 
-	rc = scram_print_client_final (&state->cl, output);
+	rc = scram_print_client_final (&cl, output);
 	if (rc != 0)
 	  return GSASL_MALLOC_ERROR;
 
@@ -430,10 +402,19 @@ _gsasl_scram_sha1_client_step (Gsasl_session * sctx,
 
     case 2:
       {
-	if (scram_parse_server_final (input, input_len, &state->sl) < 0)
+	struct scram_server_final sl;
+	char verifier[20];
+	size_t len = sizeof (verifier);
+
+	if (scram_parse_server_final (input, input_len, &sl) < 0)
 	  return GSASL_MECHANISM_PARSE_ERROR;
 
-	if (strcmp (state->sl.verifier, state->serversignature) != 0)
+	/* Compare the decoded verifier with ServerSignature. */
+	if (gsasl_base64_from_buffer (sl.verifier.ptr, sl.verifier.len,
+				      verifier, &len) != GSASL_OK
+	    || len != sizeof (verifier)
+	    || !_gsasl_digest_eq (verifier, state->serversignature,
+				  sizeof (verifier)))
 	  return GSASL_AUTHENTICATION_ERROR;
 
 	state->step++;
@@ -457,13 +438,12 @@ _gsasl_scram_sha1_client_finish (Gsasl_session * sctx, void *mech_data)
     return;
 
   free (state->cfmb);
-  free (state->serversignature);
   free (state->authmessage);
   free (state->cbtlsunique);
-  scram_free_client_first (&state->cf);
-  scram_free_server_first (&state->sf);
-  scram_free_client_final (&state->cl);
-  scram_free_server_final (&state->sl);
+  free (state->cnonce);
+  free (state->username);
+  free (state->authzid);
+  free (state->cbind);
 
   free (state);
 }
@@ -28,6 +28,17 @@
 #include "scram.h"
 
 #ifdef USE_SCRAM_SHA1
+/* SCRAM-SHA-1-PLUS can only be used with channel bindings, on both
+   sides. */
+int
+_gsasl_scram_sha1_plus_probe (Gsasl_session * sctx)
+{
+  if (!gsasl_property_get (sctx, GSASL_CB_TLS_UNIQUE))
+    return GSASL_NO_CB_TLS_UNIQUE;
+
+  return GSASL_OK;
+}
+
 Gsasl_mechanism gsasl_scram_sha1_mechanism = {
   GSASL_SCRAM_SHA1_NAME,
   {
@@ -27,10 +27,7 @@
 /* Get prototypes. */
 #include "parser.h"
 
-/* Get malloc, free. */
-#include <stdlib.h>
-
-/* Get memcpy, strlen. */
+/* Get memchr, memset. */
 #include <string.h>
 
 /* Get validator. */
@@ -39,16 +36,70 @@
 /* Get c_isalpha. */
 #include "c-ctype.h"
 
-static char *
-unescape (const char *str, size_t len)
+/* The parsers do not copy anything, the fields of the tokens point
+   into the message.  Messages containing a NUL byte are rejected, so
+   the fields never contain one. */
+
+/* How the value of an attribute ends. */
+enum
 {
-  char *out = malloc (len + 1);
-  char *p = out;
+  TO_COMMA,
+  TO_COMMA_OR_END,
+  TO_END
+};
+
+/* Parse "NAME=value" at the start of the LEN bytes at *STR into
+   VALUE, and advance past it.  The value ends as said by UNTIL,
+   before a comma or at the end of the message.  Returns -1 if the
+   attribute is not there. */
+static int
+attribute (char name, int until, const char **str, size_t * len,
+	   struct scram_span *value)
+{
+  const char *p = *str, *end;
+  size_t l = *len;
+
+  if (l < 2 || p[0] != name || p[1] != '=')
+    return -1;
+  p += 2, l -= 2;
+
+  end = until == TO_END ? NULL : memchr (p, ',', l);
+  if (!end)
+    {
+      if (until == TO_COMMA)
+	return -1;
+      end = p + l;
+    }
+
+  value->ptr = p;
+  value->len = end - p;
+  *str = end;
+  *len = l - value->len;
+
+  return 0;
+}
+
+/* Skip the comma at the start of the LEN bytes at *STR. */
+static int
+comma (const char **str, size_t * len)
+{
+  if (*len == 0 || **str != ',')
+    return -1;
+  (*str)++, (*len)--;
+
+  return 0;
+}
 
-  if (!out)
-    return NULL;
+/* Store the unescaped value of the saslname in SPAN in OUT, which
+   must have room for SPAN->len bytes, and return its length. */
+size_t
+scram_unescape (const struct scram_span *span, char *out)
+{
+  const char *str = span->ptr;
+  size_t len = span->len;
+  char *p = out;
 
-  while (len > 0 && *str)
+  while (len > 0)
     {
       if (len >= 3 && str[0] == '=' && str[1] == '2' && str[2] == 'C')
 	{
@@ -69,148 +120,49 @@ unescape (const char *str, size_t len)
 	  len--;
 	}
     }
-  *p = '\0';
 
-  return out;
+  return p - out;
 }
 
 int
 scram_parse_client_first (const char *str, size_t len,
 			  struct scram_client_first *cf)
 {
+  memset (cf, 0, sizeof (*cf));
+
   /* Minimum client first string is 'n,,n=a,r=b'. */
-  if (strnlen (str, len) < 10)
+  if (len < 10 || memchr (str, '\0', len))
     return -1;
 
-  if (len == 0 || (*str != 'n' && *str != 'y' && *str != 'p'))
+  if (*str != 'n' && *str != 'y' && *str != 'p')
     return -1;
   cf->cbflag = *str;
-  str++, len--;
 
   if (cf->cbflag == 'p')
     {
-      const char *p;
-
-      if (len == 0 || *str != '=')
-	return -1;
-      str++, len--;
-
-      p = memchr (str, ',', len);
-      if (!p)
-	return -1;
-      cf->cbname = malloc (p - str + 1);
-      if (!cf->cbname)
-	return -1;
-      memcpy (cf->cbname, str, p - str);
-      cf->cbname[p - str] = '\0';
-      len -= (p - str);
-      str += (p - str);
-    }
-
-  if (len == 0 || *str != ',')
-    return -1;
-  str++, len--;
-
-  if (len == 0)
-    return -1;
-  if (*str == 'a')
-    {
-      const char *p;
-      size_t l;
-
-      str++, len--;
-      if (len == 0 || *str != '=')
-	return -1;
-      str++, len--;
-
-      p = memchr (str, ',', len);
-      if (!p)
-	return -1;
-
-      l = p - str;
-      if (len < l)
-	return -1;
-
-      cf->authzid = unescape (str, l);
-      if (!cf->authzid)
+      if (attribute ('p', TO_COMMA, &str, &len, &cf->cbname) < 0)
 	return -1;
-
-      str = p;
-      len -= l;
     }
+  else
+    str++, len--;
 
-  if (len == 0 || *str != ',')
-    return -1;
-  str++, len--;
-
-  if (len == 0 || *str != 'n')
-    return -1;
-  str++, len--;
-
-  if (len == 0 || *str != '=')
-    return -1;
-  str++, len--;
-
-  {
-    const char *p;
-    size_t l;
-
-    p = memchr (str, ',', len);
-    if (!p)
-      return -1;
-
-    l = p - str;
-    if (len < l)
-      return -1;
-
-    cf->username = unescape (str, l);
-    if (!cf->username)
-      return -1;
-
-    str = p;
-    len -= l;
-  }
-
-  if (len == 0 || *str != ',')
+  if (comma (&str, &len) < 0)
     return -1;
-  str++, len--;
 
-  if (len == 0 || *str != 'r')
+  if (len > 0 && *str == 'a'
+      && attribute ('a', TO_COMMA, &str, &len, &cf->authzid) < 0)
     return -1;
-  str++, len--;
 
-  if (len == 0 || *str != '=')
+  if (comma (&str, &len) < 0
+      || attribute ('n', TO_COMMA, &str, &len, &cf->username) < 0
+      || comma (&str, &len) < 0
+      || attribute ('r', TO_COMMA_OR_END, &str, &len,
+		    &cf->client_nonce) < 0)
     return -1;
-  str++, len--;
-
-  {
-    const char *p;
-    size_t l;
-
-    p = memchr (str, ',', len);
-    if (!p)
-      p = str + len;
-    if (!p)
-      return -1;
-
-    l = p - str;
-    if (len < l)
-      return -1;
-
-    cf->client_nonce = malloc (l + 1);
-    if (!cf->client_nonce)
-      return -1;
-
-    memcpy (cf->client_nonce, str, l);
-    cf->client_nonce[l] = '\0';
-
-    str = p;
-    len -= l;
-  }
 
   /* FIXME check that any extension fields follow valid syntax. */
 
-  if (scram_valid_client_first (cf) < 0)
+  if (!scram_valid_client_first (cf))
     return -1;
 
   return 0;
@@ -220,89 +172,22 @@ int
 scram_parse_server_first (const char *str, size_t len,
 			  struct scram_server_first *sf)
 {
-  /* Minimum server first string is 'r=ab,s=biws,i=1'. */
-  if (strnlen (str, len) < 15)
-    return -1;
-
-  if (len == 0 || *str != 'r')
-    return -1;
-  str++, len--;
-
-  if (len == 0 || *str != '=')
-    return -1;
-  str++, len--;
-
-  {
-    const char *p;
-    size_t l;
-
-    p = memchr (str, ',', len);
-    if (!p)
-      return -1;
-
-    l = p - str;
-    if (len < l)
-      return -1;
-
-    sf->nonce = malloc (l + 1);
-    if (!sf->nonce)
-      return -1;
-
-    memcpy (sf->nonce, str, l);
-    sf->nonce[l] = '\0';
-
-    str = p;
-    len -= l;
-  }
-
-  if (len == 0 || *str != ',')
-    return -1;
-  str++, len--;
-
-  if (len == 0 || *str != 's')
-    return -1;
-  str++, len--;
-
-  if (len == 0 || *str != '=')
-    return -1;
-  str++, len--;
-
-  {
-    const char *p;
-    size_t l;
-
-    p = memchr (str, ',', len);
-    if (!p)
-      return -1;
-
-    l = p - str;
-    if (len < l)
-      return -1;
+  memset (sf, 0, sizeof (*sf));
 
-    sf->salt = malloc (l + 1);
-    if (!sf->salt)
-      return -1;
-
-    memcpy (sf->salt, str, l);
-    sf->salt[l] = '\0';
-
-    str = p;
-    len -= l;
-  }
-
-  if (len == 0 || *str != ',')
+  /* Minimum server first string is 'r=ab,s=biws,i=1'. */
+  if (len < 15 || memchr (str, '\0', len))
     return -1;
-  str++, len--;
 
-  if (len == 0 || *str != 'i')
+  if (attribute ('r', TO_COMMA, &str, &len, &sf->nonce) < 0
+      || comma (&str, &len) < 0
+      || attribute ('s', TO_COMMA, &str, &len, &sf->salt) < 0
+      || comma (&str, &len) < 0)
     return -1;
-  str++, len--;
 
-  if (len == 0 || *str != '=')
+  if (len < 2 || str[0] != 'i' || str[1] != '=')
     return -1;
-  str++, len--;
+  str += 2, len -= 2;
 
-  sf->iter = 0;
   for (; len > 0 && *str >= '0' && *str <= '9'; str++, len--)
     {
       size_t last_iter = sf->iter;
@@ -319,7 +204,7 @@ scram_parse_server_first (const char *str, size_t len,
 
   /* FIXME check that any extension fields follow valid syntax. */
 
-  if (scram_valid_server_first (sf) < 0)
+  if (!scram_valid_server_first (sf))
     return -1;
 
   return 0;
@@ -329,125 +214,32 @@ int
 scram_parse_client_final (const char *str, size_t len,
 			  struct scram_client_final *cl)
 {
-  /* Minimum client final string is 'c=biws,r=ab,p=ab=='. */
-  if (strnlen (str, len) < 18)
-    return -1;
-
-  if (len == 0 || *str != 'c')
-    return -1;
-  str++, len--;
-
-  if (len == 0 || *str != '=')
-    return -1;
-  str++, len--;
-
-  {
-    const char *p;
-    size_t l;
-
-    p = memchr (str, ',', len);
-    if (!p)
-      return -1;
-
-    l = p - str;
-    if (len < l)
-      return -1;
-
-    cl->cbind = malloc (l + 1);
-    if (!cl->cbind)
-      return -1;
-
-    memcpy (cl->cbind, str, l);
-    cl->cbind[l] = '\0';
-
-    str = p;
-    len -= l;
-  }
+  memset (cl, 0, sizeof (*cl));
 
-  if (len == 0 || *str != ',')
-    return -1;
-  str++, len--;
-
-  if (len == 0 || *str != 'r')
-    return -1;
-  str++, len--;
-
-  if (len == 0 || *str != '=')
+  /* Minimum client final string is 'c=biws,r=ab,p=ab=='. */
+  if (len < 18 || memchr (str, '\0', len))
     return -1;
-  str++, len--;
-
-  {
-    const char *p;
-    size_t l;
-
-    p = memchr (str, ',', len);
-    if (!p)
-      return -1;
-
-    l = p - str;
-    if (len < l)
-      return -1;
 
-    cl->nonce = malloc (l + 1);
-    if (!cl->nonce)
-      return -1;
-
-    memcpy (cl->nonce, str, l);
-    cl->nonce[l] = '\0';
-
-    str = p;
-    len -= l;
-  }
-
-  if (len == 0 || *str != ',')
+  if (attribute ('c', TO_COMMA, &str, &len, &cl->cbind) < 0
+      || comma (&str, &len) < 0
+      || attribute ('r', TO_COMMA, &str, &len, &cl->nonce) < 0
+      || comma (&str, &len) < 0)
     return -1;
-  str++, len--;
 
   /* Ignore extensions. */
   while (len > 0 && c_isalpha (*str) && *str != 'p')
     {
-      const char *p;
-      size_t l;
-
-      str++, len--;
-
-      if (len == 0 || *str != '=')
-	return -1;
-      str++, len--;
-
-      p = memchr (str, ',', len);
-      if (!p)
-	return -1;
-      p++;
+      struct scram_span ext;
 
-      l = p - str;
-      if (len < l)
+      if (attribute (*str, TO_COMMA, &str, &len, &ext) < 0
+	  || comma (&str, &len) < 0)
 	return -1;
-
-      str = p;
-      len -= l;
     }
 
-  if (len == 0 || *str != 'p')
-    return -1;
-  str++, len--;
-
-  if (len == 0 || *str != '=')
-    return -1;
-  str++, len--;
-
-  /* Sanity check proof. */
-  if (memchr (str, '\0', len))
-    return -1;
-
-  cl->proof = malloc (len + 1);
-  if (!cl->proof)
+  if (attribute ('p', TO_END, &str, &len, &cl->proof) < 0)
     return -1;
 
-  memcpy (cl->proof, str, len);
-  cl->proof[len] = '\0';
-
-  if (scram_valid_client_final (cl) < 0)
+  if (!scram_valid_client_final (cl))
     return -1;
 
   return 0;
@@ -457,30 +249,16 @@ int
 scram_parse_server_final (const char *str, size_t len,
 			  struct scram_server_final *sl)
 {
-  /* Minimum client final string is 'v=ab=='. */
-  if (strnlen (str, len) < 6)
-    return -1;
-
-  if (len == 0 || *str != 'v')
-    return -1;
-  str++, len--;
+  memset (sl, 0, sizeof (*sl));
 
-  if (len == 0 || *str != '=')
-    return -1;
-  str++, len--;
-
-  /* Sanity check proof. */
-  if (memchr (str, '\0', len))
+  /* Minimum client final string is 'v=ab=='. */
+  if (len < 6 || memchr (str, '\0', len))
     return -1;
 
-  sl->verifier = malloc (len + 1);
-  if (!sl->verifier)
+  if (attribute ('v', TO_END, &str, &len, &sl->verifier) < 0)
     return -1;
 
-  memcpy (sl->verifier, str, len);
-  sl->verifier[len] = '\0';
-
-  if (scram_valid_server_final (sl) < 0)
+  if (!scram_valid_server_final (sl))
     return -1;
 
   return 0;
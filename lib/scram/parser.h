@@ -26,6 +26,8 @@
 /* Get token types. */
 #include "tokens.h"
 
+/* Parse the LEN bytes at STR into the token.  The fields point into
+   STR.  Returns 0 on success and -1 on invalid messages. */
 extern int scram_parse_client_first (const char *str, size_t len,
 				     struct scram_client_first *cf);
 
@@ -38,4 +40,6 @@ extern int scram_parse_client_final (const char *str, size_t len,
 extern int scram_parse_server_final (const char *str, size_t len,
 				     struct scram_server_final *sl);
 
+extern size_t scram_unescape (const struct scram_span *span, char *out);
+
 #endif /* SCRAM_PARSER_H */
@@ -27,19 +27,58 @@
 /* Get prototypes. */
 #include "printer.h"
 
-/* Get free. */
+/* Get malloc. */
 #include <stdlib.h>
 
-/* Get asprintf. */
-#include <stdio.h>
-
-/* Get strdup. */
+/* Get memcpy, strlen. */
 #include <string.h>
 
 /* Get token validator. */
 #include "validate.h"
 
-static char *
+/* Get _gsasl_msgbuf_*. */
+#include "msgbuf.h"
+
+/* Add "NAME=value" for the field VALUE, preceded by a comma unless it
+   is the first attribute. */
+static void
+attribute (struct _gsasl_msgbuf *out, char name,
+	   const struct scram_span *value)
+{
+  char prefix[3] = { ',', name, '=' };
+
+  if (out->len > 0)
+    _gsasl_msgbuf_add (out, prefix, 3);
+  else
+    _gsasl_msgbuf_add (out, prefix + 1, 2);
+  _gsasl_msgbuf_add (out, value->ptr, value->len);
+}
+
+/* Store the message written by WRITE from TOKEN in OUT, counting its
+   length first so that it is written once into a single allocation.
+   Returns 0 on success and -2 on memory allocation errors. */
+static int
+print_token (void (*write) (struct _gsasl_msgbuf *, const void *),
+	     const void *token, char **out)
+{
+  struct _gsasl_msgbuf buf;
+
+  _gsasl_msgbuf_init (&buf, 0);
+  write (&buf, token);
+  _gsasl_msgbuf_init (&buf, buf.len);
+  write (&buf, token);
+
+  *out = _gsasl_msgbuf_finish (&buf, NULL);
+  if (*out == NULL)
+    return -2;
+
+  return 0;
+}
+
+
+/* Return a newly allocated copy of STR, with ',' and '=' escaped as
+   in a saslname, or NULL on memory allocation errors. */
+char *
 scram_escape (const char *str)
 {
   char *out = malloc (strlen (str) * 3 + 1);
@@ -72,48 +111,53 @@ scram_escape (const char *str)
   return out;
 }
 
+static void
+client_first (struct _gsasl_msgbuf *out, const void *token)
+{
+  const struct scram_client_first *cf = token;
+
+  /* The gs2-header, where the first two attributes may be empty. */
+  _gsasl_msgbuf_putc (out, cf->cbflag);
+  if (cf->cbflag == 'p')
+    {
+      _gsasl_msgbuf_putc (out, '=');
+      _gsasl_msgbuf_add (out, cf->cbname.ptr, cf->cbname.len);
+    }
+  _gsasl_msgbuf_putc (out, ',');
+  if (cf->authzid.ptr)
+    {
+      _gsasl_msgbuf_add (out, "a=", 2);
+      _gsasl_msgbuf_add (out, cf->authzid.ptr, cf->authzid.len);
+    }
+
+  attribute (out, 'n', &cf->username);
+  attribute (out, 'r', &cf->client_nonce);
+}
+
 /* Print SCRAM client-first token into newly allocated output string
    OUT.  Returns 0 on success, -1 on invalid token, and -2 on memory
-   allocation errors. */
+   allocation errors.  The username and authzid are already
+   escaped. */
 int
 scram_print_client_first (struct scram_client_first *cf, char **out)
 {
-  char *username = NULL;
-  char *authzid = NULL;
-  int n;
-
   /* Below we assume fields are sensible, so first verify that to
      avoid crashes. */
   if (!scram_valid_client_first (cf))
     return -1;
 
-  /* Escape username and authzid. */
-
-  username = scram_escape (cf->username);
-  if (!username)
-    return -2;
-
-  if (cf->authzid)
-    {
-      authzid = scram_escape (cf->authzid);
-      if (!authzid)
-	return -2;
-    }
-
-  n = asprintf (out, "%c%s%s,%s%s,n=%s,r=%s",
-		cf->cbflag,
-		cf->cbflag == 'p' ? "=" : "",
-		cf->cbflag == 'p' ? cf->cbname : "",
-		authzid ? "a=" : "",
-		authzid ? authzid : "", username, cf->client_nonce);
-
-  free (username);
-  free (authzid);
+  return print_token (client_first, cf, out);
+}
 
-  if (n <= 0 || *out == NULL)
-    return -1;
+static void
+server_first (struct _gsasl_msgbuf *out, const void *token)
+{
+  const struct scram_server_first *sf = token;
 
-  return 0;
+  attribute (out, 'r', &sf->nonce);
+  attribute (out, 's', &sf->salt);
+  _gsasl_msgbuf_add (out, ",i=", 3);
+  _gsasl_msgbuf_number (out, sf->iter, 10, 0);
 }
 
 /* Print SCRAM server-first token into newly allocated output string
@@ -122,19 +166,22 @@ scram_print_client_first (struct scram_client_first *cf, char **out)
 int
 scram_print_server_first (struct scram_server_first *sf, char **out)
 {
-  int n;
-
   /* Below we assume fields are sensible, so first verify that to
      avoid crashes. */
   if (!scram_valid_server_first (sf))
     return -1;
 
-  n = asprintf (out, "r=%s,s=%s,i=%lu",
-		sf->nonce, sf->salt, (unsigned long) sf->iter);
-  if (n <= 0 || *out == NULL)
-    return -1;
+  return print_token (server_first, sf, out);
+}
 
-  return 0;
+static void
+client_final (struct _gsasl_msgbuf *out, const void *token)
+{
+  const struct scram_client_final *cl = token;
+
+  attribute (out, 'c', &cl->cbind);
+  attribute (out, 'r', &cl->nonce);
+  attribute (out, 'p', &cl->proof);
 }
 
 /* Print SCRAM client-final token into newly allocated output string
@@ -143,18 +190,20 @@ scram_print_server_first (struct scram_server_first *sf, char **out)
 int
 scram_print_client_final (struct scram_client_final *cl, char **out)
 {
-  int n;
-
   /* Below we assume fields are sensible, so first verify that to
      avoid crashes. */
   if (!scram_valid_client_final (cl))
     return -1;
 
-  n = asprintf (out, "c=%s,r=%s,p=%s", cl->cbind, cl->nonce, cl->proof);
-  if (n <= 0 || *out == NULL)
-    return -1;
+  return print_token (client_final, cl, out);
+}
 
-  return 0;
+static void
+server_final (struct _gsasl_msgbuf *out, const void *token)
+{
+  const struct scram_server_final *sl = token;
+
+  attribute (out, 'v', &sl->verifier);
 }
 
 /* Print SCRAM server-final token into newly allocated output string
@@ -163,16 +212,10 @@ scram_print_client_final (struct scram_client_final *cl, char **out)
 int
 scram_print_server_final (struct scram_server_final *sl, char **out)
 {
-  int n;
-
   /* Below we assume fields are sensible, so first verify that to
      avoid crashes. */
   if (!scram_valid_server_final (sl))
     return -1;
 
-  n = asprintf (out, "v=%s", sl->verifier);
-  if (n <= 0 || *out == NULL)
-    return -1;
-
-  return 0;
+  return print_token (server_final, sl, out);
 }
@@ -26,6 +26,8 @@
 /* Get token types. */
 #include "tokens.h"
 
+extern char *scram_escape (const char *str);
+
 extern int
 scram_print_client_first (struct scram_client_first *cf, char **out);
 
@@ -31,6 +31,8 @@
 extern Gsasl_mechanism gsasl_scram_sha1_mechanism;
 extern Gsasl_mechanism gsasl_scram_sha1_plus_mechanism;
 
+int _gsasl_scram_sha1_plus_probe (Gsasl_session * sctx);
+
 int _gsasl_scram_sha1_client_start (Gsasl_session * sctx, void **mech_data);
 
 int
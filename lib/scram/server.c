@@ -44,6 +44,18 @@
 #include "printer.h"
 #include "gc.h"
 #include "memxor.h"
+#include "mechtools.h"
+#include "scramcache.h"
+#include "scramkeys.h"
+
+/* Get _gsasl_callback_pending. */
+#include "resume.h"
+
+/* Get _gsasl_property_prefetch. */
+#include "prefetch.h"
+
+/* Get _gsasl_session_nonce. */
+#include "noncepool.h"
 
 #define DEFAULT_SALT_BYTES 12
 #define SNONCE_ENTROPY_BYTES 18
@@ -52,21 +64,20 @@ struct scram_server_state
 {
   int plus;
   int step;
-  char *cbind;
-  char *gs2header;		/* copy of client first gs2-header */
-  char *cfmb_str;		/* copy of client first message bare */
+  char *cf_str;			/* copy of client first message */
+  struct scram_client_first cf;	/* fields point into cf_str */
+  struct scram_span gs2header;	/* gs2-header in cf_str */
+  struct scram_span cfmb;	/* client-first-message-bare in cf_str */
   char *sf_str;			/* copy of server first message */
   char *snonce;
-  char *clientproof;
-  char *storedkey;
-  char *serverkey;
+  char *nonce;			/* client nonce followed by snonce */
+  char *salt;
+  struct scram_server_first sf;	/* fields point to nonce and salt */
+  char storedkey[20];
+  char serverkey[20];
   char *authmessage;
   char *cbtlsunique;
   size_t cbtlsuniquelen;
-  struct scram_client_first cf;
-  struct scram_server_first sf;
-  struct scram_client_final cl;
-  struct scram_server_final sl;
 };
 
 static int
@@ -83,7 +94,7 @@ scram_start (Gsasl_session * sctx, void **mech_data, int plus)
 
   state->plus = plus;
 
-  rc = gsasl_nonce (buf, SNONCE_ENTROPY_BYTES);
+  rc = _gsasl_session_nonce (sctx, buf, SNONCE_ENTROPY_BYTES);
   if (rc != GSASL_OK)
     goto end;
 
@@ -91,11 +102,11 @@ scram_start (Gsasl_session * sctx, void **mech_data, int plus)
   if (rc != GSASL_OK)
     goto end;
 
-  rc = gsasl_nonce (buf, DEFAULT_SALT_BYTES);
+  rc = _gsasl_session_nonce (sctx, buf, DEFAULT_SALT_BYTES);
   if (rc != GSASL_OK)
     goto end;
 
-  rc = gsasl_base64_to (buf, DEFAULT_SALT_BYTES, &state->sf.salt, NULL);
+  rc = gsasl_base64_to (buf, DEFAULT_SALT_BYTES, &state->salt, NULL);
   if (rc != GSASL_OK)
     goto end;
 
@@ -118,7 +129,7 @@ scram_start (Gsasl_session * sctx, void **mech_data, int plus)
   return GSASL_OK;
 
 end:
-  free (state->sf.salt);
+  free (state->salt);
   free (state->snonce);
   free (state);
   return rc;
@@ -136,6 +147,53 @@ _gsasl_scram_sha1_plus_server_start (Gsasl_session * sctx, void **mech_data)
   return scram_start (sctx, mech_data, 1);
 }
 
+/* Decode a base64 encoded StoredKey or ServerKey into KEY. */
+static int
+decode_key (const char *b64, char *key)
+{
+  char *bin;
+  size_t len;
+  int rc;
+
+  rc = gsasl_base64_from (b64, strlen (b64), &bin, &len);
+  if (rc != GSASL_OK)
+    return rc;
+
+  if (len != 20)
+    {
+      free (bin);
+      return GSASL_MECHANISM_PARSE_ERROR;
+    }
+
+  memcpy (key, bin, 20);
+  free (bin);
+
+  return GSASL_OK;
+}
+
+/* Set PROP to the unescaped saslname in SPAN. */
+static int
+set_saslname (Gsasl_session * sctx, Gsasl_property prop,
+	      const struct scram_span *span)
+{
+  char *tmp;
+
+  /* Most names need no unescaping. */
+  if (!memchr (span->ptr, '=', span->len))
+    {
+      gsasl_property_set_raw (sctx, prop, span->ptr, span->len);
+      return GSASL_OK;
+    }
+
+  tmp = malloc (span->len);
+  if (!tmp)
+    return GSASL_MALLOC_ERROR;
+  gsasl_property_set_raw (sctx, prop, tmp, scram_unescape (span, tmp));
+  free (tmp);
+
+  return GSASL_OK;
+}
+
 int
 _gsasl_scram_sha1_server_step (Gsasl_session * sctx,
 			       void *mech_data,
@@ -157,7 +215,19 @@ _gsasl_scram_sha1_server_step (Gsasl_session * sctx,
 	if (input_len == 0)
 	  return GSASL_NEEDS_MORE;
 
-	if (scram_parse_client_first (input, input_len, &state->cf) < 0)
+	/* A suspended step is run again. */
+	free (state->cf_str);
+	free (state->nonce);
+	state->cf_str = state->nonce = NULL;
+
+	/* Keep the message, the fields of cf point into it. */
+	state->cf_str = malloc (input_len);
+	if (!state->cf_str)
+	  return GSASL_MALLOC_ERROR;
+	memcpy (state->cf_str, input, input_len);
+
+	if (scram_parse_client_first (state->cf_str, input_len,
+				      &state->cf) < 0)
 	  return GSASL_MECHANISM_PARSE_ERROR;
 
 	/* In PLUS server mode, we require use of channel bindings. */
@@ -170,58 +240,59 @@ _gsasl_scram_sha1_server_step (Gsasl_session * sctx,
 	    && state->cbtlsuniquelen > 0 && state->cf.cbflag == 'y')
 	  return GSASL_AUTHENTICATION_ERROR;
 
+	rc = set_saslname (sctx, GSASL_AUTHID, &state->cf.username);
+	if (rc != GSASL_OK)
+	  return rc;
+	if (state->cf.authzid.ptr)
+	  rc = set_saslname (sctx, GSASL_AUTHZID, &state->cf.authzid);
+	else
+	  gsasl_property_set (sctx, GSASL_AUTHZID, NULL);
+	if (rc != GSASL_OK)
+	  return rc;
+
 	/* Check that username doesn't fail SASLprep. */
 	{
 	  char *tmp;
-	  rc = gsasl_saslprep (state->cf.username, GSASL_ALLOW_UNASSIGNED,
-			       &tmp, NULL);
+	  rc = gsasl_saslprep (gsasl_property_fast (sctx, GSASL_AUTHID),
+			       GSASL_ALLOW_UNASSIGNED, &tmp, NULL);
 	  if (rc != GSASL_OK || *tmp == '\0')
 	    return GSASL_AUTHENTICATION_ERROR;
 	  gsasl_free (tmp);
 	}
 
-	{
-	  const char *p;
-
-	  /* Save "gs2-header" and "message-bare" for next step. */
-	  p = memchr (input, ',', input_len);
-	  if (!p)
-	    return GSASL_AUTHENTICATION_ERROR;
-	  p++;
-	  p = memchr (p, ',', input_len - (p - input));
-	  if (!p)
-	    return GSASL_AUTHENTICATION_ERROR;
-	  p++;
-
-	  state->gs2header = malloc (p - input + 1);
-	  if (!state->gs2header)
-	    return GSASL_MALLOC_ERROR;
-	  memcpy (state->gs2header, input, p - input);
-	  state->gs2header[p - input] = '\0';
-
-	  state->cfmb_str = malloc (input_len - (p - input) + 1);
-	  if (!state->cfmb_str)
-	    return GSASL_MALLOC_ERROR;
-	  memcpy (state->cfmb_str, p, input_len - (p - input));
-	  state->cfmb_str[input_len - (p - input)] = '\0';
-	}
+	/* The "gs2-header" ends where "client-first-message-bare"
+	   starts, with the username. */
+	state->gs2header.ptr = state->cf_str;
+	state->gs2header.len = state->cf.username.ptr - 2 - state->cf_str;
+	state->cfmb.ptr = state->cf.username.ptr - 2;
+	state->cfmb.len = input_len - state->gs2header.len;
 
 	/* Create new nonce. */
 	{
-	  size_t cnlen = strlen (state->cf.client_nonce);
+	  size_t cnlen = state->cf.client_nonce.len;
 
-	  state->sf.nonce = malloc (cnlen + SNONCE_ENTROPY_BYTES + 1);
-	  if (!state->sf.nonce)
+	  state->nonce = malloc (cnlen + SNONCE_ENTROPY_BYTES + 1);
+	  if (!state->nonce)
 	    return GSASL_MALLOC_ERROR;
 
-	  memcpy (state->sf.nonce, state->cf.client_nonce, cnlen);
-	  memcpy (state->sf.nonce + cnlen, state->snonce,
-		  SNONCE_ENTROPY_BYTES);
-	  state->sf.nonce[cnlen + SNONCE_ENTROPY_BYTES] = '\0';
+	  memcpy (state->nonce, state->cf.client_nonce.ptr, cnlen);
+	  memcpy (state->nonce + cnlen, state->snonce, SNONCE_ENTROPY_BYTES);
+	  state->nonce[cnlen + SNONCE_ENTROPY_BYTES] = '\0';
+	  scram_span_set (&state->sf.nonce, state->nonce);
 	}
 
-	gsasl_property_set (sctx, GSASL_AUTHID, state->cf.username);
-	gsasl_property_set (sctx, GSASL_AUTHZID, state->cf.authzid);
+	/* Let the application look up the user once, for this step and
+	   the next. */
+	{
+	  static const Gsasl_property props[] = {
+	    GSASL_SCRAM_ITER, GSASL_SCRAM_SALT,
+	    GSASL_SCRAM_SERVERKEY, GSASL_SCRAM_STOREDKEY,
+	    GSASL_SCRAM_SALTED_PASSWORD, GSASL_PASSWORD
+	  };
+
+	  _gsasl_property_prefetch (sctx, props,
+				    sizeof (props) / sizeof (props[0]));
+	}
 
 	{
 	  const char *p = gsasl_property_get (sctx, GSASL_SCRAM_ITER);
@@ -235,11 +306,19 @@ _gsasl_scram_sha1_server_step (Gsasl_session * sctx,
 	  const char *p = gsasl_property_get (sctx, GSASL_SCRAM_SALT);
 	  if (p)
 	    {
-	      free (state->sf.salt);
-	      state->sf.salt = strdup (p);
+	      char *salt = strdup (p);
+
+	      if (!salt)
+		return GSASL_MALLOC_ERROR;
+	      free (state->salt);
+	      state->salt = salt;
 	    }
+	  scram_span_set (&state->sf.salt, state->salt);
 	}
 
+	if (_gsasl_callback_pending (sctx))
+	  return GSASL_CALLBACK_PENDING;
+
 	rc = scram_print_server_first (&state->sf, &state->sf_str);
 	if (rc != 0)
 	  return GSASL_MALLOC_ERROR;
@@ -256,55 +335,61 @@ _gsasl_scram_sha1_server_step (Gsasl_session * sctx,
 
     case 1:
       {
-	if (scram_parse_client_final (input, input_len, &state->cl) < 0)
+	struct scram_client_final cl;
+	struct scram_server_final sl;
+	char clientproof[20];
+	char verifier[29];
+
+	/* A suspended step is run again. */
+	free (state->authmessage);
+	state->authmessage = NULL;
+
+	/* The fields of cl point into the input. */
+	if (scram_parse_client_final (input, input_len, &cl) < 0)
 	  return GSASL_MECHANISM_PARSE_ERROR;
 
-	if (strcmp (state->cl.nonce, state->sf.nonce) != 0)
+	if (!scram_span_eq (&cl.nonce, &state->sf.nonce))
 	  return GSASL_AUTHENTICATION_ERROR;
 
 	/* Base64 decode the c= field and check that it matches
 	   client-first.  Also check channel binding data. */
 	{
+	  const struct scram_span *gs2 = &state->gs2header;
+	  char *cbind;
 	  size_t len;
 
-	  rc = gsasl_base64_from (state->cl.cbind, strlen (state->cl.cbind),
-				  &state->cbind, &len);
+	  rc = gsasl_base64_from (cl.cbind.ptr, cl.cbind.len, &cbind, &len);
 	  if (rc != 0)
 	    return rc;
 
 	  if (state->cf.cbflag == 'p')
 	    {
-	      if (len < strlen (state->gs2header))
-		return GSASL_AUTHENTICATION_ERROR;
-
-	      if (memcmp (state->cbind, state->gs2header,
-			  strlen (state->gs2header)) != 0)
-		return GSASL_AUTHENTICATION_ERROR;
-
-	      if (len - strlen (state->gs2header) != state->cbtlsuniquelen)
-		return GSASL_AUTHENTICATION_ERROR;
-
-	      if (memcmp (state->cbind + strlen (state->gs2header),
-			  state->cbtlsunique, state->cbtlsuniquelen) != 0)
-		return GSASL_AUTHENTICATION_ERROR;
+	      if (len != gs2->len + state->cbtlsuniquelen
+		  || memcmp (cbind, gs2->ptr, gs2->len) != 0
+		  || memcmp (cbind + gs2->len, state->cbtlsunique,
+			     state->cbtlsuniquelen) != 0)
+		rc = GSASL_AUTHENTICATION_ERROR;
 	    }
 	  else
 	    {
-	      if (len != strlen (state->gs2header))
-		return GSASL_AUTHENTICATION_ERROR;
-
-	      if (memcmp (state->cbind, state->gs2header, len) != 0)
-		return GSASL_AUTHENTICATION_ERROR;
+	      if (len != gs2->len || memcmp (cbind, gs2->ptr, len) != 0)
+		rc = GSASL_AUTHENTICATION_ERROR;
 	    }
+
+	  free (cbind);
+	  if (rc != GSASL_OK)
+	    return rc;
 	}
 
 	/* Base64 decode client proof and check that length matches
 	   SHA-1 size. */
 	{
-	  size_t len;
+	  size_t len = sizeof (clientproof);
 
-	  rc = gsasl_base64_from (state->cl.proof, strlen (state->cl.proof),
-				  &state->clientproof, &len);
+	  rc = gsasl_base64_from_buffer (cl.proof.ptr, cl.proof.len,
+					 clientproof, &len);
+	  if (rc == GSASL_NEEDS_LARGER_BUFFER)
+	    return GSASL_MECHANISM_PARSE_ERROR;
 	  if (rc != 0)
 	    return rc;
 	  if (len != 20)
@@ -312,23 +397,37 @@ _gsasl_scram_sha1_server_step (Gsasl_session * sctx,
 	}
 
 	{
-	  const char *p;
+	  const char *p, *q;
 
-	  /* Get StoredKey and ServerKey */
+	  /* Get StoredKey and ServerKey.  The password is asked for
+	     first, so that applications that only have passwords see
+	     the same callbacks as in earlier releases. */
 	  if ((p = gsasl_property_get (sctx, GSASL_PASSWORD)))
 	    {
-	      Gc_rc err;
 	      char *salt;
 	      size_t saltlen;
 	      char saltedpassword[20];
-	      char *clientkey;
 	      char *preppasswd;
 
 	      rc = gsasl_saslprep (p, 0, &preppasswd, NULL);
 	      if (rc != GSASL_OK)
 		return rc;
 
-	      rc = gsasl_base64_from (state->sf.salt, strlen (state->sf.salt),
+	      /* Repeated logins may find the keys in the context cache,
+	         avoiding the expensive Hi() below. */
+	      if (_gsasl_scram_cache_lookup (sctx,
+					     gsasl_property_fast (sctx,
+								  GSASL_AUTHID),
+					     state->salt, state->sf.iter,
+					     preppasswd, saltedpassword,
+					     state->storedkey,
+					     state->serverkey))
+		{
+		  gsasl_free (preppasswd);
+		  goto keys_done;
+		}
+
+	      rc = gsasl_base64_from (state->salt, strlen (state->salt),
 				      &salt, &saltlen);
 	      if (rc != 0)
 		{
@@ -336,107 +435,115 @@ _gsasl_scram_sha1_server_step (Gsasl_session * sctx,
 		  return rc;
 		}
 
-	      /* SaltedPassword := Hi(password, salt) */
-	      err = gc_pbkdf2_sha1 (preppasswd, strlen (preppasswd),
-				    salt, saltlen,
-				    state->sf.iter, saltedpassword, 20);
-	      gsasl_free (preppasswd);
+	      /* SaltedPassword := Hi(password, salt), and the keys
+	         derived from it. */
+	      rc = _gsasl_scram_derive (preppasswd, salt, saltlen,
+					state->sf.iter, saltedpassword,
+					state->storedkey, state->serverkey);
 	      gsasl_free (salt);
-	      if (err != GC_OK)
-		return GSASL_MALLOC_ERROR;
+	      if (rc != GSASL_OK)
+		{
+		  gsasl_free (preppasswd);
+		  return rc;
+		}
 
-	      /* ClientKey := HMAC(SaltedPassword, "Client Key") */
-#define CLIENT_KEY "Client Key"
-	      rc = gsasl_hmac_sha1 (saltedpassword, 20,
-				    CLIENT_KEY, strlen (CLIENT_KEY),
-				    &clientkey);
-	      if (rc != 0)
+	      _gsasl_scram_cache_store (sctx,
+					gsasl_property_fast (sctx,
+							     GSASL_AUTHID),
+					state->salt, state->sf.iter,
+					preppasswd, saltedpassword,
+					state->storedkey, state->serverkey);
+	      gsasl_free (preppasswd);
+	    }
+	  else if ((p = gsasl_property_get (sctx, GSASL_SCRAM_SERVERKEY))
+		   && (q = gsasl_property_get (sctx, GSASL_SCRAM_STOREDKEY)))
+	    {
+	      /* Stored verifier, nothing to derive. */
+	      rc = decode_key (p, state->serverkey);
+	      if (rc != GSASL_OK)
 		return rc;
-
-	      /* StoredKey := H(ClientKey) */
-	      rc = gsasl_sha1 (clientkey, 20, &state->storedkey);
-	      free (clientkey);
-	      if (rc != 0)
+	      rc = decode_key (q, state->storedkey);
+	      if (rc != GSASL_OK)
 		return rc;
+	    }
+	  else if ((p = gsasl_property_get (sctx,
+					    GSASL_SCRAM_SALTED_PASSWORD))
+		   && strlen (p) == 40 && _gsasl_hex_p (p))
+	    {
+	      char saltedpassword[20];
 
-	      /* ServerKey := HMAC(SaltedPassword, "Server Key") */
-#define SERVER_KEY "Server Key"
-	      rc = gsasl_hmac_sha1 (saltedpassword, 20,
-				    SERVER_KEY, strlen (SERVER_KEY),
-				    &state->serverkey);
-	      if (rc != 0)
+	      _gsasl_hex_decode (p, saltedpassword);
+	      rc = _gsasl_scram_keys_from_salted (saltedpassword,
+						  state->storedkey,
+						  state->serverkey);
+	      if (rc != GSASL_OK)
 		return rc;
 	    }
 	  else
 	    return GSASL_NO_PASSWORD;
 
+	keys_done:
+
+	  /* The keys may come from a property set before the step,
+	     while the callback for the password is still pending. */
+	  if (_gsasl_callback_pending (sctx))
+	    return GSASL_CALLBACK_PENDING;
+
 	  /* Compute AuthMessage */
 	  {
-	    size_t len;
 	    int n;
 
-	    /* Get client-final-message-without-proof. */
-	    p = memmem (input, input_len, ",p=", 3);
-	    if (!p)
-	      return GSASL_MECHANISM_PARSE_ERROR;
-	    len = p - input;
-
-	    n = asprintf (&state->authmessage, "%s,%.*s,%.*s",
-			  state->cfmb_str,
-			  (int) strlen (state->sf_str), state->sf_str,
-			  (int) len, input);
+	    /* The client-final-message-without-proof ends before ",p=". */
+	    n = asprintf (&state->authmessage, "%.*s,%s,%.*s",
+			  (int) state->cfmb.len, state->cfmb.ptr,
+			  state->sf_str,
+			  (int) (cl.proof.ptr - 3 - input), input);
 	    if (n <= 0 || !state->authmessage)
 	      return GSASL_MALLOC_ERROR;
 	  }
 
 	  /* Check client proof. */
 	  {
-	    char *clientsignature;
-	    char *maybe_storedkey;
+	    char clientsignature[20];
+	    char maybe_storedkey[20];
 
 	    /* ClientSignature := HMAC(StoredKey, AuthMessage) */
-	    rc = gsasl_hmac_sha1 (state->storedkey, 20,
-				  state->authmessage,
-				  strlen (state->authmessage),
-				  &clientsignature);
-	    if (rc != 0)
-	      return rc;
+	    if (gc_hmac_sha1 (state->storedkey, 20,
+			      state->authmessage,
+			      strlen (state->authmessage),
+			      clientsignature) != GC_OK)
+	      return GSASL_CRYPTO_ERROR;
 
 	    /* ClientKey := ClientProof XOR ClientSignature */
-	    memxor (clientsignature, state->clientproof, 20);
+	    memxor (clientsignature, clientproof, 20);
 
-	    rc = gsasl_sha1 (clientsignature, 20, &maybe_storedkey);
-	    free (clientsignature);
-	    if (rc != 0)
-	      return rc;
+	    if (gc_sha1 (clientsignature, 20, maybe_storedkey) != GC_OK)
+	      return GSASL_CRYPTO_ERROR;
 
-	    rc = memcmp (state->storedkey, maybe_storedkey, 20);
-	    free (maybe_storedkey);
-	    if (rc != 0)
+	    if (!_gsasl_digest_eq (state->storedkey, maybe_storedkey, 20))
 	      return GSASL_AUTHENTICATION_ERROR;
 	  }
 
 	  /* Generate server verifier. */
 	  {
-	    char *serversignature;
+	    char serversignature[20];
+	    size_t len = sizeof (verifier);
 
 	    /* ServerSignature := HMAC(ServerKey, AuthMessage) */
-	    rc = gsasl_hmac_sha1 (state->serverkey, 20,
-				  state->authmessage,
-				  strlen (state->authmessage),
-				  &serversignature);
-	    if (rc != 0)
-	      return rc;
+	    if (gc_hmac_sha1 (state->serverkey, 20,
+			      state->authmessage,
+			      strlen (state->authmessage),
+			      serversignature) != GC_OK)
+	      return GSASL_CRYPTO_ERROR;
 
-	    rc = gsasl_base64_to (serversignature, 20,
-				  &state->sl.verifier, NULL);
-	    free (serversignature);
+	    rc = gsasl_base64_to_buffer (serversignature, 20, verifier, &len);
 	    if (rc != 0)
 	      return rc;
+	    scram_span_set (&sl.verifier, verifier);
 	  }
 	}
 
-	rc = scram_print_server_final (&state->sl, output);
+	rc = scram_print_server_final (&sl, output);
 	if (rc != 0)
 	  return GSASL_MALLOC_ERROR;
 	*output_len = strlen (*output);
@@ -461,20 +568,13 @@ _gsasl_scram_sha1_server_finish (Gsasl_session * sctx, void *mech_data)
   if (!state)
     return;
 
-  free (state->cbind);
-  free (state->gs2header);
-  free (state->cfmb_str);
+  free (state->cf_str);
   free (state->sf_str);
   free (state->snonce);
-  free (state->clientproof);
-  free (state->storedkey);
-  free (state->serverkey);
+  free (state->nonce);
+  free (state->salt);
   free (state->authmessage);
   free (state->cbtlsunique);
-  scram_free_client_first (&state->cf);
-  scram_free_server_first (&state->sf);
-  scram_free_client_final (&state->cl);
-  scram_free_server_final (&state->sl);
 
   free (state);
 }
@@ -0,0 +1,278 @@
+/* test-parser.c --- Self tests of SCRAM parser & printer.
+ * Copyright (C) 2012 Simon Josefsson
+ *
+ * This file is part of GNU SASL Library.
+ *
+ * GNU SASL Library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; either version 2.1 of
+ * the License, or (at your option) any later version.
+ *
+ * GNU SASL Library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with GNU SASL Library; if not, write to the Free
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "parser.h"
+#include "printer.h"
+
+#define MUTATIONS 20000
+#define LOOPS 100000
+
+enum
+{
+  CLIENT_FIRST,
+  SERVER_FIRST,
+  CLIENT_FINAL,
+  SERVER_FINAL
+};
+
+static const struct
+{
+  int type;
+  const char *token;
+  int valid;
+} tokens[] = {
+  {CLIENT_FIRST, "n,,n=user,r=fyko+d2lbbFgONRv9qkxdawL", 1},
+  {CLIENT_FIRST, "y,,n=user,r=fyko+d2lbbFgONRv9qkxdawL", 1},
+  {CLIENT_FIRST, "p=tls-unique,a=admin,n=us=2Cer=3D,r=abc", 1},
+  {CLIENT_FIRST, "n,a=,n=user,r=abc,x=ext", 1},
+  {CLIENT_FIRST, "n,,n=,r=abc", 0},
+  {CLIENT_FIRST, "n,,n=user,r=", 0},
+  {CLIENT_FIRST, "p=tls_unique,,n=user,r=abc", 0},
+  {CLIENT_FIRST, "x,,n=user,r=abc", 0},
+  {CLIENT_FIRST, "n,,r=abc,n=user", 0},
+  {SERVER_FIRST, "r=fyko+d2lbbFgONRv9qkxdawL3rfcNHYJY1ZVvWVs7j,"
+   "s=QSXCR+Q6sek8bf92,i=4096", 1},
+  {SERVER_FIRST, "r=ab,s=biws,i=1,x=ext", 1},
+  {SERVER_FIRST, "r=ab,s=biws,i=0", 0},
+  {SERVER_FIRST, "r=ab,s=biws,i=1x", 0},
+  {SERVER_FIRST, "r=ab,s=biws,i=99999999999999999999999", 0},
+  {SERVER_FIRST, "r=ab,s=,i=4096", 0},
+  {CLIENT_FINAL, "c=biws,r=fyko+d2lbbFgONRv9qkxdawL3rfcNHYJY1ZVvWVs7j,"
+   "p=v0X8v3Bz2T0CJGbJQyF0X+HI4Ts=", 1},
+  {CLIENT_FINAL, "c=biws,r=ab,x=ext,y=ext,p=ab==", 1},
+  {CLIENT_FINAL, "c=biws,r=ab,p=ab,cd", 0},
+  {CLIENT_FINAL, "c=biws,r=ab,x=ext", 0},
+  {CLIENT_FINAL, "c=,r=abcdef,p=ab==", 0},
+  {SERVER_FINAL, "v=rmF9pqV8S7suAoZWja4dJRkFsKQ=", 1},
+  {SERVER_FINAL, "v=ab,cd", 0},
+  {SERVER_FINAL, "e=other-error", 0}
+};
+
+/* The messages of a login, indexed by type. */
+static const char *login[] = {
+  "n,,n=user,r=fyko+d2lbbFgONRv9qkxdawL",
+  "r=fyko+d2lbbFgONRv9qkxdawL3rfcNHYJY1ZVvWVs7j,s=QSXCR+Q6sek8bf92,i=4096",
+  "c=biws,r=fyko+d2lbbFgONRv9qkxdawL3rfcNHYJY1ZVvWVs7j,"
+    "p=v0X8v3Bz2T0CJGbJQyF0X+HI4Ts=",
+  "v=rmF9pqV8S7suAoZWja4dJRkFsKQ="
+};
+
+/* Parse the LEN bytes at STR as a token of TYPE, and check that the
+   fields stay within the message.  If OUT is not NULL, print the
+   token into it.  Returns the result of the parser. */
+static int
+parse (int type, const char *str, size_t len, char **out)
+{
+  struct scram_client_first cf;
+  struct scram_server_first sf;
+  struct scram_client_final cl;
+  struct scram_server_final sl;
+  const struct scram_span *spans[4];
+  size_t i, n = 0;
+  int rc = -1;
+
+  switch (type)
+    {
+    case CLIENT_FIRST:
+      rc = scram_parse_client_first (str, len, &cf);
+      spans[n++] = &cf.cbname;
+      spans[n++] = &cf.authzid;
+      spans[n++] = &cf.username;
+      spans[n++] = &cf.client_nonce;
+      if (rc == 0 && out && scram_print_client_first (&cf, out) != 0)
+	abort ();
+      break;
+
+    case SERVER_FIRST:
+      rc = scram_parse_server_first (str, len, &sf);
+      spans[n++] = &sf.nonce;
+      spans[n++] = &sf.salt;
+      if (rc == 0 && out && scram_print_server_first (&sf, out) != 0)
+	abort ();
+      break;
+
+    case CLIENT_FINAL:
+      rc = scram_parse_client_final (str, len, &cl);
+      spans[n++] = &cl.cbind;
+      spans[n++] = &cl.nonce;
+      spans[n++] = &cl.proof;
+      if (rc == 0 && out && scram_print_client_final (&cl, out) != 0)
+	abort ();
+      break;
+
+    case SERVER_FINAL:
+      rc = scram_parse_server_final (str, len, &sl);
+      spans[n++] = &sl.verifier;
+      if (rc == 0 && out && scram_print_server_final (&sl, out) != 0)
+	abort ();
+      break;
+    }
+
+  if (rc == 0)
+    for (i = 0; i < n; i++)
+      if (spans[i]->ptr
+	  && (spans[i]->ptr < str || spans[i]->len > len
+	      || spans[i]->ptr + spans[i]->len > str + len))
+	{
+	  printf ("field %lu out of message `%.*s'\n",
+		  (unsigned long) i, (int) len, str);
+	  abort ();
+	}
+
+  return rc;
+}
+
+static unsigned long seed = 4711;
+
+static size_t
+rnd (size_t n)
+{
+  seed = seed * 1103515245 + 12345;
+  return (seed >> 16) % n;
+}
+
+/* Parse damaged copies of TOKEN, which must not crash or go outside
+   of the message. */
+static void
+fuzz (int type, const char *token)
+{
+  size_t len = strlen (token);
+  size_t i, pos, n;
+  char buf[128], *msg;
+
+  for (i = 0; i < MUTATIONS; i++)
+    {
+      static const char special[] = ",=\0pnrsicv";
+
+      memcpy (buf, token, len);
+      switch (rnd (4))
+	{
+	case 0:
+	  n = 1 + rnd (len);
+	  break;
+
+	case 1:
+	  pos = rnd (len);
+	  buf[pos] = special[rnd (sizeof (special))];
+	  n = len;
+	  break;
+
+	case 2:
+	  pos = rnd (len);
+	  buf[pos] = rnd (256);
+	  n = len;
+	  break;
+
+	default:
+	  pos = rnd (len + 1);
+	  memmove (buf + pos + 1, buf + pos, len - pos);
+	  buf[pos] = special[rnd (sizeof (special))];
+	  n = len + 1;
+	  break;
+	}
+
+      /* Exactly as long as the message, so reading past it shows up
+         under memory checkers. */
+      msg = malloc (n);
+      if (!msg)
+	abort ();
+      memcpy (msg, buf, n);
+      if (parse (type, msg, n, NULL) == 0 && memchr (msg, '\0', n))
+	{
+	  printf ("accepted NUL in `%s'\n", token);
+	  abort ();
+	}
+      free (msg);
+    }
+}
+
+int
+main (int argc, char *argv[])
+{
+  size_t i, j;
+  clock_t start;
+  char *out;
+  int rc;
+
+  for (i = 0; i < sizeof (tokens) / sizeof (tokens[0]); i++)
+    {
+      const char *token = tokens[i].token;
+
+      printf ("token `%s': ", token);
+      out = NULL;
+      rc = parse (tokens[i].type, token, strlen (token), &out);
+      if ((rc == 0) != tokens[i].valid)
+	{
+	  printf ("FAILURE\n");
+	  abort ();
+	}
+      if (out)
+	{
+	  char *again = NULL;
+
+	  /* Extensions are dropped when printing, so compare with the
+	     printed token printed again. */
+	  if (parse (tokens[i].type, out, strlen (out), &again) != 0
+	      || strcmp (out, again) != 0)
+	    {
+	      printf ("printed `%s' FAILURE\n", out);
+	      abort ();
+	    }
+	  printf ("printed `%s' ", out);
+	  free (again);
+	  free (out);
+	}
+      printf ("PASS\n");
+
+      fuzz (tokens[i].type, token);
+    }
+
+  {
+    struct scram_span span;
+    char buf[20];
+    size_t len;
+
+    scram_span_set (&span, "us=2Cer=3D=3");
+    len = scram_unescape (&span, buf);
+    if (len != 8 || memcmp (buf, "us,er==3", 8) != 0)
+      {
+	printf ("unescaped `%.*s' FAILURE\n", (int) len, buf);
+	abort ();
+      }
+  }
+
+  /* Time parsing a login, without printing. */
+  start = clock ();
+  for (i = 0; i < LOOPS; i++)
+    for (j = 0; j < sizeof (login) / sizeof (login[0]); j++)
+      if (parse (j, login[j], strlen (login[j]), NULL) != 0)
+	abort ();
+  printf ("%.0f ns/login\n",
+	  (double) (clock () - start) / CLOCKS_PER_SEC * 1e9 / LOOPS);
+
+  return 0;
+}
@@ -1,4 +1,4 @@
-/* tokens.c --- Free allocated data in SCRAM tokens.
+/* tokens.c --- Helpers for fields of SCRAM tokens.
  * Copyright (C) 2009-2012 Simon Josefsson
  *
  * This file is part of GNU SASL Library.
@@ -23,46 +23,22 @@
 /* Get prototypes. */
 #include "tokens.h"
 
-/* Get free. */
-#include <stdlib.h>
-
-/* Get memset. */
+/* Get memcmp, strlen. */
 #include <string.h>
 
+/* Point SPAN to the zero terminated string STR, or make it empty if
+   STR is NULL. */
 void
-scram_free_client_first (struct scram_client_first *cf)
-{
-  free (cf->cbname);
-  free (cf->authzid);
-  free (cf->username);
-  free (cf->client_nonce);
-
-  memset (cf, 0, sizeof (*cf));
-}
-
-void
-scram_free_server_first (struct scram_server_first *sf)
-{
-  free (sf->nonce);
-  free (sf->salt);
-
-  memset (sf, 0, sizeof (*sf));
-}
-
-void
-scram_free_client_final (struct scram_client_final *cl)
+scram_span_set (struct scram_span *span, const char *str)
 {
-  free (cl->cbind);
-  free (cl->nonce);
-  free (cl->proof);
-
-  memset (cl, 0, sizeof (*cl));
+  span->ptr = str;
+  span->len = str ? strlen (str) : 0;
 }
 
-void
-scram_free_server_final (struct scram_server_final *sl)
+/* Whether spans A and B hold the same bytes. */
+bool
+scram_span_eq (const struct scram_span *a, const struct scram_span *b)
 {
-  free (sl->verifier);
-
-  memset (sl, 0, sizeof (*sl));
+  return a->len == b->len
+    && (a->len == 0 || memcmp (a->ptr, b->ptr, a->len) == 0);
 }
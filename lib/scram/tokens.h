@@ -26,40 +26,51 @@
 /* Get size_t. */
 #include <stddef.h>
 
+/* Get bool. */
+#include <stdbool.h>
+
+/* A field of a message: LEN bytes at PTR, not zero terminated.  The
+   parser points into the message itself, and the mechanisms into
+   strings they own when they build messages.  Usernames and
+   authorization identities are kept escaped, as they appear in the
+   message, see scram_unescape. */
+struct scram_span
+{
+  const char *ptr;
+  size_t len;
+};
+
 struct scram_client_first
 {
   char cbflag;
-  char *cbname;
-  char *authzid;
-  char *username;
-  char *client_nonce;
+  struct scram_span cbname;
+  struct scram_span authzid;
+  struct scram_span username;
+  struct scram_span client_nonce;
 };
 
 struct scram_server_first
 {
-  char *nonce;
-  char *salt;
+  struct scram_span nonce;
+  struct scram_span salt;
   size_t iter;
 };
 
 struct scram_client_final
 {
-  char *cbind;
-  char *nonce;
-  char *proof;
+  struct scram_span cbind;
+  struct scram_span nonce;
+  struct scram_span proof;
 };
 
 struct scram_server_final
 {
-  char *verifier;
+  struct scram_span verifier;
 };
 
-extern void scram_free_client_first (struct scram_client_first *cf);
-
-extern void scram_free_server_first (struct scram_server_first *sf);
-
-extern void scram_free_client_final (struct scram_client_final *cl);
+extern void scram_span_set (struct scram_span *span, const char *str);
 
-extern void scram_free_server_final (struct scram_server_final *sl);
+extern bool scram_span_eq (const struct scram_span *a,
+			   const struct scram_span *b);
 
 #endif /* SCRAM_TOKENS_H */
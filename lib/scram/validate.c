@@ -27,12 +27,24 @@
 /* Get prototypes. */
 #include "validate.h"
 
-/* Get strcmp, strlen. */
+/* Get memchr. */
 #include <string.h>
 
+/* Get c_isalnum. */
+#include "c-ctype.h"
+
+/* Whether SPAN is a non-empty field without ','. */
+static bool
+nonempty_field (const struct scram_span *span)
+{
+  return span->len > 0 && !memchr (span->ptr, ',', span->len);
+}
+
 bool
 scram_valid_client_first (struct scram_client_first *cf)
 {
+  size_t i;
+
   /* Check that cbflag is one of permitted values. */
   switch (cf->cbflag)
     {
@@ -46,32 +58,22 @@ scram_valid_client_first (struct scram_client_first *cf)
     }
 
   /* Check that cbname is only set when cbflag is p. */
-  if (cf->cbflag == 'p' && cf->cbname == NULL)
+  if (cf->cbflag == 'p' && cf->cbname.ptr == NULL)
     return false;
-  else if (cf->cbflag != 'p' && cf->cbname != NULL)
+  else if (cf->cbflag != 'p' && cf->cbname.ptr != NULL)
     return false;
 
-  if (cf->cbname)
-    {
-      const char *p = cf->cbname;
-
-      while (*p && strchr ("ABCDEFGHIJKLMNOPQRSTUVWXYZ"
-			   "abcdefghijklmnopqrstuvwxyz" "0123456789.-", *p))
-	p++;
-      if (*p)
-	return false;
-    }
+  for (i = 0; i < cf->cbname.len; i++)
+    if (!c_isalnum (cf->cbname.ptr[i])
+	&& cf->cbname.ptr[i] != '.' && cf->cbname.ptr[i] != '-')
+      return false;
 
   /* We require a non-zero username string. */
-  if (cf->username == NULL || *cf->username == '\0')
+  if (cf->username.len == 0)
     return false;
 
-  /* We require a non-zero client nonce. */
-  if (cf->client_nonce == NULL || *cf->client_nonce == '\0')
-    return false;
-
-  /* Nonce cannot contain ','. */
-  if (strchr (cf->client_nonce, ','))
+  /* We require a non-zero client nonce, which cannot contain ','. */
+  if (!nonempty_field (&cf->client_nonce))
     return false;
 
   return true;
@@ -80,20 +82,13 @@ scram_valid_client_first (struct scram_client_first *cf)
 bool
 scram_valid_server_first (struct scram_server_first * sf)
 {
-  /* We require a non-zero nonce. */
-  if (sf->nonce == NULL || *sf->nonce == '\0')
+  /* We require a non-zero nonce, which cannot contain ','. */
+  if (!nonempty_field (&sf->nonce))
     return false;
 
-  /* Nonce cannot contain ','. */
-  if (strchr (sf->nonce, ','))
-    return false;
-
-  /* We require a non-zero salt. */
-  if (sf->salt == NULL || *sf->salt == '\0')
-    return false;
-
-  /* FIXME check that salt is valid base64. */
-  if (strchr (sf->salt, ','))
+  /* We require a non-zero salt.  FIXME check that salt is valid
+     base64. */
+  if (!nonempty_field (&sf->salt))
     return false;
 
   if (sf->iter == 0)
@@ -105,28 +100,18 @@ scram_valid_server_first (struct scram_server_first * sf)
 bool
 scram_valid_client_final (struct scram_client_final * cl)
 {
-  /* We require a non-zero cbind. */
-  if (cl->cbind == NULL || *cl->cbind == '\0')
+  /* We require a non-zero cbind.  FIXME check that cbind is valid
+     base64. */
+  if (!nonempty_field (&cl->cbind))
     return false;
 
-  /* FIXME check that cbind is valid base64. */
-  if (strchr (cl->cbind, ','))
+  /* We require a non-zero nonce, which cannot contain ','. */
+  if (!nonempty_field (&cl->nonce))
     return false;
 
-  /* We require a non-zero nonce. */
-  if (cl->nonce == NULL || *cl->nonce == '\0')
-    return false;
-
-  /* Nonce cannot contain ','. */
-  if (strchr (cl->nonce, ','))
-    return false;
-
-  /* We require a non-zero proof. */
-  if (cl->proof == NULL || *cl->proof == '\0')
-    return false;
-
-  /* FIXME check that proof is valid base64. */
-  if (strchr (cl->proof, ','))
+  /* We require a non-zero proof.  FIXME check that proof is valid
+     base64. */
+  if (!nonempty_field (&cl->proof))
     return false;
 
   return true;
@@ -135,12 +120,9 @@ scram_valid_client_final (struct scram_client_final * cl)
 bool
 scram_valid_server_final (struct scram_server_final * sl)
 {
-  /* We require a non-zero verifier. */
-  if (sl->verifier == NULL || *sl->verifier == '\0')
-    return false;
-
-  /* FIXME check that verifier is valid base64. */
-  if (strchr (sl->verifier, ','))
+  /* We require a non-zero verifier.  FIXME check that verifier is
+     valid base64. */
+  if (!nonempty_field (&sl->verifier))
     return false;
 
   return true;
@@ -22,7 +22,203 @@
 
 #include "internal.h"
 
-#include "base64.h"
+static const char b64str[] =
+  "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+/* Value of each base64 character, X for all other bytes. */
+#define X 0x80
+static const unsigned char b64val[256] = {
+   X,  X,  X,  X,  X,  X,  X,  X,  X,  X,  X,  X,  X,  X,  X,  X,
+   X,  X,  X,  X,  X,  X,  X,  X,  X,  X,  X,  X,  X,  X,  X,  X,
+   X,  X,  X,  X,  X,  X,  X,  X,  X,  X,  X, 62,  X,  X,  X, 63,
+  52, 53, 54, 55, 56, 57, 58, 59, 60, 61,  X,  X,  X,  X,  X,  X,
+   X,  0,  1,  2,  3,  4,  5,  6,  7,  8,  9, 10, 11, 12, 13, 14,
+  15, 16, 17, 18, 19, 20, 21, 22, 23, 24, 25,  X,  X,  X,  X,  X,
+   X, 26, 27, 28, 29, 30, 31, 32, 33, 34, 35, 36, 37, 38, 39, 40,
+  41, 42, 43, 44, 45, 46, 47, 48, 49, 50, 51,  X,  X,  X,  X,  X,
+   X,  X,  X,  X,  X,  X,  X,  X,  X,  X,  X,  X,  X,  X,  X,  X,
+   X,  X,  X,  X,  X,  X,  X,  X,  X,  X,  X,  X,  X,  X,  X,  X,
+   X,  X,  X,  X,  X,  X,  X,  X,  X,  X,  X,  X,  X,  X,  X,  X,
+   X,  X,  X,  X,  X,  X,  X,  X,  X,  X,  X,  X,  X,  X,  X,  X,
+   X,  X,  X,  X,  X,  X,  X,  X,  X,  X,  X,  X,  X,  X,  X,  X,
+   X,  X,  X,  X,  X,  X,  X,  X,  X,  X,  X,  X,  X,  X,  X,  X,
+   X,  X,  X,  X,  X,  X,  X,  X,  X,  X,  X,  X,  X,  X,  X,  X,
+   X,  X,  X,  X,  X,  X,  X,  X,  X,  X,  X,  X,  X,  X,  X,  X
+};
+#undef X
+
+/* Store in *LEN the length of the base64 encoding of INLEN bytes,
+   without terminating zero.  Return false on overflow. */
+static int
+encoded_length (size_t inlen, size_t * len)
+{
+  if (inlen > ((size_t) -1 - 1) / 4 * 3)
+    return 0;
+
+  *len = (inlen + 2) / 3 * 4;
+
+  return 1;
+}
+
+/* Store in *LEN the length of the data encoded by the INLEN base64
+   characters at IN.  Return false if INLEN is not a multiple of 4. */
+static int
+decoded_length (const char *in, size_t inlen, size_t * len)
+{
+  if (inlen % 4)
+    return 0;
+
+  *len = inlen / 4 * 3;
+  if (inlen > 0 && in[inlen - 1] == '=')
+    {
+      (*len)--;
+      if (in[inlen - 2] == '=')
+	(*len)--;
+    }
+
+  return 1;
+}
+
+/* Encode the INLEN bytes at IN followed by a zero to OUT.  IN may
+   occupy the last INLEN bytes of OUT: every group of input is read
+   before its output is written, and the output never catches up with
+   the unread input. */
+static void
+encode (const char *in, size_t inlen, char *out)
+{
+  const unsigned char *p = (const unsigned char *) in;
+  unsigned long a, b, c, d;
+
+  /* Four groups at a time, read in full before writing. */
+  for (; inlen >= 12; inlen -= 12, p += 12, out += 16)
+    {
+      a = (unsigned long) p[0] << 16 | p[1] << 8 | p[2];
+      b = (unsigned long) p[3] << 16 | p[4] << 8 | p[5];
+      c = (unsigned long) p[6] << 16 | p[7] << 8 | p[8];
+      d = (unsigned long) p[9] << 16 | p[10] << 8 | p[11];
+
+      out[0] = b64str[a >> 18];
+      out[1] = b64str[(a >> 12) & 0x3F];
+      out[2] = b64str[(a >> 6) & 0x3F];
+      out[3] = b64str[a & 0x3F];
+      out[4] = b64str[b >> 18];
+      out[5] = b64str[(b >> 12) & 0x3F];
+      out[6] = b64str[(b >> 6) & 0x3F];
+      out[7] = b64str[b & 0x3F];
+      out[8] = b64str[c >> 18];
+      out[9] = b64str[(c >> 12) & 0x3F];
+      out[10] = b64str[(c >> 6) & 0x3F];
+      out[11] = b64str[c & 0x3F];
+      out[12] = b64str[d >> 18];
+      out[13] = b64str[(d >> 12) & 0x3F];
+      out[14] = b64str[(d >> 6) & 0x3F];
+      out[15] = b64str[d & 0x3F];
+    }
+
+  for (; inlen >= 3; inlen -= 3, p += 3, out += 4)
+    {
+      a = (unsigned long) p[0] << 16 | p[1] << 8 | p[2];
+
+      out[0] = b64str[a >> 18];
+      out[1] = b64str[(a >> 12) & 0x3F];
+      out[2] = b64str[(a >> 6) & 0x3F];
+      out[3] = b64str[a & 0x3F];
+    }
+
+  if (inlen > 0)
+    {
+      a = (unsigned long) p[0] << 16;
+      if (inlen > 1)
+	a |= p[1] << 8;
+
+      out[0] = b64str[a >> 18];
+      out[1] = b64str[(a >> 12) & 0x3F];
+      out[2] = inlen > 1 ? b64str[(a >> 6) & 0x3F] : '=';
+      out[3] = '=';
+      out += 4;
+    }
+
+  *out = '\0';
+}
+
+/* Decode the INLEN base64 characters at IN, a multiple of 4, to OUT,
+   which may be IN itself.  Return false if the input is invalid. */
+static int
+decode (const char *in, size_t inlen, char *out)
+{
+  const unsigned char *p = (const unsigned char *) in;
+  unsigned char c, d;
+  unsigned long a, b;
+  unsigned bad;
+
+  if (inlen == 0)
+    return 1;
+
+  /* All groups but the last have no padding.  Check two of them at a
+     time for invalid characters. */
+  for (inlen -= 4; inlen >= 8; inlen -= 8, p += 8, out += 6)
+    {
+      bad = b64val[p[0]] | b64val[p[1]] | b64val[p[2]] | b64val[p[3]]
+	| b64val[p[4]] | b64val[p[5]] | b64val[p[6]] | b64val[p[7]];
+      if (bad & 0x80)
+	return 0;
+
+      a = (unsigned long) b64val[p[0]] << 18 | b64val[p[1]] << 12
+	| b64val[p[2]] << 6 | b64val[p[3]];
+      b = (unsigned long) b64val[p[4]] << 18 | b64val[p[5]] << 12
+	| b64val[p[6]] << 6 | b64val[p[7]];
+
+      out[0] = a >> 16;
+      out[1] = a >> 8;
+      out[2] = a;
+      out[3] = b >> 16;
+      out[4] = b >> 8;
+      out[5] = b;
+    }
+
+  if (inlen > 0)
+    {
+      bad = b64val[p[0]] | b64val[p[1]] | b64val[p[2]] | b64val[p[3]];
+      if (bad & 0x80)
+	return 0;
+
+      a = (unsigned long) b64val[p[0]] << 18 | b64val[p[1]] << 12
+	| b64val[p[2]] << 6 | b64val[p[3]];
+
+      out[0] = a >> 16;
+      out[1] = a >> 8;
+      out[2] = a;
+      p += 4;
+      out += 3;
+    }
+
+  /* The last group, with optional padding. */
+  c = p[2];
+  d = p[3];
+  bad = b64val[p[0]] | b64val[p[1]];
+  if (c == '=' && d != '=')
+    return 0;
+  if (c != '=')
+    bad |= b64val[c];
+  if (d != '=')
+    bad |= b64val[d];
+  if (bad & 0x80)
+    return 0;
+
+  a = (unsigned long) b64val[p[0]] << 18 | b64val[p[1]] << 12;
+  if (c != '=')
+    a |= b64val[c] << 6;
+  if (d != '=')
+    a |= b64val[d];
+
+  out[0] = a >> 16;
+  if (c != '=')
+    out[1] = a >> 8;
+  if (d != '=')
+    out[2] = a;
+
+  return 1;
+}
 
 /**
  * gsasl_base64_to:
@@ -43,14 +239,20 @@
 int
 gsasl_base64_to (const char *in, size_t inlen, char **out, size_t * outlen)
 {
-  size_t len = base64_encode_alloc (in, inlen, out);
+  size_t len = 0;
+
+  *out = NULL;
+  if (encoded_length (inlen, &len))
+    *out = malloc (len + 1);
 
   if (outlen)
-    *outlen = len;
+    *outlen = *out ? len : 0;
 
   if (*out == NULL)
     return GSASL_MALLOC_ERROR;
 
+  encode (in, inlen, *out);
+
   return GSASL_OK;
 }
 
@@ -73,13 +275,114 @@ gsasl_base64_to (const char *in, size_t inlen, char **out, size_t * outlen)
 int
 gsasl_base64_from (const char *in, size_t inlen, char **out, size_t * outlen)
 {
-  int ok = base64_decode_alloc (in, inlen, out, outlen);
+  size_t len;
 
-  if (!ok)
+  *out = NULL;
+  if (outlen)
+    *outlen = 0;
+
+  if (!decoded_length (in, inlen, &len))
     return GSASL_BASE64_ERROR;
 
+  *out = malloc (len + 1);
   if (*out == NULL)
     return GSASL_MALLOC_ERROR;
 
+  if (!decode (in, inlen, *out))
+    {
+      free (*out);
+      *out = NULL;
+      return GSASL_BASE64_ERROR;
+    }
+  (*out)[len] = '\0';
+  if (outlen)
+    *outlen = len;
+
+  return GSASL_OK;
+}
+
+/**
+ * gsasl_base64_to_buffer:
+ * @in: input byte array.
+ * @inlen: size of input byte array.
+ * @out: output buffer supplied by the caller.
+ * @outlen: on input the size of @out, on output the length of the
+ *   encoded data or the size needed.
+ *
+ * Encode data as base64 into @out, like gsasl_base64_to() but without
+ * allocating memory.  The string is zero terminated, and on success
+ * @outlen holds the length excluding the terminating zero.
+ *
+ * The input may be stored in the last @inlen bytes of @out itself,
+ * so that data produced at the end of a buffer can be encoded in
+ * place.  Other overlaps are not allowed.
+ *
+ * Return value: Returns %GSASL_OK on success, or
+ *   %GSASL_NEEDS_LARGER_BUFFER if @out is too small, in which case
+ *   @outlen holds the size needed including the terminating zero, or
+ *   %GSASL_MALLOC_ERROR if the input is too large.
+ *
+ * Since: 1.8.1
+ **/
+int
+gsasl_base64_to_buffer (const char *in, size_t inlen,
+			char *out, size_t * outlen)
+{
+  size_t len;
+
+  if (!encoded_length (inlen, &len))
+    return GSASL_MALLOC_ERROR;
+
+  if (*outlen <= len)
+    {
+      *outlen = len + 1;
+      return GSASL_NEEDS_LARGER_BUFFER;
+    }
+
+  encode (in, inlen, out);
+  *outlen = len;
+
+  return GSASL_OK;
+}
+
+/**
+ * gsasl_base64_from_buffer:
+ * @in: input byte array.
+ * @inlen: size of input byte array.
+ * @out: output buffer supplied by the caller.
+ * @outlen: on input the size of @out, on output the length of the
+ *   decoded data or the size needed.
+ *
+ * Decode Base64 data into @out, like gsasl_base64_from() but without
+ * allocating memory.  The decoded data is never longer than the
+ * input, and @out may be @in itself to decode in place.  Other
+ * overlaps are not allowed.  When decoding fails the contents of @out
+ * are undefined.
+ *
+ * Return value: Returns %GSASL_OK on success, %GSASL_BASE64_ERROR if
+ *   input was invalid, or %GSASL_NEEDS_LARGER_BUFFER if @out is too
+ *   small, in which case @outlen holds the size needed.
+ *
+ * Since: 1.8.1
+ **/
+int
+gsasl_base64_from_buffer (const char *in, size_t inlen,
+			  char *out, size_t * outlen)
+{
+  size_t len;
+
+  if (!decoded_length (in, inlen, &len))
+    return GSASL_BASE64_ERROR;
+
+  if (*outlen < len)
+    {
+      *outlen = len;
+      return GSASL_NEEDS_LARGER_BUFFER;
+    }
+
+  if (!decode (in, inlen, out))
+    return GSASL_BASE64_ERROR;
+  *outlen = len;
+
   return GSASL_OK;
 }
@@ -38,12 +38,17 @@
  * SASL mechanism to use.  See the manual for the meaning of all
  * parameters.
  *
+ * The callback of a handle frozen with gsasl_freeze() may be replaced
+ * while other threads use it.
+ *
  * Since: 0.2.0
  **/
 void
 gsasl_callback_set (Gsasl * ctx, Gsasl_callback_function cb)
 {
-  ctx->cb = cb;
+  _gsasl_publish (&ctx->cb, cb);
+
+  _gsasl_mechlist_invalidate (ctx);
 }
 
 /**
@@ -66,6 +71,9 @@ gsasl_callback_set (Gsasl * ctx, Gsasl_callback_function cb)
  * translate the old callback interface into the new.  This interface
  * should be sufficient to invoke all callbacks, both new and old.
  *
+ * The application callback may return %GSASL_CALLBACK_PENDING to
+ * answer later, see gsasl_step_resume().
+ *
  * Return value: Returns whatever the application callback returns, or
  *   %GSASL_NO_CALLBACK if no application was known.
  *
@@ -74,14 +82,21 @@ gsasl_callback_set (Gsasl * ctx, Gsasl_callback_function cb)
 int
 gsasl_callback (Gsasl * ctx, Gsasl_session * sctx, Gsasl_property prop)
 {
+  Gsasl_callback_function cb;
+  int rc;
+
   if (ctx == NULL && sctx == NULL)
     return GSASL_NO_CALLBACK;
 
   if (ctx == NULL)
     ctx = sctx->ctx;
 
-  if (ctx->cb)
-    return ctx->cb (ctx, sctx, prop);
+  if (sctx && _gsasl_callback_hold (sctx, prop, &rc))
+    return rc;
+
+  cb = _gsasl_acquire (&ctx->cb);
+  if (cb)
+    return _gsasl_callback_result (sctx, prop, cb (ctx, sctx, prop));
 
 #ifndef GSASL_NO_OBSOLETE
   return _gsasl_obsolete_callback (ctx, sctx, prop);
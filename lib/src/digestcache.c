@@ -0,0 +1,427 @@
+/* digestcache.c --- Cache of DIGEST-MD5 secrets in the server.
+ * Copyright (C) 2012 Simon Josefsson
+ *
+ * This file is part of GNU SASL Library.
+ *
+ * GNU SASL Library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; either version 2.1 of
+ * the License, or (at your option) any later version.
+ *
+ * GNU SASL Library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with GNU SASL Library; if not, write to the Free
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ *
+ */
+
+#include "internal.h"
+
+/* Get specification. */
+#include "digestcache.h"
+
+/* Get time. */
+#include <time.h>
+
+/* Upper bound on the size of the hash table index. */
+#define MAX_BUCKETS (1 << 20)
+
+/* One cached secret.  Entries are hashed on (authid, realm) and kept
+   in a doubly linked list ordered by last use, most recently used
+   first. */
+struct digest_cache_entry
+{
+  struct digest_cache_entry *hnext;
+  struct digest_cache_entry *prev;
+  struct digest_cache_entry *next;
+  size_t hash;
+  time_t expires;
+  /* Whether the client sent the user name and realm in ISO-8859-1,
+     which changes the secret for names outside of ASCII. */
+  bool latin1;
+  char secret[GSASL_DIGEST_MD5_CACHE_KEYLEN];
+  /* Zero terminated authid followed by zero terminated realm. */
+  char *realm;
+  char authid[1];
+};
+
+struct _gsasl_digest_md5_cache
+{
+  _gsasl_lock_t lock;
+  size_t max_entries;
+  size_t n_entries;
+  unsigned int ttl;
+  size_t n_buckets;
+  struct digest_cache_entry **buckets;
+  struct digest_cache_entry *head;
+  struct digest_cache_entry *tail;
+  size_t hits;
+  size_t misses;
+};
+
+/* FNV-1a over the components of the lookup key. */
+static size_t
+hash_key (const char *authid, const char *realm)
+{
+  size_t h = 2166136261U;
+  const char *p;
+
+  for (p = authid; *p; p++)
+    h = (h ^ (unsigned char) *p) * 16777619U;
+  h = (h ^ 0) * 16777619U;
+  for (p = realm; *p; p++)
+    h = (h ^ (unsigned char) *p) * 16777619U;
+
+  return h;
+}
+
+static void
+lru_unlink (struct _gsasl_digest_md5_cache *cache,
+	    struct digest_cache_entry *e)
+{
+  if (e->prev)
+    e->prev->next = e->next;
+  else
+    cache->head = e->next;
+  if (e->next)
+    e->next->prev = e->prev;
+  else
+    cache->tail = e->prev;
+  e->prev = e->next = NULL;
+}
+
+static void
+lru_push (struct _gsasl_digest_md5_cache *cache,
+	  struct digest_cache_entry *e)
+{
+  e->prev = NULL;
+  e->next = cache->head;
+  if (cache->head)
+    cache->head->prev = e;
+  else
+    cache->tail = e;
+  cache->head = e;
+}
+
+static void
+remove_entry (struct _gsasl_digest_md5_cache *cache,
+	      struct digest_cache_entry *e)
+{
+  struct digest_cache_entry **pp;
+
+  for (pp = &cache->buckets[e->hash & (cache->n_buckets - 1)];
+       *pp; pp = &(*pp)->hnext)
+    if (*pp == e)
+      {
+	*pp = e->hnext;
+	break;
+      }
+
+  lru_unlink (cache, e);
+  cache->n_entries--;
+
+  memset (e, 0, sizeof (*e));
+  free (e);
+}
+
+static struct digest_cache_entry *
+find_entry (struct _gsasl_digest_md5_cache *cache, size_t hash,
+	    const char *authid, const char *realm, bool latin1)
+{
+  struct digest_cache_entry *e;
+
+  for (e = cache->buckets[hash & (cache->n_buckets - 1)]; e; e = e->hnext)
+    if (e->hash == hash && e->latin1 == latin1
+	&& strcmp (e->authid, authid) == 0 && strcmp (e->realm, realm) == 0)
+      return e;
+
+  return NULL;
+}
+
+static bool
+expired_p (struct _gsasl_digest_md5_cache *cache,
+	   struct digest_cache_entry *e)
+{
+  return cache->ttl > 0 && time (NULL) >= e->expires;
+}
+
+void
+_gsasl_digest_md5_cache_free (struct _gsasl_digest_md5_cache *cache)
+{
+  struct digest_cache_entry *e, *next;
+
+  if (cache == NULL)
+    return;
+
+  for (e = cache->head; e; e = next)
+    {
+      next = e->next;
+      memset (e, 0, sizeof (*e));
+      free (e);
+    }
+
+  _gsasl_lock_destroy (&cache->lock);
+  free (cache->buckets);
+  memset (cache, 0, sizeof (*cache));
+  free (cache);
+}
+
+/* Look for the secret of AUTHID in REALM, which may be NULL for no
+   realm, as sent in ISO-8859-1 if LATIN1 is true.  On a hit, copy it
+   into the GSASL_DIGEST_MD5_CACHE_KEYLEN sized buffer SECRET and
+   return true.  Returns false if the cache is disabled or holds no
+   usable entry. */
+bool
+_gsasl_digest_md5_cache_lookup (Gsasl_session * sctx,
+				const char *authid, const char *realm,
+				bool latin1, char *secret)
+{
+  struct _gsasl_digest_md5_cache *cache = sctx->ctx->digest_md5_cache;
+  struct digest_cache_entry *e;
+  size_t hash;
+  bool found = false;
+
+  if (cache == NULL)
+    return false;
+
+  if (realm == NULL)
+    realm = "";
+  hash = hash_key (authid, realm);
+
+  _gsasl_lock (&cache->lock);
+
+  e = find_entry (cache, hash, authid, realm, latin1);
+  if (e && expired_p (cache, e))
+    {
+      remove_entry (cache, e);
+      e = NULL;
+    }
+
+  if (e)
+    {
+      memcpy (secret, e->secret, GSASL_DIGEST_MD5_CACHE_KEYLEN);
+      lru_unlink (cache, e);
+      lru_push (cache, e);
+      cache->hits++;
+      found = true;
+    }
+  else
+    cache->misses++;
+
+  _gsasl_unlock (&cache->lock);
+
+  return found;
+}
+
+/* Remember SECRET for AUTHID, REALM and LATIN1, replacing any previous
+   entry for the same key and evicting the least recently used entry
+   if the cache is full.  Failures are silently ignored, the cache is
+   only an optimization. */
+void
+_gsasl_digest_md5_cache_store (Gsasl_session * sctx,
+			       const char *authid, const char *realm,
+			       bool latin1, const char *secret)
+{
+  struct _gsasl_digest_md5_cache *cache = sctx->ctx->digest_md5_cache;
+  struct digest_cache_entry *e;
+  size_t hash;
+
+  if (cache == NULL)
+    return;
+
+  if (realm == NULL)
+    realm = "";
+  hash = hash_key (authid, realm);
+
+  _gsasl_lock (&cache->lock);
+
+  e = find_entry (cache, hash, authid, realm, latin1);
+  if (e)
+    lru_unlink (cache, e);
+  else
+    {
+      size_t authidlen = strlen (authid);
+      size_t realmlen = strlen (realm);
+
+      e = calloc (1, sizeof (*e) + authidlen + 1 + realmlen);
+      if (e == NULL)
+	{
+	  _gsasl_unlock (&cache->lock);
+	  return;
+	}
+
+      e->hash = hash;
+      e->latin1 = latin1;
+      memcpy (e->authid, authid, authidlen + 1);
+      e->realm = e->authid + authidlen + 1;
+      memcpy (e->realm, realm, realmlen + 1);
+
+      e->hnext = cache->buckets[hash & (cache->n_buckets - 1)];
+      cache->buckets[hash & (cache->n_buckets - 1)] = e;
+      cache->n_entries++;
+    }
+
+  memcpy (e->secret, secret, GSASL_DIGEST_MD5_CACHE_KEYLEN);
+  if (cache->ttl > 0)
+    e->expires = time (NULL) + cache->ttl;
+  lru_push (cache, e);
+
+  while (cache->n_entries > cache->max_entries)
+    remove_entry (cache, cache->tail);
+
+  _gsasl_unlock (&cache->lock);
+}
+
+/**
+ * gsasl_digest_md5_cache_set:
+ * @ctx: libgsasl handle.
+ * @max_entries: maximum number of users to remember, or 0 to disable.
+ * @ttl: number of seconds an entry remains valid, or 0 for no limit.
+ *
+ * Enable, resize or disable the DIGEST-MD5 server secret cache of
+ * @ctx.  The DIGEST-MD5 server asks for %GSASL_DIGEST_MD5_HASHED_PASSWORD
+ * or %GSASL_PASSWORD on every authentication, and hashes the password
+ * with the user name and realm.  With the cache enabled, the secret
+ * hashed from a %GSASL_PASSWORD is remembered per user name, realm
+ * and character set of the client, and subsequent authentications of
+ * the same user use it without invoking the callback for these
+ * properties.  A %GSASL_DIGEST_MD5_HASHED_PASSWORD is used as given
+ * and not cached.  When more than @max_entries users are cached, the
+ * least recently used entry is discarded.
+ *
+ * Since the password is not looked up on a cache hit, the application
+ * must call gsasl_digest_md5_cache_forget() when it changes the
+ * password of a user, or choose a @ttl that bounds how long an old
+ * password keeps working.
+ *
+ * The cache is disabled by default.  Any previously cached secrets
+ * and statistics are discarded by this function, and it must not be
+ * called while sessions using @ctx are active.
+ *
+ * Return value: Returns %GSASL_OK iff successful, or an error code.
+ *
+ * Since: 1.8.1
+ **/
+int
+gsasl_digest_md5_cache_set (Gsasl * ctx, size_t max_entries,
+			    unsigned int ttl)
+{
+  struct _gsasl_digest_md5_cache *cache;
+  size_t n_buckets = 16;
+
+  _gsasl_digest_md5_cache_free (ctx->digest_md5_cache);
+  ctx->digest_md5_cache = NULL;
+
+  if (max_entries == 0)
+    return GSASL_OK;
+
+  while (n_buckets < max_entries && n_buckets < MAX_BUCKETS)
+    n_buckets <<= 1;
+
+  cache = calloc (1, sizeof (*cache));
+  if (cache == NULL)
+    return GSASL_MALLOC_ERROR;
+
+  cache->buckets = calloc (n_buckets, sizeof (*cache->buckets));
+  if (cache->buckets == NULL)
+    {
+      free (cache);
+      return GSASL_MALLOC_ERROR;
+    }
+
+  cache->n_buckets = n_buckets;
+  cache->max_entries = max_entries;
+  cache->ttl = ttl;
+  _gsasl_lock_init (&cache->lock);
+
+  ctx->digest_md5_cache = cache;
+
+  return GSASL_OK;
+}
+
+/**
+ * gsasl_digest_md5_cache_forget:
+ * @ctx: libgsasl handle.
+ * @authid: UTF-8 user name to forget, or NULL for all users.
+ * @realm: UTF-8 realm of @authid, or NULL for all realms.
+ *
+ * Remove the secrets of @authid in @realm from the DIGEST-MD5 server
+ * secret cache, see gsasl_digest_md5_cache_set().  The application
+ * should call this whenever it changes the password of a user.  When
+ * @realm is NULL the user is forgotten in all realms, and when
+ * @authid is NULL the whole cache is emptied.  The statistics are not
+ * reset.  Nothing happens when the cache is disabled.
+ *
+ * Since: 1.8.1
+ **/
+void
+gsasl_digest_md5_cache_forget (Gsasl * ctx, const char *authid,
+			       const char *realm)
+{
+  struct _gsasl_digest_md5_cache *cache = ctx->digest_md5_cache;
+  struct digest_cache_entry *e, *next;
+
+  if (cache == NULL)
+    return;
+
+  _gsasl_lock (&cache->lock);
+
+  if (authid && realm)
+    {
+      size_t hash = hash_key (authid, realm);
+
+      for (e = cache->buckets[hash & (cache->n_buckets - 1)]; e; e = next)
+	{
+	  next = e->hnext;
+	  if (e->hash == hash && strcmp (e->authid, authid) == 0
+	      && strcmp (e->realm, realm) == 0)
+	    remove_entry (cache, e);
+	}
+    }
+  else
+    for (e = cache->head; e; e = next)
+      {
+	next = e->next;
+	if (authid == NULL || strcmp (e->authid, authid) == 0)
+	  remove_entry (cache, e);
+      }
+
+  _gsasl_unlock (&cache->lock);
+}
+
+/**
+ * gsasl_digest_md5_cache_stats:
+ * @ctx: libgsasl handle.
+ * @hits: output variable with number of cache hits, or NULL.
+ * @misses: output variable with number of cache misses, or NULL.
+ *
+ * Retrieve usage counters for the DIGEST-MD5 server secret cache, see
+ * gsasl_digest_md5_cache_set().  Both counters are zero when the
+ * cache is disabled.
+ *
+ * Since: 1.8.1
+ **/
+void
+gsasl_digest_md5_cache_stats (Gsasl * ctx, size_t * hits, size_t * misses)
+{
+  struct _gsasl_digest_md5_cache *cache = ctx->digest_md5_cache;
+  size_t h = 0, m = 0;
+
+  if (cache)
+    {
+      _gsasl_lock (&cache->lock);
+      h = cache->hits;
+      m = cache->misses;
+      _gsasl_unlock (&cache->lock);
+    }
+
+  if (hits)
+    *hits = h;
+  if (misses)
+    *misses = m;
+}
@@ -0,0 +1,46 @@
+/* digestcache.h --- Cache of DIGEST-MD5 secrets in the server.
+ * Copyright (C) 2012 Simon Josefsson
+ *
+ * This file is part of GNU SASL Library.
+ *
+ * GNU SASL Library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; either version 2.1 of
+ * the License, or (at your option) any later version.
+ *
+ * GNU SASL Library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with GNU SASL Library; if not, write to the Free
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ *
+ */
+
+#ifndef DIGESTCACHE_H
+#define DIGESTCACHE_H
+
+/* Get bool. */
+#include <stdbool.h>
+
+/* Get Gsasl_session. */
+#include <gsasl.h>
+
+/* Size of the secret H({ username-value, ":", realm-value, ":",
+   passwd }). */
+#define GSASL_DIGEST_MD5_CACHE_KEYLEN 16
+
+extern bool _gsasl_digest_md5_cache_lookup (Gsasl_session * sctx,
+					    const char *authid,
+					    const char *realm, bool latin1,
+					    char *secret);
+
+extern void _gsasl_digest_md5_cache_store (Gsasl_session * sctx,
+					   const char *authid,
+					   const char *realm, bool latin1,
+					   const char *secret);
+
+#endif /* DIGESTCACHE_H */
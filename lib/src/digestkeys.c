@@ -0,0 +1,184 @@
+/* digestkeys.c --- Hashing of DIGEST-MD5 secrets from passwords.
+ * Copyright (C) 2012 Simon Josefsson
+ *
+ * This file is part of GNU SASL Library.
+ *
+ * GNU SASL Library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; either version 2.1 of
+ * the License, or (at your option) any later version.
+ *
+ * GNU SASL Library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with GNU SASL Library; if not, write to the Free
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ *
+ */
+
+#include "internal.h"
+
+/* Get specification. */
+#include "digestkeys.h"
+
+/* Get gc_md5. */
+#include "gc.h"
+
+/* Messages up to this size are hashed from a stack buffer. */
+#define STACK_SIZE 256
+
+/* Copy the UTF-8 string PASSWD to OUT, converted to ISO-8859-1 if all
+   its characters are in that set, as RFC 2831 asks for.  OUT must
+   hold strlen (PASSWD) bytes.  Returns the number of bytes written,
+   which is not zero terminated. */
+static size_t
+latin1_password (const char *passwd, char *out)
+{
+  const unsigned char *p = (const unsigned char *) passwd;
+  size_t i, j = 0;
+
+  for (i = 0; p[i]; i++)
+    if (p[i] > 0x7F)
+      {
+	if (p[i] < 0xC0 || p[i] > 0xC3 || p[i + 1] < 0x80 || p[i + 1] > 0xBF)
+	  {
+	    i = strlen (passwd);
+	    memcpy (out, passwd, i);
+	    return i;
+	  }
+	i++;
+      }
+
+  for (i = 0; p[i]; i++)
+    if (p[i] > 0x7F)
+      {
+	out[j++] = ((p[i] & 0x3) << 6) | (p[i + 1] & 0x3F);
+	i++;
+      }
+    else
+      out[j++] = p[i];
+
+  return j;
+}
+
+/* Compute the DIGEST-MD5 secret H({ username-value, ":", realm-value,
+   ":", passwd }) into the 16 byte buffer SECRET.  USERNAME is used as
+   is, REALM may be NULL for an empty realm, and PASSWORD is converted
+   to ISO-8859-1 when possible. */
+int
+_gsasl_digest_md5_secret (const char *username, const char *realm,
+			  const char *password, char *secret)
+{
+  size_t ulen = strlen (username);
+  size_t rlen = realm ? strlen (realm) : 0;
+  size_t plen = strlen (password);
+  char stack[STACK_SIZE], *buf = stack, *p;
+  Gc_rc err;
+
+  if (ulen + rlen + plen + 2 > sizeof (stack))
+    {
+      buf = malloc (ulen + rlen + plen + 2);
+      if (buf == NULL)
+	return GSASL_MALLOC_ERROR;
+    }
+
+  p = buf;
+  memcpy (p, username, ulen);
+  p += ulen;
+  *p++ = ':';
+  if (rlen)
+    memcpy (p, realm, rlen);
+  p += rlen;
+  *p++ = ':';
+  p += latin1_password (password, p);
+
+  err = gc_md5 (buf, p - buf, secret);
+
+  memset (buf, 0, p - buf);
+  if (buf != stack)
+    free (buf);
+
+  return err == GC_OK ? GSASL_OK : GSASL_CRYPTO_ERROR;
+}
+
+/**
+ * gsasl_digest_md5_hash:
+ * @username: input zero terminated UTF-8 user name.
+ * @realm: input zero terminated UTF-8 realm, or NULL.
+ * @password: input zero terminated UTF-8 password.
+ * @hashed: output buffer of 33 bytes for the hex encoded secret.
+ *
+ * Compute the hashed secret that the DIGEST-MD5 server derives from
+ * %GSASL_PASSWORD, as the lowercase hex string that the application
+ * may return for %GSASL_DIGEST_MD5_HASHED_PASSWORD instead of the
+ * password.  The secret is bound to @username and @realm as sent by
+ * the client, and @realm is NULL when the client sends no realm.
+ *
+ * Return value: Returns %GSASL_OK iff successful.
+ *
+ * Since: 1.8.1
+ **/
+int
+gsasl_digest_md5_hash (const char *username, const char *realm,
+		       const char *password, char *hashed)
+{
+  static const char hex[] = "0123456789abcdef";
+  char secret[16];
+  size_t i;
+  int rc;
+
+  rc = _gsasl_digest_md5_secret (username, realm, password, secret);
+  if (rc != GSASL_OK)
+    return rc;
+
+  for (i = 0; i < sizeof (secret); i++)
+    {
+      hashed[2 * i] = hex[(secret[i] >> 4) & 0x0f];
+      hashed[2 * i + 1] = hex[secret[i] & 0x0f];
+    }
+  hashed[2 * sizeof (secret)] = '\0';
+
+  memset (secret, 0, sizeof (secret));
+
+  return GSASL_OK;
+}
+
+/**
+ * gsasl_digest_md5_hash_batch:
+ * @secrets: array of #Gsasl_digest_md5_secret entries.
+ * @nsecrets: number of entries in @secrets.
+ *
+ * Compute hashed DIGEST-MD5 secrets, see gsasl_digest_md5_hash(), for
+ * many accounts at once.  The input fields of each entry are
+ * @username, @realm and @password; on return @hashed and @rc are
+ * filled in.  This is intended for provisioning tools that store
+ * %GSASL_DIGEST_MD5_HASHED_PASSWORD values instead of passwords.
+ *
+ * Return value: Returns %GSASL_OK if every secret was computed,
+ *   otherwise the error code of the first failed entry.
+ *
+ * Since: 1.8.1
+ **/
+int
+gsasl_digest_md5_hash_batch (Gsasl_digest_md5_secret * secrets,
+			     size_t nsecrets)
+{
+  int rc = GSASL_OK;
+  size_t i;
+
+  for (i = 0; i < nsecrets; i++)
+    {
+      Gsasl_digest_md5_secret *s = &secrets[i];
+
+      s->rc = gsasl_digest_md5_hash (s->username, s->realm, s->password,
+				     s->hashed);
+      if (s->rc != GSASL_OK && rc == GSASL_OK)
+	rc = s->rc;
+    }
+
+  return rc;
+}
@@ -37,21 +37,29 @@ gsasl_done (Gsasl * ctx)
   if (ctx == NULL)
     return;
 
-#ifdef USE_CLIENT
-  for (i = 0; i < ctx->n_client_mechs; i++)
-    if (ctx->client_mechs[i].client.done)
-      ctx->client_mechs[i].client.done (ctx);
+  if (ctx->client_tab)
+    for (i = 0; i < ctx->client_tab->n; i++)
+      if (ctx->client_tab->ent[i]->mech.client.done)
+	ctx->client_tab->ent[i]->mech.client.done (ctx);
+  _gsasl_mechtab_free (ctx->client_tab, 1);
 
-  free (ctx->client_mechs);
-#endif
+  if (ctx->server_tab)
+    for (i = 0; i < ctx->server_tab->n; i++)
+      if (ctx->server_tab->ent[i]->mech.server.done)
+	ctx->server_tab->ent[i]->mech.server.done (ctx);
+  _gsasl_mechtab_free (ctx->server_tab, 1);
+  _gsasl_lock_destroy (&ctx->register_lock);
 
-#ifdef USE_SERVER
-  for (i = 0; i < ctx->n_server_mechs; i++)
-    if (ctx->server_mechs[i].server.done)
-      ctx->server_mechs[i].server.done (ctx);
+  _gsasl_scram_cache_free (ctx->scram_cache);
+  _gsasl_digest_md5_cache_free (ctx->digest_md5_cache);
 
-  free (ctx->server_mechs);
-#endif
+  _gsasl_session_pool_free (ctx);
+  _gsasl_lock_destroy (&ctx->pool_lock);
+
+  _gsasl_mechlist_invalidate (ctx);
+  _gsasl_lock_destroy (&ctx->mechlist_lock);
+
+  _gsasl_nonce_pool_unref ();
 
   free (ctx);
 
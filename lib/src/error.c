@@ -205,7 +205,11 @@ static struct
   ERR (GSASL_NO_SAML20_REDIRECT_URL,
        N_("Callback failed to provide SAML20 redirect URL.")),
   ERR (GSASL_NO_OPENID20_REDIRECT_URL,
-       N_("Callback failed to provide OPENID20 redirect URL."))
+       N_("Callback failed to provide OPENID20 redirect URL.")),
+  ERR (GSASL_NEEDS_LARGER_BUFFER,
+       N_("Output does not fit in the supplied buffer.")),
+  ERR (GSASL_CALLBACK_PENDING,
+       N_("The authentication step waits for the application callback."))
 };
 /* *INDENT-ON* */
 
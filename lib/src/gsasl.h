@@ -141,6 +141,10 @@ extern "C"
    *   redirect URL.
    * @GSASL_NO_OPENID20_REDIRECT_URL: Could not get required OpenID
    *   redirect URL.
+   * @GSASL_NEEDS_LARGER_BUFFER: Output does not fit in the buffer
+   *   supplied by the application.
+   * @GSASL_CALLBACK_PENDING: The callback will answer later, and the
+   *   step waits for gsasl_step_resume().
    * @GSASL_GSSAPI_RELEASE_BUFFER_ERROR: GSS-API library call error.
    * @GSASL_GSSAPI_IMPORT_NAME_ERROR: GSS-API library call error.
    * @GSASL_GSSAPI_INIT_SEC_CONTEXT_ERROR: GSS-API library call error.
@@ -194,6 +198,8 @@ extern "C"
     GSASL_NO_SAML20_IDP_IDENTIFIER = 66,
     GSASL_NO_SAML20_REDIRECT_URL = 67,
     GSASL_NO_OPENID20_REDIRECT_URL = 68,
+    GSASL_NEEDS_LARGER_BUFFER = 69,
+    GSASL_CALLBACK_PENDING = 70,
     /* Mechanism specific errors. */
     GSASL_GSSAPI_RELEASE_BUFFER_ERROR = 37,
     GSASL_GSSAPI_IMPORT_NAME_ERROR = 38,
@@ -286,6 +292,75 @@ extern "C"
    */
   typedef struct Gsasl_session Gsasl_session;
 
+  /**
+   * Gsasl_iov:
+   * @base: start of the data.
+   * @len: length of the data.
+   *
+   * One segment of scattered data, for gsasl_encodev() and
+   * gsasl_decodev().
+   */
+  struct Gsasl_iov
+  {
+    const char *base;
+    size_t len;
+  };
+  typedef struct Gsasl_iov Gsasl_iov;
+
+  /**
+   * Gsasl_stream:
+   *
+   * Handle to a framed byte stream over a SASL session, see
+   * gsasl_stream_init().
+   */
+  typedef struct Gsasl_stream Gsasl_stream;
+
+  /**
+   * Gsasl_scram_keys:
+   * @password: input zero terminated UTF-8 password.
+   * @salt: input raw salt.
+   * @saltlen: length of @salt.
+   * @iter: input iteration count.
+   * @saltedpassword: output SCRAM-SHA-1 SaltedPassword.
+   * @storedkey: output SCRAM-SHA-1 StoredKey.
+   * @serverkey: output SCRAM-SHA-1 ServerKey.
+   * @rc: output result code for this entry.
+   *
+   * One entry for gsasl_scram_derive_batch().
+   */
+  struct Gsasl_scram_keys
+  {
+    const char *password;
+    const char *salt;
+    size_t saltlen;
+    unsigned int iter;
+    char saltedpassword[20];
+    char storedkey[20];
+    char serverkey[20];
+    int rc;
+  };
+  typedef struct Gsasl_scram_keys Gsasl_scram_keys;
+
+  /**
+   * Gsasl_digest_md5_secret:
+   * @username: input zero terminated UTF-8 user name.
+   * @realm: input zero terminated UTF-8 realm, or NULL.
+   * @password: input zero terminated UTF-8 password.
+   * @hashed: output zero terminated hex encoded secret.
+   * @rc: output result code for this entry.
+   *
+   * One entry for gsasl_digest_md5_hash_batch().
+   */
+  struct Gsasl_digest_md5_secret
+  {
+    const char *username;
+    const char *realm;
+    const char *password;
+    char hashed[33];
+    int rc;
+  };
+  typedef struct Gsasl_digest_md5_secret Gsasl_digest_md5_secret;
+
   /**
    * Gsasl_property:
    * @GSASL_AUTHID: Authentication identity (username).
@@ -312,6 +387,8 @@ extern "C"
    * @GSASL_SAML20_REDIRECT_URL: SAML 2.0 URL to access in browser.
    * @GSASL_OPENID20_REDIRECT_URL: OpenID 2.0 URL to access in browser.
    * @GSASL_OPENID20_OUTCOME_DATA: OpenID 2.0 authentication outcome data.
+   * @GSASL_SCRAM_SERVERKEY: Base64 encoded SCRAM ServerKey.
+   * @GSASL_SCRAM_STOREDKEY: Base64 encoded SCRAM StoredKey.
    * @GSASL_SAML20_AUTHENTICATE_IN_BROWSER: Request to perform SAML 2.0
    *   authentication in browser.
    * @GSASL_OPENID20_AUTHENTICATE_IN_BROWSER: Request to perform OpenID 2.0
@@ -323,6 +400,8 @@ extern "C"
    * @GSASL_VALIDATE_SECURID: Reqest for validation of SecurID.
    * @GSASL_VALIDATE_SAML20: Reqest for validation of SAML20.
    * @GSASL_VALIDATE_OPENID20: Reqest for validation of OpenID 2.0 login.
+   * @GSASL_PREFETCH: Hint that the properties returned by
+   *   gsasl_prefetch_properties() are about to be asked for.
    *
    * Callback/property types.
    */
@@ -351,6 +430,8 @@ extern "C"
     GSASL_SAML20_REDIRECT_URL = 20,
     GSASL_OPENID20_REDIRECT_URL = 21,
     GSASL_OPENID20_OUTCOME_DATA = 22,
+    GSASL_SCRAM_SERVERKEY = 23,
+    GSASL_SCRAM_STOREDKEY = 24,
     /* Client callbacks. */
     GSASL_SAML20_AUTHENTICATE_IN_BROWSER = 250,
     GSASL_OPENID20_AUTHENTICATE_IN_BROWSER = 251,
@@ -361,7 +442,9 @@ extern "C"
     GSASL_VALIDATE_GSSAPI = 503,
     GSASL_VALIDATE_SECURID = 504,
     GSASL_VALIDATE_SAML20 = 505,
-    GSASL_VALIDATE_OPENID20 = 506
+    GSASL_VALIDATE_OPENID20 = 506,
+    /* Server hint callback properties. */
+    GSASL_PREFETCH = 600
   } Gsasl_property;
 
   /**
@@ -391,9 +474,11 @@ extern "C"
   typedef int (*Gsasl_callback_function) (Gsasl * ctx, Gsasl_session * sctx,
 					  Gsasl_property prop);
 
-  /* Library entry and exit points: version.c, init.c, done.c */
+  /* Library entry and exit points: version.c, init.c, done.c,
+     register.c */
   extern GSASL_API int gsasl_init (Gsasl ** ctx);
   extern GSASL_API void gsasl_done (Gsasl * ctx);
+  extern GSASL_API void gsasl_freeze (Gsasl * ctx);
   extern GSASL_API const char *gsasl_check_version (const char *req_version);
 
   /* Callback handling: callback.c */
@@ -420,6 +505,9 @@ extern "C"
 						   Gsasl_property prop);
   extern GSASL_API const char *gsasl_property_fast (Gsasl_session * sctx,
 						    Gsasl_property prop);
+  extern GSASL_API void gsasl_prefetch_set (Gsasl * ctx, int enable);
+  extern GSASL_API const Gsasl_property *
+    gsasl_prefetch_properties (Gsasl_session * sctx, size_t * n);
 
   /* Mechanism handling: listmech.c, supportp.c, suggest.c */
   extern GSASL_API int gsasl_client_mechlist (Gsasl * ctx, char **out);
@@ -427,6 +515,11 @@ extern "C"
   extern GSASL_API const char *gsasl_client_suggest_mechanism (Gsasl * ctx,
 							       const char
 							       *mechlist);
+  extern GSASL_API size_t gsasl_client_suggest_mechanisms (Gsasl * ctx,
+							   const char
+							   *mechlist,
+							   const char **out,
+							   size_t outlen);
 
   extern GSASL_API int gsasl_server_mechlist (Gsasl * ctx, char **out);
   extern GSASL_API int gsasl_server_support_p (Gsasl * ctx, const char *name);
@@ -441,7 +534,20 @@ extern "C"
 				   char **output, size_t * output_len);
   extern GSASL_API int gsasl_step64 (Gsasl_session * sctx,
 				     const char *b64input, char **b64output);
+  extern GSASL_API int gsasl_step_buffer (Gsasl_session * sctx,
+					  const char *input, size_t input_len,
+					  char *output, size_t * output_len);
   extern GSASL_API void gsasl_finish (Gsasl_session * sctx);
+  extern GSASL_API int gsasl_session_reset (Gsasl_session * sctx,
+					    const char *mech);
+
+  /* Suspended steps: resume.c */
+  extern GSASL_API int gsasl_step_resume (Gsasl_session * sctx, int result,
+					  char **output, size_t * output_len);
+
+  /* Session handle pool: pool.c */
+  extern GSASL_API int gsasl_session_pool_set (Gsasl * ctx,
+					       size_t max_sessions);
 
   /* Session functions: xcode.c, mechname.c */
   extern GSASL_API int gsasl_encode (Gsasl_session * sctx,
@@ -450,8 +556,51 @@ extern "C"
   extern GSASL_API int gsasl_decode (Gsasl_session * sctx,
 				     const char *input, size_t input_len,
 				     char **output, size_t * output_len);
+  extern GSASL_API int gsasl_encode_buffer (Gsasl_session * sctx,
+					    const char *input,
+					    size_t input_len,
+					    char *output,
+					    size_t * output_len);
+  extern GSASL_API int gsasl_decode_buffer (Gsasl_session * sctx,
+					    const char *input,
+					    size_t input_len,
+					    char *output,
+					    size_t * output_len);
+  extern GSASL_API int gsasl_encode_ref (Gsasl_session * sctx,
+					 const char *input, size_t input_len,
+					 const char **output,
+					 size_t * output_len);
+  extern GSASL_API int gsasl_decode_ref (Gsasl_session * sctx,
+					 const char *input, size_t input_len,
+					 const char **output,
+					 size_t * output_len);
+  extern GSASL_API int gsasl_encodev (Gsasl_session * sctx,
+				      const Gsasl_iov * input,
+				      size_t input_count,
+				      Gsasl_iov * output,
+				      size_t * output_count);
+  extern GSASL_API int gsasl_decodev (Gsasl_session * sctx,
+				      const Gsasl_iov * input,
+				      size_t input_count,
+				      Gsasl_iov * output,
+				      size_t * output_count);
   extern GSASL_API const char *gsasl_mechanism_name (Gsasl_session * sctx);
 
+  /* Security layer streams: stream.c */
+  extern GSASL_API int gsasl_stream_init (Gsasl_session * sctx,
+					  Gsasl_stream ** stream);
+  extern GSASL_API void gsasl_stream_done (Gsasl_stream * stream);
+  extern GSASL_API int gsasl_stream_encode (Gsasl_stream * stream,
+					    const char *input,
+					    size_t input_len,
+					    const char **output,
+					    size_t * output_len);
+  extern GSASL_API int gsasl_stream_decode (Gsasl_stream * stream,
+					    const char *input,
+					    size_t input_len,
+					    const char **output,
+					    size_t * output_len);
+
   /* Error handling: error.c */
   extern GSASL_API const char *gsasl_strerror (int err);
   extern GSASL_API const char *gsasl_strerror_name (int err);
@@ -469,8 +618,14 @@ extern "C"
 					char **out, size_t * outlen);
   extern GSASL_API int gsasl_base64_from (const char *in, size_t inlen,
 					  char **out, size_t * outlen);
+  extern GSASL_API int gsasl_base64_to_buffer (const char *in, size_t inlen,
+					       char *out, size_t * outlen);
+  extern GSASL_API int gsasl_base64_from_buffer (const char *in,
+						 size_t inlen, char *out,
+						 size_t * outlen);
   extern GSASL_API int gsasl_nonce (char *data, size_t datalen);
   extern GSASL_API int gsasl_random (char *data, size_t datalen);
+  extern GSASL_API void gsasl_nonce_pool_set (Gsasl * ctx, int enable);
   extern GSASL_API int gsasl_md5 (const char *in, size_t inlen,
 				  char *out[16]);
   extern GSASL_API int gsasl_hmac_md5 (const char *key, size_t keylen,
@@ -483,6 +638,43 @@ extern "C"
 					char *outhash[20]);
   extern GSASL_API void gsasl_free (void *ptr);
 
+  /* SCRAM server key cache: scramcache.c */
+  extern GSASL_API int gsasl_scram_cache_set (Gsasl * ctx,
+					      size_t max_entries,
+					      unsigned int ttl);
+  extern GSASL_API void gsasl_scram_cache_stats (Gsasl * ctx,
+						 size_t * hits,
+						 size_t * misses);
+
+  /* SCRAM key derivation: scramkeys.c */
+  extern GSASL_API int gsasl_scram_derive (const char *password,
+					   const char *salt, size_t saltlen,
+					   unsigned int iter,
+					   char *saltedpassword,
+					   char *storedkey, char *serverkey);
+  extern GSASL_API int gsasl_scram_derive_batch (Gsasl_scram_keys * keys,
+						 size_t nkeys,
+						 unsigned int nthreads);
+
+  /* DIGEST-MD5 server secret cache: digestcache.c */
+  extern GSASL_API int gsasl_digest_md5_cache_set (Gsasl * ctx,
+						   size_t max_entries,
+						   unsigned int ttl);
+  extern GSASL_API void gsasl_digest_md5_cache_forget (Gsasl * ctx,
+						       const char *authid,
+						       const char *realm);
+  extern GSASL_API void gsasl_digest_md5_cache_stats (Gsasl * ctx,
+						      size_t * hits,
+						      size_t * misses);
+
+  /* DIGEST-MD5 secret hashing: digestkeys.c */
+  extern GSASL_API int gsasl_digest_md5_hash (const char *username,
+					      const char *realm,
+					      const char *password,
+					      char *hashed);
+  extern GSASL_API int gsasl_digest_md5_hash_batch (Gsasl_digest_md5_secret *
+						    secrets, size_t nsecrets);
+
   /* Get the mechanism API. */
 #include <gsasl-mech.h>
 
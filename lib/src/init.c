@@ -53,89 +53,162 @@ const char *GSASL_VALID_MECHANISM_CHARACTERS_RTN(void)
   return "ABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789-_";
 }
 
+/* Extra functions of the builtin mechanisms. */
+static const struct _gsasl_mech_ext always = {
+  .probe = _gsasl_probe_always
+};
+
+/* Server side of mechanisms whose steps can wait for the callback. */
+static const struct _gsasl_mech_ext resumable = {
+  .probe = _gsasl_probe_always,
+  .resumable = 1
+};
+
+#ifdef USE_DIGEST_MD5
+static const struct _gsasl_mech_ext digest_md5_client = {
+  .probe = _gsasl_probe_always,
+#ifdef USE_CLIENT
+  .encodev = _gsasl_digest_md5_client_encodev,
+  .decodev = _gsasl_digest_md5_client_decodev,
+  .layer = _gsasl_digest_md5_client_layer,
+  .prefixed = 1
+#endif
+};
+
+static const struct _gsasl_mech_ext digest_md5_server = {
+  .probe = _gsasl_probe_always,
+#ifdef USE_SERVER
+  .encodev = _gsasl_digest_md5_server_encodev,
+  .decodev = _gsasl_digest_md5_server_decodev,
+  .layer = _gsasl_digest_md5_server_layer,
+  .prefixed = 1,
+  .resumable = 1
+#endif
+};
+#endif /* USE_DIGEST_MD5 */
+
+#ifdef USE_SCRAM_SHA1
+static const struct _gsasl_mech_ext scram_sha1_plus = {
+  .probe = _gsasl_scram_sha1_plus_probe
+};
+
+static const struct _gsasl_mech_ext scram_sha1_plus_server = {
+  .probe = _gsasl_scram_sha1_plus_probe,
+  .resumable = 1
+};
+#endif /* USE_SCRAM_SHA1 */
+
+#ifdef USE_GSSAPI
+static const struct _gsasl_mech_ext gssapi_client = {
+  .probe = _gsasl_probe_always,
+#ifdef USE_CLIENT
+  .encodev = _gsasl_gssapi_client_encodev,
+  .decodev = _gsasl_gssapi_client_decodev
+#endif
+};
+
+static const struct _gsasl_mech_ext gssapi_server = {
+  .probe = _gsasl_gssapi_server_probe
+};
+#endif /* USE_GSSAPI */
+
+#ifdef USE_GS2
+static const struct _gsasl_mech_ext gs2_server = {
+  .probe = _gsasl_gs2_server_probe
+};
+#endif /* USE_GS2 */
+
 static int
 register_builtin_mechs (Gsasl * ctx)
 {
   int rc = GSASL_OK;
 
 #ifdef USE_ANONYMOUS
-  rc = gsasl_register (ctx, &gsasl_anonymous_mechanism);
+  rc = _gsasl_register_ext (ctx, &gsasl_anonymous_mechanism, &always, &always);
   if (rc != GSASL_OK)
     return rc;
 #endif /* USE_ANONYMOUS */
 
 #ifdef USE_EXTERNAL
-  rc = gsasl_register (ctx, &gsasl_external_mechanism);
+  rc = _gsasl_register_ext (ctx, &gsasl_external_mechanism, &always, &always);
   if (rc != GSASL_OK)
     return rc;
 #endif /* USE_EXTERNAL */
 
 #ifdef USE_LOGIN
-  rc = gsasl_register (ctx, &gsasl_login_mechanism);
+  rc = _gsasl_register_ext (ctx, &gsasl_login_mechanism, &always,
+			    &resumable);
   if (rc != GSASL_OK)
     return rc;
 #endif /* USE_LOGIN */
 
 #ifdef USE_PLAIN
-  rc = gsasl_register (ctx, &gsasl_plain_mechanism);
+  rc = _gsasl_register_ext (ctx, &gsasl_plain_mechanism, &always,
+			    &resumable);
   if (rc != GSASL_OK)
     return rc;
 #endif /* USE_PLAIN */
 
 #ifdef USE_SECURID
-  rc = gsasl_register (ctx, &gsasl_securid_mechanism);
+  rc = _gsasl_register_ext (ctx, &gsasl_securid_mechanism, &always, &always);
   if (rc != GSASL_OK)
     return rc;
 #endif /* USE_SECURID */
 
 #ifdef USE_NTLM
-  rc = gsasl_register (ctx, &gsasl_ntlm_mechanism);
+  rc = _gsasl_register_ext (ctx, &gsasl_ntlm_mechanism, &always, &always);
   if (rc != GSASL_OK)
     return rc;
 #endif /* USE_NTLM */
 
 #ifdef USE_DIGEST_MD5
-  rc = gsasl_register (ctx, &gsasl_digest_md5_mechanism);
+  rc = _gsasl_register_ext (ctx, &gsasl_digest_md5_mechanism,
+			    &digest_md5_client, &digest_md5_server);
   if (rc != GSASL_OK)
     return rc;
 #endif /* USE_DIGEST_MD5 */
 
 #ifdef USE_CRAM_MD5
-  rc = gsasl_register (ctx, &gsasl_cram_md5_mechanism);
+  rc = _gsasl_register_ext (ctx, &gsasl_cram_md5_mechanism, &always,
+			    &resumable);
   if (rc != GSASL_OK)
     return rc;
 #endif /* USE_CRAM_MD5 */
 
 #ifdef USE_SCRAM_SHA1
-  rc = gsasl_register (ctx, &gsasl_scram_sha1_mechanism);
+  rc = _gsasl_register_ext (ctx, &gsasl_scram_sha1_mechanism,
+			    &always, &resumable);
   if (rc != GSASL_OK)
     return rc;
 
-  rc = gsasl_register (ctx, &gsasl_scram_sha1_plus_mechanism);
+  rc = _gsasl_register_ext (ctx, &gsasl_scram_sha1_plus_mechanism,
+			    &scram_sha1_plus, &scram_sha1_plus_server);
   if (rc != GSASL_OK)
     return rc;
 #endif /* USE_SCRAM_SHA1 */
 
 #ifdef USE_SAML20
-  rc = gsasl_register (ctx, &gsasl_saml20_mechanism);
+  rc = _gsasl_register_ext (ctx, &gsasl_saml20_mechanism, &always, &always);
   if (rc != GSASL_OK)
     return rc;
 #endif /* USE_SAML20 */
 
 #ifdef USE_OPENID20
-  rc = gsasl_register (ctx, &gsasl_openid20_mechanism);
+  rc = _gsasl_register_ext (ctx, &gsasl_openid20_mechanism, &always, &always);
   if (rc != GSASL_OK)
     return rc;
 #endif /* USE_OPENID20 */
 
 #ifdef USE_GSSAPI
-  rc = gsasl_register (ctx, &gsasl_gssapi_mechanism);
+  rc = _gsasl_register_ext (ctx, &gsasl_gssapi_mechanism,
+			    &gssapi_client, &gssapi_server);
   if (rc != GSASL_OK)
     return rc;
 #endif /* USE_GSSAPI */
 
 #ifdef USE_GS2
-  rc = gsasl_register (ctx, &gsasl_gs2_krb5_mechanism);
+  rc = _gsasl_register_ext (ctx, &gsasl_gs2_krb5_mechanism,
+			    &always, &gs2_server);
   if (rc != GSASL_OK)
     return rc;
 #endif /* USE_GSSAPI */
@@ -167,6 +240,21 @@ gsasl_init (Gsasl ** ctx)
   if (*ctx == NULL)
     return GSASL_MALLOC_ERROR;
 
+  _gsasl_lock_init (&(*ctx)->pool_lock);
+  _gsasl_lock_init (&(*ctx)->mechlist_lock);
+  _gsasl_lock_init (&(*ctx)->register_lock);
+  _gsasl_nonce_pool_ref ();
+
+  (*ctx)->nonce_pool = 1;
+
+  (*ctx)->client_tab = _gsasl_mechtab_new ();
+  (*ctx)->server_tab = _gsasl_mechtab_new ();
+  if (!(*ctx)->client_tab || !(*ctx)->server_tab)
+    {
+      gsasl_done (*ctx);
+      return GSASL_MALLOC_ERROR;
+    }
+
   rc = register_builtin_mechs (*ctx);
   if (rc != GSASL_OK)
     {
@@ -37,16 +37,155 @@
 /* Get strlen, strcpy, ... */
 #include <string.h>
 
+/* Locks protecting data shared between sessions of one handle.  When
+   the library is built without thread support these are no-ops. */
+#if USE_POSIX_THREADS
+# include <pthread.h>
+typedef pthread_mutex_t _gsasl_lock_t;
+# define _gsasl_lock_init(l) pthread_mutex_init ((l), NULL)
+# define _gsasl_lock_destroy(l) pthread_mutex_destroy (l)
+# define _gsasl_lock(l) pthread_mutex_lock (l)
+# define _gsasl_unlock(l) pthread_mutex_unlock (l)
+#else
+typedef int _gsasl_lock_t;
+# define _gsasl_lock_init(l) ((void) (l))
+# define _gsasl_lock_destroy(l) ((void) (l))
+# define _gsasl_lock(l) ((void) (l))
+# define _gsasl_unlock(l) ((void) (l))
+#endif
+
+/* Pointers read by other threads without taking a lock.  What was
+   written before _gsasl_publish stored a pointer is seen by the
+   threads that loaded it with _gsasl_acquire.  Compilers without the
+   atomic builtins get plain accesses, which suffice on the common
+   platforms where pointer stores are not torn. */
+#if USE_POSIX_THREADS && defined __ATOMIC_ACQUIRE
+# define _gsasl_acquire(p) __atomic_load_n ((p), __ATOMIC_ACQUIRE)
+# define _gsasl_publish(p, v) __atomic_store_n ((p), (v), __ATOMIC_RELEASE)
+#else
+# define _gsasl_acquire(p) (*(p))
+# define _gsasl_publish(p, v) ((void) (*(p) = (v)))
+#endif
+
+/* SCRAM SaltedPassword cache, see scramcache.c. */
+struct _gsasl_scram_cache;
+extern void _gsasl_scram_cache_free (struct _gsasl_scram_cache *cache);
+
+/* DIGEST-MD5 secret cache, see digestcache.c. */
+struct _gsasl_digest_md5_cache;
+extern void _gsasl_digest_md5_cache_free (struct _gsasl_digest_md5_cache
+					  *cache);
+
+/* Per-thread nonce pools, see noncepool.c.  Every handle holds a
+   reference from gsasl_init to gsasl_done. */
+extern void _gsasl_nonce_pool_ref (void);
+extern void _gsasl_nonce_pool_unref (void);
+
+/* Cheap check whether a mechanism could be started in SCTX, used
+   when listing mechanisms instead of running its start function.
+   Returns GSASL_OK when it could.  Mechanisms registered through
+   gsasl_register have no probe and are started for real. */
+typedef int (*_gsasl_probe_function) (Gsasl_session * sctx);
+
+/* Scatter/gather variant of Gsasl_code_function.  OUTPUT has room for
+   INPUT_COUNT + 2 segments, which may point into INPUT or into
+   MECH_DATA, until the next call. */
+typedef int (*_gsasl_codev_function) (Gsasl_session * sctx, void *mech_data,
+				      const Gsasl_iov * input,
+				      size_t input_count,
+				      Gsasl_iov * output,
+				      size_t * output_count);
+
+/* Tell whether a security layer is in effect in SCTX, see stream.c.
+   When it is, return non-zero after lowering *SENDMAX to the largest
+   payload to protect in one message and *RECVMAX to the largest
+   message, without length prefix, the peer may send. */
+typedef int (*_gsasl_layer_function) (Gsasl_session * sctx, void *mech_data,
+				      size_t * sendmax, size_t * recvmax);
+
+/* Functions of a builtin mechanism beyond Gsasl_mechanism_functions,
+   which cannot grow without changing the ABI of gsasl_register.  Any
+   of them may be NULL. */
+struct _gsasl_mech_ext
+{
+  _gsasl_probe_function probe;
+  _gsasl_codev_function encodev;
+  _gsasl_codev_function decodev;
+  _gsasl_layer_function layer;
+  /* Non-zero when encoded messages include their 4 byte length. */
+  int prefixed;
+  /* Non-zero when a step can be suspended by a callback returning
+     GSASL_CALLBACK_PENDING and run again, see resume.c. */
+  int resumable;
+};
+
+/* Hash index over the names in a mechanism table, see register.c. */
+struct _gsasl_mechindex
+{
+  size_t size;			/* Number of slots, a power of two. */
+  size_t *slot;			/* Mechanism index plus one, 0 if unused. */
+};
+
+/* A registered mechanism with its extra functions.  Entries are
+   never moved or freed before gsasl_done, so sessions may point into
+   them. */
+struct _gsasl_mechent
+{
+  Gsasl_mechanism mech;
+  struct _gsasl_mech_ext ext;
+};
+
+/* The mechanisms of one side, in registration order, see register.c.
+   A table is not changed once it is published: registering publishes
+   a new table and, in a frozen handle, keeps the replaced ones on the
+   RETIRED list until gsasl_done since other threads may still read
+   them. */
+struct _gsasl_mechtab
+{
+  size_t n;
+  struct _gsasl_mechent **ent;
+  struct _gsasl_mechindex index;
+  struct _gsasl_mechtab *retired;
+};
+
+/* Cached mechanism list for one side, see listmech.c. */
+struct _gsasl_mechlist
+{
+  const struct _gsasl_mechtab *tab;
+  unsigned char *avail;
+  char *list;
+};
+
 /* Main library handle. */
 struct Gsasl
 {
-  size_t n_client_mechs;
-  Gsasl_mechanism *client_mechs;
-  size_t n_server_mechs;
-  Gsasl_mechanism *server_mechs;
+  /* Mechanism tables, read through _gsasl_mechtab.  register_lock
+     serializes registrations, and FROZEN tells them that other
+     threads may be using the handle, see gsasl_freeze. */
+  struct _gsasl_mechtab *client_tab;
+  struct _gsasl_mechtab *server_tab;
+  _gsasl_lock_t register_lock;
+  int frozen;
+  /* Last computed mechanism lists, see listmech.c. */
+  _gsasl_lock_t mechlist_lock;
+  struct _gsasl_mechlist client_mechlist;
+  struct _gsasl_mechlist server_mechlist;
   /* Callback. */
   Gsasl_callback_function cb;
   void *application_hook;
+  /* Whether to make GSASL_PREFETCH callbacks, see property.c. */
+  int prefetch;
+  /* Whether mechanisms take nonces from the pool, see noncepool.c. */
+  int nonce_pool;
+  /* Optional cache of derived SCRAM keys, NULL when disabled. */
+  struct _gsasl_scram_cache *scram_cache;
+  /* Optional cache of DIGEST-MD5 secrets, NULL when disabled. */
+  struct _gsasl_digest_md5_cache *digest_md5_cache;
+  /* Finished sessions kept for reuse, see pool.c. */
+  _gsasl_lock_t pool_lock;
+  size_t pool_max;
+  size_t pool_count;
+  Gsasl_session *pool;
 #ifndef GSASL_NO_OBSOLETE
   /* Obsolete stuff. */
   Gsasl_client_callback_authorization_id cbc_authorization_id;
@@ -75,40 +214,66 @@ struct Gsasl
 #endif
 };
 
+/* Highest numbered property stored in a session.  Properties are
+   numbered consecutively from GSASL_AUTHID up to this value. */
+#define GSASL_MAX_PROPERTY GSASL_SCRAM_STOREDKEY
+
+/* Bytes of property data kept inside the session structure.  This
+   covers the properties of a typical authentication exchange. */
+#define GSASL_PROPERTY_ARENA 256
+
+/* Result of a callback given to gsasl_step_resume, see resume.c. */
+struct _gsasl_replay
+{
+  Gsasl_property prop;
+  int rc;
+  char *value;
+};
+
 /* Per-session library handle. */
 struct Gsasl_session
 {
   Gsasl *ctx;
   int clientp;
   Gsasl_mechanism *mech;
+  const struct _gsasl_mech_ext *ext;
   void *mech_data;
   void *application_hook;
+  /* Output of a gsasl_*_buffer or gsasl_*_ref call, see xcode.c.
+     kept_op is set while it waits for a larger buffer. */
+  char *kept;
+  size_t kept_len;
+  int kept_op;
+  int kept_rc;
+  /* Decoded input of gsasl_step64, reused by later steps. */
+  char *scratch;
+  size_t scratch_size;
+  /* Suspended step, see resume.c.  STEPPING is set while the
+     mechanism runs, PENDING is the property whose callback is
+     outstanding, and REPLAY holds the results given to
+     gsasl_step_resume for the step. */
+  int stepping;
+  Gsasl_property pending;
+  char *pending_input;
+  size_t pending_input_len;
+  struct _gsasl_replay *replay;
+  size_t n_replay;
+  /* Next session in the context pool, see pool.c. */
+  Gsasl_session *pool_next;
 
-  /* Properties. */
-  char *anonymous_token;
-  char *authid;
-  char *authzid;
-  char *password;
-  char *passcode;
-  char *pin;
-  char *suggestedpin;
-  char *service;
-  char *hostname;
-  char *gssapi_display_name;
-  char *realm;
-  char *digest_md5_hashed_password;
-  char *qops;
-  char *qop;
-  char *scram_iter;
-  char *scram_salt;
-  char *scram_salted_password;
-  char *cb_tls_unique;
-  char *saml20_idp_identifier;
-  char *saml20_redirect_url;
-  char *openid20_redirect_url;
-  char *openid20_outcome_data;
-  /* If you add anything here, remember to change change
-     gsasl_finish() in xfinish.c and map() in property.c.  */
+  /* Properties, indexed by Gsasl_property.  Values are stored in
+     prop_arena while it has room and are malloc'ed after that; bit
+     N of prop_heap is set when property N is malloc'ed. */
+  char *property[GSASL_MAX_PROPERTY + 1];
+  unsigned long prop_heap;
+  /* Bit N is set when property N was offered to a successful
+     GSASL_PREFETCH callback, and PREFETCH is the list offered to the
+     callback while it runs. */
+  unsigned long prop_prefetched;
+  const Gsasl_property *prefetch;
+  size_t n_prefetch;
+  size_t prop_arena_used;
+  char prop_arena[GSASL_PROPERTY_ARENA];
 
 #ifndef GSASL_NO_OBSOLETE
   /* Obsolete stuff. */
@@ -116,6 +281,52 @@ struct Gsasl_session
 #endif
 };
 
+/* Operations for _gsasl_buffer_op, in xcode.c. */
+#define GSASL_OP_STEP 1
+#define GSASL_OP_ENCODE 2
+#define GSASL_OP_DECODE 3
+extern int _gsasl_buffer_op (Gsasl_session * sctx, int op,
+			     const char *input, size_t input_len,
+			     char *output, size_t * output_len);
+
+/* Suspension of steps waiting for a callback, in resume.c. */
+extern int _gsasl_step_run (Gsasl_session * sctx,
+			    const char *input, size_t input_len,
+			    char **output, size_t * output_len);
+extern int _gsasl_callback_hold (Gsasl_session * sctx, Gsasl_property prop,
+				 int *rc);
+extern int _gsasl_callback_result (Gsasl_session * sctx,
+				   Gsasl_property prop, int rc);
+extern void _gsasl_step_resume_clear (Gsasl_session * sctx);
+
+/* Forget all properties of a session, in property.c. */
+extern void _gsasl_property_clear (Gsasl_session * sctx);
+
+/* Release mechanism state and properties of a session, in
+   xfinish.c. */
+extern void _gsasl_session_clear (Gsasl_session * sctx);
+
+/* Session allocation through the context pool, in pool.c. */
+extern Gsasl_session *_gsasl_session_alloc (Gsasl * ctx);
+extern void _gsasl_session_release (Gsasl_session * sctx);
+extern void _gsasl_session_pool_free (Gsasl * ctx);
+
+/* Mechanism registration with extra functions, in register.c, and
+   the mechanism list cache, in listmech.c. */
+extern int _gsasl_register_ext (Gsasl * ctx, const Gsasl_mechanism * mech,
+				const struct _gsasl_mech_ext *client_ext,
+				const struct _gsasl_mech_ext *server_ext);
+extern const struct _gsasl_mech_ext *_gsasl_session_ext (Gsasl_session *
+							  sctx);
+extern const struct _gsasl_mechtab *_gsasl_mechtab (Gsasl * ctx,
+						    int clientp);
+extern struct _gsasl_mechtab *_gsasl_mechtab_new (void);
+extern void _gsasl_mechtab_free (struct _gsasl_mechtab *tab, int entries);
+extern size_t _gsasl_find_mechanism (const struct _gsasl_mechtab *tab,
+				     const char *name, size_t len);
+extern int _gsasl_probe_always (Gsasl_session * sctx);
+extern void _gsasl_mechlist_invalidate (Gsasl * ctx);
+
 #ifndef GSASL_NO_OBSOLETE
 const char *_gsasl_obsolete_property_map (Gsasl_session * sctx,
 					  Gsasl_property prop);
@@ -22,40 +22,168 @@
 
 #include "internal.h"
 
+/* Availability probe for mechanisms that can always be started.  The
+   mechanism lists recognize it and do not call it. */
+int
+_gsasl_probe_always (Gsasl_session * sctx)
+{
+  (void) sctx;
+  return GSASL_OK;
+}
+
+/* Forget the cached mechanism lists of CTX. */
+void
+_gsasl_mechlist_invalidate (Gsasl * ctx)
+{
+  _gsasl_lock (&ctx->mechlist_lock);
+  free (ctx->client_mechlist.avail);
+  free (ctx->client_mechlist.list);
+  free (ctx->server_mechlist.avail);
+  free (ctx->server_mechlist.list);
+  memset (&ctx->client_mechlist, 0, sizeof (ctx->client_mechlist));
+  memset (&ctx->server_mechlist, 0, sizeof (ctx->server_mechlist));
+  _gsasl_unlock (&ctx->mechlist_lock);
+}
+
+/* Check whether the mechanism ENT can be started, storing the answer
+   in *AVAIL.  Its probe is used if present, SCTX being a scratch
+   session for it. */
 static int
-_gsasl_listmech (Gsasl * ctx,
-		 Gsasl_mechanism * mechs,
-		 size_t n_mechs, char **out, int clientp)
+available (Gsasl * ctx, Gsasl_session * sctx, struct _gsasl_mechent *ent,
+	   int clientp, unsigned char *avail)
 {
-  Gsasl_session *sctx;
-  char *list;
-  size_t i;
+  Gsasl_mechanism *mech = &ent->mech;
+  _gsasl_probe_function probe = ent->ext.probe;
+  Gsasl_session *tmp;
   int rc;
 
-  list = calloc (n_mechs + 1, GSASL_MAX_MECHANISM_SIZE + 1);
-  if (!list)
-    return GSASL_MALLOC_ERROR;
-
-  for (i = 0; i < n_mechs; i++)
+  if (clientp ? !mech->client.start && !mech->client.step
+      : !mech->server.start && !mech->server.step)
+    rc = clientp ? GSASL_NO_CLIENT_CODE : GSASL_NO_SERVER_CODE;
+  else if (probe == _gsasl_probe_always)
+    rc = GSASL_OK;
+  else if (probe)
+    {
+      sctx->mech = mech;
+      sctx->ext = &ent->ext;
+      sctx->clientp = clientp;
+      rc = probe (sctx);
+      sctx->mech = NULL;
+      sctx->ext = NULL;
+    }
+  else
     {
       if (clientp)
-	rc = gsasl_client_start (ctx, mechs[i].name, &sctx);
+	rc = gsasl_client_start (ctx, mech->name, &tmp);
       else
-	rc = gsasl_server_start (ctx, mechs[i].name, &sctx);
+	rc = gsasl_server_start (ctx, mech->name, &tmp);
+      if (rc == GSASL_OK)
+	gsasl_finish (tmp);
+      else if (rc == GSASL_MALLOC_ERROR)
+	return rc;
+    }
+
+  *avail = rc == GSASL_OK;
+
+  return GSASL_OK;
+}
+
+static int
+_gsasl_listmech (Gsasl * ctx, struct _gsasl_mechlist *cache,
+		 char **out, int clientp)
+{
+  const struct _gsasl_mechtab *tab = _gsasl_mechtab (ctx, clientp);
+  size_t n_mechs = tab->n;
+  Gsasl_session *sctx = NULL;
+  unsigned char *avail;
+  char *list, *p;
+  size_t i, len;
+  int rc = GSASL_OK;
+
+  avail = malloc (n_mechs + 1);
+  if (!avail)
+    return GSASL_MALLOC_ERROR;
 
+  /* Availability may depend on the callback, so it is checked on
+     every call; only building the string is avoided when the
+     answers match the cached ones. */
+  for (i = 0; i < n_mechs && rc == GSASL_OK; i++)
+    {
+      _gsasl_probe_function probe = tab->ent[i]->ext.probe;
+
+      if (probe && probe != _gsasl_probe_always && !sctx)
+	{
+	  sctx = _gsasl_session_alloc (ctx);
+	  if (!sctx)
+	    rc = GSASL_MALLOC_ERROR;
+	}
       if (rc == GSASL_OK)
+	rc = available (ctx, sctx, tab->ent[i], clientp, &avail[i]);
+    }
+
+  if (sctx)
+    {
+      _gsasl_session_clear (sctx);
+      _gsasl_session_release (sctx);
+    }
+
+  if (rc != GSASL_OK)
+    {
+      free (avail);
+      return rc;
+    }
+
+  _gsasl_lock (&ctx->mechlist_lock);
+
+  if (cache->list && cache->tab == tab
+      && memcmp (cache->avail, avail, n_mechs) == 0)
+    {
+      *out = strdup (cache->list);
+      rc = *out ? GSASL_OK : GSASL_MALLOC_ERROR;
+      free (avail);
+    }
+  else
+    {
+      len = 0;
+      for (i = 0; i < n_mechs; i++)
+	if (avail[i])
+	  len += strlen (tab->ent[i]->mech.name) + 1;
+
+      list = malloc (len + 1);
+      *out = malloc (len + 1);
+      if (!list || !*out)
 	{
-	  gsasl_finish (sctx);
+	  free (list);
+	  free (*out);
+	  free (avail);
+	  rc = GSASL_MALLOC_ERROR;
+	}
+      else
+	{
+	  p = list;
+	  for (i = 0; i < n_mechs; i++)
+	    if (avail[i])
+	      {
+		if (p != list)
+		  *p++ = ' ';
+		len = strlen (tab->ent[i]->mech.name);
+		memcpy (p, tab->ent[i]->mech.name, len);
+		p += len;
+	      }
+	  *p = '\0';
+	  memcpy (*out, list, p - list + 1);
 
-	  strcat (list, mechs[i].name);
-	  if (i < n_mechs - 1)
-	    strcat (list, " ");
+	  free (cache->avail);
+	  free (cache->list);
+	  cache->tab = tab;
+	  cache->avail = avail;
+	  cache->list = list;
 	}
     }
 
-  *out = list;
+  _gsasl_unlock (&ctx->mechlist_lock);
 
-  return GSASL_OK;
+  return rc;
 }
 
 /**
@@ -73,8 +201,7 @@ _gsasl_listmech (Gsasl * ctx,
 int
 gsasl_client_mechlist (Gsasl * ctx, char **out)
 {
-  return _gsasl_listmech (ctx, ctx->client_mechs, ctx->n_client_mechs,
-			  out, 1);
+  return _gsasl_listmech (ctx, &ctx->client_mechlist, out, 1);
 }
 
 /**
@@ -87,11 +214,18 @@ gsasl_client_mechlist (Gsasl * ctx, char **out)
  * allocated by this function, and it is the responsibility of caller
  * to deallocate it.
  *
+ * The builtin mechanisms are checked with cheap probes of the
+ * properties they need rather than by starting them, so this does no
+ * cryptographic work, and the string is only rebuilt when the set of
+ * available mechanisms changes.  The GSSAPI and GS2 probes still
+ * acquire and release an acceptor credential, so that they are only
+ * listed when one is available.  Mechanisms added with
+ * gsasl_register() are still started to check their availability.
+ *
  * Return value: Returns %GSASL_OK if successful, or error code.
  **/
 int
 gsasl_server_mechlist (Gsasl * ctx, char **out)
 {
-  return _gsasl_listmech (ctx, ctx->server_mechs, ctx->n_server_mechs,
-			  out, 0);
+  return _gsasl_listmech (ctx, &ctx->server_mechlist, out, 0);
 }
@@ -27,7 +27,7 @@
 /* Get specification. */
 #include "mechtools.h"
 
-/* Get strcmp. */
+/* Get memcpy, strcmp. */
 #include <string.h>
 
 /* Get malloc, free. */
@@ -215,3 +215,87 @@ _gsasl_gs2_generate_header (bool nonstd, char cbflag,
 
   return GSASL_OK;
 }
+
+static char
+hexdigit_to_char (char hexdigit)
+{
+  if (hexdigit >= '0' && hexdigit <= '9')
+    return hexdigit - '0';
+  if (hexdigit >= 'a' && hexdigit <= 'f')
+    return hexdigit - 'a' + 10;
+  return 0;
+}
+
+static char
+hex_to_char (char u, char l)
+{
+  return (char) (((unsigned char) hexdigit_to_char (u)) * 16
+		 + hexdigit_to_char (l));
+}
+
+/* Decode zero terminated lowercase hex string HEXSTR into BIN, which
+   must hold strlen (HEXSTR) / 2 bytes. */
+void
+_gsasl_hex_decode (const char *hexstr, char *bin)
+{
+  while (*hexstr)
+    {
+      *bin = hex_to_char (hexstr[0], hexstr[1]);
+      hexstr += 2;
+      bin++;
+    }
+}
+
+/* Return true iff HEXSTR only contains lowercase hex digits. */
+bool
+_gsasl_hex_p (const char *hexstr)
+{
+  static const char hexalpha[] = "0123456789abcdef";
+
+  for (; *hexstr; hexstr++)
+    if (strchr (hexalpha, *hexstr) == NULL)
+      return false;
+
+  return true;
+}
+
+/* Decode the 2 * BINLEN lowercase hex digits at HEX, which need not be
+   zero terminated, into BIN.  Returns false if HEX contains other
+   characters. */
+bool
+_gsasl_hex_to_bin (const char *hex, size_t binlen, char *bin)
+{
+  size_t i;
+
+  for (i = 0; i < 2 * binlen; i++)
+    if (!((hex[i] >= '0' && hex[i] <= '9')
+	  || (hex[i] >= 'a' && hex[i] <= 'f')))
+      return false;
+
+  for (i = 0; i < binlen; i++)
+    bin[i] = hex_to_char (hex[2 * i], hex[2 * i + 1]);
+
+  return true;
+}
+
+/* Return true iff the LEN bytes at A and B are equal.  All bytes are
+   compared, a machine word at a time, so the time taken does not tell
+   where the first difference is.  Use this to check MACs and other
+   digests an attacker could otherwise guess byte by byte. */
+bool
+_gsasl_digest_eq (const char *a, const char *b, size_t len)
+{
+  unsigned long diff = 0, x, y;
+  size_t i;
+
+  for (i = 0; i + sizeof (x) <= len; i += sizeof (x))
+    {
+      memcpy (&x, a + i, sizeof (x));
+      memcpy (&y, b + i, sizeof (y));
+      diff |= x ^ y;
+    }
+  for (; i < len; i++)
+    diff |= (unsigned char) (a[i] ^ b[i]);
+
+  return diff == 0;
+}
@@ -38,4 +38,10 @@ extern int _gsasl_gs2_generate_header (bool nonstd, char cbflag,
 				       const char *extra, char **gs2h,
 				       size_t * gs2hlen);
 
+extern void _gsasl_hex_decode (const char *hexstr, char *bin);
+extern bool _gsasl_hex_p (const char *hexstr);
+extern bool _gsasl_hex_to_bin (const char *hex, size_t binlen, char *bin);
+
+extern bool _gsasl_digest_eq (const char *a, const char *b, size_t len);
+
 #endif
@@ -0,0 +1,154 @@
+/* msgbuf.h --- Build mechanism messages in a single buffer.
+ * Copyright (C) 2012 Simon Josefsson
+ *
+ * This file is part of GNU SASL Library.
+ *
+ * GNU SASL Library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; either version 2.1 of
+ * the License, or (at your option) any later version.
+ *
+ * GNU SASL Library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with GNU SASL Library; if not, write to the Free
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ *
+ */
+
+#ifndef MSGBUF_H
+#define MSGBUF_H
+
+/* Get size_t. */
+#include <stddef.h>
+
+/* Get bool. */
+#include <stdbool.h>
+
+/* Get malloc, realloc, free. */
+#include <stdlib.h>
+
+/* Get memcpy, strlen. */
+#include <string.h>
+
+/* The functions are defined here, rather than in the library, so that
+   the parser self tests of the mechanisms can use them without
+   linking to libgsasl.
+
+   A printer writes its message twice.  The first time into a buffer
+   started with no size, which only counts the length.  The second
+   time into a buffer of that size, so that the message is copied once
+   into a single allocation.  The buffer still grows if more is added
+   than it was started with. */
+
+struct _gsasl_msgbuf
+{
+  char *data;
+  size_t len;
+  size_t size;
+  bool failed;
+};
+
+/* Start BUF with room for SIZE bytes, or for counting when SIZE is
+   zero. */
+static inline void
+_gsasl_msgbuf_init (struct _gsasl_msgbuf *buf, size_t size)
+{
+  buf->len = 0;
+  buf->size = size;
+  buf->failed = false;
+  buf->data = NULL;
+  if (size > 0)
+    {
+      buf->data = malloc (size + 1);
+      buf->failed = buf->data == NULL;
+    }
+}
+
+static inline void
+_gsasl_msgbuf_add (struct _gsasl_msgbuf *buf, const char *data, size_t len)
+{
+  if (buf->failed)
+    return;
+
+  if (len > (size_t) -1 / 4 - buf->len)
+    {
+      buf->failed = true;
+      return;
+    }
+
+  if (buf->data && buf->len + len > buf->size)
+    {
+      size_t size = buf->len + len > 2 * buf->size
+	? buf->len + len : 2 * buf->size;
+      char *tmp = realloc (buf->data, size + 1);
+
+      if (!tmp)
+	{
+	  buf->failed = true;
+	  return;
+	}
+      buf->data = tmp;
+      buf->size = size;
+    }
+
+  if (buf->data)
+    memcpy (buf->data + buf->len, data, len);
+  buf->len += len;
+}
+
+static inline void
+_gsasl_msgbuf_puts (struct _gsasl_msgbuf *buf, const char *str)
+{
+  _gsasl_msgbuf_add (buf, str, strlen (str));
+}
+
+static inline void
+_gsasl_msgbuf_putc (struct _gsasl_msgbuf *buf, char c)
+{
+  _gsasl_msgbuf_add (buf, &c, 1);
+}
+
+/* Add N in BASE 10 or 16, with leading zeros to at least WIDTH
+   digits. */
+static inline void
+_gsasl_msgbuf_number (struct _gsasl_msgbuf *buf, unsigned long n,
+		      unsigned base, size_t width)
+{
+  char digits[3 * sizeof (n) + 1];
+  char *p = digits + sizeof (digits);
+
+  do
+    {
+      *--p = "0123456789abcdef"[n % base];
+      n /= base;
+    }
+  while (p > digits
+	 && (n > 0 || (size_t) (digits + sizeof (digits) - p) < width));
+
+  _gsasl_msgbuf_add (buf, p, digits + sizeof (digits) - p);
+}
+
+/* Return the zero terminated message in BUF, and its length in *LEN
+   if LEN is not NULL, or NULL if memory could not be allocated. */
+static inline char *
+_gsasl_msgbuf_finish (struct _gsasl_msgbuf *buf, size_t * len)
+{
+  if (buf->failed || !buf->data)
+    {
+      free (buf->data);
+      return NULL;
+    }
+
+  buf->data[buf->len] = '\0';
+  if (len)
+    *len = buf->len;
+
+  return buf->data;
+}
+
+#endif /* MSGBUF_H */
@@ -0,0 +1,224 @@
+/* noncepool.c --- Per-thread pool of nonce bytes.
+ * Copyright (C) 2012 Simon Josefsson
+ *
+ * This file is part of GNU SASL Library.
+ *
+ * GNU SASL Library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; either version 2.1 of
+ * the License, or (at your option) any later version.
+ *
+ * GNU SASL Library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with GNU SASL Library; if not, write to the Free
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ *
+ */
+
+
+#include "internal.h"
+#include "noncepool.h"
+
+/* Get gc_nonce. */
+#include "gc.h"
+
+/* Get MIN. */
+#include "minmax.h"
+
+/* Number of bytes taken from the generator at once. */
+#define NONCE_POOL_SIZE 4096
+
+#if USE_POSIX_THREADS
+
+/* Get getpid. */
+#include <unistd.h>
+
+/* Servers need a few random bytes for every session they start.  Each
+   thread keeps a buffer of them so that the generator is called once
+   per NONCE_POOL_SIZE bytes, and needs no lock to take from it.  The
+   bytes are wiped as they are handed out.
+
+   The thread-specific key exists while any handle does, so that no
+   destructor of this library is left behind when the application
+   calls gsasl_done and unloads it.  All pools are kept on a list, to
+   be freed along with the key.  A pool is only used by the process
+   that filled it, so that a forked child does not hand out the bytes
+   its parent will use. */
+struct nonce_pool
+{
+  struct nonce_pool *next, **prev;
+  pid_t pid;
+  size_t used;
+  char buf[NONCE_POOL_SIZE];
+};
+
+static pthread_mutex_t pool_lock = PTHREAD_MUTEX_INITIALIZER;
+static size_t pool_users;
+static pthread_key_t pool_key;
+static int pool_ok;
+static struct nonce_pool *pools;
+
+/* Unlink and free POOL.  Called with pool_lock held. */
+static void
+pool_discard (struct nonce_pool *pool)
+{
+  *pool->prev = pool->next;
+  if (pool->next)
+    pool->next->prev = pool->prev;
+  memset (pool->buf, 0, sizeof (pool->buf));
+  free (pool);
+}
+
+/* Destructor of a thread's pool.  The last gsasl_done may have freed
+   it already while the thread was exiting. */
+static void
+pool_free (void *p)
+{
+  struct nonce_pool *pool;
+
+  pthread_mutex_lock (&pool_lock);
+  for (pool = pools; pool; pool = pool->next)
+    if (pool == p)
+      {
+	pool_discard (pool);
+	break;
+      }
+  pthread_mutex_unlock (&pool_lock);
+}
+
+static struct nonce_pool *
+pool_get (void)
+{
+  struct nonce_pool *pool;
+
+  if (!pool_ok)
+    return NULL;
+
+  pool = pthread_getspecific (pool_key);
+  if (pool)
+    {
+      if (pool->pid != getpid ())
+	{
+	  memset (pool->buf, 0, sizeof (pool->buf));
+	  pool->used = NONCE_POOL_SIZE;
+	  pool->pid = getpid ();
+	}
+      return pool;
+    }
+
+  pool = malloc (sizeof (*pool));
+  if (!pool)
+    return NULL;
+  pool->pid = getpid ();
+  pool->used = NONCE_POOL_SIZE;
+
+  pthread_mutex_lock (&pool_lock);
+  pool->next = pools;
+  pool->prev = &pools;
+  if (pools)
+    pools->prev = &pool->next;
+  pools = pool;
+  if (pthread_setspecific (pool_key, pool) != 0)
+    {
+      pool_discard (pool);
+      pool = NULL;
+    }
+  pthread_mutex_unlock (&pool_lock);
+
+  return pool;
+}
+
+#endif
+
+/* Create the thread-specific key for the first handle. */
+void
+_gsasl_nonce_pool_ref (void)
+{
+#if USE_POSIX_THREADS
+  pthread_mutex_lock (&pool_lock);
+  if (pool_users++ == 0)
+    pool_ok = pthread_key_create (&pool_key, pool_free) == 0;
+  pthread_mutex_unlock (&pool_lock);
+#endif
+}
+
+/* Delete the key and free the pools of all threads with the last
+   handle. */
+void
+_gsasl_nonce_pool_unref (void)
+{
+#if USE_POSIX_THREADS
+  pthread_mutex_lock (&pool_lock);
+  if (--pool_users == 0 && pool_ok)
+    {
+      pthread_key_delete (pool_key);
+      pool_ok = 0;
+      while (pools)
+	pool_discard (pools);
+    }
+  pthread_mutex_unlock (&pool_lock);
+#endif
+}
+
+/* Store DATALEN unpredictable bytes in DATA, like gsasl_nonce, for a
+   mechanism of SCTX.  They come from the pool of the calling thread
+   unless the application disabled it. */
+int
+_gsasl_session_nonce (Gsasl_session * sctx, char *data, size_t datalen)
+{
+#if USE_POSIX_THREADS
+  struct nonce_pool *pool;
+  size_t n;
+
+  if (!sctx->ctx->nonce_pool || datalen > NONCE_POOL_SIZE
+      || !(pool = pool_get ()))
+    return gsasl_nonce (data, datalen);
+
+  while (datalen > 0)
+    {
+      if (pool->used == NONCE_POOL_SIZE)
+	{
+	  if (gc_nonce (pool->buf, NONCE_POOL_SIZE) != GC_OK)
+	    return GSASL_CRYPTO_ERROR;
+	  pool->used = 0;
+	}
+
+      n = MIN (datalen, NONCE_POOL_SIZE - pool->used);
+      memcpy (data, pool->buf + pool->used, n);
+      memset (pool->buf + pool->used, 0, n);
+      pool->used += n;
+      data += n;
+      datalen -= n;
+    }
+
+  return GSASL_OK;
+#else
+  return gsasl_nonce (data, datalen);
+#endif
+}
+
+/**
+ * gsasl_nonce_pool_set:
+ * @ctx: libgsasl handle.
+ * @enable: whether mechanisms take nonces from a pool.
+ *
+ * Control where the DIGEST-MD5, CRAM-MD5 and SCRAM servers get the
+ * random bytes for their nonces and default salts.  By default each
+ * thread keeps a pool of such bytes that is filled from the random
+ * generator 4096 bytes at a time, which makes starting
+ * sessions cheaper.  When disabled, every session calls the generator
+ * directly, as gsasl_nonce() does.  Builds without POSIX threads
+ * always call it directly.
+ *
+ * Since: 1.8.1
+ **/
+void
+gsasl_nonce_pool_set (Gsasl * ctx, int enable)
+{
+  ctx->nonce_pool = enable;
+}
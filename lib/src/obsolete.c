@@ -1988,7 +1988,8 @@ pmap (Gsasl_session * sctx, Gsasl_property prop, char *buf, size_t buflen)
 	  = gsasl_client_callback_pin_get (sctx->ctx);
 	if (!cb_pin)
 	  break;
-	res = cb_pin (sctx, sctx->suggestedpin, buf, &buflen);
+	res = cb_pin (sctx, sctx->property[GSASL_SUGGESTED_PIN],
+		      buf, &buflen);
 	if (res != GSASL_OK)
 	  break;
 	buf[buflen] = '\0';
@@ -2019,7 +2020,8 @@ pmap (Gsasl_session * sctx, Gsasl_property prop, char *buf, size_t buflen)
 	Gsasl_qop qop;
 	if (!cb_qop)
 	  break;
-	serverqops = digest_md5_qopstr2qops (sctx->qops);
+	serverqops =
+	  digest_md5_qopstr2qops (sctx->property[GSASL_QOPS]);
 	if (serverqops == -1)
 	  return NULL;
 	qop = cb_qop (sctx, serverqops);
@@ -2067,12 +2069,12 @@ _gsasl_obsolete_callback (Gsasl * ctx, Gsasl_session * sctx,
     case GSASL_VALIDATE_ANONYMOUS:
       {
 	Gsasl_server_callback_anonymous cb_anonymous;
-	if (!sctx->anonymous_token)
+	if (!sctx->property[GSASL_ANONYMOUS_TOKEN])
 	  break;
 	cb_anonymous = gsasl_server_callback_anonymous_get (sctx->ctx);
 	if (!cb_anonymous)
 	  break;
-	res = cb_anonymous (sctx, sctx->anonymous_token);
+	res = cb_anonymous (sctx, sctx->property[GSASL_ANONYMOUS_TOKEN]);
 	return res;
 	break;
       }
@@ -2097,8 +2099,10 @@ _gsasl_obsolete_callback (Gsasl * ctx, Gsasl_session * sctx,
 	size_t buflen = MAX_SECURID;
 	if (!cb_securid)
 	  break;
-	res = cb_securid (sctx, sctx->authid, sctx->authzid, sctx->passcode,
-			  sctx->pin, buf, &buflen);
+	res = cb_securid (sctx, sctx->property[GSASL_AUTHID],
+			  sctx->property[GSASL_AUTHZID],
+			  sctx->property[GSASL_PASSCODE],
+			  sctx->property[GSASL_PIN], buf, &buflen);
 	if (buflen > 0 && buflen < MAX_SECURID)
 	  {
 	    buf[buflen] = '\0';
@@ -2114,7 +2118,8 @@ _gsasl_obsolete_callback (Gsasl * ctx, Gsasl_session * sctx,
 	  = gsasl_server_callback_gssapi_get (sctx->ctx);
 	if (!cb_gssapi)
 	  break;
-	res = cb_gssapi (sctx, sctx->gssapi_display_name, sctx->authzid);
+	res = cb_gssapi (sctx, sctx->property[GSASL_GSSAPI_DISPLAY_NAME],
+			 sctx->property[GSASL_AUTHZID]);
 	return res;
 	break;
       }
@@ -2125,7 +2130,9 @@ _gsasl_obsolete_callback (Gsasl * ctx, Gsasl_session * sctx,
 	  = gsasl_server_callback_validate_get (sctx->ctx);
 	if (!cb_validate)
 	  break;
-	res = cb_validate (sctx, sctx->authzid, sctx->authid, sctx->password);
+	res = cb_validate (sctx, sctx->property[GSASL_AUTHZID],
+			   sctx->property[GSASL_AUTHID],
+			   sctx->property[GSASL_PASSWORD]);
 	return res;
 	break;
       }
@@ -2141,8 +2148,9 @@ _gsasl_obsolete_callback (Gsasl * ctx, Gsasl_session * sctx,
 	buf = malloc (BUFSIZ);
 	if (!buf)
 	  return GSASL_MALLOC_ERROR;
-	res = cb_retrieve (sctx, sctx->authid, sctx->authzid,
-			   sctx->hostname, buf, &buflen);
+	res = cb_retrieve (sctx, sctx->property[GSASL_AUTHID],
+			   sctx->property[GSASL_AUTHZID],
+			   sctx->property[GSASL_HOSTNAME], buf, &buflen);
 	if (res == GSASL_OK)
 	  gsasl_property_set_raw (sctx, GSASL_PASSWORD, buf, buflen);
 	/* FIXME else if (res == GSASL_TOO_SMALL_BUFFER)... */
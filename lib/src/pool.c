@@ -0,0 +1,133 @@
+/* pool.c --- Reuse of finished session handles.
+ * Copyright (C) 2012 Simon Josefsson
+ *
+ * This file is part of GNU SASL Library.
+ *
+ * GNU SASL Library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; either version 2.1 of
+ * the License, or (at your option) any later version.
+ *
+ * GNU SASL Library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with GNU SASL Library; if not, write to the Free
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ *
+ */
+
+#include "internal.h"
+
+/* Get offsetof. */
+#include <stddef.h>
+
+/* Return a cleared session handle for CTX, taken from the pool if
+   possible.  The property arena of pooled handles is already wiped
+   by _gsasl_property_clear. */
+Gsasl_session *
+_gsasl_session_alloc (Gsasl * ctx)
+{
+  Gsasl_session *sctx = NULL;
+
+  _gsasl_lock (&ctx->pool_lock);
+  sctx = ctx->pool;
+  if (sctx)
+    {
+      ctx->pool = sctx->pool_next;
+      ctx->pool_count--;
+    }
+  _gsasl_unlock (&ctx->pool_lock);
+
+  if (sctx)
+    memset (sctx, 0, offsetof (Gsasl_session, prop_arena));
+  else
+    sctx = calloc (1, sizeof (*sctx));
+
+  if (sctx)
+    sctx->ctx = ctx;
+
+  return sctx;
+}
+
+/* Give a cleared session handle back to its context pool, or free it
+   when the pool is full or disabled. */
+void
+_gsasl_session_release (Gsasl_session * sctx)
+{
+  Gsasl *ctx = sctx->ctx;
+
+  if (ctx)
+    {
+      _gsasl_lock (&ctx->pool_lock);
+      if (ctx->pool_count < ctx->pool_max)
+	{
+	  sctx->pool_next = ctx->pool;
+	  ctx->pool = sctx;
+	  ctx->pool_count++;
+	  sctx = NULL;
+	}
+      _gsasl_unlock (&ctx->pool_lock);
+    }
+
+  free (sctx);
+}
+
+/* Free all pooled session handles of CTX. */
+void
+_gsasl_session_pool_free (Gsasl * ctx)
+{
+  Gsasl_session *sctx, *next;
+
+  for (sctx = ctx->pool; sctx; sctx = next)
+    {
+      next = sctx->pool_next;
+      free (sctx);
+    }
+
+  ctx->pool = NULL;
+  ctx->pool_count = 0;
+}
+
+/**
+ * gsasl_session_pool_set:
+ * @ctx: libgsasl handle.
+ * @max_sessions: maximum number of finished session handles to keep,
+ *   or 0 to disable pooling.
+ *
+ * Keep up to @max_sessions handles released by gsasl_finish() in a
+ * pool, and let gsasl_client_start() and gsasl_server_start() reuse
+ * them instead of allocating new ones.  This helps servers that start
+ * many short sessions.  Pooling is disabled by default.  Lowering the
+ * limit frees handles above it.
+ *
+ * When pooling is enabled, all sessions must be finished before
+ * gsasl_done() is called on @ctx.
+ *
+ * Return value: Returns %GSASL_OK.
+ *
+ * Since: 1.8.1
+ **/
+int
+gsasl_session_pool_set (Gsasl * ctx, size_t max_sessions)
+{
+  Gsasl_session *sctx;
+
+  _gsasl_lock (&ctx->pool_lock);
+
+  ctx->pool_max = max_sessions;
+  while (ctx->pool_count > max_sessions)
+    {
+      sctx = ctx->pool;
+      ctx->pool = sctx->pool_next;
+      ctx->pool_count--;
+      free (sctx);
+    }
+
+  _gsasl_unlock (&ctx->pool_lock);
+
+  return GSASL_OK;
+}
@@ -21,114 +21,170 @@
  */
 
 #include "internal.h"
+#include "prefetch.h"
 
-static char **
-map (Gsasl_session * sctx, Gsasl_property prop)
-{
-  char **p = NULL;
-
-  if (!sctx)
-    return NULL;
-
-  switch (prop)
-    {
-    case GSASL_ANONYMOUS_TOKEN:
-      p = &sctx->anonymous_token;
-      break;
-
-    case GSASL_SERVICE:
-      p = &sctx->service;
-      break;
-
-    case GSASL_HOSTNAME:
-      p = &sctx->hostname;
-      break;
-
-    case GSASL_AUTHID:
-      p = &sctx->authid;
-      break;
-
-    case GSASL_AUTHZID:
-      p = &sctx->authzid;
-      break;
-
-    case GSASL_PASSWORD:
-      p = &sctx->password;
-      break;
-
-    case GSASL_PASSCODE:
-      p = &sctx->passcode;
-      break;
-
-    case GSASL_PIN:
-      p = &sctx->pin;
-      break;
+/* Get CHAR_BIT. */
+#include <limits.h>
 
-    case GSASL_SUGGESTED_PIN:
-      p = &sctx->suggestedpin;
-      break;
+/* Get bool. */
+#include <stdbool.h>
 
-    case GSASL_GSSAPI_DISPLAY_NAME:
-      p = &sctx->gssapi_display_name;
-      break;
+/* Get verify. */
+#include "verify.h"
 
-    case GSASL_REALM:
-      p = &sctx->realm;
-      break;
+verify (GSASL_MAX_PROPERTY < CHAR_BIT * sizeof (unsigned long));
 
-    case GSASL_DIGEST_MD5_HASHED_PASSWORD:
-      p = &sctx->digest_md5_hashed_password;
-      break;
-
-    case GSASL_QOPS:
-      p = &sctx->qops;
-      break;
+static char **
+map (Gsasl_session * sctx, Gsasl_property prop)
+{
+  if (!sctx || prop < GSASL_AUTHID || prop > GSASL_MAX_PROPERTY)
+    return NULL;
 
-    case GSASL_QOP:
-      p = &sctx->qop;
-      break;
+  return &sctx->property[prop];
+}
 
-    case GSASL_SCRAM_ITER:
-      p = &sctx->scram_iter;
-      break;
+/* Return storage for a LEN + 1 byte value of property PROP, whose
+   current value is OLD.  Sets *HEAP when the storage was malloc'ed.
+   The storage may overlap OLD. */
+static char *
+property_alloc (Gsasl_session * sctx, Gsasl_property prop,
+		char *old, size_t len, bool * heap)
+{
+  size_t avail;
 
-    case GSASL_SCRAM_SALT:
-      p = &sctx->scram_salt;
-      break;
+  *heap = false;
 
-    case GSASL_SCRAM_SALTED_PASSWORD:
-      p = &sctx->scram_salted_password;
-      break;
+  if (old && !(sctx->prop_heap & (1UL << prop)))
+    {
+      size_t oldlen = strlen (old);
 
-    case GSASL_CB_TLS_UNIQUE:
-      p = &sctx->cb_tls_unique;
-      break;
+      /* Overwrite in place if the new value fits. */
+      if (len <= oldlen)
+	return old;
 
-    case GSASL_SAML20_IDP_IDENTIFIER:
-      p = &sctx->saml20_idp_identifier;
-      break;
+      /* Give back the space if OLD was the last value added. */
+      if (old + oldlen + 1 == sctx->prop_arena + sctx->prop_arena_used)
+	sctx->prop_arena_used -= oldlen + 1;
+    }
 
-    case GSASL_SAML20_REDIRECT_URL:
-      p = &sctx->saml20_redirect_url;
-      break;
+  avail = sizeof (sctx->prop_arena) - sctx->prop_arena_used;
+  if (len < avail)
+    {
+      char *p = sctx->prop_arena + sctx->prop_arena_used;
+      sctx->prop_arena_used += len + 1;
+      return p;
+    }
 
-    case GSASL_OPENID20_REDIRECT_URL:
-      p = &sctx->openid20_redirect_url;
-      break;
+  *heap = true;
+  return malloc (len + 1);
+}
 
-    case GSASL_OPENID20_OUTCOME_DATA:
-      p = &sctx->openid20_outcome_data;
-      break;
+/* Forget all property values, making the whole arena available. */
+void
+_gsasl_property_clear (Gsasl_session * sctx)
+{
+  size_t i;
+
+  for (i = 0; i <= GSASL_MAX_PROPERTY; i++)
+    if (sctx->prop_heap & (1UL << i))
+      free (sctx->property[i]);
+
+  /* Values may be passwords, do not leave them around. */
+  memset (sctx->prop_arena, 0, sctx->prop_arena_used);
+  memset (sctx->property, 0, sizeof (sctx->property));
+  sctx->prop_heap = 0;
+  sctx->prop_prefetched = 0;
+  sctx->prop_arena_used = 0;
+}
 
-      /* If you add anything here, remember to change change
-         gsasl_finish() in xfinish.c and Gsasl_session in
-         internal.h.  */
+/* Offer the properties in PROPS that have no value yet to the
+   application in one GSASL_PREFETCH callback, and return its result.
+   When it succeeds, the properties it left unset are not asked for
+   again by gsasl_property_get. */
+int
+_gsasl_property_prefetch (Gsasl_session * sctx,
+			  const Gsasl_property * props, size_t n)
+{
+  Gsasl_property want[GSASL_MAX_PROPERTY + 1];
+  unsigned long bits = 0;
+  size_t i, n_want = 0;
+  int res;
+
+  if (!sctx->ctx->prefetch)
+    return GSASL_NO_CALLBACK;
+
+  for (i = 0; i < n; i++)
+    if (map (sctx, props[i]) && !gsasl_property_fast (sctx, props[i])
+	&& !(bits & (1UL << props[i])))
+      {
+	want[n_want++] = props[i];
+	bits |= 1UL << props[i];
+      }
+
+  if (n_want == 0)
+    return GSASL_OK;
+
+  sctx->prefetch = want;
+  sctx->n_prefetch = n_want;
+  res = gsasl_callback (NULL, sctx, GSASL_PREFETCH);
+  sctx->prefetch = NULL;
+  sctx->n_prefetch = 0;
+
+  if (res == GSASL_OK)
+    sctx->prop_prefetched |= bits;
+
+  return res;
+}
 
-    default:
-      break;
-    }
+/**
+ * gsasl_prefetch_set:
+ * @ctx: libgsasl handle.
+ * @enable: whether to make %GSASL_PREFETCH callbacks.
+ *
+ * Let server mechanisms announce the properties they need with a
+ * %GSASL_PREFETCH callback, see gsasl_prefetch_properties().  This is
+ * disabled by default, since callbacks written before it existed may
+ * not expect the property.
+ *
+ * Since: 1.8.1
+ **/
+void
+gsasl_prefetch_set (Gsasl * ctx, int enable)
+{
+  ctx->prefetch = enable;
+}
 
-  return p;
+/**
+ * gsasl_prefetch_properties:
+ * @sctx: session handle.
+ * @n: output variable with number of properties.
+ *
+ * Return the properties a mechanism is about to ask for, during a
+ * %GSASL_PREFETCH callback enabled by gsasl_prefetch_set().  The
+ * callback can then set all of them with gsasl_property_set() after a
+ * single lookup in the user database, instead of answering one
+ * callback per property.  If the callback returns %GSASL_OK,
+ * properties of the list that it did not set are taken to be
+ * unavailable and are not asked for again in the authentication.
+ * Other return values are ignored, except %GSASL_CALLBACK_PENDING,
+ * see gsasl_step_resume().
+ *
+ * The server side of the SCRAM mechanisms makes one prefetch when the
+ * username is known, for the properties of both steps.  DIGEST-MD5
+ * makes one before sending the challenge and one when the username
+ * is known.
+ *
+ * Return value: Returns the array of properties, or NULL with *@n
+ *   set to 0 outside of a %GSASL_PREFETCH callback.  The array is
+ *   owned by the library and only valid during the callback.
+ *
+ * Since: 1.8.1
+ **/
+const Gsasl_property *
+gsasl_prefetch_properties (Gsasl_session * sctx, size_t * n)
+{
+  *n = sctx->n_prefetch;
+  return sctx->prefetch;
 }
 
 /**
@@ -177,22 +233,30 @@ gsasl_property_set_raw (Gsasl_session * sctx, Gsasl_property prop,
 			const char *data, size_t len)
 {
   char **p = map (sctx, prop);
+  char *value = NULL;
+  bool heap = false;
 
-  if (p)
+  if (!p)
+    return;
+
+  if (data)
     {
-      free (*p);
-      if (data)
+      value = property_alloc (sctx, prop, *p, len, &heap);
+      if (value)
 	{
-	  *p = malloc (len + 1);
-	  if (*p)
-	    {
-	      memcpy (*p, data, len);
-	      (*p)[len] = '\0';
-	    }
+	  memmove (value, data, len);
+	  value[len] = '\0';
 	}
-      else
-	*p = NULL;
     }
+
+  if (*p != value && (sctx->prop_heap & (1UL << prop)))
+    free (*p);
+
+  *p = value;
+  if (heap)
+    sctx->prop_heap |= 1UL << prop;
+  else
+    sctx->prop_heap &= ~(1UL << prop);
 }
 
 /**
@@ -239,6 +303,8 @@ gsasl_property_fast (Gsasl_session * sctx, Gsasl_property prop)
  *
  * This function will invoke the application callback, using
  * gsasl_callback(), when a property value is not known.
+ * Properties that a %GSASL_PREFETCH callback did not set are not
+ * asked for again, see gsasl_prefetch_properties().
  *
  * If no value is known, and no callback is specified or if the
  * callback fail to return data, and if any obsolete callback
@@ -256,7 +322,7 @@ gsasl_property_get (Gsasl_session * sctx, Gsasl_property prop)
 {
   const char *p = gsasl_property_fast (sctx, prop);
 
-  if (!p)
+  if (!p && !(map (sctx, prop) && (sctx->prop_prefetched & (1UL << prop))))
     {
       gsasl_callback (NULL, sctx, prop);
       p = gsasl_property_fast (sctx, prop);
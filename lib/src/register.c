@@ -22,6 +22,266 @@
 
 #include "internal.h"
 
+/* FNV-1a hash of the LEN bytes long mechanism NAME. */
+static size_t
+hash_name (const char *name, size_t len)
+{
+  size_t h = 2166136261U;
+
+  while (len--)
+    {
+      h ^= (unsigned char) *name++;
+      h *= 16777619U;
+    }
+
+  return h;
+}
+
+/* Return the index of the mechanism called NAME, of length LEN, in
+   the first N_MECHS entries of ENT, or N_MECHS if it is not there. */
+static size_t
+index_find (const struct _gsasl_mechindex *idx,
+	    struct _gsasl_mechent *const *ent, size_t n_mechs,
+	    const char *name, size_t len)
+{
+  size_t mask = idx->size - 1;
+  size_t h, i;
+
+  if (idx->size == 0)
+    return n_mechs;
+
+  for (h = hash_name (name, len) & mask; (i = idx->slot[h]) != 0;
+       h = (h + 1) & mask)
+    if (strncmp (ent[i - 1]->mech.name, name, len) == 0
+	&& ent[i - 1]->mech.name[len] == '\0')
+      return i - 1;
+
+  return n_mechs;
+}
+
+/* Add entry I of ENT to the index, unless an earlier mechanism has
+   the same name. */
+static void
+index_add (struct _gsasl_mechindex *idx, struct _gsasl_mechent *const *ent,
+	   size_t i)
+{
+  size_t mask = idx->size - 1;
+  const char *name = ent[i]->mech.name;
+  size_t len = strlen (name);
+  size_t h;
+
+  if (index_find (idx, ent, i, name, len) != i)
+    return;
+
+  for (h = hash_name (name, len) & mask; idx->slot[h] != 0;
+       h = (h + 1) & mask)
+    ;
+  idx->slot[h] = i + 1;
+}
+
+/* Return a new empty mechanism table, or NULL on allocation
+   failure. */
+struct _gsasl_mechtab *
+_gsasl_mechtab_new (void)
+{
+  return calloc (1, sizeof (struct _gsasl_mechtab));
+}
+
+/* Free TAB and the tables retired behind it, and when ENTRIES is
+   non-zero the mechanism entries too.  TAB may be NULL. */
+void
+_gsasl_mechtab_free (struct _gsasl_mechtab *tab, int entries)
+{
+  struct _gsasl_mechtab *next;
+  size_t i;
+
+  if (tab && entries)
+    for (i = 0; i < tab->n; i++)
+      free (tab->ent[i]);
+
+  for (; tab; tab = next)
+    {
+      next = tab->retired;
+      free (tab->ent);
+      free (tab->index.slot);
+      free (tab);
+    }
+}
+
+/* Return a copy of TAB with ENT appended, or NULL on allocation
+   failure.  The index is kept at most half full. */
+static struct _gsasl_mechtab *
+append (const struct _gsasl_mechtab *tab, struct _gsasl_mechent *ent)
+{
+  struct _gsasl_mechtab *new;
+  size_t n = tab->n;
+  size_t i;
+
+  new = _gsasl_mechtab_new ();
+  if (new == NULL)
+    return NULL;
+
+  new->index.size = tab->index.size;
+  while (2 * (n + 1) > new->index.size)
+    new->index.size = new->index.size ? 2 * new->index.size : 32;
+
+  new->ent = malloc (sizeof (*new->ent) * (n + 1));
+  new->index.slot = calloc (new->index.size, sizeof (*new->index.slot));
+  if (new->ent == NULL || new->index.slot == NULL)
+    {
+      _gsasl_mechtab_free (new, 0);
+      return NULL;
+    }
+
+  if (n > 0)
+    memcpy (new->ent, tab->ent, sizeof (*new->ent) * n);
+  new->ent[n] = ent;
+  new->n = n + 1;
+
+  if (new->index.size == tab->index.size)
+    {
+      memcpy (new->index.slot, tab->index.slot,
+	      sizeof (*new->index.slot) * tab->index.size);
+      index_add (&new->index, new->ent, n);
+    }
+  else
+    for (i = 0; i <= n; i++)
+      index_add (&new->index, new->ent, i);
+
+  return new;
+}
+
+/* Add MECH, with the extra functions EXT (or none if NULL), to the
+   table *TABP of CTX and publish the result.  Until the handle is
+   frozen nobody else reads the table and the old one is freed,
+   afterwards it stays around for threads that still use it. */
+static int
+add (Gsasl * ctx, struct _gsasl_mechtab **tabp,
+     const Gsasl_mechanism * mech, const struct _gsasl_mech_ext *ext)
+{
+  struct _gsasl_mechtab *old = *tabp, *new;
+  struct _gsasl_mechent *ent;
+
+  ent = calloc (1, sizeof (*ent));
+  if (ent == NULL)
+    return GSASL_MALLOC_ERROR;
+  ent->mech = *mech;
+  if (ext)
+    ent->ext = *ext;
+
+  new = append (old, ent);
+  if (new == NULL)
+    {
+      free (ent);
+      return GSASL_MALLOC_ERROR;
+    }
+
+  if (ctx->frozen)
+    new->retired = old;
+  else
+    {
+      new->retired = old->retired;
+      old->retired = NULL;
+    }
+
+  _gsasl_publish (tabp, new);
+
+  if (!ctx->frozen)
+    _gsasl_mechtab_free (old, 0);
+
+  return GSASL_OK;
+}
+
+/* Return the extra functions of the mechanism used by SCTX. */
+const struct _gsasl_mech_ext *
+_gsasl_session_ext (Gsasl_session * sctx)
+{
+  return sctx->ext;
+}
+
+/* Return the current client (if CLIENTP) or server mechanism table
+   of CTX.  It stays valid until gsasl_done. */
+const struct _gsasl_mechtab *
+_gsasl_mechtab (Gsasl * ctx, int clientp)
+{
+  if (clientp)
+    return _gsasl_acquire (&ctx->client_tab);
+  else
+    return _gsasl_acquire (&ctx->server_tab);
+}
+
+/* Return the index in TAB of the mechanism called NAME, of length
+   LEN, or the number of mechanisms if there is none. */
+size_t
+_gsasl_find_mechanism (const struct _gsasl_mechtab *tab, const char *name,
+		       size_t len)
+{
+  return index_find (&tab->index, tab->ent, tab->n, name, len);
+}
+
+/* Register MECH like gsasl_register, together with the extra
+   functions in CLIENT_EXT and SERVER_EXT, which may be NULL. */
+int
+_gsasl_register_ext (Gsasl * ctx, const Gsasl_mechanism * mech,
+		     const struct _gsasl_mech_ext *client_ext,
+		     const struct _gsasl_mech_ext *server_ext)
+{
+  int rc = GSASL_OK;
+
+  _gsasl_lock (&ctx->register_lock);
+
+#ifdef USE_CLIENT
+  if (mech->client.init == NULL || mech->client.init (ctx) == GSASL_OK)
+    rc = add (ctx, &ctx->client_tab, mech, client_ext);
+#endif
+
+#ifdef USE_SERVER
+  if (rc == GSASL_OK
+      && (mech->server.init == NULL || mech->server.init (ctx) == GSASL_OK))
+    rc = add (ctx, &ctx->server_tab, mech, server_ext);
+#endif
+
+  _gsasl_unlock (&ctx->register_lock);
+
+  _gsasl_mechlist_invalidate (ctx);
+
+  return rc;
+}
+
+/**
+ * gsasl_freeze:
+ * @ctx: libgsasl handle.
+ *
+ * Declare that the configuration of @ctx is complete, so that it can
+ * be shared by several threads.  Call this after gsasl_init(),
+ * gsasl_callback_set() and the other configuration functions, such
+ * as gsasl_scram_cache_set() and gsasl_session_pool_set(), and
+ * before other threads start to use @ctx.
+ *
+ * A frozen handle may be used by any number of threads at once to
+ * start sessions, list, suggest and look up mechanisms, without
+ * taking locks on the authentication path.  Each session must still
+ * be used by one thread at a time.  Mechanisms may be registered with
+ * gsasl_register() later on: the new mechanism table is published
+ * atomically and is seen by sessions started afterwards, while the
+ * replaced table is kept until gsasl_done() for threads still using
+ * it.  gsasl_callback_set() may likewise change the callback of a
+ * frozen handle, which takes effect for the next callback made.
+ *
+ * Until a handle is frozen, registering a mechanism frees the
+ * replaced table at once, so it must not be done while other threads
+ * use the handle.
+ *
+ * Since: 1.8.1
+ **/
+void
+gsasl_freeze (Gsasl * ctx)
+{
+  _gsasl_lock (&ctx->register_lock);
+  ctx->frozen = 1;
+  _gsasl_unlock (&ctx->register_lock);
+}
+
 /**
  * gsasl_register:
  * @ctx: pointer to libgsasl handle.
@@ -37,37 +297,5 @@
 int
 gsasl_register (Gsasl * ctx, const Gsasl_mechanism * mech)
 {
-  Gsasl_mechanism *tmp;
-
-#ifdef USE_CLIENT
-  if (mech->client.init == NULL || mech->client.init (ctx) == GSASL_OK)
-    {
-      tmp = realloc (ctx->client_mechs,
-		     sizeof (*ctx->client_mechs) * (ctx->n_client_mechs + 1));
-      if (tmp == NULL)
-	return GSASL_MALLOC_ERROR;
-
-      memcpy (&tmp[ctx->n_client_mechs], mech, sizeof (*mech));
-
-      ctx->client_mechs = tmp;
-      ctx->n_client_mechs++;
-    }
-#endif
-
-#ifdef USE_SERVER
-  if (mech->server.init == NULL || mech->server.init (ctx) == GSASL_OK)
-    {
-      tmp = realloc (ctx->server_mechs,
-		     sizeof (*ctx->server_mechs) * (ctx->n_server_mechs + 1));
-      if (tmp == NULL)
-	return GSASL_MALLOC_ERROR;
-
-      memcpy (&tmp[ctx->n_server_mechs], mech, sizeof (*mech));
-
-      ctx->server_mechs = tmp;
-      ctx->n_server_mechs++;
-    }
-#endif
-
-  return GSASL_OK;
+  return _gsasl_register_ext (ctx, mech, NULL, NULL);
 }
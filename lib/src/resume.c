@@ -0,0 +1,220 @@
+/* resume.c --- Suspend steps waiting for the application callback.
+ * Copyright (C) 2012 Simon Josefsson
+ *
+ * This file is part of GNU SASL Library.
+ *
+ * GNU SASL Library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; either version 2.1 of
+ * the License, or (at your option) any later version.
+ *
+ * GNU SASL Library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with GNU SASL Library; if not, write to the Free
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ *
+ */
+
+#include "internal.h"
+#include "resume.h"
+
+/* A step is suspended by running it to its end with the callback
+   that returned GSASL_CALLBACK_PENDING, and every later one, failing.
+   The mechanism discards what it did and the input is kept.
+   gsasl_step_resume then runs the step again on that input.  The
+   callbacks whose results were given to gsasl_step_resume are
+   answered from the session, and the others are asked again.
+   Mechanisms that allow this set the resumable flag of their extra
+   functions, and make sure that running a step again from the
+   beginning is the same as running it once. */
+
+/* Whether a callback made in the current step of SCTX is pending.
+   Mechanisms check this before changing state that would break
+   running the step again, and return GSASL_CALLBACK_PENDING. */
+bool
+_gsasl_callback_pending (Gsasl_session * sctx)
+{
+  return sctx->pending != 0;
+}
+
+/* Called by gsasl_callback before asking the application about PROP.
+   Returns true, with the answer in *RC, when its result was given to
+   gsasl_step_resume or another callback of the step is pending. */
+int
+_gsasl_callback_hold (Gsasl_session * sctx, Gsasl_property prop, int *rc)
+{
+  size_t i;
+
+  if (!sctx->stepping)
+    return 0;
+
+  for (i = 0; i < sctx->n_replay; i++)
+    if (sctx->replay[i].prop == prop)
+      {
+	if (sctx->replay[i].value)
+	  gsasl_property_set (sctx, prop, sctx->replay[i].value);
+	*rc = sctx->replay[i].rc;
+	return 1;
+      }
+
+  if (sctx->pending)
+    {
+      *rc = GSASL_CALLBACK_PENDING;
+      return 1;
+    }
+
+  return 0;
+}
+
+/* Called by gsasl_callback with the result RC of the application
+   callback for PROP, returns what to give to the mechanism.  A
+   pending result suspends the step if the mechanism allows it, and
+   is a missing callback otherwise. */
+int
+_gsasl_callback_result (Gsasl_session * sctx, Gsasl_property prop, int rc)
+{
+  if (rc != GSASL_CALLBACK_PENDING)
+    return rc;
+
+  if (!sctx || !sctx->stepping || !sctx->ext || !sctx->ext->resumable)
+    return GSASL_NO_CALLBACK;
+
+  sctx->pending = prop;
+
+  return rc;
+}
+
+/* Forget a suspended step of SCTX. */
+void
+_gsasl_step_resume_clear (Gsasl_session * sctx)
+{
+  size_t i;
+
+  for (i = 0; i < sctx->n_replay; i++)
+    free (sctx->replay[i].value);
+  free (sctx->replay);
+  sctx->replay = NULL;
+  sctx->n_replay = 0;
+
+  free (sctx->pending_input);
+  sctx->pending_input = NULL;
+  sctx->pending_input_len = 0;
+  sctx->pending = 0;
+}
+
+/* Run the mechanism step of SCTX like gsasl_step, suspending it when
+   a callback is pending. */
+int
+_gsasl_step_run (Gsasl_session * sctx,
+		 const char *input, size_t input_len,
+		 char **output, size_t * output_len)
+{
+  Gsasl_step_function step;
+  int res;
+
+  if (sctx->clientp)
+    step = sctx->mech->client.step;
+  else
+    step = sctx->mech->server.step;
+
+  sctx->stepping = 1;
+  res = step (sctx, sctx->mech_data, input, input_len, output, output_len);
+  sctx->stepping = 0;
+
+  if (!sctx->pending)
+    {
+      _gsasl_step_resume_clear (sctx);
+      return res;
+    }
+
+  if (res == GSASL_OK || res == GSASL_NEEDS_MORE)
+    free (*output);
+  *output = NULL;
+  *output_len = 0;
+
+  if (input != sctx->pending_input)
+    {
+      char *copy = malloc (input_len + 1);
+
+      if (!copy)
+	{
+	  _gsasl_step_resume_clear (sctx);
+	  return GSASL_MALLOC_ERROR;
+	}
+      if (input_len > 0)
+	memcpy (copy, input, input_len);
+      free (sctx->pending_input);
+      sctx->pending_input = copy;
+      sctx->pending_input_len = input_len;
+    }
+
+  return GSASL_CALLBACK_PENDING;
+}
+
+/**
+ * gsasl_step_resume:
+ * @sctx: libgsasl session handle.
+ * @result: result of the pending callback.
+ * @output: newly allocated output byte array.
+ * @output_len: pointer to output variable with size of output byte array.
+ *
+ * Complete a step that returned %GSASL_CALLBACK_PENDING, and return
+ * what gsasl_step() would have returned for it.
+ *
+ * The callback may return %GSASL_CALLBACK_PENDING when it cannot
+ * answer right away, for example because a password has to be looked
+ * up in a directory.  The step then returns %GSASL_CALLBACK_PENDING
+ * without output, and the thread can go on with other sessions.  When
+ * the answer is known, set the property with gsasl_property_set() if
+ * one was asked for, and call this function with what the callback
+ * would have returned as @result.  The step is then run again on the
+ * same input.  The callbacks completed through this function are not
+ * made again, but those answered right away are repeated.  The step
+ * may be suspended again by another callback.
+ *
+ * Only server steps of the PLAIN, LOGIN, CRAM-MD5, DIGEST-MD5,
+ * SCRAM-SHA-1 and SCRAM-SHA-1-PLUS mechanisms can be suspended.  For
+ * the others, and outside of steps, a callback returning
+ * %GSASL_CALLBACK_PENDING is treated like %GSASL_NO_CALLBACK.
+ *
+ * Return value: Returns %GSASL_OK if authenticated terminated
+ *   successfully, %GSASL_NEEDS_MORE if more data is needed,
+ *   %GSASL_CALLBACK_PENDING if the step is waiting for another
+ *   callback, %GSASL_MECHANISM_CALLED_TOO_MANY_TIMES if no step is
+ *   suspended, or error code.
+ *
+ * Since: 1.8.1
+ **/
+int
+gsasl_step_resume (Gsasl_session * sctx, int result,
+		   char **output, size_t * output_len)
+{
+  struct _gsasl_replay *replay;
+  const char *value;
+
+  if (!sctx->pending)
+    return GSASL_MECHANISM_CALLED_TOO_MANY_TIMES;
+
+  replay = realloc (sctx->replay, (sctx->n_replay + 1) * sizeof (*replay));
+  if (!replay)
+    return GSASL_MALLOC_ERROR;
+  sctx->replay = replay;
+  replay += sctx->n_replay;
+
+  value = gsasl_property_fast (sctx, sctx->pending);
+  replay->value = value ? strdup (value) : NULL;
+  if (value && !replay->value)
+    return GSASL_MALLOC_ERROR;
+  replay->prop = sctx->pending;
+  replay->rc = result;
+  sctx->n_replay++;
+  sctx->pending = 0;
+
+  return _gsasl_step_run (sctx, sctx->pending_input, sctx->pending_input_len,
+			  output, output_len);
+}
@@ -0,0 +1,409 @@
+/* scramcache.c --- Cache of derived SCRAM keys shared between sessions.
+ * Copyright (C) 2012 Simon Josefsson
+ *
+ * This file is part of GNU SASL Library.
+ *
+ * GNU SASL Library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; either version 2.1 of
+ * the License, or (at your option) any later version.
+ *
+ * GNU SASL Library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with GNU SASL Library; if not, write to the Free
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ *
+ */
+
+#include "internal.h"
+
+/* Get specification. */
+#include "scramcache.h"
+
+/* Get time. */
+#include <time.h>
+
+/* Get gc_hmac_sha1, gc_nonce. */
+#include "gc.h"
+
+/* Upper bound on the size of the hash table index. */
+#define MAX_BUCKETS (1 << 20)
+
+/* One cached set of keys.  Entries are hashed on (authid, salt,
+   iter) and kept in a doubly linked list ordered by last use, most
+   recently used first. */
+struct scram_cache_entry
+{
+  struct scram_cache_entry *hnext;
+  struct scram_cache_entry *prev;
+  struct scram_cache_entry *next;
+  size_t hash;
+  time_t expires;
+  size_t iter;
+  char fingerprint[GSASL_SCRAM_CACHE_KEYLEN];
+  char saltedpassword[GSASL_SCRAM_CACHE_KEYLEN];
+  char storedkey[GSASL_SCRAM_CACHE_KEYLEN];
+  char serverkey[GSASL_SCRAM_CACHE_KEYLEN];
+  /* Zero terminated authid followed by zero terminated salt. */
+  char *salt;
+  char authid[1];
+};
+
+struct _gsasl_scram_cache
+{
+  _gsasl_lock_t lock;
+  size_t max_entries;
+  size_t n_entries;
+  unsigned int ttl;
+  size_t n_buckets;
+  struct scram_cache_entry **buckets;
+  struct scram_cache_entry *head;
+  struct scram_cache_entry *tail;
+  /* Per-cache random key used when fingerprinting passwords. */
+  char secret[GSASL_SCRAM_CACHE_KEYLEN];
+  size_t hits;
+  size_t misses;
+};
+
+/* FNV-1a over the components of the lookup key. */
+static size_t
+hash_key (const char *authid, const char *salt, size_t iter)
+{
+  size_t h = 2166136261U;
+  const char *p;
+  size_t i;
+
+  for (p = authid; *p; p++)
+    h = (h ^ (unsigned char) *p) * 16777619U;
+  h = (h ^ 0) * 16777619U;
+  for (p = salt; *p; p++)
+    h = (h ^ (unsigned char) *p) * 16777619U;
+  for (i = 0; i < sizeof (iter); i++)
+    h = (h ^ ((iter >> (8 * i)) & 0xff)) * 16777619U;
+
+  return h;
+}
+
+/* The cache is keyed on public data only, so a fingerprint of the
+   password is stored with each entry to notice password changes.  It
+   is keyed with a secret that never leaves the process, so that it is
+   of no use as a password verifier if it leaks. */
+static int
+fingerprint (struct _gsasl_scram_cache *cache, const char *password,
+	     char *out)
+{
+  return gc_hmac_sha1 (cache->secret, sizeof (cache->secret),
+		       password, strlen (password), out);
+}
+
+static void
+lru_unlink (struct _gsasl_scram_cache *cache, struct scram_cache_entry *e)
+{
+  if (e->prev)
+    e->prev->next = e->next;
+  else
+    cache->head = e->next;
+  if (e->next)
+    e->next->prev = e->prev;
+  else
+    cache->tail = e->prev;
+  e->prev = e->next = NULL;
+}
+
+static void
+lru_push (struct _gsasl_scram_cache *cache, struct scram_cache_entry *e)
+{
+  e->prev = NULL;
+  e->next = cache->head;
+  if (cache->head)
+    cache->head->prev = e;
+  else
+    cache->tail = e;
+  cache->head = e;
+}
+
+static void
+remove_entry (struct _gsasl_scram_cache *cache, struct scram_cache_entry *e)
+{
+  struct scram_cache_entry **pp;
+
+  for (pp = &cache->buckets[e->hash & (cache->n_buckets - 1)];
+       *pp; pp = &(*pp)->hnext)
+    if (*pp == e)
+      {
+	*pp = e->hnext;
+	break;
+      }
+
+  lru_unlink (cache, e);
+  cache->n_entries--;
+
+  memset (e, 0, sizeof (*e));
+  free (e);
+}
+
+static struct scram_cache_entry *
+find_entry (struct _gsasl_scram_cache *cache, size_t hash,
+	    const char *authid, const char *salt, size_t iter)
+{
+  struct scram_cache_entry *e;
+
+  for (e = cache->buckets[hash & (cache->n_buckets - 1)]; e; e = e->hnext)
+    if (e->hash == hash && e->iter == iter
+	&& strcmp (e->authid, authid) == 0 && strcmp (e->salt, salt) == 0)
+      return e;
+
+  return NULL;
+}
+
+static bool
+expired_p (struct _gsasl_scram_cache *cache, struct scram_cache_entry *e)
+{
+  return cache->ttl > 0 && time (NULL) >= e->expires;
+}
+
+void
+_gsasl_scram_cache_free (struct _gsasl_scram_cache *cache)
+{
+  struct scram_cache_entry *e, *next;
+
+  if (cache == NULL)
+    return;
+
+  for (e = cache->head; e; e = next)
+    {
+      next = e->next;
+      memset (e, 0, sizeof (*e));
+      free (e);
+    }
+
+  _gsasl_lock_destroy (&cache->lock);
+  free (cache->buckets);
+  memset (cache, 0, sizeof (*cache));
+  free (cache);
+}
+
+/* Look for keys derived from PASSWORD for AUTHID, SALT (in base64
+   form as sent to the client) and ITER.  On a hit, copy the cached
+   SaltedPassword, StoredKey and ServerKey into the provided
+   GSASL_SCRAM_CACHE_KEYLEN sized buffers and return true.  Returns
+   false if the cache is disabled or holds no usable entry. */
+bool
+_gsasl_scram_cache_lookup (Gsasl_session * sctx,
+			   const char *authid, const char *salt,
+			   size_t iter, const char *password,
+			   char *saltedpassword,
+			   char *storedkey, char *serverkey)
+{
+  struct _gsasl_scram_cache *cache = sctx->ctx->scram_cache;
+  struct scram_cache_entry *e;
+  char fp[GSASL_SCRAM_CACHE_KEYLEN];
+  size_t hash;
+  bool found = false;
+
+  if (cache == NULL)
+    return false;
+
+  if (fingerprint (cache, password, fp) != GC_OK)
+    return false;
+
+  hash = hash_key (authid, salt, iter);
+
+  _gsasl_lock (&cache->lock);
+
+  e = find_entry (cache, hash, authid, salt, iter);
+  if (e && expired_p (cache, e))
+    {
+      remove_entry (cache, e);
+      e = NULL;
+    }
+
+  if (e && memcmp (e->fingerprint, fp, sizeof (fp)) == 0)
+    {
+      memcpy (saltedpassword, e->saltedpassword, GSASL_SCRAM_CACHE_KEYLEN);
+      memcpy (storedkey, e->storedkey, GSASL_SCRAM_CACHE_KEYLEN);
+      memcpy (serverkey, e->serverkey, GSASL_SCRAM_CACHE_KEYLEN);
+      lru_unlink (cache, e);
+      lru_push (cache, e);
+      cache->hits++;
+      found = true;
+    }
+  else
+    cache->misses++;
+
+  _gsasl_unlock (&cache->lock);
+
+  return found;
+}
+
+/* Remember keys derived from PASSWORD for AUTHID, SALT and ITER,
+   replacing any previous entry for the same key and evicting the
+   least recently used entry if the cache is full.  Failures are
+   silently ignored, the cache is only an optimization. */
+void
+_gsasl_scram_cache_store (Gsasl_session * sctx,
+			  const char *authid, const char *salt,
+			  size_t iter, const char *password,
+			  const char *saltedpassword,
+			  const char *storedkey, const char *serverkey)
+{
+  struct _gsasl_scram_cache *cache = sctx->ctx->scram_cache;
+  struct scram_cache_entry *e;
+  char fp[GSASL_SCRAM_CACHE_KEYLEN];
+  size_t hash;
+
+  if (cache == NULL)
+    return;
+
+  if (fingerprint (cache, password, fp) != GC_OK)
+    return;
+
+  hash = hash_key (authid, salt, iter);
+
+  _gsasl_lock (&cache->lock);
+
+  e = find_entry (cache, hash, authid, salt, iter);
+  if (e)
+    lru_unlink (cache, e);
+  else
+    {
+      size_t authidlen = strlen (authid);
+      size_t saltlen = strlen (salt);
+
+      e = calloc (1, sizeof (*e) + authidlen + 1 + saltlen);
+      if (e == NULL)
+	{
+	  _gsasl_unlock (&cache->lock);
+	  return;
+	}
+
+      e->hash = hash;
+      e->iter = iter;
+      memcpy (e->authid, authid, authidlen + 1);
+      e->salt = e->authid + authidlen + 1;
+      memcpy (e->salt, salt, saltlen + 1);
+
+      e->hnext = cache->buckets[hash & (cache->n_buckets - 1)];
+      cache->buckets[hash & (cache->n_buckets - 1)] = e;
+      cache->n_entries++;
+    }
+
+  memcpy (e->fingerprint, fp, sizeof (fp));
+  memcpy (e->saltedpassword, saltedpassword, GSASL_SCRAM_CACHE_KEYLEN);
+  memcpy (e->storedkey, storedkey, GSASL_SCRAM_CACHE_KEYLEN);
+  memcpy (e->serverkey, serverkey, GSASL_SCRAM_CACHE_KEYLEN);
+  if (cache->ttl > 0)
+    e->expires = time (NULL) + cache->ttl;
+  lru_push (cache, e);
+
+  while (cache->n_entries > cache->max_entries)
+    remove_entry (cache, cache->tail);
+
+  _gsasl_unlock (&cache->lock);
+}
+
+/**
+ * gsasl_scram_cache_set:
+ * @ctx: libgsasl handle.
+ * @max_entries: maximum number of users to remember, or 0 to disable.
+ * @ttl: number of seconds an entry remains valid, or 0 for no limit.
+ *
+ * Enable, resize or disable the SCRAM server key cache of @ctx.  The
+ * SCRAM-SHA-1 server derives SaltedPassword from %GSASL_PASSWORD
+ * using PBKDF2 on every authentication, which is expensive for the
+ * usual iteration counts.  With the cache enabled, the derived
+ * SaltedPassword, StoredKey and ServerKey are remembered per
+ * authentication identity, salt and iteration count, and subsequent
+ * authentications with the same password skip the key derivation.
+ * When more than @max_entries users are cached, the least recently
+ * used entry is discarded.
+ *
+ * The cache is disabled by default.  Any previously cached keys and
+ * statistics are discarded by this function, and it must not be
+ * called while sessions using @ctx are active.
+ *
+ * Return value: Returns %GSASL_OK iff successful, or an error code.
+ *
+ * Since: 1.8.1
+ **/
+int
+gsasl_scram_cache_set (Gsasl * ctx, size_t max_entries, unsigned int ttl)
+{
+  struct _gsasl_scram_cache *cache;
+  size_t n_buckets = 16;
+  int rc;
+
+  _gsasl_scram_cache_free (ctx->scram_cache);
+  ctx->scram_cache = NULL;
+
+  if (max_entries == 0)
+    return GSASL_OK;
+
+  while (n_buckets < max_entries && n_buckets < MAX_BUCKETS)
+    n_buckets <<= 1;
+
+  cache = calloc (1, sizeof (*cache));
+  if (cache == NULL)
+    return GSASL_MALLOC_ERROR;
+
+  cache->buckets = calloc (n_buckets, sizeof (*cache->buckets));
+  if (cache->buckets == NULL)
+    {
+      free (cache);
+      return GSASL_MALLOC_ERROR;
+    }
+
+  rc = gc_nonce (cache->secret, sizeof (cache->secret));
+  if (rc != GC_OK)
+    {
+      free (cache->buckets);
+      free (cache);
+      return GSASL_CRYPTO_ERROR;
+    }
+
+  cache->n_buckets = n_buckets;
+  cache->max_entries = max_entries;
+  cache->ttl = ttl;
+  _gsasl_lock_init (&cache->lock);
+
+  ctx->scram_cache = cache;
+
+  return GSASL_OK;
+}
+
+/**
+ * gsasl_scram_cache_stats:
+ * @ctx: libgsasl handle.
+ * @hits: output variable with number of cache hits, or NULL.
+ * @misses: output variable with number of cache misses, or NULL.
+ *
+ * Retrieve usage counters for the SCRAM server key cache, see
+ * gsasl_scram_cache_set().  Both counters are zero when the cache is
+ * disabled.
+ *
+ * Since: 1.8.1
+ **/
+void
+gsasl_scram_cache_stats (Gsasl * ctx, size_t * hits, size_t * misses)
+{
+  struct _gsasl_scram_cache *cache = ctx->scram_cache;
+  size_t h = 0, m = 0;
+
+  if (cache)
+    {
+      _gsasl_lock (&cache->lock);
+      h = cache->hits;
+      m = cache->misses;
+      _gsasl_unlock (&cache->lock);
+    }
+
+  if (hits)
+    *hits = h;
+  if (misses)
+    *misses = m;
+}
@@ -0,0 +1,51 @@
+/* scramcache.h --- Cache of derived SCRAM keys shared between sessions.
+ * Copyright (C) 2012 Simon Josefsson
+ *
+ * This file is part of GNU SASL Library.
+ *
+ * GNU SASL Library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; either version 2.1 of
+ * the License, or (at your option) any later version.
+ *
+ * GNU SASL Library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with GNU SASL Library; if not, write to the Free
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ *
+ */
+
+#ifndef SCRAMCACHE_H
+#define SCRAMCACHE_H
+
+/* Get size_t. */
+#include <stddef.h>
+
+/* Get bool. */
+#include <stdbool.h>
+
+/* Get Gsasl_session. */
+#include <gsasl.h>
+
+/* Size of SaltedPassword, StoredKey and ServerKey. */
+#define GSASL_SCRAM_CACHE_KEYLEN 20
+
+extern bool _gsasl_scram_cache_lookup (Gsasl_session * sctx,
+				       const char *authid, const char *salt,
+				       size_t iter, const char *password,
+				       char *saltedpassword,
+				       char *storedkey, char *serverkey);
+
+extern void _gsasl_scram_cache_store (Gsasl_session * sctx,
+				      const char *authid, const char *salt,
+				      size_t iter, const char *password,
+				      const char *saltedpassword,
+				      const char *storedkey,
+				      const char *serverkey);
+
+#endif /* SCRAMCACHE_H */
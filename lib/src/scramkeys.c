@@ -0,0 +1,238 @@
+/* scramkeys.c --- Derivation of SCRAM-SHA-1 keys from passwords.
+ * Copyright (C) 2012 Simon Josefsson
+ *
+ * This file is part of GNU SASL Library.
+ *
+ * GNU SASL Library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; either version 2.1 of
+ * the License, or (at your option) any later version.
+ *
+ * GNU SASL Library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with GNU SASL Library; if not, write to the Free
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ *
+ */
+
+#include "internal.h"
+
+/* Get specification. */
+#include "scramkeys.h"
+
+/* Get sysconf. */
+#include <unistd.h>
+
+/* Get gc_pbkdf2_sha1, gc_hmac_sha1, gc_sha1. */
+#include "gc.h"
+
+/* Upper bound on the number of threads gsasl_scram_derive_batch
+   starts. */
+#define MAX_THREADS 256
+
+#define CLIENT_KEY "Client Key"
+#define SERVER_KEY "Server Key"
+
+/* Compute StoredKey and ServerKey from SALTEDPASSWORD.  All buffers
+   are 20 bytes. */
+int
+_gsasl_scram_keys_from_salted (const char *saltedpassword,
+			       char *storedkey, char *serverkey)
+{
+  char clientkey[20];
+  Gc_rc err;
+
+  /* ClientKey := HMAC(SaltedPassword, "Client Key") */
+  err = gc_hmac_sha1 (saltedpassword, 20,
+		      CLIENT_KEY, strlen (CLIENT_KEY), clientkey);
+  if (err != GC_OK)
+    return GSASL_CRYPTO_ERROR;
+
+  /* StoredKey := H(ClientKey) */
+  err = gc_sha1 (clientkey, 20, storedkey);
+  if (err != GC_OK)
+    return GSASL_CRYPTO_ERROR;
+
+  /* ServerKey := HMAC(SaltedPassword, "Server Key") */
+  err = gc_hmac_sha1 (saltedpassword, 20,
+		      SERVER_KEY, strlen (SERVER_KEY), serverkey);
+  if (err != GC_OK)
+    return GSASL_CRYPTO_ERROR;
+
+  return GSASL_OK;
+}
+
+/* Compute SaltedPassword, StoredKey and ServerKey from an already
+   SASLprep'ed PASSWORD.  Output buffers must hold 20 bytes each. */
+int
+_gsasl_scram_derive (const char *password,
+		     const char *salt, size_t saltlen,
+		     unsigned int iter,
+		     char *saltedpassword, char *storedkey, char *serverkey)
+{
+  Gc_rc err;
+
+  /* SaltedPassword := Hi(password, salt) */
+  err = gc_pbkdf2_sha1 (password, strlen (password), salt, saltlen,
+			iter, saltedpassword, 20);
+  if (err != GC_OK)
+    return GSASL_CRYPTO_ERROR;
+
+  return _gsasl_scram_keys_from_salted (saltedpassword,
+					storedkey, serverkey);
+}
+
+/**
+ * gsasl_scram_derive:
+ * @password: input zero terminated UTF-8 password.
+ * @salt: input character array with salt.
+ * @saltlen: length of @salt.
+ * @iter: iteration count, must be positive.
+ * @saltedpassword: output 20 byte buffer for SaltedPassword.
+ * @storedkey: output 20 byte buffer for StoredKey.
+ * @serverkey: output 20 byte buffer for ServerKey.
+ *
+ * Derive the SCRAM-SHA-1 keys for a password, as done by the
+ * SCRAM-SHA-1 server when the callback returns %GSASL_PASSWORD.  The
+ * password is prepared with SASLprep first.  The @salt is the raw
+ * salt, not its base64 encoding.
+ *
+ * Return value: Returns %GSASL_OK iff successful.
+ *
+ * Since: 1.8.1
+ **/
+int
+gsasl_scram_derive (const char *password,
+		    const char *salt, size_t saltlen,
+		    unsigned int iter,
+		    char *saltedpassword, char *storedkey, char *serverkey)
+{
+  char *preppasswd;
+  int rc;
+
+  rc = gsasl_saslprep (password, 0, &preppasswd, NULL);
+  if (rc != GSASL_OK)
+    return rc;
+
+  rc = _gsasl_scram_derive (preppasswd, salt, saltlen, iter,
+			    saltedpassword, storedkey, serverkey);
+
+  gsasl_free (preppasswd);
+
+  return rc;
+}
+
+struct derive_batch
+{
+  _gsasl_lock_t lock;
+  Gsasl_scram_keys *keys;
+  size_t nkeys;
+  size_t next;
+};
+
+/* Worker loop: claim the next unprocessed entry until none remain. */
+static void *
+derive_worker (void *arg)
+{
+  struct derive_batch *b = arg;
+  Gsasl_scram_keys *k;
+
+  for (;;)
+    {
+      _gsasl_lock (&b->lock);
+      k = b->next < b->nkeys ? &b->keys[b->next++] : NULL;
+      _gsasl_unlock (&b->lock);
+
+      if (k == NULL)
+	break;
+
+      k->rc = gsasl_scram_derive (k->password, k->salt, k->saltlen,
+				  k->iter, k->saltedpassword,
+				  k->storedkey, k->serverkey);
+    }
+
+  return NULL;
+}
+
+/**
+ * gsasl_scram_derive_batch:
+ * @keys: array of #Gsasl_scram_keys entries.
+ * @nkeys: number of entries in @keys.
+ * @nthreads: number of threads to use, or 0 to use one per CPU.
+ *
+ * Derive SCRAM-SHA-1 keys, see gsasl_scram_derive(), for many
+ * passwords at once.  The input fields of each entry are @password,
+ * @salt, @saltlen and @iter; on return @saltedpassword, @storedkey,
+ * @serverkey and @rc are filled in.  This is intended for
+ * provisioning or re-keying SCRAM verifiers of many accounts.
+ *
+ * When the library is built with thread support the entries are
+ * spread over @nthreads threads, including the calling thread,
+ * otherwise they are processed sequentially.
+ *
+ * Return value: Returns %GSASL_OK if keys were derived for every
+ *   entry, otherwise the error code of the first failed entry.
+ *
+ * Since: 1.8.1
+ **/
+int
+gsasl_scram_derive_batch (Gsasl_scram_keys * keys, size_t nkeys,
+			  unsigned int nthreads)
+{
+  struct derive_batch b;
+  size_t i;
+
+  b.keys = keys;
+  b.nkeys = nkeys;
+  b.next = 0;
+  _gsasl_lock_init (&b.lock);
+
+#if USE_POSIX_THREADS
+  {
+    pthread_t threads[MAX_THREADS];
+    size_t nstarted = 0;
+
+#ifdef _SC_NPROCESSORS_ONLN
+    if (nthreads == 0)
+      {
+	long n = sysconf (_SC_NPROCESSORS_ONLN);
+	nthreads = n > 0 ? n : 1;
+      }
+#endif
+    if (nthreads == 0)
+      nthreads = 1;
+    if (nthreads > MAX_THREADS)
+      nthreads = MAX_THREADS;
+    if (nthreads > nkeys)
+      nthreads = nkeys;
+
+    /* The calling thread is one of the workers.  A failure to start
+       a thread just leaves more work for the others. */
+    while (nstarted + 1 < nthreads
+	   && pthread_create (&threads[nstarted], NULL,
+			      derive_worker, &b) == 0)
+      nstarted++;
+
+    derive_worker (&b);
+
+    for (i = 0; i < nstarted; i++)
+      pthread_join (threads[i], NULL);
+  }
+#else
+  (void) nthreads;
+  derive_worker (&b);
+#endif
+
+  _gsasl_lock_destroy (&b.lock);
+
+  for (i = 0; i < nkeys; i++)
+    if (keys[i].rc != GSASL_OK)
+      return keys[i].rc;
+
+  return GSASL_OK;
+}
@@ -0,0 +1,38 @@
+/* scramkeys.h --- Derivation of SCRAM-SHA-1 keys from passwords.
+ * Copyright (C) 2012 Simon Josefsson
+ *
+ * This file is part of GNU SASL Library.
+ *
+ * GNU SASL Library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; either version 2.1 of
+ * the License, or (at your option) any later version.
+ *
+ * GNU SASL Library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with GNU SASL Library; if not, write to the Free
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ *
+ */
+
+#ifndef SCRAMKEYS_H
+#define SCRAMKEYS_H
+
+/* Get size_t. */
+#include <stddef.h>
+
+extern int _gsasl_scram_keys_from_salted (const char *saltedpassword,
+					  char *storedkey, char *serverkey);
+
+extern int _gsasl_scram_derive (const char *password,
+				const char *salt, size_t saltlen,
+				unsigned int iter,
+				char *saltedpassword,
+				char *storedkey, char *serverkey);
+
+#endif /* SCRAMKEYS_H */
@@ -0,0 +1,438 @@
+/* stream.c --- Framing of security layer messages on a byte stream.
+ * Copyright (C) 2012 Simon Josefsson
+ *
+ * This file is part of GNU SASL Library.
+ *
+ * GNU SASL Library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; either version 2.1 of
+ * the License, or (at your option) any later version.
+ *
+ * GNU SASL Library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with GNU SASL Library; if not, write to the Free
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ *
+ */
+
+#include "internal.h"
+
+/* Largest message accepted from a peer that did not say, the most a
+   SASL maxbuf can express. */
+#define STREAM_RECVMAX 0xFFFFFF
+
+/* Payload protected in one message when the mechanism does not say,
+   leaving room below the usual 64 KiB maxbuf for its framing. */
+#define STREAM_SENDMAX (65536 - 1024)
+
+/* Initial size of the receive ring. */
+#define STREAM_RING_SIZE 4096
+
+struct Gsasl_stream
+{
+  Gsasl_session *sctx;
+  /* Received data not yet decoded, LEN bytes starting at HEAD in a
+     ring of SIZE bytes, a power of two. */
+  char *ring;
+  size_t size;
+  size_t head;
+  size_t len;
+  /* Decoded messages that did not come out contiguous. */
+  char *in;
+  size_t insize;
+  /* Encoded messages. */
+  char *out;
+  size_t outsize;
+};
+
+/* Tell whether a security layer is in effect, and its limits. */
+static int
+stream_layer (Gsasl_stream * stream, size_t * sendmax, size_t * recvmax)
+{
+  Gsasl_session *sctx = stream->sctx;
+  const struct _gsasl_mech_ext *ext = _gsasl_session_ext (sctx);
+
+  *sendmax = STREAM_SENDMAX;
+  *recvmax = STREAM_RECVMAX;
+
+  if (ext->layer)
+    return ext->layer (sctx, sctx->mech_data, sendmax, recvmax);
+
+  if (sctx->clientp)
+    return sctx->mech->client.encode != NULL;
+  else
+    return sctx->mech->server.encode != NULL;
+}
+
+/* Make sure BUF, of *SIZE bytes, holds at least NEED bytes. */
+static int
+reserve (char **buf, size_t * size, size_t need)
+{
+  size_t n = *size ? *size : STREAM_RING_SIZE;
+  char *p;
+
+  if (need <= *size)
+    return GSASL_OK;
+
+  while (n < need)
+    {
+      if (n > (size_t) -1 / 2)
+	return GSASL_MALLOC_ERROR;
+      n *= 2;
+    }
+
+  p = realloc (*buf, n);
+  if (!p)
+    return GSASL_MALLOC_ERROR;
+
+  *buf = p;
+  *size = n;
+
+  return GSASL_OK;
+}
+
+/* Append the LEN bytes at DATA to the ring, growing it when full. */
+static int
+ring_push (Gsasl_stream * stream, const char *data, size_t len)
+{
+  size_t tail, n;
+
+  if (len == 0)
+    return GSASL_OK;
+
+  if (stream->len > (size_t) -1 - len)
+    return GSASL_MALLOC_ERROR;
+
+  if (stream->len + len > stream->size)
+    {
+      char *ring = NULL;
+      size_t size = 0;
+      int res;
+
+      res = reserve (&ring, &size, stream->len + len);
+      if (res != GSASL_OK)
+	return res;
+
+      /* Straighten the old contents out at the start. */
+      n = stream->size - stream->head;
+      if (n > stream->len)
+	n = stream->len;
+      if (n > 0)
+	memcpy (ring, stream->ring + stream->head, n);
+      if (stream->len > n)
+	memcpy (ring + n, stream->ring, stream->len - n);
+
+      free (stream->ring);
+      stream->ring = ring;
+      stream->size = size;
+      stream->head = 0;
+    }
+
+  tail = (stream->head + stream->len) & (stream->size - 1);
+  n = stream->size - tail;
+  if (n > len)
+    n = len;
+  memcpy (stream->ring + tail, data, n);
+  memcpy (stream->ring, data + n, len - n);
+  stream->len += len;
+
+  return GSASL_OK;
+}
+
+/* Describe the LEN buffered bytes at offset OFF with at most two
+   segments in IOV, return the number of segments. */
+static size_t
+ring_peek (Gsasl_stream * stream, size_t off, size_t len, Gsasl_iov * iov)
+{
+  size_t start = (stream->head + off) & (stream->size - 1);
+  size_t n = stream->size - start;
+
+  iov[0].base = stream->ring + start;
+  if (len <= n)
+    {
+      iov[0].len = len;
+      return 1;
+    }
+
+  iov[0].len = n;
+  iov[1].base = stream->ring;
+  iov[1].len = len - n;
+  return 2;
+}
+
+static void
+ring_consume (Gsasl_stream * stream, size_t len)
+{
+  stream->len -= len;
+  if (stream->len == 0)
+    stream->head = 0;
+  else
+    stream->head = (stream->head + len) & (stream->size - 1);
+}
+
+/**
+ * gsasl_stream_init:
+ * @sctx: libgsasl session handle.
+ * @stream: output pointer to a newly allocated stream handle.
+ *
+ * Create a handle that frames the messages of the security layer of
+ * @sctx on a byte stream, like a TCP connection.  Data read from the
+ * connection can be fed in chunks of any size to
+ * gsasl_stream_decode(), which reassembles and decodes the messages.
+ * Data to write is protected by gsasl_stream_encode(), which splits
+ * it into messages no larger than what the peer accepts.  When the
+ * mechanism of @sctx negotiated no security layer, both pass the data
+ * through unchanged.
+ *
+ * The stream keeps a pointer to @sctx, which must outlive it.
+ * Release it by calling gsasl_stream_done().
+ *
+ * Return value: Returns %GSASL_OK if successful, or
+ *   %GSASL_MALLOC_ERROR on memory allocation errors.
+ *
+ * Since: 1.8.1
+ **/
+int
+gsasl_stream_init (Gsasl_session * sctx, Gsasl_stream ** stream)
+{
+  *stream = calloc (1, sizeof (**stream));
+  if (!*stream)
+    return GSASL_MALLOC_ERROR;
+
+  (*stream)->sctx = sctx;
+
+  return GSASL_OK;
+}
+
+/**
+ * gsasl_stream_done:
+ * @stream: stream handle, or %NULL.
+ *
+ * Release the resources of @stream, allocated by
+ * gsasl_stream_init().  Any received data not yet decoded is lost.
+ *
+ * Since: 1.8.1
+ **/
+void
+gsasl_stream_done (Gsasl_stream * stream)
+{
+  if (!stream)
+    return;
+
+  free (stream->ring);
+  free (stream->in);
+  free (stream->out);
+  free (stream);
+}
+
+/**
+ * gsasl_stream_encode:
+ * @stream: stream handle.
+ * @input: data to send.
+ * @input_len: length of @input.
+ * @output: output pointer to the data to write to the connection.
+ * @output_len: output pointer to the length of @output.
+ *
+ * Protect @input with the security layer of the session of @stream.
+ * The data is split into as many messages as needed for none to
+ * exceed the maximum the peer negotiated, each with its 4 byte
+ * length, and the messages are placed back to back in @output.
+ *
+ * Without a security layer @output is @input.  Otherwise it points to
+ * memory owned by @stream that stays valid until the next call to
+ * gsasl_stream_encode() or gsasl_stream_done(), and that is reused so
+ * that no memory is allocated once it has grown large enough.
+ *
+ * Return value: Returns %GSASL_OK if encoding was successful,
+ *   otherwise an error code.
+ *
+ * Since: 1.8.1
+ **/
+int
+gsasl_stream_encode (Gsasl_stream * stream,
+		     const char *input, size_t input_len,
+		     const char **output, size_t * output_len)
+{
+  Gsasl_session *sctx = stream->sctx;
+  size_t sendmax, recvmax, prefix, outlen = 0;
+  Gsasl_iov in, out[3];
+  int res;
+
+  if (!stream_layer (stream, &sendmax, &recvmax))
+    {
+      *output = input;
+      *output_len = input_len;
+      return GSASL_OK;
+    }
+
+  prefix = _gsasl_session_ext (sctx)->prefixed ? 0 : 4;
+
+  while (input_len > 0)
+    {
+      size_t n = 3, total = 0, i;
+
+      in.base = input;
+      in.len = input_len < sendmax ? input_len : sendmax;
+
+      res = gsasl_encodev (sctx, &in, 1, out, &n);
+      if (res != GSASL_OK)
+	return res;
+
+      for (i = 0; i < n; i++)
+	total += out[i].len;
+      if (prefix && total > 0xFFFFFFFFUL)
+	return GSASL_INTEGRITY_ERROR;
+      if (outlen > (size_t) -1 - prefix - total)
+	return GSASL_MALLOC_ERROR;
+
+      res = reserve (&stream->out, &stream->outsize, outlen + prefix + total);
+      if (res != GSASL_OK)
+	return res;
+
+      if (prefix)
+	{
+	  stream->out[outlen++] = (total >> 24) & 0xFF;
+	  stream->out[outlen++] = (total >> 16) & 0xFF;
+	  stream->out[outlen++] = (total >> 8) & 0xFF;
+	  stream->out[outlen++] = total & 0xFF;
+	}
+      for (i = 0; i < n; i++)
+	if (out[i].len > 0)
+	  {
+	    memcpy (stream->out + outlen, out[i].base, out[i].len);
+	    outlen += out[i].len;
+	  }
+
+      input += in.len;
+      input_len -= in.len;
+    }
+
+  *output = stream->out;
+  *output_len = outlen;
+
+  return GSASL_OK;
+}
+
+/**
+ * gsasl_stream_decode:
+ * @stream: stream handle.
+ * @input: data read from the connection, or %NULL.
+ * @input_len: length of @input, may be 0.
+ * @output: output pointer to the decoded data.
+ * @output_len: output pointer to the length of @output.
+ *
+ * Append @input to the data received on @stream and decode the first
+ * complete message of the security layer, if any.  Since one read may
+ * bring several messages, call the function again with an empty
+ * @input after each %GSASL_OK until it returns %GSASL_NEEDS_MORE.
+ * Messages larger than the maximum negotiated for this side are
+ * rejected.
+ *
+ * Without a security layer the received data is passed through, with
+ * @output possibly pointing into @input.  Otherwise @output points to
+ * memory owned by @stream.  Either way it stays valid until the next
+ * call to gsasl_stream_decode() or gsasl_stream_done().
+ *
+ * Return value: Returns %GSASL_OK if a message was decoded,
+ *   %GSASL_NEEDS_MORE if more data has to be read first, otherwise an
+ *   error code.
+ *
+ * Since: 1.8.1
+ **/
+int
+gsasl_stream_decode (Gsasl_stream * stream,
+		     const char *input, size_t input_len,
+		     const char **output, size_t * output_len)
+{
+  Gsasl_session *sctx = stream->sctx;
+  size_t sendmax, recvmax, len, skip, n, i;
+  Gsasl_iov frame[2], out[4];
+  Gsasl_iov head[2];
+  char prefix[4];
+  int res;
+
+  *output = NULL;
+  *output_len = 0;
+
+  if (!stream_layer (stream, &sendmax, &recvmax))
+    {
+      if (stream->len == 0)
+	{
+	  if (input_len == 0)
+	    return GSASL_NEEDS_MORE;
+	  *output = input;
+	  *output_len = input_len;
+	  return GSASL_OK;
+	}
+
+      res = ring_push (stream, input, input_len);
+      if (res != GSASL_OK)
+	return res;
+
+      ring_peek (stream, 0, stream->len, frame);
+      *output = frame[0].base;
+      *output_len = frame[0].len;
+      ring_consume (stream, frame[0].len);
+      return GSASL_OK;
+    }
+
+  res = ring_push (stream, input, input_len);
+  if (res != GSASL_OK)
+    return res;
+
+  if (stream->len < 4)
+    return GSASL_NEEDS_MORE;
+
+  n = ring_peek (stream, 0, 4, head);
+  memcpy (prefix, head[0].base, head[0].len);
+  if (n > 1)
+    memcpy (prefix + head[0].len, head[1].base, head[1].len);
+  len = (prefix[0] & 0xFFUL) << 24 | (prefix[1] & 0xFFUL) << 16
+    | (prefix[2] & 0xFFUL) << 8 | (prefix[3] & 0xFFUL);
+
+  if (len > recvmax)
+    return GSASL_INTEGRITY_ERROR;
+  if (stream->len - 4 < len)
+    return GSASL_NEEDS_MORE;
+
+  /* Hand the mechanism the message the way it expects it. */
+  skip = _gsasl_session_ext (sctx)->prefixed ? 0 : 4;
+  n = ring_peek (stream, skip, 4 + len - skip, frame);
+
+  i = sizeof (out) / sizeof (out[0]);
+  res = gsasl_decodev (sctx, frame, n, out, &i);
+  ring_consume (stream, 4 + len);
+  if (res != GSASL_OK)
+    return res;
+
+  if (i == 1)
+    {
+      *output = out[0].base;
+      *output_len = out[0].len;
+      return GSASL_OK;
+    }
+
+  for (n = 0, len = 0; n < i; n++)
+    len += out[n].len;
+
+  res = reserve (&stream->in, &stream->insize, len);
+  if (res != GSASL_OK)
+    return res;
+
+  for (n = 0, len = 0; n < i; n++)
+    if (out[n].len > 0)
+      {
+	memcpy (stream->in + len, out[n].base, out[n].len);
+	len += out[n].len;
+      }
+
+  *output = stream->in;
+  *output_len = len;
+
+  return GSASL_OK;
+}
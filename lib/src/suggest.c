@@ -22,60 +22,129 @@
 
 #include "internal.h"
 
+/* Whether the client mechanism ENT can be used, judged by its
+   availability probe only.  SCTX is a scratch handle for the probe.
+   Mechanisms without a probe are assumed to be usable. */
+static int
+ready (Gsasl_session * sctx, struct _gsasl_mechent *ent)
+{
+  _gsasl_probe_function probe = ent->ext.probe;
+  Gsasl_mechanism *mech = &ent->mech;
+  int rc;
+
+  if (!mech->client.start && !mech->client.step)
+    return 0;
+  if (!probe || probe == _gsasl_probe_always)
+    return 1;
+
+  sctx->mech = mech;
+  sctx->ext = &ent->ext;
+  rc = probe (sctx);
+  sctx->mech = NULL;
+  sctx->ext = NULL;
+
+  return rc == GSASL_OK;
+}
+
 /**
- * gsasl_client_suggest_mechanism:
+ * gsasl_client_suggest_mechanisms:
  * @ctx: libgsasl handle.
  * @mechlist: input character array with SASL mechanism names,
  *   separated by invalid characters (e.g. SPC).
+ * @out: output array of mechanism names.
+ * @outlen: number of elements in @out.
  *
- * Given a list of mechanisms, suggest which to use.
+ * Given a list of mechanisms, store up to @outlen of those that the
+ * libgsasl client supports into @out, best first.  Each name occurs
+ * at most once.  The names point into @ctx and stay valid until it is
+ * destroyed.
  *
- * Return value: Returns name of "best" SASL mechanism supported by
- *   the libgsasl client which is present in the input string, or
- *   NULL if no supported mechanism is found.
+ * Mechanisms are ranked by the order they were registered in, which
+ * for the builtin mechanisms goes from low to high security.  A
+ * mechanism is left out when its availability check fails, for
+ * example SCRAM-SHA-1-PLUS when the callback does not provide
+ * %GSASL_CB_TLS_UNIQUE.  No session is started and no memory is
+ * allocated, unless the callback does so.
+ *
+ * Return value: Returns the number of names stored in @out.
+ *
+ * Since: 1.8.1
  **/
-const char *
-gsasl_client_suggest_mechanism (Gsasl * ctx, const char *mechlist)
+size_t
+gsasl_client_suggest_mechanisms (Gsasl * ctx, const char *mechlist,
+				 const char **out, size_t outlen)
 {
-  size_t mechlist_len, target_mech, i;
+  const struct _gsasl_mechtab *tab = _gsasl_mechtab (ctx, 1);
+  Gsasl_session sctx;
+  size_t n = 0, i, j, k, len, mechlist_len;
+  int probed = 0;
 
   mechlist_len = mechlist ? strlen (mechlist) : 0;
-  target_mech = ctx->n_client_mechs;	/* ~ no target */
 
-  for (i = 0; i < mechlist_len;)
+  for (i = 0; i < mechlist_len && outlen > 0; i += len + 1)
     {
-      size_t len;
-
       len = strspn (mechlist + i, GSASL_VALID_MECHANISM_CHARACTERS);
       if (!len)
-	++i;
-      else
+	continue;
+
+      j = _gsasl_find_mechanism (tab, mechlist + i, len);
+      if (j == tab->n)
+	continue;
+
+      /* Find the insertion point, ranking later registered
+	 mechanisms first, and skip duplicates. */
+      for (k = 0; k < n; k++)
+	{
+	  size_t r = _gsasl_find_mechanism (tab, out[k], strlen (out[k]));
+	  if (r <= j)
+	    break;
+	}
+      if ((k < n && out[k] == tab->ent[j]->mech.name) || k == outlen)
+	continue;
+
+      if (!probed)
 	{
-	  size_t j;
-
-	  /* Assumption: the mechs array is sorted by preference
-	   * from low security to high security. */
-	  for (j = (target_mech < ctx->n_client_mechs ? target_mech + 1 : 0);
-	       j < ctx->n_client_mechs; ++j)
-	    {
-	      if (strncmp (ctx->client_mechs[j].name, mechlist + i, len) == 0)
-		{
-		  Gsasl_session *sctx;
-
-		  if (gsasl_client_start (ctx, ctx->client_mechs[j].name,
-					  &sctx) == GSASL_OK)
-		    {
-		      gsasl_finish (sctx);
-		      target_mech = j;
-		    }
-
-		  break;
-		}
-	    }
-	  i += len + 1;
+	  memset (&sctx, 0, sizeof (sctx));
+	  sctx.ctx = ctx;
+	  sctx.clientp = 1;
+	  probed = 1;
 	}
+      if (!ready (&sctx, tab->ent[j]))
+	continue;
+
+      if (n == outlen)
+	n--;
+      memmove (&out[k + 1], &out[k], (n - k) * sizeof (*out));
+      out[k] = tab->ent[j]->mech.name;
+      n++;
     }
 
-  return target_mech < ctx->n_client_mechs ?
-    ctx->client_mechs[target_mech].name : NULL;
+  if (probed)
+    _gsasl_property_clear (&sctx);
+
+  return n;
+}
+
+/**
+ * gsasl_client_suggest_mechanism:
+ * @ctx: libgsasl handle.
+ * @mechlist: input character array with SASL mechanism names,
+ *   separated by invalid characters (e.g. SPC).
+ *
+ * Given a list of mechanisms, suggest which to use.  This is the
+ * first name gsasl_client_suggest_mechanisms() would return.
+ *
+ * Return value: Returns name of "best" SASL mechanism supported by
+ *   the libgsasl client which is present in the input string, or
+ *   NULL if no supported mechanism is found.
+ **/
+const char *
+gsasl_client_suggest_mechanism (Gsasl * ctx, const char *mechlist)
+{
+  const char *out;
+
+  if (gsasl_client_suggest_mechanisms (ctx, mechlist, &out, 1) == 0)
+    return NULL;
+
+  return out;
 }
@@ -23,15 +23,15 @@
 #include "internal.h"
 
 static int
-_gsasl_support_p (Gsasl_mechanism * mechs, size_t n_mechs, const char *name)
+_gsasl_support_p (Gsasl * ctx, int clientp, const char *name)
 {
-  size_t i;
+  const struct _gsasl_mechtab *tab;
 
-  for (i = 0; i < n_mechs; i++)
-    if (name && strcmp (name, mechs[i].name) == 0)
-      return 1;
+  if (name == NULL)
+    return 0;
 
-  return 0;
+  tab = _gsasl_mechtab (ctx, clientp);
+  return _gsasl_find_mechanism (tab, name, strlen (name)) < tab->n;
 }
 
 /**
@@ -48,7 +48,7 @@ _gsasl_support_p (Gsasl_mechanism * mechs, size_t n_mechs, const char *name)
 int
 gsasl_client_support_p (Gsasl * ctx, const char *name)
 {
-  return _gsasl_support_p (ctx->client_mechs, ctx->n_client_mechs, name);
+  return _gsasl_support_p (ctx, 1, name);
 }
 
 /**
@@ -65,5 +65,5 @@ gsasl_client_support_p (Gsasl * ctx, const char *name)
 int
 gsasl_server_support_p (Gsasl * ctx, const char *name)
 {
-  return _gsasl_support_p (ctx->server_mechs, ctx->n_server_mechs, name);
+  return _gsasl_support_p (ctx, 0, name);
 }
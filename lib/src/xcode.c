@@ -22,6 +22,116 @@
 
 #include "internal.h"
 
+static Gsasl_code_function
+code_function (Gsasl_session * sctx, int op)
+{
+  if (op == GSASL_OP_ENCODE)
+    return sctx->clientp ? sctx->mech->client.encode
+      : sctx->mech->server.encode;
+  else
+    return sctx->clientp ? sctx->mech->client.decode
+      : sctx->mech->server.decode;
+}
+
+static _gsasl_codev_function
+codev_function (Gsasl_session * sctx, int op)
+{
+  const struct _gsasl_mech_ext *ext = _gsasl_session_ext (sctx);
+
+  return op == GSASL_OP_ENCODE ? ext->encodev : ext->decodev;
+}
+
+static size_t
+iov_length (const Gsasl_iov * iov, size_t n)
+{
+  size_t len = 0;
+
+  while (n--)
+    len += iov++->len;
+
+  return len;
+}
+
+/* Copy the data in the N segments of IOV to OUT. */
+static void
+iov_gather (const Gsasl_iov * iov, size_t n, char *out)
+{
+  for (; n > 0; iov++, n--)
+    if (iov->len > 0)
+      {
+	memmove (out, iov->base, iov->len);
+	out += iov->len;
+      }
+}
+
+/* Perform OP, GSASL_OP_ENCODE or GSASL_OP_DECODE, on the INPUT_COUNT
+   segments in INPUT and describe the result in OUTPUT, of
+   *OUTPUT_COUNT segments.  Mechanisms without a scatter/gather
+   implementation see the gathered input, and their output is kept
+   in SCTX. */
+static int
+_gsasl_codev (Gsasl_session * sctx, int op,
+	      const Gsasl_iov * input, size_t input_count,
+	      Gsasl_iov * output, size_t * output_count)
+{
+  _gsasl_codev_function codev = codev_function (sctx, op);
+  Gsasl_code_function code = code_function (sctx, op);
+  char *tmp = NULL;
+  const char *in;
+  size_t inlen;
+  int rc;
+
+  if (*output_count < input_count + 2)
+    {
+      *output_count = input_count + 2;
+      return GSASL_NEEDS_LARGER_BUFFER;
+    }
+
+  free (sctx->kept);
+  sctx->kept = NULL;
+  sctx->kept_op = 0;
+
+  if (codev)
+    return codev (sctx, sctx->mech_data, input, input_count,
+		  output, output_count);
+
+  if (code == NULL)
+    {
+      memcpy (output, input, input_count * sizeof (*input));
+      *output_count = input_count;
+      return GSASL_OK;
+    }
+
+  if (input_count == 1)
+    {
+      in = input[0].base;
+      inlen = input[0].len;
+    }
+  else
+    {
+      inlen = iov_length (input, input_count);
+      tmp = malloc (inlen ? inlen : 1);
+      if (!tmp)
+	return GSASL_MALLOC_ERROR;
+      iov_gather (input, input_count, tmp);
+      in = tmp;
+    }
+
+  rc = code (sctx, sctx->mech_data, in, inlen, &sctx->kept, &sctx->kept_len);
+  free (tmp);
+  if (rc != GSASL_OK)
+    {
+      sctx->kept = NULL;
+      return rc;
+    }
+
+  output[0].base = sctx->kept;
+  output[0].len = sctx->kept_len;
+  *output_count = 1;
+
+  return GSASL_OK;
+}
+
 static int
 _gsasl_code (Gsasl_session * sctx,
 	     Gsasl_code_function code,
@@ -65,14 +175,8 @@ gsasl_encode (Gsasl_session * sctx,
 	      const char *input, size_t input_len,
 	      char **output, size_t * output_len)
 {
-  Gsasl_code_function code;
-
-  if (sctx->clientp)
-    code = sctx->mech->client.encode;
-  else
-    code = sctx->mech->server.encode;
-
-  return _gsasl_code (sctx, code, input, input_len, output, output_len);
+  return _gsasl_code (sctx, code_function (sctx, GSASL_OP_ENCODE),
+		      input, input_len, output, output_len);
 }
 
 /**
@@ -97,12 +201,345 @@ gsasl_decode (Gsasl_session * sctx,
 	      const char *input, size_t input_len,
 	      char **output, size_t * output_len)
 {
-  Gsasl_code_function code;
+  return _gsasl_code (sctx, code_function (sctx, GSASL_OP_DECODE),
+		      input, input_len, output, output_len);
+}
+
+/* Perform OP with a scatter/gather mechanism on INPUT and copy the
+   result to the caller buffer OUTPUT, or keep a copy in SCTX if it is
+   too small. */
+static int
+gather_op (Gsasl_session * sctx, int op,
+	   const char *input, size_t input_len,
+	   char *output, size_t * output_len)
+{
+  Gsasl_iov in, out[3];
+  size_t n = 3, len;
+  char *p;
+  int rc;
+
+  in.base = input;
+  in.len = input_len;
+
+  rc = _gsasl_codev (sctx, op, &in, 1, out, &n);
+  if (rc != GSASL_OK)
+    return rc;
+
+  len = iov_length (out, n);
+  if (len > *output_len)
+    {
+      p = malloc (len);
+      if (!p)
+	return GSASL_MALLOC_ERROR;
+      iov_gather (out, n, p);
+      free (sctx->kept);
+      sctx->kept = p;
+      sctx->kept_len = len;
+      sctx->kept_op = op;
+      sctx->kept_rc = GSASL_OK;
+      *output_len = len;
+      return GSASL_NEEDS_LARGER_BUFFER;
+    }
+
+  iov_gather (out, n, output);
+  *output_len = len;
+
+  return GSASL_OK;
+}
+
+/* Perform OP, one of the GSASL_OP_* values, on INPUT, and store the
+   output in the caller buffer OUTPUT of size *OUTPUT_LEN.  Output
+   that does not fit is kept in SCTX and handed out by the next call
+   with the same OP.  Data is moved without any allocation when there
+   is no security layer. */
+int
+_gsasl_buffer_op (Gsasl_session * sctx, int op,
+		  const char *input, size_t input_len,
+		  char *output, size_t * output_len)
+{
+  size_t avail = *output_len;
+  char *out = NULL;
+  size_t outlen = 0;
+  int rc;
 
-  if (sctx->clientp)
-    code = sctx->mech->client.decode;
+  if (sctx->kept_op == op)
+    {
+      out = sctx->kept;
+      outlen = sctx->kept_len;
+      rc = sctx->kept_rc;
+      sctx->kept = NULL;
+      sctx->kept_op = 0;
+    }
   else
-    code = sctx->mech->server.decode;
+    {
+      free (sctx->kept);
+      sctx->kept = NULL;
+      sctx->kept_op = 0;
+
+      if (op != GSASL_OP_STEP && code_function (sctx, op) == NULL)
+	{
+	  *output_len = input_len;
+	  if (input_len > avail)
+	    return GSASL_NEEDS_LARGER_BUFFER;
+	  if (output != input && input_len > 0)
+	    memmove (output, input, input_len);
+	  return GSASL_OK;
+	}
+
+      /* The framing of a scatter/gather mechanism is copied straight
+	 to the caller buffer, unless it overlaps the input. */
+      if (op != GSASL_OP_STEP && codev_function (sctx, op)
+	  && (output == NULL || output + avail <= input
+	      || input + input_len <= output))
+	return gather_op (sctx, op, input, input_len, output, output_len);
+
+      if (op == GSASL_OP_STEP)
+	rc = gsasl_step (sctx, input, input_len, &out, &outlen);
+      else
+	rc = _gsasl_code (sctx, code_function (sctx, op),
+			  input, input_len, &out, &outlen);
+      if (rc != GSASL_OK && (op != GSASL_OP_STEP || rc != GSASL_NEEDS_MORE))
+	return rc;
+    }
+
+  *output_len = outlen;
+  if (outlen > avail)
+    {
+      sctx->kept = out;
+      sctx->kept_len = outlen;
+      sctx->kept_op = op;
+      sctx->kept_rc = rc;
+      return GSASL_NEEDS_LARGER_BUFFER;
+    }
+
+  if (outlen > 0)
+    memcpy (output, out, outlen);
+  free (out);
 
-  return _gsasl_code (sctx, code, input, input_len, output, output_len);
+  return rc;
+}
+
+/**
+ * gsasl_encode_buffer:
+ * @sctx: libgsasl session handle.
+ * @input: input byte array.
+ * @input_len: size of input byte array.
+ * @output: output byte array supplied by the caller, or %NULL.
+ * @output_len: on input the size of @output, on output the size of
+ *   the encoded data.
+ *
+ * Encode data like gsasl_encode(), but store the result in a buffer
+ * supplied by the caller.  When no security layer is in effect the
+ * data is copied without any allocation, and @output may be the same
+ * as @input.
+ *
+ * If the result does not fit, %GSASL_NEEDS_LARGER_BUFFER is returned
+ * and @output_len is set to the required size.  The result is then
+ * kept in @sctx, and the next call to this function returns it,
+ * ignoring its @input.  Calling it with a %NULL @output and a zero
+ * @output_len is thus a way to query the size.
+ *
+ * Return value: Returns %GSASL_OK if encoding was successful,
+ *   %GSASL_NEEDS_LARGER_BUFFER if @output is too small, otherwise an
+ *   error code.
+ *
+ * Since: 1.8.1
+ **/
+int
+gsasl_encode_buffer (Gsasl_session * sctx,
+		     const char *input, size_t input_len,
+		     char *output, size_t * output_len)
+{
+  return _gsasl_buffer_op (sctx, GSASL_OP_ENCODE, input, input_len,
+			   output, output_len);
+}
+
+/**
+ * gsasl_decode_buffer:
+ * @sctx: libgsasl session handle.
+ * @input: input byte array.
+ * @input_len: size of input byte array.
+ * @output: output byte array supplied by the caller, or %NULL.
+ * @output_len: on input the size of @output, on output the size of
+ *   the decoded data.
+ *
+ * Decode data like gsasl_decode(), but store the result in a buffer
+ * supplied by the caller.  See gsasl_encode_buffer() for how a too
+ * small buffer is handled.
+ *
+ * Return value: Returns %GSASL_OK if decoding was successful,
+ *   %GSASL_NEEDS_LARGER_BUFFER if @output is too small, otherwise an
+ *   error code.
+ *
+ * Since: 1.8.1
+ **/
+int
+gsasl_decode_buffer (Gsasl_session * sctx,
+		     const char *input, size_t input_len,
+		     char *output, size_t * output_len)
+{
+  return _gsasl_buffer_op (sctx, GSASL_OP_DECODE, input, input_len,
+			   output, output_len);
+}
+
+static int
+_gsasl_code_ref (Gsasl_session * sctx, int op,
+		 const char *input, size_t input_len,
+		 const char **output, size_t * output_len)
+{
+  Gsasl_iov in, out[3];
+  size_t n = 3;
+  char *p;
+  int rc;
+
+  in.base = input;
+  in.len = input_len;
+
+  rc = _gsasl_codev (sctx, op, &in, 1, out, &n);
+  if (rc != GSASL_OK)
+    return rc;
+
+  /* A single segment, into INPUT or SCTX, is returned as is. */
+  if (n <= 1)
+    {
+      *output = n ? out[0].base : input;
+      *output_len = n ? out[0].len : 0;
+      return GSASL_OK;
+    }
+
+  *output_len = iov_length (out, n);
+  p = malloc (*output_len);
+  if (!p)
+    return GSASL_MALLOC_ERROR;
+  iov_gather (out, n, p);
+  sctx->kept = p;
+  sctx->kept_len = *output_len;
+  *output = p;
+
+  return GSASL_OK;
+}
+
+/**
+ * gsasl_encode_ref:
+ * @sctx: libgsasl session handle.
+ * @input: input byte array.
+ * @input_len: size of input byte array.
+ * @output: pointer to the encoded data.
+ * @output_len: size of the encoded data.
+ *
+ * Encode data like gsasl_encode(), without handing over ownership of
+ * the result.  When no security layer is in effect, @output is set
+ * to @input and nothing is copied.  Otherwise @output points to
+ * memory held by @sctx, which stays valid until the next call to a
+ * gsasl_*_ref() or gsasl_*_buffer() function on @sctx, or until it is
+ * finished.
+ *
+ * Return value: Returns %GSASL_OK if encoding was successful,
+ *   otherwise an error code.
+ *
+ * Since: 1.8.1
+ **/
+int
+gsasl_encode_ref (Gsasl_session * sctx,
+		  const char *input, size_t input_len,
+		  const char **output, size_t * output_len)
+{
+  return _gsasl_code_ref (sctx, GSASL_OP_ENCODE, input, input_len,
+			  output, output_len);
+}
+
+/**
+ * gsasl_decode_ref:
+ * @sctx: libgsasl session handle.
+ * @input: input byte array.
+ * @input_len: size of input byte array.
+ * @output: pointer to the decoded data.
+ * @output_len: size of the decoded data.
+ *
+ * Decode data like gsasl_decode(), without handing over ownership of
+ * the result.  See gsasl_encode_ref() for where @output points.
+ *
+ * Return value: Returns %GSASL_OK if decoding was successful,
+ *   otherwise an error code.
+ *
+ * Since: 1.8.1
+ **/
+int
+gsasl_decode_ref (Gsasl_session * sctx,
+		  const char *input, size_t input_len,
+		  const char **output, size_t * output_len)
+{
+  return _gsasl_code_ref (sctx, GSASL_OP_DECODE, input, input_len,
+			  output, output_len);
+}
+
+/**
+ * gsasl_encodev:
+ * @sctx: libgsasl session handle.
+ * @input: array of input segments.
+ * @input_count: number of segments in @input.
+ * @output: array of output segments supplied by the caller.
+ * @output_count: on input the number of segments @output has room
+ *   for, on output the number of segments used.
+ *
+ * Encode the data in the segments of @input, taken in order, like
+ * gsasl_encode() would encode their concatenation.  The result is
+ * described by the segments in @output, which may point into the
+ * @input data as well as to memory held by @sctx.  Mechanisms with
+ * scatter/gather support, such as DIGEST-MD5, only add segments for
+ * their framing around the caller data, which is thus neither
+ * gathered nor copied, and the @output segments can be handed
+ * directly to writev().  The segments stay valid until the next call
+ * to a gsasl_*v(), gsasl_*_ref() or gsasl_*_buffer() function on
+ * @sctx, or until it is finished, and as long as the @input data is
+ * unchanged.
+ *
+ * @output needs room for @input_count + 2 segments.  If it has less,
+ * %GSASL_NEEDS_LARGER_BUFFER is returned and @output_count is set to
+ * the number of segments needed.
+ *
+ * Return value: Returns %GSASL_OK if encoding was successful,
+ *   %GSASL_NEEDS_LARGER_BUFFER if @output is too small, otherwise an
+ *   error code.
+ *
+ * Since: 1.8.1
+ **/
+int
+gsasl_encodev (Gsasl_session * sctx,
+	       const Gsasl_iov * input, size_t input_count,
+	       Gsasl_iov * output, size_t * output_count)
+{
+  return _gsasl_codev (sctx, GSASL_OP_ENCODE, input, input_count,
+		       output, output_count);
+}
+
+/**
+ * gsasl_decodev:
+ * @sctx: libgsasl session handle.
+ * @input: array of input segments.
+ * @input_count: number of segments in @input.
+ * @output: array of output segments supplied by the caller.
+ * @output_count: on input the number of segments @output has room
+ *   for, on output the number of segments used.
+ *
+ * Decode the data in the segments of @input, taken in order, like
+ * gsasl_decode() would decode their concatenation.  A message read
+ * into several buffers, for example by readv(), can thus be decoded
+ * without first gathering it.  With DIGEST-MD5 the @output segments
+ * point to the payload inside the @input data.  See gsasl_encodev()
+ * for how long @output stays valid and how much room it needs.
+ *
+ * Return value: Returns %GSASL_OK if decoding was successful,
+ *   %GSASL_NEEDS_LARGER_BUFFER if @output is too small, otherwise an
+ *   error code.
+ *
+ * Since: 1.8.1
+ **/
+int
+gsasl_decodev (Gsasl_session * sctx,
+	       const Gsasl_iov * input, size_t input_count,
+	       Gsasl_iov * output, size_t * output_count)
+{
+  return _gsasl_codev (sctx, GSASL_OP_DECODE, input, input_count,
+		       output, output_count);
 }
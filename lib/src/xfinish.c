@@ -22,19 +22,11 @@
 
 #include "internal.h"
 
-/**
- * gsasl_finish:
- * @sctx: libgsasl session handle.
- *
- * Destroy a libgsasl client or server handle.  The handle must not be
- * used with other libgsasl functions after this call.
- **/
+/* Finish the mechanism and forget all properties and hooks of SCTX,
+   leaving it as if it was freshly allocated for the same context. */
 void
-gsasl_finish (Gsasl_session * sctx)
+_gsasl_session_clear (Gsasl_session * sctx)
 {
-  if (sctx == NULL)
-    return;
-
   if (sctx->clientp)
     {
       if (sctx->mech && sctx->mech->client.finish)
@@ -46,30 +38,41 @@ gsasl_finish (Gsasl_session * sctx)
 	sctx->mech->server.finish (sctx, sctx->mech_data);
     }
 
-  free (sctx->anonymous_token);
-  free (sctx->authid);
-  free (sctx->authzid);
-  free (sctx->password);
-  free (sctx->passcode);
-  free (sctx->pin);
-  free (sctx->suggestedpin);
-  free (sctx->service);
-  free (sctx->hostname);
-  free (sctx->gssapi_display_name);
-  free (sctx->realm);
-  free (sctx->digest_md5_hashed_password);
-  free (sctx->qops);
-  free (sctx->qop);
-  free (sctx->scram_iter);
-  free (sctx->scram_salt);
-  free (sctx->scram_salted_password);
-  free (sctx->cb_tls_unique);
-  free (sctx->saml20_idp_identifier);
-  free (sctx->saml20_redirect_url);
-  free (sctx->openid20_redirect_url);
-  free (sctx->openid20_outcome_data);
-  /* If you add anything here, remember to change change
-     gsasl_finish() in xfinish.c and Gsasl_session in internal.h.  */
+  free (sctx->kept);
+  sctx->kept = NULL;
+  sctx->kept_op = 0;
+  free (sctx->scratch);
+  sctx->scratch = NULL;
+  sctx->scratch_size = 0;
+  _gsasl_step_resume_clear (sctx);
+
+  sctx->mech = NULL;
+  sctx->mech_data = NULL;
+  sctx->application_hook = NULL;
+#ifndef GSASL_NO_OBSOLETE
+  sctx->application_data = NULL;
+#endif
+
+  _gsasl_property_clear (sctx);
+}
+
+/**
+ * gsasl_finish:
+ * @sctx: libgsasl session handle.
+ *
+ * Destroy a libgsasl client or server handle.  The handle must not be
+ * used with other libgsasl functions after this call.
+ *
+ * If a session pool is enabled with gsasl_session_pool_set(), the
+ * handle may be kept for reuse by a later session instead.
+ **/
+void
+gsasl_finish (Gsasl_session * sctx)
+{
+  if (sctx == NULL)
+    return;
+
+  _gsasl_session_clear (sctx);
 
-  free (sctx);
+  _gsasl_session_release (sctx);
 }
@@ -22,36 +22,23 @@
 
 #include "internal.h"
 
-static Gsasl_mechanism *
-find_mechanism (const char *mech, size_t n_mechs, Gsasl_mechanism * mechs)
+static int
+setup (Gsasl * ctx, const char *mech, Gsasl_session * sctx, int clientp)
 {
+  const struct _gsasl_mechtab *tab = _gsasl_mechtab (ctx, clientp);
   size_t i;
+  int res;
 
   if (mech == NULL)
-    return NULL;
-
-  for (i = 0; i < n_mechs; i++)
-    if (strcmp (mech, mechs[i].name) == 0)
-      return &mechs[i];
-
-  return NULL;
-}
-
-static int
-setup (Gsasl * ctx,
-       const char *mech,
-       Gsasl_session * sctx,
-       size_t n_mechs, Gsasl_mechanism * mechs, int clientp)
-{
-  Gsasl_mechanism *mechptr = NULL;
-  int res;
+    return GSASL_UNKNOWN_MECHANISM;
 
-  mechptr = find_mechanism (mech, n_mechs, mechs);
-  if (mechptr == NULL)
+  i = _gsasl_find_mechanism (tab, mech, strlen (mech));
+  if (i == tab->n)
     return GSASL_UNKNOWN_MECHANISM;
 
   sctx->ctx = ctx;
-  sctx->mech = mechptr;
+  sctx->mech = &tab->ent[i]->mech;
+  sctx->ext = &tab->ent[i]->ext;
   sctx->clientp = clientp;
 
   if (clientp)
@@ -79,19 +66,16 @@ setup (Gsasl * ctx,
 }
 
 static int
-start (Gsasl * ctx,
-       const char *mech,
-       Gsasl_session ** sctx,
-       size_t n_mechs, Gsasl_mechanism * mechs, int clientp)
+start (Gsasl * ctx, const char *mech, Gsasl_session ** sctx, int clientp)
 {
   Gsasl_session *out;
   int res;
 
-  out = calloc (1, sizeof (*out));
+  out = _gsasl_session_alloc (ctx);
   if (out == NULL)
     return GSASL_MALLOC_ERROR;
 
-  res = setup (ctx, mech, out, n_mechs, mechs, clientp);
+  res = setup (ctx, mech, out, clientp);
   if (res != GSASL_OK)
     {
       gsasl_finish (out);
@@ -118,7 +102,7 @@ start (Gsasl * ctx,
 int
 gsasl_client_start (Gsasl * ctx, const char *mech, Gsasl_session ** sctx)
 {
-  return start (ctx, mech, sctx, ctx->n_client_mechs, ctx->client_mechs, 1);
+  return start (ctx, mech, sctx, 1);
 }
 
 /**
@@ -136,5 +120,35 @@ gsasl_client_start (Gsasl * ctx, const char *mech, Gsasl_session ** sctx)
 int
 gsasl_server_start (Gsasl * ctx, const char *mech, Gsasl_session ** sctx)
 {
-  return start (ctx, mech, sctx, ctx->n_server_mechs, ctx->server_mechs, 0);
+  return start (ctx, mech, sctx, 0);
+}
+
+/**
+ * gsasl_session_reset:
+ * @sctx: libgsasl client or server handle.
+ * @mech: name of SASL mechanism, or NULL to use the current one.
+ *
+ * Prepare @sctx for a new authentication, as if it had been finished
+ * with gsasl_finish() and started again with gsasl_client_start() or
+ * gsasl_server_start().  The mechanism state, all properties and the
+ * session hook are discarded, but the handle itself is reused.
+ *
+ * If this function fails, the only valid operation on @sctx is
+ * gsasl_finish().
+ *
+ * Return value: Returns %GSASL_OK if successful, or error code.
+ *
+ * Since: 1.8.1
+ **/
+int
+gsasl_session_reset (Gsasl_session * sctx, const char *mech)
+{
+  Gsasl *ctx = sctx->ctx;
+
+  if (mech == NULL && sctx->mech)
+    mech = sctx->mech->name;
+
+  _gsasl_session_clear (sctx);
+
+  return setup (ctx, mech, sctx, sctx->clientp);
 }
@@ -43,23 +43,58 @@
  * responsibility of caller to deallocate it by calling free
  * (@output).
  *
+ * A server step may return %GSASL_CALLBACK_PENDING when the callback
+ * asked to answer later, see gsasl_step_resume().  Until it is
+ * resumed, this function returns %GSASL_CALLBACK_PENDING.
+ *
  * Return value: Returns %GSASL_OK if authenticated terminated
- *   successfully, %GSASL_NEEDS_MORE if more data is needed, or error
- *   code.
+ *   successfully, %GSASL_NEEDS_MORE if more data is needed,
+ *   %GSASL_CALLBACK_PENDING if the step waits for a callback, or
+ *   error code.
  **/
 int
 gsasl_step (Gsasl_session * sctx,
 	    const char *input, size_t input_len,
 	    char **output, size_t * output_len)
 {
-  Gsasl_step_function step;
+  if (sctx->pending)
+    return GSASL_CALLBACK_PENDING;
 
-  if (sctx->clientp)
-    step = sctx->mech->client.step;
-  else
-    step = sctx->mech->server.step;
+  return _gsasl_step_run (sctx, input, input_len, output, output_len);
+}
 
-  return step (sctx, sctx->mech_data, input, input_len, output, output_len);
+/**
+ * gsasl_step_buffer:
+ * @sctx: libgsasl session handle.
+ * @input: input byte array.
+ * @input_len: size of input byte array.
+ * @output: output byte array supplied by the caller, or %NULL.
+ * @output_len: on input the size of @output, on output the size of
+ *   the data to send.
+ *
+ * Perform one step of SASL authentication like gsasl_step(), but
+ * store the data to send in a buffer supplied by the caller.
+ *
+ * If it does not fit, %GSASL_NEEDS_LARGER_BUFFER is returned and
+ * @output_len is set to the required size.  The step has then been
+ * performed and its output is kept in @sctx; the next call to this
+ * function stores it and returns what the step returned, ignoring
+ * its @input.
+ *
+ * Return value: Returns %GSASL_OK if authenticated terminated
+ *   successfully, %GSASL_NEEDS_MORE if the mechanism would like
+ *   another round trip, %GSASL_NEEDS_LARGER_BUFFER if @output is too
+ *   small, or an error code.
+ *
+ * Since: 1.8.1
+ **/
+int
+gsasl_step_buffer (Gsasl_session * sctx,
+		   const char *input, size_t input_len,
+		   char *output, size_t * output_len)
+{
+  return _gsasl_buffer_op (sctx, GSASL_OP_STEP, input, input_len,
+			   output, output_len);
 }
 
 /**
@@ -69,7 +104,10 @@ gsasl_step (Gsasl_session * sctx,
  * @b64output: newly allocated output base64 encoded byte array.
  *
  * This is a simple wrapper around gsasl_step() that base64 decodes
- * the input and base64 encodes the output.
+ * the input and base64 encodes the output.  The input is decoded into
+ * a buffer kept in @sctx for the following steps, and the output of
+ * the mechanism is encoded in place, so that no memory is allocated
+ * besides what the mechanism itself needs.
  *
  * The contents of the @b64output buffer is unspecified if this
  * functions returns anything other than %GSASL_OK or
@@ -85,31 +123,65 @@ gsasl_step (Gsasl_session * sctx,
 int
 gsasl_step64 (Gsasl_session * sctx, const char *b64input, char **b64output)
 {
-  size_t input_len = 0, output_len = 0;
-  char *input = NULL, *output = NULL;
-  int res;
+  size_t input_len = 0, output_len = 0, len;
+  const char *input = NULL;
+  char *output = NULL, *p;
+  int res, tmpres;
 
   if (b64input)
     {
-      res = gsasl_base64_from (b64input, strlen (b64input),
-			       &input, &input_len);
+      /* Decode into the scratch buffer of the session, which is kept
+	 for the next step. */
+      len = strlen (b64input);
+      input_len = sctx->scratch_size;
+      res = gsasl_base64_from_buffer (b64input, len, sctx->scratch,
+				      &input_len);
+      if (res == GSASL_NEEDS_LARGER_BUFFER)
+	{
+	  p = realloc (sctx->scratch, input_len);
+	  if (!p)
+	    return GSASL_MALLOC_ERROR;
+	  sctx->scratch = p;
+	  sctx->scratch_size = input_len;
+	  res = gsasl_base64_from_buffer (b64input, len, sctx->scratch,
+					  &input_len);
+	}
       if (res != GSASL_OK)
 	return GSASL_BASE64_ERROR;
+      input = sctx->scratch ? sctx->scratch : "";
     }
 
   res = gsasl_step (sctx, input, input_len, &output, &output_len);
+  if (res != GSASL_OK && res != GSASL_NEEDS_MORE)
+    return res;
 
-  free (input);
-
-  if (res == GSASL_OK || res == GSASL_NEEDS_MORE)
+  /* Grow the output of the mechanism to hold its encoding, and encode
+     it in place after moving it to the end. */
+  len = 0;
+  tmpres = gsasl_base64_to_buffer (NULL, output_len, NULL, &len);
+  if (tmpres != GSASL_NEEDS_LARGER_BUFFER)
     {
-      int tmpres = gsasl_base64_to (output, output_len, b64output, NULL);
+      free (output);
+      return tmpres;
+    }
 
+  p = realloc (output, len);
+  if (!p)
+    {
       free (output);
+      return GSASL_MALLOC_ERROR;
+    }
+  if (output_len > 0)
+    memmove (p + len - output_len, p, output_len);
 
-      if (tmpres != GSASL_OK)
-	return tmpres;
+  tmpres = gsasl_base64_to_buffer (p + len - output_len, output_len, p, &len);
+  if (tmpres != GSASL_OK)
+    {
+      free (p);
+      return tmpres;
     }
 
+  *b64output = p;
+
   return res;
 }
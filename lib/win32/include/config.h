@@ -16,6 +16,7 @@
 #ifndef EOVERFLOW
 #define EOVERFLOW E2BIG
 #endif
+#define GNULIB_GC_ARCFOUR 1
 #define GNULIB_GC_HMAC_MD5 1
 #define GNULIB_GC_MD5 1
 #define GNULIB_GC_RANDOM 1
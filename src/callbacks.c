@@ -203,6 +203,8 @@ callback (Gsasl * ctx, Gsasl_session * sctx, Gsasl_property prop)
     case GSASL_SCRAM_SALTED_PASSWORD:
     case GSASL_SCRAM_ITER:
     case GSASL_SCRAM_SALT:
+    case GSASL_SCRAM_SERVERKEY:
+    case GSASL_SCRAM_STOREDKEY:
       break;
 
     case GSASL_SAML20_IDP_IDENTIFIER:
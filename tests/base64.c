@@ -0,0 +1,239 @@
+/* base64.c --- Test and time the base64 functions.
+ * Copyright (C) 2012 Simon Josefsson
+ *
+ * This file is part of GNU SASL.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdio.h>
+#include <stdarg.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "utils.h"
+
+#define MAXLEN 300
+#define VOLUME (16 * 1024 * 1024)
+
+/* Test vectors from RFC 4648. */
+static const struct
+{
+  const char *data;
+  const char *b64;
+} tv[] =
+{
+  {"", ""},
+  {"f", "Zg=="},
+  {"fo", "Zm8="},
+  {"foo", "Zm9v"},
+  {"foob", "Zm9vYg=="},
+  {"fooba", "Zm9vYmE="},
+  {"foobar", "Zm9vYmFy"}
+};
+
+static const char *invalid[] = {
+  "Z", "Zg", "Zg=", "Zm9vY", "Z===", "====", "Zg=a", "Zm9v\n",
+  "Zm=v", "Zg==Zg==", "Zm9!", "Zm9vYmF!", "Zm9v Zm9v", "Zm9vYm\xc3\xa9"
+};
+
+static void
+vectors (void)
+{
+  char buf[100], *p;
+  size_t i, len;
+  int res;
+
+  for (i = 0; i < sizeof (tv) / sizeof (tv[0]); i++)
+    {
+      res = gsasl_base64_to (tv[i].data, strlen (tv[i].data), &p, &len);
+      if (res != GSASL_OK || len != strlen (tv[i].b64)
+	  || strcmp (p, tv[i].b64) != 0)
+	fail ("gsasl_base64_to (%s) = %s\n", tv[i].data, p ? p : "(null)");
+      free (p);
+
+      res = gsasl_base64_from (tv[i].b64, strlen (tv[i].b64), &p, &len);
+      if (res != GSASL_OK || len != strlen (tv[i].data)
+	  || memcmp (p, tv[i].data, len) != 0)
+	fail ("gsasl_base64_from (%s) (%d)\n", tv[i].b64, res);
+      free (p);
+
+      len = sizeof (buf);
+      res = gsasl_base64_to_buffer (tv[i].data, strlen (tv[i].data),
+				    buf, &len);
+      if (res != GSASL_OK || len != strlen (tv[i].b64)
+	  || strcmp (buf, tv[i].b64) != 0)
+	fail ("gsasl_base64_to_buffer (%s) = %s\n", tv[i].data, buf);
+
+      /* Decode in place. */
+      len = sizeof (buf);
+      res = gsasl_base64_from_buffer (buf, strlen (buf), buf, &len);
+      if (res != GSASL_OK || len != strlen (tv[i].data)
+	  || memcmp (buf, tv[i].data, len) != 0)
+	fail ("gsasl_base64_from_buffer (%s) (%d)\n", tv[i].b64, res);
+    }
+
+  for (i = 0; i < sizeof (invalid) / sizeof (invalid[0]); i++)
+    {
+      res = gsasl_base64_from (invalid[i], strlen (invalid[i]), &p, &len);
+      if (res != GSASL_BASE64_ERROR)
+	fail ("gsasl_base64_from accepted \"%s\"\n", invalid[i]);
+
+      len = sizeof (buf);
+      res = gsasl_base64_from_buffer (invalid[i], strlen (invalid[i]),
+				      buf, &len);
+      if (res != GSASL_BASE64_ERROR)
+	fail ("gsasl_base64_from_buffer accepted \"%s\"\n", invalid[i]);
+    }
+
+  /* Too small buffers report the size needed. */
+  len = 8;
+  res = gsasl_base64_to_buffer ("foobar", 6, buf, &len);
+  if (res != GSASL_NEEDS_LARGER_BUFFER || len != 9)
+    fail ("short encode buffer (%d) %lu\n", res, (unsigned long) len);
+  len = 3;
+  res = gsasl_base64_from_buffer ("Zm9vYg==", 8, buf, &len);
+  if (res != GSASL_NEEDS_LARGER_BUFFER || len != 4)
+    fail ("short decode buffer (%d) %lu\n", res, (unsigned long) len);
+}
+
+/* Round trip every length up to MAXLEN, through the allocating and
+   the buffer functions, including in place at the end of the
+   buffer. */
+static void
+lengths (void)
+{
+  static char data[MAXLEN], buf[MAXLEN * 2];
+  char *b64, *p;
+  size_t i, len, b64len, plen;
+  int res;
+
+  for (i = 0; i < MAXLEN; i++)
+    data[i] = (i * 151 + 7) ^ (i >> 3);
+
+  for (i = 0; i <= MAXLEN; i++)
+    {
+      res = gsasl_base64_to (data, i, &b64, &b64len);
+      if (res != GSASL_OK || b64len != (i + 2) / 3 * 4
+	  || strlen (b64) != b64len)
+	fail ("gsasl_base64_to of %lu bytes (%d)\n", (unsigned long) i, res);
+
+      res = gsasl_base64_from (b64, b64len, &p, &plen);
+      if (res != GSASL_OK || plen != i || memcmp (p, data, i) != 0)
+	fail ("round trip of %lu bytes (%d)\n", (unsigned long) i, res);
+      free (p);
+
+      /* Encode data stored at the end of the output buffer. */
+      memcpy (buf + b64len + 1 - i, data, i);
+      len = b64len + 1;
+      res = gsasl_base64_to_buffer (buf + b64len + 1 - i, i, buf, &len);
+      if (res != GSASL_OK || len != b64len || strcmp (buf, b64) != 0)
+	fail ("in place encode of %lu bytes (%d)\n", (unsigned long) i, res);
+
+      len = b64len;
+      res = gsasl_base64_from_buffer (buf, b64len, buf, &len);
+      if (res != GSASL_OK || len != i || memcmp (buf, data, i) != 0)
+	fail ("in place decode of %lu bytes (%d)\n", (unsigned long) i, res);
+
+      free (b64);
+    }
+}
+
+static void
+report (const char *what, size_t bytes, clock_t start)
+{
+  double secs = (double) (clock () - start) / CLOCKS_PER_SEC;
+
+  if (debug && secs > 0)
+    printf ("%-26s %5lu bytes: %8.1f MB/s\n", what, (unsigned long) bytes,
+	    VOLUME / secs / 1e6);
+}
+
+/* Time the functions on messages of typical SASL sizes. */
+static void
+bench (size_t size)
+{
+  char *data, *b64, *p, *buf;
+  size_t i, n = VOLUME / size, len, b64len, plen;
+  clock_t start;
+
+  data = malloc (size);
+  buf = malloc (2 * size + 4);
+  if (!data || !buf)
+    fail ("malloc\n");
+  for (i = 0; i < size; i++)
+    data[i] = i * 13;
+  if (gsasl_base64_to (data, size, &b64, &b64len) != GSASL_OK)
+    fail ("gsasl_base64_to\n");
+
+  start = clock ();
+  for (i = 0; i < n; i++)
+    {
+      if (gsasl_base64_to (data, size, &p, &len) != GSASL_OK)
+	fail ("gsasl_base64_to\n");
+      free (p);
+    }
+  report ("gsasl_base64_to", size, start);
+
+  start = clock ();
+  for (i = 0; i < n; i++)
+    {
+      len = 2 * size + 4;
+      if (gsasl_base64_to_buffer (data, size, buf, &len) != GSASL_OK)
+	fail ("gsasl_base64_to_buffer\n");
+    }
+  report ("gsasl_base64_to_buffer", size, start);
+
+  start = clock ();
+  for (i = 0; i < n; i++)
+    {
+      if (gsasl_base64_from (b64, b64len, &p, &plen) != GSASL_OK)
+	fail ("gsasl_base64_from\n");
+      free (p);
+    }
+  report ("gsasl_base64_from", size, start);
+
+  start = clock ();
+  for (i = 0; i < n; i++)
+    {
+      len = 2 * size + 4;
+      if (gsasl_base64_from_buffer (b64, b64len, buf, &len) != GSASL_OK)
+	fail ("gsasl_base64_from_buffer\n");
+    }
+  report ("gsasl_base64_from_buffer", size, start);
+
+  if (len != size || memcmp (buf, data, size) != 0)
+    fail ("benchmark data corrupted\n");
+
+  free (b64);
+  free (buf);
+  free (data);
+}
+
+void
+doit (void)
+{
+  vectors ();
+  lengths ();
+
+  bench (32);
+  bench (1024);
+  bench (65536);
+}
@@ -0,0 +1,258 @@
+/* codebuffer.c --- Test stepping and coding into caller buffers.
+ * Copyright (C) 2012 Simon Josefsson
+ *
+ * This file is part of GNU SASL.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdio.h>
+#include <stdarg.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "utils.h"
+
+static int
+callback (Gsasl * ctx, Gsasl_session * sctx, Gsasl_property prop)
+{
+  switch (prop)
+    {
+    case GSASL_AUTHID:
+      gsasl_property_set (sctx, prop, "user");
+      return GSASL_OK;
+
+    case GSASL_PASSWORD:
+      gsasl_property_set (sctx, prop, "pencil");
+      return GSASL_OK;
+
+    case GSASL_SERVICE:
+      gsasl_property_set (sctx, prop, "imap");
+      return GSASL_OK;
+
+    case GSASL_HOSTNAME:
+      gsasl_property_set (sctx, prop, "hostname");
+      return GSASL_OK;
+
+    case GSASL_QOPS:
+    case GSASL_QOP:
+      gsasl_property_set (sctx, prop, "qop-int");
+      return GSASL_OK;
+
+    case GSASL_VALIDATE_SIMPLE:
+      return GSASL_OK;
+
+    default:
+      return GSASL_NO_CALLBACK;
+    }
+}
+
+/* Run the authentication, the server speaking first, passing all
+   tokens through BUF in place. */
+static void
+authenticate (Gsasl_session * client, Gsasl_session * server)
+{
+  char buf[BUFSIZ];
+  size_t len = 0, n;
+  int crc = GSASL_NEEDS_MORE, src = GSASL_NEEDS_MORE;
+  int res;
+
+  /* A query with no buffer reports the size and keeps the output. */
+  n = 0;
+  res = gsasl_step_buffer (server, NULL, 0, NULL, &n);
+  if (res != GSASL_NEEDS_LARGER_BUFFER || n == 0)
+    fail ("size query failed (%d) %lu\n", res, (unsigned long) n);
+  len = n;
+  src = gsasl_step_buffer (server, "ignored", 7, buf, &len);
+  if (src != GSASL_NEEDS_MORE || len != n)
+    fail ("kept step failed (%d) %lu\n", src, (unsigned long) len);
+
+  while (crc == GSASL_NEEDS_MORE || src == GSASL_NEEDS_MORE)
+    {
+      if (crc == GSASL_NEEDS_MORE)
+	{
+	  n = sizeof (buf);
+	  crc = gsasl_step_buffer (client, buf, len, buf, &n);
+	  if (crc != GSASL_OK && crc != GSASL_NEEDS_MORE)
+	    fail ("client step failed (%d): %s\n", crc, gsasl_strerror (crc));
+	  len = n;
+	  if (debug)
+	    printf ("C: %.*s\n", (int) len, buf);
+	}
+
+      if (src == GSASL_NEEDS_MORE)
+	{
+	  n = sizeof (buf);
+	  src = gsasl_step_buffer (server, buf, len, buf, &n);
+	  if (src != GSASL_OK && src != GSASL_NEEDS_MORE)
+	    fail ("server step failed (%d): %s\n", src, gsasl_strerror (src));
+	  len = n;
+	  if (debug)
+	    printf ("S: %.*s\n", (int) len, buf);
+	}
+    }
+}
+
+static void
+digest_md5 (Gsasl * ctx)
+{
+  Gsasl_session *client, *server;
+  char enc[100], dec[100], *p;
+  const char *ref, *ref2;
+  size_t enclen, declen, reflen, ref2len, plen;
+  int res;
+
+  if (!gsasl_client_support_p (ctx, "DIGEST-MD5")
+      || !gsasl_server_support_p (ctx, "DIGEST-MD5"))
+    return;
+
+  res = gsasl_client_start (ctx, "DIGEST-MD5", &client);
+  if (res != GSASL_OK)
+    fail ("gsasl_client_start() failed (%d):\n%s\n", res,
+	  gsasl_strerror (res));
+  res = gsasl_server_start (ctx, "DIGEST-MD5", &server);
+  if (res != GSASL_OK)
+    fail ("gsasl_server_start() failed (%d):\n%s\n", res,
+	  gsasl_strerror (res));
+
+  authenticate (client, server);
+
+  /* Integrity protected data is 4 + 3 + 16 bytes. */
+  enclen = 10;
+  res = gsasl_encode_buffer (client, "foo", 3, enc, &enclen);
+  if (res != GSASL_NEEDS_LARGER_BUFFER || enclen != 23)
+    fail ("encode to short buffer (%d) %lu\n", res, (unsigned long) enclen);
+  enclen = sizeof (enc);
+  res = gsasl_encode_buffer (client, "ignored", 7, enc, &enclen);
+  if (res != GSASL_OK || enclen != 23)
+    fail ("kept encode (%d) %lu\n", res, (unsigned long) enclen);
+
+  declen = sizeof (dec);
+  res = gsasl_decode_buffer (server, enc, enclen, dec, &declen);
+  if (res != GSASL_OK || declen != 3 || memcmp (dec, "foo", 3) != 0)
+    fail ("decode (%d) %lu\n", res, (unsigned long) declen);
+
+  /* The reference variants agree with the allocating functions. */
+  res = gsasl_encode_ref (server, "bar", 3, &ref, &reflen);
+  if (res != GSASL_OK || reflen != 23)
+    fail ("encode_ref (%d) %lu\n", res, (unsigned long) reflen);
+  res = gsasl_decode (client, ref, reflen, &p, &plen);
+  if (res != GSASL_OK || plen != 3 || memcmp (p, "bar", 3) != 0)
+    fail ("decode of encode_ref output (%d)\n", res);
+  free (p);
+
+  res = gsasl_encode (server, "baz", 3, &p, &plen);
+  if (res != GSASL_OK)
+    fail ("encode (%d)\n", res);
+  res = gsasl_decode_ref (client, p, plen, &ref2, &ref2len);
+  if (res != GSASL_OK || ref2len != 3 || memcmp (ref2, "baz", 3) != 0)
+    fail ("decode_ref (%d) %lu\n", res, (unsigned long) ref2len);
+  if (ref2 == p)
+    fail ("decode_ref returned its input with a security layer\n");
+  free (p);
+
+  /* A tampered message is rejected. */
+  enc[5] ^= 1;
+  declen = sizeof (dec);
+  res = gsasl_decode_buffer (server, enc, enclen, dec, &declen);
+  if (res == GSASL_OK)
+    fail ("tampered message accepted\n");
+
+  gsasl_finish (client);
+  gsasl_finish (server);
+}
+
+static void
+plain (Gsasl * ctx)
+{
+  Gsasl_session *client, *server;
+  char buf[100] = "hello world";
+  const char *ref;
+  size_t len, reflen;
+  int res;
+
+  if (!gsasl_client_support_p (ctx, "PLAIN")
+      || !gsasl_server_support_p (ctx, "PLAIN"))
+    return;
+
+  res = gsasl_client_start (ctx, "PLAIN", &client);
+  if (res != GSASL_OK)
+    fail ("gsasl_client_start() failed (%d):\n%s\n", res,
+	  gsasl_strerror (res));
+  res = gsasl_server_start (ctx, "PLAIN", &server);
+  if (res != GSASL_OK)
+    fail ("gsasl_server_start() failed (%d):\n%s\n", res,
+	  gsasl_strerror (res));
+
+  /* PLAIN is client first, let the server see an empty token. */
+  len = sizeof (buf);
+  res = gsasl_step_buffer (server, NULL, 0, buf, &len);
+  if (res != GSASL_NEEDS_MORE || len != 0)
+    fail ("server first step (%d)\n", res);
+  len = sizeof (buf);
+  res = gsasl_step_buffer (client, NULL, 0, buf, &len);
+  if (res != GSASL_OK)
+    fail ("client step (%d)\n", res);
+  res = gsasl_step_buffer (server, buf, len, buf, &len);
+  if (res != GSASL_OK)
+    fail ("server step (%d)\n", res);
+
+  /* Without a security layer the data passes through. */
+  strcpy (buf, "hello world");
+  res = gsasl_encode_ref (client, buf, 11, &ref, &reflen);
+  if (res != GSASL_OK || ref != buf || reflen != 11)
+    fail ("encode_ref did not pass through (%d)\n", res);
+  res = gsasl_decode_ref (server, buf, 11, &ref, &reflen);
+  if (res != GSASL_OK || ref != buf || reflen != 11)
+    fail ("decode_ref did not pass through (%d)\n", res);
+
+  len = sizeof (buf);
+  res = gsasl_encode_buffer (client, buf, 11, buf, &len);
+  if (res != GSASL_OK || len != 11 || memcmp (buf, "hello world", 11) != 0)
+    fail ("in place encode (%d)\n", res);
+
+  len = 5;
+  res = gsasl_decode_buffer (server, buf, 11, buf + 50, &len);
+  if (res != GSASL_NEEDS_LARGER_BUFFER || len != 11)
+    fail ("short pass through buffer (%d) %lu\n", res, (unsigned long) len);
+
+  gsasl_finish (client);
+  gsasl_finish (server);
+}
+
+void
+doit (void)
+{
+  Gsasl *ctx = NULL;
+  int res;
+
+  res = gsasl_init (&ctx);
+  if (res != GSASL_OK)
+    {
+      fail ("gsasl_init() failed (%d):\n%s\n", res, gsasl_strerror (res));
+      return;
+    }
+
+  gsasl_callback_set (ctx, callback);
+
+  digest_md5 (ctx);
+  plain (ctx);
+
+  gsasl_done (ctx);
+}
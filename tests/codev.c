@@ -0,0 +1,277 @@
+/* codev.c --- Test scatter/gather encoding and decoding.
+ * Copyright (C) 2012 Simon Josefsson
+ *
+ * This file is part of GNU SASL.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdio.h>
+#include <stdarg.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "utils.h"
+
+static int
+callback (Gsasl * ctx, Gsasl_session * sctx, Gsasl_property prop)
+{
+  switch (prop)
+    {
+    case GSASL_AUTHID:
+      gsasl_property_set (sctx, prop, "user");
+      return GSASL_OK;
+
+    case GSASL_PASSWORD:
+      gsasl_property_set (sctx, prop, "pencil");
+      return GSASL_OK;
+
+    case GSASL_SERVICE:
+      gsasl_property_set (sctx, prop, "imap");
+      return GSASL_OK;
+
+    case GSASL_HOSTNAME:
+      gsasl_property_set (sctx, prop, "hostname");
+      return GSASL_OK;
+
+    case GSASL_QOPS:
+    case GSASL_QOP:
+      gsasl_property_set (sctx, prop, "qop-int");
+      return GSASL_OK;
+
+    default:
+      return GSASL_NO_CALLBACK;
+    }
+}
+
+static void
+authenticate (Gsasl_session * client, Gsasl_session * server)
+{
+  char *in = NULL, *out = NULL;
+  size_t inlen = 0, outlen;
+  int crc = GSASL_NEEDS_MORE, src;
+
+  src = gsasl_step (server, NULL, 0, &out, &outlen);
+  while (src == GSASL_NEEDS_MORE || crc == GSASL_NEEDS_MORE)
+    {
+      if (src != GSASL_OK && src != GSASL_NEEDS_MORE)
+	fail ("server step failed (%d): %s\n", src, gsasl_strerror (src));
+      free (in);
+      in = out;
+      inlen = outlen;
+      out = NULL;
+      if (crc == GSASL_NEEDS_MORE)
+	{
+	  crc = gsasl_step (client, in, inlen, &out, &outlen);
+	  if (crc != GSASL_OK && crc != GSASL_NEEDS_MORE)
+	    fail ("client step failed (%d): %s\n", crc, gsasl_strerror (crc));
+	}
+      free (in);
+      in = out;
+      inlen = outlen;
+      out = NULL;
+      if (src == GSASL_NEEDS_MORE)
+	src = gsasl_step (server, in, inlen, &out, &outlen);
+    }
+  free (in);
+  free (out);
+}
+
+/* Concatenate the N segments in IOV to BUF and return the length. */
+static size_t
+flatten (const Gsasl_iov * iov, size_t n, char *buf)
+{
+  size_t len = 0;
+
+  for (; n > 0; iov++, n--)
+    {
+      memcpy (buf + len, iov->base, iov->len);
+      len += iov->len;
+    }
+
+  return len;
+}
+
+static int
+within (const char *p, const char *buf, size_t len)
+{
+  return p >= buf && p < buf + len;
+}
+
+static void
+digest_md5 (Gsasl * ctx)
+{
+  const char *data = "hello scattered world";
+  Gsasl_iov in[3], out[5], dec[5];
+  Gsasl_session *client, *server;
+  char enc[100], *p;
+  size_t n, m, enclen, plen, i;
+  int res;
+
+  if (!gsasl_client_support_p (ctx, "DIGEST-MD5")
+      || !gsasl_server_support_p (ctx, "DIGEST-MD5"))
+    return;
+
+  res = gsasl_client_start (ctx, "DIGEST-MD5", &client);
+  if (res != GSASL_OK)
+    fail ("gsasl_client_start() failed (%d):\n%s\n", res,
+	  gsasl_strerror (res));
+  res = gsasl_server_start (ctx, "DIGEST-MD5", &server);
+  if (res != GSASL_OK)
+    fail ("gsasl_server_start() failed (%d):\n%s\n", res,
+	  gsasl_strerror (res));
+
+  authenticate (client, server);
+
+  in[0].base = data;
+  in[0].len = 6;
+  in[1].base = data + 6;
+  in[1].len = 0;
+  in[2].base = data + 6;
+  in[2].len = strlen (data) - 6;
+
+  n = 4;
+  res = gsasl_encodev (client, in, 3, out, &n);
+  if (res != GSASL_NEEDS_LARGER_BUFFER || n != 5)
+    fail ("short output array (%d) %lu\n", res, (unsigned long) n);
+
+  /* The payload is referenced, only the framing is added. */
+  res = gsasl_encodev (client, in, 3, out, &n);
+  if (res != GSASL_OK || n != 4)
+    fail ("gsasl_encodev (%d) %lu\n", res, (unsigned long) n);
+  if (out[1].base != in[0].base || out[2].base != in[2].base)
+    fail ("payload was copied\n");
+  enclen = flatten (out, n, enc);
+  if (enclen != 4 + strlen (data) + 16)
+    fail ("unexpected length %lu\n", (unsigned long) enclen);
+
+  res = gsasl_decode (server, enc, enclen, &p, &plen);
+  if (res != GSASL_OK || plen != strlen (data) || memcmp (p, data, plen))
+    fail ("gsasl_decode of gsasl_encodev output (%d)\n", res);
+  free (p);
+
+  /* Decode a message split at every position. */
+  for (i = 0; i <= enclen; i++)
+    {
+      res = gsasl_encode (server, data, strlen (data), &p, &plen);
+      if (res != GSASL_OK)
+	fail ("gsasl_encode (%d)\n", res);
+
+      in[0].base = p;
+      in[0].len = i;
+      in[1].base = p + i;
+      in[1].len = plen - i;
+      m = 5;
+      res = gsasl_decodev (client, in, 2, dec, &m);
+      if (res != GSASL_OK || m < 1 || m > 2)
+	fail ("gsasl_decodev split at %lu (%d)\n", (unsigned long) i, res);
+      if (!within (dec[0].base, p, plen))
+	fail ("payload was copied\n");
+      if (flatten (dec, m, enc) != strlen (data)
+	  || memcmp (enc, data, strlen (data)) != 0)
+	fail ("gsasl_decodev data mismatch at %lu\n", (unsigned long) i);
+      free (p);
+    }
+
+  /* Incomplete and tampered messages. */
+  res = gsasl_encode (server, data, strlen (data), &p, &plen);
+  if (res != GSASL_OK)
+    fail ("gsasl_encode (%d)\n", res);
+  in[0].base = p;
+  in[0].len = plen - 1;
+  m = 5;
+  res = gsasl_decodev (client, in, 1, dec, &m);
+  if (res != GSASL_NEEDS_MORE)
+    fail ("incomplete message (%d)\n", res);
+  in[0].len = plen;
+  p[6] ^= 1;
+  m = 5;
+  res = gsasl_decodev (client, in, 1, dec, &m);
+  if (res != GSASL_INTEGRITY_ERROR)
+    fail ("tampered message (%d)\n", res);
+  free (p);
+
+  gsasl_finish (client);
+  gsasl_finish (server);
+}
+
+static void
+plain (Gsasl * ctx)
+{
+  Gsasl_session *client, *server;
+  Gsasl_iov in[2], out[4];
+  char *p;
+  size_t n, plen;
+  int res;
+
+  if (!gsasl_client_support_p (ctx, "PLAIN")
+      || !gsasl_server_support_p (ctx, "PLAIN"))
+    return;
+
+  res = gsasl_client_start (ctx, "PLAIN", &client);
+  if (res != GSASL_OK)
+    fail ("gsasl_client_start() failed (%d):\n%s\n", res,
+	  gsasl_strerror (res));
+  res = gsasl_step (client, NULL, 0, &p, &plen);
+  if (res != GSASL_OK)
+    fail ("gsasl_step (%d)\n", res);
+  free (p);
+  res = gsasl_server_start (ctx, "PLAIN", &server);
+  if (res != GSASL_OK)
+    fail ("gsasl_server_start() failed (%d):\n%s\n", res,
+	  gsasl_strerror (res));
+
+  /* Without a security layer the segments are passed through. */
+  in[0].base = "foo";
+  in[0].len = 3;
+  in[1].base = "bar";
+  in[1].len = 3;
+  n = 4;
+  res = gsasl_encodev (client, in, 2, out, &n);
+  if (res != GSASL_OK || n != 2 || memcmp (in, out, sizeof (in)) != 0)
+    fail ("encodev pass through (%d)\n", res);
+  n = 4;
+  res = gsasl_decodev (server, in, 2, out, &n);
+  if (res != GSASL_OK || n != 2 || memcmp (in, out, sizeof (in)) != 0)
+    fail ("decodev pass through (%d)\n", res);
+
+  gsasl_finish (client);
+  gsasl_finish (server);
+}
+
+void
+doit (void)
+{
+  Gsasl *ctx = NULL;
+  int res;
+
+  res = gsasl_init (&ctx);
+  if (res != GSASL_OK)
+    {
+      fail ("gsasl_init() failed (%d):\n%s\n", res, gsasl_strerror (res));
+      return;
+    }
+
+  gsasl_callback_set (ctx, callback);
+
+  digest_md5 (ctx);
+  plain (ctx);
+
+  gsasl_done (ctx);
+}
@@ -0,0 +1,273 @@
+/* digest-md5-conf.c --- Test the DIGEST-MD5 confidentiality layer.
+ * Copyright (C) 2012 Simon Josefsson
+ *
+ * This file is part of GNU SASL.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdio.h>
+#include <stdarg.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "utils.h"
+
+#define SECRET "attack at dawn, attack at dawn"
+
+static int
+callback (Gsasl * ctx, Gsasl_session * sctx, Gsasl_property prop)
+{
+  switch (prop)
+    {
+    case GSASL_AUTHID:
+      gsasl_property_set (sctx, prop, "user");
+      return GSASL_OK;
+
+    case GSASL_PASSWORD:
+      gsasl_property_set (sctx, prop, "pencil");
+      return GSASL_OK;
+
+    case GSASL_SERVICE:
+      gsasl_property_set (sctx, prop, "imap");
+      return GSASL_OK;
+
+    case GSASL_HOSTNAME:
+      gsasl_property_set (sctx, prop, "hostname");
+      return GSASL_OK;
+
+    case GSASL_QOPS:
+      gsasl_property_set (sctx, prop, "qop-auth, qop-int, qop-conf");
+      return GSASL_OK;
+
+    case GSASL_QOP:
+      gsasl_property_set (sctx, prop, "qop-conf");
+      return GSASL_OK;
+
+    default:
+      return GSASL_NO_CALLBACK;
+    }
+}
+
+/* Replace the list of ciphers in the CHALLENGE with CIPHER.  Returns
+   false if the challenge does not offer CIPHER. */
+static int
+only (char **challenge, size_t * len, const char *cipher)
+{
+  char *p = strstr (*challenge, "cipher=\"");
+  char *end, *out, *q;
+  size_t n = strlen (cipher);
+
+  if (!p)
+    return 0;
+  p += strlen ("cipher=\"");
+  end = strchr (p, '"');
+  if (!end)
+    fail ("unterminated cipher list\n");
+
+  for (q = p; q < end; q += strcspn (q, ",\"") + 1)
+    {
+      q += strspn (q, " ");
+      if (strncmp (q, cipher, n) == 0 && (q[n] == ',' || q[n] == '"'))
+	break;
+    }
+  if (q >= end)
+    return 0;
+
+  out = malloc (*len + strlen (cipher) + 1);
+  if (!out)
+    fail ("malloc\n");
+  sprintf (out, "%.*s%s%s", (int) (p - *challenge), *challenge, cipher, end);
+  free (*challenge);
+  *challenge = out;
+  *len = strlen (out);
+
+  return 1;
+}
+
+/* Return true iff the LEN bytes at DATA contain the N bytes at P. */
+static int
+contains (const char *data, size_t len, const char *p, size_t n)
+{
+  size_t i;
+
+  for (i = 0; i + n <= len; i++)
+    if (memcmp (data + i, p, n) == 0)
+      return 1;
+
+  return 0;
+}
+
+static void
+exchange (Gsasl_session * from, Gsasl_session * to, size_t len)
+{
+  char *enc, *dec, *p;
+  Gsasl_iov in[2], out[4], dv[4];
+  size_t enclen, declen, n;
+  int res;
+
+  res = gsasl_encode (from, SECRET, len, &enc, &enclen);
+  if (res != GSASL_OK)
+    fail ("gsasl_encode (%d)\n", res);
+  if (len > 8 && contains (enc, enclen, SECRET, 8))
+    fail ("plaintext visible in sealed message\n");
+  res = gsasl_decode (to, enc, enclen, &dec, &declen);
+  if (res != GSASL_OK || declen != len || memcmp (dec, SECRET, len) != 0)
+    fail ("gsasl_decode of %lu bytes (%d)\n", (unsigned long) len, res);
+  free (enc);
+  free (dec);
+
+  /* The same with segments, and the message split in two. */
+  in[0].base = SECRET;
+  in[0].len = len / 2;
+  in[1].base = SECRET + len / 2;
+  in[1].len = len - len / 2;
+  n = 4;
+  res = gsasl_encodev (from, in, 2, out, &n);
+  if (res != GSASL_OK || n != 1)
+    fail ("gsasl_encodev (%d)\n", res);
+  p = malloc (out[0].len);
+  if (!p)
+    fail ("malloc\n");
+  memcpy (p, out[0].base, out[0].len);
+  in[0].base = p;
+  in[0].len = out[0].len / 3;
+  in[1].base = p + in[0].len;
+  in[1].len = out[0].len - in[0].len;
+  n = 4;
+  res = gsasl_decodev (to, in, 2, dv, &n);
+  if (res != GSASL_OK || n != 1 || dv[0].len != len
+      || memcmp (dv[0].base, SECRET, len) != 0)
+    fail ("gsasl_decodev of %lu bytes (%d)\n", (unsigned long) len, res);
+  free (p);
+}
+
+/* Run the confidentiality layer with CIPHER.  Returns false if the
+   server does not offer CIPHER. */
+static int
+conf (Gsasl * ctx, const char *cipher)
+{
+  Gsasl_session *client, *server;
+  char *s1, *s2;
+  size_t s1len, s2len, i;
+  int res;
+
+  res = gsasl_server_start (ctx, "DIGEST-MD5", &server);
+  if (res != GSASL_OK)
+    fail ("gsasl_server_start() failed (%d):\n%s\n", res,
+	  gsasl_strerror (res));
+  res = gsasl_client_start (ctx, "DIGEST-MD5", &client);
+  if (res != GSASL_OK)
+    fail ("gsasl_client_start() failed (%d):\n%s\n", res,
+	  gsasl_strerror (res));
+
+  res = gsasl_step (server, NULL, 0, &s1, &s1len);
+  if (res != GSASL_NEEDS_MORE)
+    fail ("server step 1 (%d)\n", res);
+  if (!only (&s1, &s1len, cipher))
+    {
+      if (debug)
+	printf ("Cipher %s not offered: %s\n", cipher, s1);
+      free (s1);
+      gsasl_finish (client);
+      gsasl_finish (server);
+      return 0;
+    }
+  if (debug)
+    printf ("S: %.*s\n", (int) s1len, s1);
+
+  res = gsasl_step (client, s1, s1len, &s2, &s2len);
+  free (s1);
+  if (res != GSASL_NEEDS_MORE)
+    fail ("client step 1 (%d)\n", res);
+  if (debug)
+    printf ("C: %.*s\n", (int) s2len, s2);
+
+  res = gsasl_step (server, s2, s2len, &s1, &s1len);
+  free (s2);
+  if (res != GSASL_OK)
+    fail ("server step 2 with %s (%d)\n", cipher, res);
+
+  res = gsasl_step (client, s1, s1len, &s2, &s2len);
+  free (s1);
+  free (s2);
+  if (res != GSASL_OK)
+    fail ("client step 2 (%d)\n", res);
+
+  /* Cover each padding length, and the cipher state carried from
+     one message to the next. */
+  for (i = 0; i <= strlen (SECRET); i++)
+    {
+      exchange (client, server, i);
+      exchange (server, client, i);
+    }
+
+  /* A modified message is rejected. */
+  res = gsasl_encode (client, SECRET, strlen (SECRET), &s1, &s1len);
+  if (res != GSASL_OK)
+    fail ("gsasl_encode (%d)\n", res);
+  s1[8] ^= 1;
+  res = gsasl_decode (server, s1, s1len, &s2, &s2len);
+  if (res != GSASL_INTEGRITY_ERROR)
+    fail ("tampered message with %s (%d)\n", cipher, res);
+  free (s1);
+
+  gsasl_finish (client);
+  gsasl_finish (server);
+
+  return 1;
+}
+
+void
+doit (void)
+{
+  static const char *ciphers[] = { "rc4", "rc4-56", "rc4-40", "des", "3des" };
+  Gsasl *ctx = NULL;
+  size_t i, n = 0;
+  int res;
+
+  res = gsasl_init (&ctx);
+  if (res != GSASL_OK)
+    {
+      fail ("gsasl_init() failed (%d):\n%s\n", res, gsasl_strerror (res));
+      return;
+    }
+
+  if (!gsasl_client_support_p (ctx, "DIGEST-MD5")
+      || !gsasl_server_support_p (ctx, "DIGEST-MD5"))
+    {
+      gsasl_done (ctx);
+      fail ("No support for DIGEST-MD5.\n");
+      exit (77);
+    }
+
+  gsasl_callback_set (ctx, callback);
+
+  for (i = 0; i < sizeof (ciphers) / sizeof (ciphers[0]); i++)
+    n += conf (ctx, ciphers[i]);
+
+  gsasl_done (ctx);
+
+  if (n == 0)
+    {
+      if (debug)
+	printf ("No ciphers for DIGEST-MD5.\n");
+      exit (77);
+    }
+}
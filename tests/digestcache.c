@@ -0,0 +1,311 @@
+/* digestcache.c --- Test the DIGEST-MD5 server secret cache.
+ * Copyright (C) 2012 Simon Josefsson
+ *
+ * This file is part of GNU SASL.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdio.h>
+#include <stdarg.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "utils.h"
+
+#define PASSWORD "Open, Sesame"
+#define DIGEST_URI "imap/mail.example.org"
+#define CNONCE "OA6MHXh6VqTrRk"
+
+/* Whether the server callback gives a hashed password instead of the
+   password, and how many times it was asked for either. */
+static int use_hashed;
+static size_t lookups;
+
+static int
+callback (Gsasl * ctx, Gsasl_session * sctx, Gsasl_property prop)
+{
+  char hashed[33];
+
+  switch (prop)
+    {
+    case GSASL_PASSWORD:
+      lookups++;
+      gsasl_property_set (sctx, prop, PASSWORD);
+      return GSASL_OK;
+
+    case GSASL_DIGEST_MD5_HASHED_PASSWORD:
+      if (!use_hashed)
+	return GSASL_NO_CALLBACK;
+      lookups++;
+      if (gsasl_digest_md5_hash (gsasl_property_fast (sctx, GSASL_AUTHID),
+				 gsasl_property_fast (sctx, GSASL_REALM),
+				 PASSWORD, hashed) != GSASL_OK)
+	return GSASL_AUTHENTICATION_ERROR;
+      gsasl_property_set (sctx, prop, hashed);
+      return GSASL_OK;
+
+    default:
+      return GSASL_NO_CALLBACK;
+    }
+}
+
+/* Store the lower case hex MD5 of IN in OUT. */
+static void
+md5hex (const char *in, size_t inlen, char out[33])
+{
+  char *md5;
+  size_t i;
+
+  if (gsasl_md5 (in, inlen, &md5) != GSASL_OK)
+    {
+      fail ("gsasl_md5() failed\n");
+      exit (EXIT_FAILURE);
+    }
+  for (i = 0; i < 16; i++)
+    sprintf (out + 2 * i, "%02x", (unsigned char) md5[i]);
+  gsasl_free (md5);
+}
+
+/* Write into OUT the response of USERNAME in REALM, which may be
+   NULL, to the server CHALLENGE.  USERNAME is in UTF-8 if UTF8 is
+   true, and in ISO-8859-1 otherwise.  The secret is hashed from the
+   user name as sent, so the two forms of a name have different
+   secrets.  The client of the library always uses UTF-8, hence this
+   one. */
+static void
+response (const char *challenge, const char *username, const char *realm,
+	  int utf8, char *out, size_t outlen)
+{
+  char buf[512], *md5;
+  char ha1[33], ha2[33], resp[33];
+  const char *nonce, *end;
+  size_t len;
+
+  nonce = strstr (challenge, "nonce=\"");
+  if (!nonce || !(end = strchr (nonce + 7, '"')))
+    {
+      fail ("no nonce in `%s'\n", challenge);
+      exit (EXIT_FAILURE);
+    }
+  nonce += 7;
+
+  /* A1 := { H ({ username, ":", realm, ":", passwd }), ":", nonce,
+     ":", cnonce } */
+  len = sprintf (buf, "%s:%s:%s", username, realm ? realm : "", PASSWORD);
+  if (gsasl_md5 (buf, len, &md5) != GSASL_OK)
+    {
+      fail ("gsasl_md5() failed\n");
+      exit (EXIT_FAILURE);
+    }
+  memcpy (buf, md5, 16);
+  gsasl_free (md5);
+  len = 16 + sprintf (buf + 16, ":%.*s:%s", (int) (end - nonce), nonce,
+		      CNONCE);
+  md5hex (buf, len, ha1);
+
+  len = sprintf (buf, "AUTHENTICATE:%s", DIGEST_URI);
+  md5hex (buf, len, ha2);
+
+  len = sprintf (buf, "%s:%.*s:00000001:%s:auth:%s", ha1,
+		 (int) (end - nonce), nonce, CNONCE, ha2);
+  md5hex (buf, len, resp);
+
+  snprintf (out, outlen, "username=\"%s\",%s%s%snonce=\"%.*s\","
+	    "cnonce=\"%s\",nc=00000001,qop=auth,digest-uri=\"%s\","
+	    "response=%s%s", username,
+	    realm ? "realm=\"" : "", realm ? realm : "", realm ? "\"," : "",
+	    (int) (end - nonce), nonce, CNONCE, DIGEST_URI, resp,
+	    utf8 ? ",charset=utf-8" : "");
+}
+
+/* Authenticate USERNAME in REALM, see response(), and check that the
+   secret came from the cache if HIT is true, and from the callback
+   otherwise. */
+static void
+login (Gsasl * ctx, const char *username, const char *realm, int utf8,
+       int hit)
+{
+  Gsasl_session *server;
+  char *out;
+  char buf[512];
+  size_t outlen, hits, misses, h, m, n = lookups;
+  int res;
+
+  gsasl_digest_md5_cache_stats (ctx, &hits, &misses);
+
+  res = gsasl_server_start (ctx, "DIGEST-MD5", &server);
+  if (res != GSASL_OK)
+    {
+      fail ("gsasl_server_start() failed (%d):\n%s\n",
+	    res, gsasl_strerror (res));
+      return;
+    }
+
+  res = gsasl_step (server, NULL, 0, &out, &outlen);
+  if (res != GSASL_NEEDS_MORE)
+    fail ("challenge failed (%d): %s\n", res, gsasl_strerror (res));
+  else
+    {
+      response (out, username, realm, utf8, buf, sizeof (buf));
+      gsasl_free (out);
+      if (debug)
+	printf ("C: %s\n", buf);
+
+      res = gsasl_step (server, buf, strlen (buf), &out, &outlen);
+      if (res != GSASL_OK)
+	fail ("login of %s in %s failed (%d): %s\n", username,
+	      realm ? realm : "no realm", res, gsasl_strerror (res));
+      else
+	gsasl_free (out);
+    }
+  gsasl_finish (server);
+
+  gsasl_digest_md5_cache_stats (ctx, &h, &m);
+  if (hit ? h != hits + 1 || m != misses || lookups != n
+      : h != hits || m != misses + 1 || lookups != n + 1)
+    fail ("%s in %s should be a cache %s\n", username,
+	  realm ? realm : "no realm", hit ? "hit" : "miss");
+}
+
+static void
+check_hash (void)
+{
+  Gsasl_digest_md5_secret secrets[3];
+  char hashed[33];
+  int res;
+
+  /* RFC 2831 section 4. */
+  res = gsasl_digest_md5_hash ("chris", "elwood.innosoft.com", "secret",
+			       hashed);
+  if (res != GSASL_OK || strcmp (hashed, "eb5a750053e4d2c34aa84bbc9b0b6ee7"))
+    fail ("gsasl_digest_md5_hash() = %d `%s'\n", res, hashed);
+
+  memset (secrets, 0, sizeof (secrets));
+  secrets[0].username = "chris";
+  secrets[0].realm = "elwood.innosoft.com";
+  secrets[0].password = "secret";
+  /* The password is hashed in ISO-8859-1 when possible. */
+  secrets[1].username = "user";
+  secrets[1].realm = "example.org";
+  secrets[1].password = "Ses\xC2\xAA" "me";
+  secrets[2].username = "user";
+  secrets[2].realm = NULL;
+  secrets[2].password = "pw";
+
+  res = gsasl_digest_md5_hash_batch (secrets, 3);
+  if (res != GSASL_OK)
+    fail ("gsasl_digest_md5_hash_batch() failed (%d)\n", res);
+  if (secrets[0].rc != GSASL_OK
+      || strcmp (secrets[0].hashed, "eb5a750053e4d2c34aa84bbc9b0b6ee7"))
+    fail ("batch entry 0 `%s'\n", secrets[0].hashed);
+  if (secrets[1].rc != GSASL_OK
+      || strcmp (secrets[1].hashed, "2b07930d0dbf4349da4a30bff4449f83"))
+    fail ("batch entry 1 `%s'\n", secrets[1].hashed);
+  if (secrets[2].rc != GSASL_OK
+      || strcmp (secrets[2].hashed, "08a27b9a55dca5ac5f0a2bc7361c514d"))
+    fail ("batch entry 2 `%s'\n", secrets[2].hashed);
+}
+
+void
+doit (void)
+{
+  Gsasl *ctx = NULL;
+  size_t hits, misses;
+  int res;
+
+  check_hash ();
+
+  res = gsasl_init (&ctx);
+  if (res != GSASL_OK)
+    {
+      fail ("gsasl_init() failed (%d):\n%s\n", res, gsasl_strerror (res));
+      return;
+    }
+
+  if (!gsasl_server_support_p (ctx, "DIGEST-MD5"))
+    {
+      gsasl_done (ctx);
+      fail ("No support for DIGEST-MD5.\n");
+      exit (77);
+    }
+
+  gsasl_callback_set (ctx, callback);
+
+  res = gsasl_digest_md5_cache_set (ctx, 10, 0);
+  if (res != GSASL_OK)
+    fail ("gsasl_digest_md5_cache_set() failed (%d): %s\n",
+	  res, gsasl_strerror (res));
+
+  /* The realm is part of the secret, and of the cache key. */
+  login (ctx, "user", "a.example.org", 1, 0);
+  login (ctx, "user", "b.example.org", 1, 0);
+  login (ctx, "user", NULL, 1, 0);
+  login (ctx, "user", "a.example.org", 1, 1);
+  login (ctx, "user", "b.example.org", 1, 1);
+  login (ctx, "user", NULL, 1, 1);
+
+  gsasl_digest_md5_cache_forget (ctx, "user", "a.example.org");
+  login (ctx, "user", "a.example.org", 1, 0);
+  login (ctx, "user", "b.example.org", 1, 1);
+
+  /* The same GSASL_AUTHID, sent in ISO-8859-1 and in UTF-8, has two
+     secrets.  Forgetting the user removes both. */
+  login (ctx, "J\xF6rg", "a.example.org", 0, 0);
+  login (ctx, "J\xC3\xB6rg", "a.example.org", 1, 0);
+  login (ctx, "J\xF6rg", "a.example.org", 0, 1);
+  login (ctx, "J\xC3\xB6rg", "a.example.org", 1, 1);
+  gsasl_digest_md5_cache_forget (ctx, "J\xC3\xB6rg", NULL);
+  login (ctx, "J\xF6rg", "a.example.org", 0, 0);
+  login (ctx, "J\xC3\xB6rg", "a.example.org", 1, 0);
+
+  /* A hashed password from the application is used as is, and does
+     not end up as the entry that a password would get. */
+  gsasl_digest_md5_cache_forget (ctx, NULL, NULL);
+  use_hashed = 1;
+  login (ctx, "user", "a.example.org", 1, 0);
+  login (ctx, "user", "a.example.org", 1, 0);
+  use_hashed = 0;
+  login (ctx, "user", "a.example.org", 1, 0);
+  login (ctx, "user", "a.example.org", 1, 1);
+
+  /* The least recently used user and realm is evicted. */
+  res = gsasl_digest_md5_cache_set (ctx, 2, 0);
+  if (res != GSASL_OK)
+    fail ("gsasl_digest_md5_cache_set() failed (%d): %s\n",
+	  res, gsasl_strerror (res));
+  login (ctx, "user", "a.example.org", 1, 0);
+  login (ctx, "user", "b.example.org", 1, 0);
+  login (ctx, "user", "a.example.org", 1, 1);
+  login (ctx, "user", NULL, 1, 0);
+  login (ctx, "user", "a.example.org", 1, 1);
+  login (ctx, "user", "b.example.org", 1, 0);
+
+  /* Disabling the cache resets the counters. */
+  res = gsasl_digest_md5_cache_set (ctx, 0, 0);
+  if (res != GSASL_OK)
+    fail ("gsasl_digest_md5_cache_set() failed (%d): %s\n",
+	  res, gsasl_strerror (res));
+  gsasl_digest_md5_cache_stats (ctx, &hits, &misses);
+  if (hits != 0 || misses != 0)
+    fail ("stats of disabled cache %lu/%lu\n", (unsigned long) hits,
+	  (unsigned long) misses);
+
+  gsasl_done (ctx);
+}
@@ -0,0 +1,324 @@
+/* freeze.c --- Test sharing a frozen handle between threads.
+ * Copyright (C) 2012 Simon Josefsson
+ *
+ * This file is part of GNU SASL.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdio.h>
+#include <stdarg.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if USE_POSIX_THREADS
+# include <pthread.h>
+#endif
+
+#include "utils.h"
+
+#define NTHREADS 4
+#define LOOPS 20
+#define NREGISTER 100
+#define MAXMECHS 32
+
+static Gsasl *ctx;
+static const char *usable[MAXMECHS];
+static size_t n_usable;
+
+static char names[NREGISTER][GSASL_MAX_MECHANISM_SIZE + 1];
+static Gsasl_mechanism mechs[NREGISTER];
+
+static int
+callback (Gsasl * ctx, Gsasl_session * sctx, Gsasl_property prop)
+{
+  switch (prop)
+    {
+    case GSASL_AUTHID:
+      gsasl_property_set (sctx, prop, "user");
+      return GSASL_OK;
+
+    case GSASL_PASSWORD:
+      gsasl_property_set (sctx, prop, "pencil");
+      return GSASL_OK;
+
+    case GSASL_PASSCODE:
+      gsasl_property_set (sctx, prop, "4711");
+      return GSASL_OK;
+
+    case GSASL_ANONYMOUS_TOKEN:
+      gsasl_property_set (sctx, prop, "token");
+      return GSASL_OK;
+
+    case GSASL_SERVICE:
+      gsasl_property_set (sctx, prop, "imap");
+      return GSASL_OK;
+
+    case GSASL_HOSTNAME:
+      gsasl_property_set (sctx, prop, "localhost");
+      return GSASL_OK;
+
+    case GSASL_CB_TLS_UNIQUE:
+      /* Only for SCRAM-SHA-1-PLUS, which SCRAM-SHA-1 would take as a
+         downgrade. */
+      if (!strstr (gsasl_mechanism_name (sctx), "-PLUS"))
+	return GSASL_NO_CALLBACK;
+      gsasl_property_set (sctx, prop, "Zm5vcmQ=");
+      return GSASL_OK;
+
+    case GSASL_SAML20_IDP_IDENTIFIER:
+      gsasl_property_set (sctx, prop, "https://saml.example.org/");
+      return GSASL_OK;
+
+    case GSASL_SAML20_REDIRECT_URL:
+      gsasl_property_set (sctx, prop, "https://saml.example.org/SSO/");
+      return GSASL_OK;
+
+    case GSASL_OPENID20_REDIRECT_URL:
+      gsasl_property_set (sctx, prop, "http://idp.example/NONCE/");
+      return GSASL_OK;
+
+    case GSASL_SAML20_AUTHENTICATE_IN_BROWSER:
+    case GSASL_OPENID20_AUTHENTICATE_IN_BROWSER:
+    case GSASL_VALIDATE_SIMPLE:
+    case GSASL_VALIDATE_ANONYMOUS:
+    case GSASL_VALIDATE_EXTERNAL:
+    case GSASL_VALIDATE_SECURID:
+    case GSASL_VALIDATE_SAML20:
+    case GSASL_VALIDATE_OPENID20:
+      return GSASL_OK;
+
+    default:
+      return GSASL_NO_CALLBACK;
+    }
+}
+
+/* The same callback at another address, installed while the handle
+   is in use. */
+static int
+callback2 (Gsasl * ctx, Gsasl_session * sctx, Gsasl_property prop)
+{
+  return callback (ctx, sctx, prop);
+}
+
+static int
+dummy_step (Gsasl_session * sctx, void *mech_data,
+	    const char *input, size_t input_len,
+	    char **output, size_t * output_len)
+{
+  *output = NULL;
+  *output_len = 0;
+  return GSASL_OK;
+}
+
+/* Authenticate a client to a server with MECH, and return GSASL_OK
+   when both ends succeed. */
+static int
+authenticate (const char *mech)
+{
+  Gsasl_session *client, *server;
+  char *s = NULL, *c = NULL;
+  size_t slen = 0, clen = 0;
+  int cres, sres, rounds;
+
+  cres = gsasl_client_start (ctx, mech, &client);
+  if (cres != GSASL_OK)
+    return cres;
+  sres = gsasl_server_start (ctx, mech, &server);
+  if (sres != GSASL_OK)
+    {
+      gsasl_finish (client);
+      return sres;
+    }
+  cres = GSASL_NEEDS_MORE;
+
+  /* The server goes first, sending an empty challenge to mechanisms
+     where the client starts. */
+  for (rounds = 0; rounds < 10; rounds++)
+    {
+      sres = gsasl_step (server, c, clen, &s, &slen);
+      free (c);
+      c = NULL;
+      if (sres != GSASL_OK && sres != GSASL_NEEDS_MORE)
+	break;
+      if (sres == GSASL_OK && cres == GSASL_OK && slen == 0)
+	break;
+
+      cres = gsasl_step (client, s, slen, &c, &clen);
+      free (s);
+      s = NULL;
+      if (cres != GSASL_OK && cres != GSASL_NEEDS_MORE)
+	break;
+      if (sres == GSASL_OK)
+	break;
+    }
+
+  free (c);
+  free (s);
+  gsasl_finish (client);
+  gsasl_finish (server);
+
+  if (sres != GSASL_OK)
+    return sres;
+  return cres == GSASL_NEEDS_MORE ? GSASL_AUTHENTICATION_ERROR : cres;
+}
+
+/* Authenticate with every usable mechanism, look them up and list
+   them. */
+static void *
+worker (void *arg)
+{
+  const char *best;
+  char *list;
+  size_t i, j;
+  int res;
+
+  for (i = 0; i < LOOPS; i++)
+    for (j = 0; j < n_usable; j++)
+      {
+	res = authenticate (usable[j]);
+	if (res != GSASL_OK)
+	  fail ("%s failed in a thread (%d)\n", usable[j], res);
+
+	if (!gsasl_server_support_p (ctx, usable[j]))
+	  fail ("%s not supported\n", usable[j]);
+	best = gsasl_client_suggest_mechanism (ctx, usable[j]);
+	if (!best || strcmp (best, usable[j]) != 0)
+	  fail ("%s not suggested\n", usable[j]);
+
+	if (j == 0)
+	  {
+	    res = gsasl_server_mechlist (ctx, &list);
+	    if (res != GSASL_OK || !strstr (list, usable[0]))
+	      fail ("gsasl_server_mechlist (%d)\n", res);
+	    free (list);
+	  }
+      }
+
+  return arg;
+}
+
+/* Register new mechanisms and swap callbacks while the workers
+   run. */
+static void *
+registrar (void *arg)
+{
+  char *list;
+  size_t i;
+  int res;
+
+  for (i = 0; i < NREGISTER; i++)
+    {
+      res = gsasl_register (ctx, &mechs[i]);
+      if (res != GSASL_OK)
+	fail ("gsasl_register (%d)\n", res);
+      if (!gsasl_client_support_p (ctx, names[i])
+	  || !gsasl_server_support_p (ctx, names[i]))
+	fail ("%s not registered\n", names[i]);
+
+      gsasl_callback_set (ctx, i % 2 ? callback : callback2);
+
+      if (i % 10 == 0)
+	{
+	  res = gsasl_server_mechlist (ctx, &list);
+	  if (res != GSASL_OK || !strstr (list, names[i]))
+	    fail ("%s not listed (%d)\n", names[i], res);
+	  free (list);
+	}
+    }
+
+  return arg;
+}
+
+void
+doit (void)
+{
+#if USE_POSIX_THREADS
+  pthread_t threads[NTHREADS + 1];
+#endif
+  char *list, *p;
+  size_t i;
+  int res;
+
+  res = gsasl_init (&ctx);
+  if (res != GSASL_OK)
+    {
+      fail ("gsasl_init() failed (%d):\n%s\n", res, gsasl_strerror (res));
+      return;
+    }
+
+  gsasl_callback_set (ctx, callback);
+
+  for (i = 0; i < NREGISTER; i++)
+    {
+      sprintf (names[i], "X-FREEZE-%lu", (unsigned long) i);
+      mechs[i].name = names[i];
+      mechs[i].client.step = dummy_step;
+      mechs[i].server.step = dummy_step;
+    }
+
+  /* Find the builtin mechanisms that work without external
+     services. */
+  res = gsasl_server_mechlist (ctx, &list);
+  if (res != GSASL_OK)
+    fail ("gsasl_server_mechlist (%d)\n", res);
+  for (p = strtok (list, " "); p && n_usable < MAXMECHS;
+       p = strtok (NULL, " "))
+    if (gsasl_client_support_p (ctx, p) && authenticate (p) == GSASL_OK)
+      usable[n_usable++] = strdup (p);
+    else if (debug)
+      printf ("Skipping %s\n", p);
+  free (list);
+
+  if (n_usable == 0)
+    {
+      gsasl_done (ctx);
+      return;
+    }
+  if (debug)
+    for (i = 0; i < n_usable; i++)
+      printf ("Using %s\n", usable[i]);
+
+  gsasl_freeze (ctx);
+
+#if USE_POSIX_THREADS
+  for (i = 0; i < NTHREADS; i++)
+    if (pthread_create (&threads[i], NULL, worker, NULL) != 0)
+      fail ("pthread_create\n");
+  if (pthread_create (&threads[NTHREADS], NULL, registrar, NULL) != 0)
+    fail ("pthread_create\n");
+  for (i = 0; i <= NTHREADS; i++)
+    pthread_join (threads[i], NULL);
+#else
+  worker (NULL);
+  registrar (NULL);
+#endif
+
+  for (i = 0; i < NREGISTER; i++)
+    if (!gsasl_server_support_p (ctx, names[i]))
+      fail ("%s lost\n", names[i]);
+  for (i = 0; i < n_usable; i++)
+    if (authenticate (usable[i]) != GSASL_OK)
+      fail ("%s failed after registrations\n", usable[i]);
+
+  for (i = 0; i < n_usable; i++)
+    free ((char *) usable[i]);
+
+  gsasl_done (ctx);
+}
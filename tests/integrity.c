@@ -0,0 +1,217 @@
+/* integrity.c --- Test and time the DIGEST-MD5 integrity layer.
+ * Copyright (C) 2012 Simon Josefsson
+ *
+ * This file is part of GNU SASL.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdio.h>
+#include <stdarg.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "utils.h"
+
+static int
+callback (Gsasl * ctx, Gsasl_session * sctx, Gsasl_property prop)
+{
+  switch (prop)
+    {
+    case GSASL_AUTHID:
+      gsasl_property_set (sctx, prop, "user");
+      return GSASL_OK;
+
+    case GSASL_PASSWORD:
+      gsasl_property_set (sctx, prop, "pencil");
+      return GSASL_OK;
+
+    case GSASL_SERVICE:
+      gsasl_property_set (sctx, prop, "imap");
+      return GSASL_OK;
+
+    case GSASL_HOSTNAME:
+      gsasl_property_set (sctx, prop, "hostname");
+      return GSASL_OK;
+
+    case GSASL_QOPS:
+    case GSASL_QOP:
+      gsasl_property_set (sctx, prop, "qop-int");
+      return GSASL_OK;
+
+    default:
+      return GSASL_NO_CALLBACK;
+    }
+}
+
+static void
+authenticate (Gsasl_session * client, Gsasl_session * server)
+{
+  char *in = NULL, *out = NULL;
+  size_t inlen = 0, outlen;
+  int crc = GSASL_NEEDS_MORE, src;
+
+  src = gsasl_step (server, NULL, 0, &out, &outlen);
+  while (src == GSASL_NEEDS_MORE || crc == GSASL_NEEDS_MORE)
+    {
+      if (src != GSASL_OK && src != GSASL_NEEDS_MORE)
+	fail ("server step failed (%d): %s\n", src, gsasl_strerror (src));
+      free (in);
+      in = out;
+      inlen = outlen;
+      out = NULL;
+      if (crc == GSASL_NEEDS_MORE)
+	{
+	  crc = gsasl_step (client, in, inlen, &out, &outlen);
+	  if (crc != GSASL_OK && crc != GSASL_NEEDS_MORE)
+	    fail ("client step failed (%d): %s\n", crc, gsasl_strerror (crc));
+	}
+      free (in);
+      in = out;
+      inlen = outlen;
+      out = NULL;
+      if (src == GSASL_NEEDS_MORE)
+	src = gsasl_step (server, in, inlen, &out, &outlen);
+    }
+  free (in);
+  free (out);
+}
+
+#define MAXSIZE (16 * 1024 * 1024)
+
+/* Data hashed for each message size. */
+#define VOLUME (16 * 1024 * 1024)
+
+static void
+report (const char *what, size_t size, size_t loops, clock_t start)
+{
+  double secs = (double) (clock () - start) / CLOCKS_PER_SEC;
+
+  if (debug)
+    printf ("%s %8lu bytes: %5lu calls in %.3f s, %.1f MB/s\n", what,
+	    (unsigned long) size, (unsigned long) loops, secs,
+	    secs > 0 ? (double) size * loops / secs / 1e6 : 0.0);
+}
+
+void
+doit (void)
+{
+  static const size_t sizes[] = { 1024, 16 * 1024, 256 * 1024,
+    4 * 1024 * 1024, MAXSIZE
+  };
+  Gsasl *ctx = NULL;
+  Gsasl_session *client, *server;
+  Gsasl_iov in, out[3], dec[3];
+  const char *ref;
+  char *data, *msg;
+  size_t i, j, n, m, loops, reflen, msglen;
+  clock_t start;
+  int res;
+
+  res = gsasl_init (&ctx);
+  if (res != GSASL_OK)
+    {
+      fail ("gsasl_init() failed (%d):\n%s\n", res, gsasl_strerror (res));
+      return;
+    }
+
+  if (!gsasl_client_support_p (ctx, "DIGEST-MD5")
+      || !gsasl_server_support_p (ctx, "DIGEST-MD5"))
+    {
+      gsasl_done (ctx);
+      if (debug)
+	printf ("No support for DIGEST-MD5.\n");
+      return;
+    }
+
+  gsasl_callback_set (ctx, callback);
+
+  res = gsasl_client_start (ctx, "DIGEST-MD5", &client);
+  if (res != GSASL_OK)
+    fail ("gsasl_client_start() failed (%d):\n%s\n", res,
+	  gsasl_strerror (res));
+  res = gsasl_server_start (ctx, "DIGEST-MD5", &server);
+  if (res != GSASL_OK)
+    fail ("gsasl_server_start() failed (%d):\n%s\n", res,
+	  gsasl_strerror (res));
+
+  authenticate (client, server);
+
+  data = malloc (MAXSIZE);
+  msg = malloc (MAXSIZE + 20);
+  if (!data || !msg)
+    fail ("malloc\n");
+  for (i = 0; i < MAXSIZE; i++)
+    data[i] = i * 7 + (i >> 8);
+
+  for (i = 0; i < sizeof (sizes) / sizeof (sizes[0]); i++)
+    {
+      loops = VOLUME / sizes[i];
+      in.base = data;
+      in.len = sizes[i];
+
+      /* Only the framing is written, the MAC is computed in place. */
+      start = clock ();
+      for (j = 0; j < loops; j++)
+	{
+	  n = 3;
+	  res = gsasl_encodev (client, &in, 1, out, &n);
+	  if (res != GSASL_OK || n != 3)
+	    fail ("gsasl_encodev (%d)\n", res);
+	}
+      report ("encode", sizes[i], loops, start);
+
+      /* Messages from the server are checked by the client. */
+      start = clock ();
+      for (j = 0; j < loops; j++)
+	{
+	  res = gsasl_encode_ref (server, data, sizes[i], &ref, &reflen);
+	  if (res != GSASL_OK || reflen != sizes[i] + 20)
+	    fail ("gsasl_encode_ref (%d)\n", res);
+	  memcpy (msg, ref, reflen);
+	  msglen = reflen;
+
+	  in.base = msg;
+	  in.len = msglen;
+	  m = 3;
+	  res = gsasl_decodev (client, &in, 1, dec, &m);
+	  if (res != GSASL_OK || m != 1 || dec[0].len != sizes[i]
+	      || dec[0].base != msg + 4)
+	    fail ("gsasl_decodev (%d)\n", res);
+	}
+      report ("decode", sizes[i], loops, start);
+
+      if (memcmp (dec[0].base, data, sizes[i]) != 0)
+	fail ("data mismatch for %lu bytes\n", (unsigned long) sizes[i]);
+
+      /* Any modification is detected. */
+      msg[4 + sizes[i] / 2] ^= 0x80;
+      m = 3;
+      res = gsasl_decodev (client, &in, 1, dec, &m);
+      if (res != GSASL_INTEGRITY_ERROR)
+	fail ("tampered message accepted (%d)\n", res);
+    }
+
+  free (data);
+  free (msg);
+  gsasl_finish (client);
+  gsasl_finish (server);
+  gsasl_done (ctx);
+}
@@ -0,0 +1,145 @@
+/* mechindex.c --- Test and time mechanism lookup by name.
+ * Copyright (C) 2012 Simon Josefsson
+ *
+ * This file is part of GNU SASL.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdio.h>
+#include <stdarg.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "utils.h"
+
+#define NMECHS 500
+#define LOOPS 20000
+
+static char names[NMECHS][GSASL_MAX_MECHANISM_SIZE + 1];
+static Gsasl_mechanism mechs[NMECHS];
+
+static int
+bench_step (Gsasl_session * sctx, void *mech_data,
+	    const char *input, size_t input_len,
+	    char **output, size_t * output_len)
+{
+  *output = NULL;
+  *output_len = 0;
+  return GSASL_OK;
+}
+
+static void
+report (const char *what, clock_t start)
+{
+  double secs = (double) (clock () - start) / CLOCKS_PER_SEC;
+
+  if (debug)
+    printf ("%s: %d calls in %.3f s, %.0f ns/call\n", what, LOOPS, secs,
+	    secs * 1e9 / LOOPS);
+}
+
+void
+doit (void)
+{
+  Gsasl *ctx = NULL;
+  Gsasl_session *sctx;
+  const char *p;
+  char list[200];
+  clock_t start;
+  size_t i;
+  int res;
+
+  res = gsasl_init (&ctx);
+  if (res != GSASL_OK)
+    {
+      fail ("gsasl_init() failed (%d):\n%s\n", res, gsasl_strerror (res));
+      return;
+    }
+
+  for (i = 0; i < NMECHS; i++)
+    {
+      sprintf (names[i], "X-BENCH-%lu", (unsigned long) i);
+      mechs[i].name = names[i];
+      mechs[i].client.step = bench_step;
+      mechs[i].server.step = bench_step;
+
+      res = gsasl_register (ctx, &mechs[i]);
+      if (res != GSASL_OK)
+	fail ("gsasl_register(%s) failed (%d):\n%s\n", names[i],
+	      res, gsasl_strerror (res));
+    }
+
+  for (i = 0; i < NMECHS; i++)
+    if (!gsasl_client_support_p (ctx, names[i])
+	|| !gsasl_server_support_p (ctx, names[i]))
+      fail ("%s not found\n", names[i]);
+
+  /* Only complete names match. */
+  if (gsasl_server_support_p (ctx, "X-BENCH-")
+      || gsasl_server_support_p (ctx, "X-BENCH-1000")
+      || gsasl_server_support_p (ctx, "x-bench-1")
+      || gsasl_server_support_p (ctx, "")
+      || gsasl_server_support_p (ctx, NULL))
+    fail ("unexpected mechanism found\n");
+
+  if (gsasl_server_start (ctx, "X-BENCH", &sctx) != GSASL_UNKNOWN_MECHANISM)
+    fail ("started unknown mechanism\n");
+
+  /* The suggestion is the last registered mechanism in the list. */
+  p = gsasl_client_suggest_mechanism (ctx, "X-BENCH-25 X-BENCH-2 "
+				      "X-BENCH-499 X-BENCH-250 X-BENCH");
+  if (!p || strcmp (p, "X-BENCH-499") != 0)
+    fail ("unexpected suggestion %s\n", p ? p : "(null)");
+
+  p = gsasl_client_suggest_mechanism (ctx, "X-BENCH X-BENCH-2X");
+  if (p)
+    fail ("suggested %s for unknown mechanisms\n", p);
+
+  start = clock ();
+  for (i = 0; i < LOOPS; i++)
+    if (!gsasl_server_support_p (ctx, names[i % NMECHS]))
+      fail ("support_p failed\n");
+  report ("support_p", start);
+
+  start = clock ();
+  for (i = 0; i < LOOPS; i++)
+    {
+      res = gsasl_server_start (ctx, names[i % NMECHS], &sctx);
+      if (res != GSASL_OK)
+	fail ("gsasl_server_start() failed (%d):\n%s\n",
+	      res, gsasl_strerror (res));
+      gsasl_finish (sctx);
+    }
+  report ("server_start", start);
+
+  sprintf (list, "FOO BAR %s %s %s", names[NMECHS - 3], names[7],
+	   names[NMECHS / 2]);
+  start = clock ();
+  for (i = 0; i < LOOPS; i++)
+    {
+      p = gsasl_client_suggest_mechanism (ctx, list);
+      if (!p || strcmp (p, names[NMECHS - 3]) != 0)
+	fail ("unexpected suggestion %s\n", p ? p : "(null)");
+    }
+  report ("suggest", start);
+
+  gsasl_done (ctx);
+}
@@ -0,0 +1,203 @@
+/* mechlist.c --- Test the client and server mechanism lists.
+ * Copyright (C) 2012 Simon Josefsson
+ *
+ * This file is part of GNU SASL.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdio.h>
+#include <stdarg.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "utils.h"
+
+static int have_tls;
+static int x_test_ok;
+static size_t x_test_starts;
+static size_t cb_tls_calls;
+
+static int
+callback (Gsasl * ctx, Gsasl_session * sctx, Gsasl_property prop)
+{
+  if (prop != GSASL_CB_TLS_UNIQUE)
+    return GSASL_NO_CALLBACK;
+
+  cb_tls_calls++;
+
+  if (strcmp (gsasl_mechanism_name (sctx), "SCRAM-SHA-1-PLUS") != 0)
+    fail ("probe for %s asked for channel bindings\n",
+	  gsasl_mechanism_name (sctx));
+
+  if (!have_tls)
+    return GSASL_NO_CALLBACK;
+
+  gsasl_property_set (sctx, prop, "Zm5vcmQ=");
+
+  return GSASL_OK;
+}
+
+static int
+x_test_start (Gsasl_session * sctx, void **mech_data)
+{
+  x_test_starts++;
+  *mech_data = NULL;
+  return x_test_ok ? GSASL_OK : GSASL_AUTHENTICATION_ERROR;
+}
+
+static int
+x_test_step (Gsasl_session * sctx, void *mech_data,
+	     const char *input, size_t input_len,
+	     char **output, size_t * output_len)
+{
+  *output = NULL;
+  *output_len = 0;
+  return GSASL_OK;
+}
+
+static Gsasl_mechanism x_test_mechanism = {
+  "X-TEST",
+  {NULL, NULL, NULL, NULL, NULL, NULL, NULL},
+  {NULL, NULL, x_test_start, x_test_step, NULL, NULL, NULL}
+};
+
+/* Return true iff the space separated LIST contains NAME. */
+static int
+has (const char *list, const char *name)
+{
+  size_t len = strlen (name);
+  const char *p = list;
+
+  while ((p = strstr (p, name)) != NULL)
+    {
+      if ((p == list || p[-1] == ' ') && (p[len] == ' ' || p[len] == '\0'))
+	return 1;
+      p += len;
+    }
+
+  return 0;
+}
+
+static char *
+server_list (Gsasl * ctx)
+{
+  char *out;
+  int res;
+
+  res = gsasl_server_mechlist (ctx, &out);
+  if (res != GSASL_OK)
+    fail ("gsasl_server_mechlist() failed (%d):\n%s\n",
+	  res, gsasl_strerror (res));
+
+  if (debug)
+    printf ("server: %s\n", out);
+
+  if (*out == ' ' || (*out && out[strlen (out) - 1] == ' ')
+      || strstr (out, "  "))
+    fail ("badly separated list '%s'\n", out);
+
+  return out;
+}
+
+void
+doit (void)
+{
+  Gsasl *ctx = NULL;
+  char *out, *out2;
+  int res;
+
+  res = gsasl_init (&ctx);
+  if (res != GSASL_OK)
+    {
+      fail ("gsasl_init() failed (%d):\n%s\n", res, gsasl_strerror (res));
+      return;
+    }
+
+  if (!gsasl_server_support_p (ctx, "SCRAM-SHA-1-PLUS"))
+    {
+      gsasl_done (ctx);
+      if (debug)
+	printf ("No support for SCRAM-SHA-1-PLUS.\n");
+      return;
+    }
+
+  gsasl_callback_set (ctx, callback);
+
+  /* Without channel bindings, PLUS is not offered. */
+  out = server_list (ctx);
+  if (has (out, "SCRAM-SHA-1-PLUS") || !has (out, "SCRAM-SHA-1"))
+    fail ("unexpected list without TLS '%s'\n", out);
+  if (cb_tls_calls != 1)
+    fail ("expected one probe, got %lu\n", (unsigned long) cb_tls_calls);
+
+  out2 = server_list (ctx);
+  if (strcmp (out, out2) != 0)
+    fail ("lists differ '%s' '%s'\n", out, out2);
+  gsasl_free (out2);
+
+  /* The probe is evaluated on each call, so a connection using TLS
+     sees PLUS. */
+  have_tls = 1;
+  out2 = server_list (ctx);
+  if (!has (out2, "SCRAM-SHA-1-PLUS"))
+    fail ("PLUS missing with TLS '%s'\n", out2);
+  if (strlen (out2) != strlen (out) + strlen (" SCRAM-SHA-1-PLUS"))
+    fail ("unexpected list with TLS '%s'\n", out2);
+  gsasl_free (out2);
+  gsasl_free (out);
+
+  have_tls = 0;
+  out = server_list (ctx);
+  if (has (out, "SCRAM-SHA-1-PLUS"))
+    fail ("PLUS offered after TLS went away '%s'\n", out);
+  gsasl_free (out);
+
+  /* Mechanisms registered by the application are still started. */
+  res = gsasl_register (ctx, &x_test_mechanism);
+  if (res != GSASL_OK)
+    fail ("gsasl_register() failed (%d):\n%s\n", res, gsasl_strerror (res));
+
+  out = server_list (ctx);
+  if (has (out, "X-TEST") || x_test_starts != 1)
+    fail ("failing X-TEST listed '%s' (%lu)\n", out,
+	  (unsigned long) x_test_starts);
+  gsasl_free (out);
+
+  x_test_ok = 1;
+  out = server_list (ctx);
+  if (!has (out, "X-TEST") || x_test_starts != 2)
+    fail ("X-TEST not listed '%s' (%lu)\n", out,
+	  (unsigned long) x_test_starts);
+  gsasl_free (out);
+
+  /* X-TEST has no client code. */
+  res = gsasl_client_mechlist (ctx, &out);
+  if (res != GSASL_OK)
+    fail ("gsasl_client_mechlist() failed (%d):\n%s\n",
+	  res, gsasl_strerror (res));
+  if (debug)
+    printf ("client: %s\n", out);
+  if (has (out, "X-TEST") || has (out, "SCRAM-SHA-1-PLUS")
+      || !has (out, "SCRAM-SHA-1"))
+    fail ("unexpected client list '%s'\n", out);
+  gsasl_free (out);
+
+  gsasl_done (ctx);
+}
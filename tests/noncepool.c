@@ -0,0 +1,265 @@
+/* noncepool.c --- Test and time the nonce pool of servers.
+ * Copyright (C) 2012 Simon Josefsson
+ *
+ * This file is part of GNU SASL.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdio.h>
+#include <stdarg.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#if USE_POSIX_THREADS
+# include <pthread.h>
+# include <unistd.h>
+# include <sys/wait.h>
+#endif
+
+#include "utils.h"
+
+#define NTHREADS 4
+#define PER_THREAD 500
+#define LOOPS 20000
+
+static Gsasl *ctx;
+static char *challenges[NTHREADS * PER_THREAD];
+
+/* Return the challenge of a new CRAM-MD5 server session. */
+static char *
+challenge (void)
+{
+  Gsasl_session *server;
+  char *out = NULL;
+  size_t len;
+  int res;
+
+  res = gsasl_server_start (ctx, "CRAM-MD5", &server);
+  if (res != GSASL_OK)
+    fail ("gsasl_server_start (%d)\n", res);
+  res = gsasl_step (server, NULL, 0, &out, &len);
+  if (res != GSASL_NEEDS_MORE)
+    fail ("gsasl_step (%d)\n", res);
+  gsasl_finish (server);
+
+  return out;
+}
+
+static void *
+worker (void *arg)
+{
+  char **out = arg;
+  size_t i;
+
+  for (i = 0; i < PER_THREAD; i++)
+    out[i] = challenge ();
+
+  return NULL;
+}
+
+static int
+compare (const void *a, const void *b)
+{
+  return strcmp (*(char *const *) a, *(char *const *) b);
+}
+
+/* Make challenges in several threads, and check that they all
+   differ. */
+static void
+unique (void)
+{
+#if USE_POSIX_THREADS
+  pthread_t threads[NTHREADS];
+#endif
+  size_t i, n = NTHREADS * PER_THREAD;
+
+#if USE_POSIX_THREADS
+  for (i = 0; i < NTHREADS; i++)
+    if (pthread_create (&threads[i], NULL, worker,
+			challenges + i * PER_THREAD) != 0)
+      fail ("pthread_create\n");
+  for (i = 0; i < NTHREADS; i++)
+    pthread_join (threads[i], NULL);
+#else
+  for (i = 0; i < NTHREADS; i++)
+    worker (challenges + i * PER_THREAD);
+#endif
+
+  qsort (challenges, n, sizeof (challenges[0]), compare);
+  for (i = 1; i < n; i++)
+    if (strcmp (challenges[i - 1], challenges[i]) == 0)
+      fail ("challenge repeated: %s\n", challenges[i]);
+  for (i = 0; i < n; i++)
+    free (challenges[i]);
+}
+
+/* A forked child must not get the nonces of its parent. */
+static void
+forked (void)
+{
+#if USE_POSIX_THREADS
+  char buf[100], *p;
+  int fds[2], status;
+  ssize_t len;
+  pid_t pid;
+
+  /* Fill the pool of this thread. */
+  free (challenge ());
+
+  if (pipe (fds) != 0)
+    fail ("pipe\n");
+  pid = fork ();
+  if (pid < 0)
+    fail ("fork\n");
+  if (pid == 0)
+    {
+      p = challenge ();
+      if (write (fds[1], p, strlen (p)) < 0)
+	_exit (1);
+      _exit (0);
+    }
+
+  close (fds[1]);
+  len = read (fds[0], buf, sizeof (buf) - 1);
+  close (fds[0]);
+  waitpid (pid, &status, 0);
+  if (len <= 0)
+    fail ("read\n");
+  buf[len] = '\0';
+
+  p = challenge ();
+  if (debug)
+    printf ("parent %s child %s\n", p, buf);
+  if (strcmp (p, buf) == 0)
+    fail ("child repeated the challenge of its parent\n");
+  free (p);
+#endif
+}
+
+#if USE_POSIX_THREADS
+static int release[2];
+
+static void *
+waiter (void *arg)
+{
+  char c;
+
+  free (challenge ());
+  if (write (release[1], "", 1) != 1 || read (release[0], &c, 1) != 1)
+    fail ("pipe\n");
+
+  return NULL;
+}
+#endif
+
+/* The pools go away with the last handle, also those of threads that
+   are still running, and come back with the next one. */
+static void
+restart (void)
+{
+#if USE_POSIX_THREADS
+  pthread_t thread;
+  char c;
+
+  if (pipe (release) != 0)
+    fail ("pipe\n");
+  if (pthread_create (&thread, NULL, waiter, NULL) != 0)
+    fail ("pthread_create\n");
+  if (read (release[0], &c, 1) != 1)
+    fail ("read\n");
+#endif
+
+  free (challenge ());
+  gsasl_done (ctx);
+
+#if USE_POSIX_THREADS
+  /* The thread exits without a destructor to run. */
+  if (write (release[1], "", 1) != 1)
+    fail ("write\n");
+  pthread_join (thread, NULL);
+  close (release[0]);
+  close (release[1]);
+#endif
+
+  if (gsasl_init (&ctx) != GSASL_OK)
+    fail ("gsasl_init\n");
+  unique ();
+}
+
+static void
+bench (const char *mech, const char *what)
+{
+  Gsasl_session *server;
+  clock_t start;
+  double secs;
+  size_t i;
+  int res;
+
+  if (!gsasl_server_support_p (ctx, mech))
+    return;
+
+  start = clock ();
+  for (i = 0; i < LOOPS; i++)
+    {
+      res = gsasl_server_start (ctx, mech, &server);
+      if (res != GSASL_OK)
+	fail ("gsasl_server_start (%d)\n", res);
+      gsasl_finish (server);
+    }
+  secs = (double) (clock () - start) / CLOCKS_PER_SEC;
+
+  if (debug)
+    printf ("%-12s %-7s %.0f ns/start\n", mech, what, secs * 1e9 / LOOPS);
+}
+
+void
+doit (void)
+{
+  static const char *mechs[] = { "CRAM-MD5", "DIGEST-MD5", "SCRAM-SHA-1" };
+  size_t i;
+  int res;
+
+  res = gsasl_init (&ctx);
+  if (res != GSASL_OK)
+    {
+      fail ("gsasl_init() failed (%d):\n%s\n", res, gsasl_strerror (res));
+      return;
+    }
+
+  if (!gsasl_server_support_p (ctx, "CRAM-MD5"))
+    {
+      gsasl_done (ctx);
+      return;
+    }
+
+  unique ();
+  forked ();
+  restart ();
+  for (i = 0; i < sizeof (mechs) / sizeof (mechs[0]); i++)
+    bench (mechs[i], "pool");
+
+  gsasl_nonce_pool_set (ctx, 0);
+  unique ();
+  for (i = 0; i < sizeof (mechs) / sizeof (mechs[0]); i++)
+    bench (mechs[i], "direct");
+
+  gsasl_done (ctx);
+}
@@ -0,0 +1,293 @@
+/* prefetch.c --- Test looking up properties in one callback.
+ * Copyright (C) 2012 Simon Josefsson
+ *
+ * This file is part of GNU SASL.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdio.h>
+#include <stdarg.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "utils.h"
+
+#define SALT "salt"
+#define ITER 1024
+
+enum
+{
+  PASSWORD_ONLY,
+  STORED_KEYS,
+  NO_PREFETCH
+};
+
+static int mode;
+static char storedkey[30];
+static char serverkey[30];
+
+/* Number of lookups in the user database, and of callbacks for the
+   properties the server needs. */
+static size_t lookups;
+static size_t callbacks;
+
+static int
+client_callback (Gsasl * ctx, Gsasl_session * sctx, Gsasl_property prop)
+{
+  switch (prop)
+    {
+    case GSASL_AUTHID:
+      gsasl_property_set (sctx, prop, "user");
+      return GSASL_OK;
+
+    case GSASL_PASSWORD:
+      gsasl_property_set (sctx, prop, "pencil");
+      return GSASL_OK;
+
+    case GSASL_SERVICE:
+      gsasl_property_set (sctx, prop, "imap");
+      return GSASL_OK;
+
+    case GSASL_HOSTNAME:
+      gsasl_property_set (sctx, prop, "localhost");
+      return GSASL_OK;
+
+    default:
+      return GSASL_NO_CALLBACK;
+    }
+}
+
+/* Set what the user database has for PROP, if anything. */
+static void
+lookup (Gsasl_session * sctx, Gsasl_property prop)
+{
+  switch (prop)
+    {
+    case GSASL_PASSWORD:
+      if (mode != STORED_KEYS)
+	gsasl_property_set (sctx, prop, "pencil");
+      break;
+
+    case GSASL_SCRAM_ITER:
+      if (mode == STORED_KEYS)
+	gsasl_property_set (sctx, prop, "1024");
+      break;
+
+    case GSASL_SCRAM_SALT:
+      if (mode == STORED_KEYS)
+	gsasl_property_set (sctx, prop, "c2FsdA==");
+      break;
+
+    case GSASL_SCRAM_STOREDKEY:
+      if (mode == STORED_KEYS)
+	gsasl_property_set (sctx, prop, storedkey);
+      break;
+
+    case GSASL_SCRAM_SERVERKEY:
+      if (mode == STORED_KEYS)
+	gsasl_property_set (sctx, prop, serverkey);
+      break;
+
+    default:
+      break;
+    }
+}
+
+static int
+server_callback (Gsasl * ctx, Gsasl_session * sctx, Gsasl_property prop)
+{
+  const Gsasl_property *props;
+  size_t i, n;
+
+  switch (prop)
+    {
+    case GSASL_PREFETCH:
+      if (mode == NO_PREFETCH)
+	fail ("prefetch made while disabled\n");
+      props = gsasl_prefetch_properties (sctx, &n);
+      if (!props || n == 0)
+	fail ("prefetch without properties\n");
+      for (i = 0; i < n; i++)
+	{
+	  if (gsasl_property_fast (sctx, props[i]))
+	    fail ("prefetch of known property %d\n", props[i]);
+	  lookup (sctx, props[i]);
+	}
+      lookups++;
+      return GSASL_OK;
+
+    case GSASL_PASSWORD:
+    case GSASL_REALM:
+    case GSASL_QOPS:
+    case GSASL_DIGEST_MD5_HASHED_PASSWORD:
+    case GSASL_SCRAM_ITER:
+    case GSASL_SCRAM_SALT:
+    case GSASL_SCRAM_SALTED_PASSWORD:
+    case GSASL_SCRAM_SERVERKEY:
+    case GSASL_SCRAM_STOREDKEY:
+      callbacks++;
+      lookups++;
+      lookup (sctx, prop);
+      if (!gsasl_property_fast (sctx, prop))
+	return GSASL_NO_CALLBACK;
+      return GSASL_OK;
+
+    default:
+      return GSASL_NO_CALLBACK;
+    }
+}
+
+/* Authenticate a client to a server with MECH, and return GSASL_OK
+   when both ends succeed. */
+static int
+authenticate (Gsasl * cctx, Gsasl * sctx, const char *mech)
+{
+  Gsasl_session *client, *server;
+  char *s = NULL, *c = NULL;
+  size_t slen = 0, clen = 0;
+  int cres, sres, rounds;
+
+  cres = gsasl_client_start (cctx, mech, &client);
+  if (cres != GSASL_OK)
+    return cres;
+  sres = gsasl_server_start (sctx, mech, &server);
+  if (sres != GSASL_OK)
+    {
+      gsasl_finish (client);
+      return sres;
+    }
+  cres = GSASL_NEEDS_MORE;
+
+  for (rounds = 0; rounds < 10; rounds++)
+    {
+      sres = gsasl_step (server, c, clen, &s, &slen);
+      free (c);
+      c = NULL;
+      if (sres != GSASL_OK && sres != GSASL_NEEDS_MORE)
+	break;
+      if (sres == GSASL_OK && cres == GSASL_OK && slen == 0)
+	break;
+
+      cres = gsasl_step (client, s, slen, &c, &clen);
+      free (s);
+      s = NULL;
+      if (cres != GSASL_OK && cres != GSASL_NEEDS_MORE)
+	break;
+      if (sres == GSASL_OK)
+	break;
+    }
+
+  free (c);
+  free (s);
+  gsasl_finish (client);
+  gsasl_finish (server);
+
+  if (sres != GSASL_OK)
+    return sres;
+  return cres == GSASL_NEEDS_MORE ? GSASL_AUTHENTICATION_ERROR : cres;
+}
+
+static void
+check (Gsasl * cctx, Gsasl * sctx, const char *mech,
+       size_t want_lookups, size_t want_callbacks)
+{
+  int res;
+
+  if (!gsasl_client_support_p (cctx, mech)
+      || !gsasl_server_support_p (sctx, mech))
+    return;
+
+  lookups = callbacks = 0;
+  res = authenticate (cctx, sctx, mech);
+  if (res != GSASL_OK)
+    fail ("%s mode %d failed (%d)\n", mech, mode, res);
+  if (debug)
+    printf ("%s mode %d: %lu lookups, %lu callbacks\n", mech, mode,
+	    (unsigned long) lookups, (unsigned long) callbacks);
+  if (lookups != want_lookups || callbacks != want_callbacks)
+    fail ("%s mode %d: %lu lookups, %lu callbacks\n", mech, mode,
+	  (unsigned long) lookups, (unsigned long) callbacks);
+}
+
+void
+doit (void)
+{
+  Gsasl *cctx = NULL, *sctx = NULL;
+  Gsasl_session *server;
+  const Gsasl_property *props;
+  char sp[20], stk[20], svk[20];
+  size_t len, n;
+  int res;
+
+  if (gsasl_init (&cctx) != GSASL_OK || gsasl_init (&sctx) != GSASL_OK)
+    {
+      fail ("gsasl_init() failed\n");
+      return;
+    }
+
+  gsasl_callback_set (cctx, client_callback);
+  gsasl_callback_set (sctx, server_callback);
+
+  res = gsasl_scram_derive ("pencil", SALT, strlen (SALT), ITER,
+			    sp, stk, svk);
+  if (res != GSASL_OK)
+    fail ("gsasl_scram_derive (%d)\n", res);
+  len = sizeof (storedkey);
+  res = gsasl_base64_to_buffer (stk, 20, storedkey, &len);
+  len = sizeof (serverkey);
+  if (res == GSASL_OK)
+    res = gsasl_base64_to_buffer (svk, 20, serverkey, &len);
+  if (res != GSASL_OK)
+    fail ("gsasl_base64_to_buffer (%d)\n", res);
+
+  /* Without prefetching, every property is its own lookup.  SCRAM
+     asks for the iteration count, the salt and the password, and
+     DIGEST-MD5 for the realm, the QOPs, the hashed password and the
+     password. */
+  mode = NO_PREFETCH;
+  check (cctx, sctx, "SCRAM-SHA-1", 3, 3);
+  check (cctx, sctx, "DIGEST-MD5", 4, 4);
+  check (cctx, sctx, "CRAM-MD5", 1, 1);
+
+  /* With it, one lookup for SCRAM and one per step for DIGEST-MD5. */
+  gsasl_prefetch_set (sctx, 1);
+  mode = PASSWORD_ONLY;
+  check (cctx, sctx, "SCRAM-SHA-1", 1, 0);
+  check (cctx, sctx, "DIGEST-MD5", 2, 0);
+  /* CRAM-MD5 needs one property, and asks for it directly. */
+  check (cctx, sctx, "CRAM-MD5", 1, 1);
+
+  mode = STORED_KEYS;
+  check (cctx, sctx, "SCRAM-SHA-1", 1, 0);
+
+  /* Only during a prefetch callback. */
+  res = gsasl_server_start (sctx, "PLAIN", &server);
+  if (res == GSASL_OK)
+    {
+      n = 42;
+      props = gsasl_prefetch_properties (server, &n);
+      if (props || n != 0)
+	fail ("properties outside of prefetch\n");
+      gsasl_finish (server);
+    }
+
+  gsasl_done (cctx);
+  gsasl_done (sctx);
+}
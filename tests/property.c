@@ -0,0 +1,117 @@
+/* property.c --- Test session property storage.
+ * Copyright (C) 2012 Simon Josefsson
+ *
+ * This file is part of GNU SASL.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdio.h>
+#include <stdarg.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "utils.h"
+
+static void
+check (Gsasl_session * sctx, Gsasl_property prop, const char *expect)
+{
+  const char *p = gsasl_property_fast (sctx, prop);
+
+  if (expect == NULL && p == NULL)
+    return;
+  if (expect == NULL || p == NULL || strcmp (p, expect) != 0)
+    fail ("property %d is `%s', expected `%s'\n", prop,
+	  p ? p : "(null)", expect ? expect : "(null)");
+}
+
+void
+doit (void)
+{
+  Gsasl *ctx = NULL;
+  Gsasl_session *sctx = NULL;
+  char big[1000];
+  char buf[100];
+  int prop;
+  int res;
+
+  res = gsasl_init (&ctx);
+  if (res != GSASL_OK)
+    {
+      fail ("gsasl_init() failed (%d):\n%s\n", res, gsasl_strerror (res));
+      return;
+    }
+
+  res = gsasl_client_start (ctx, "PLAIN", &sctx);
+  if (res != GSASL_OK)
+    {
+      fail ("gsasl_client_start() failed (%d):\n%s\n",
+	    res, gsasl_strerror (res));
+      return;
+    }
+
+  memset (big, 'x', sizeof (big) - 1);
+  big[sizeof (big) - 1] = '\0';
+
+  /* Non-storable properties are ignored. */
+  gsasl_property_set (sctx, GSASL_VALIDATE_SIMPLE, "foo");
+  check (sctx, GSASL_VALIDATE_SIMPLE, NULL);
+  gsasl_property_set (sctx, 0, "foo");
+  check (sctx, 0, NULL);
+
+  /* Fill every property, enough to run out of inline storage. */
+  for (prop = GSASL_AUTHID; prop <= GSASL_SCRAM_STOREDKEY; prop++)
+    {
+      sprintf (buf, "value of property %d", prop);
+      gsasl_property_set (sctx, prop, buf);
+    }
+  for (prop = GSASL_AUTHID; prop <= GSASL_SCRAM_STOREDKEY; prop++)
+    {
+      sprintf (buf, "value of property %d", prop);
+      check (sctx, prop, buf);
+    }
+
+  /* Shrink, grow, and replace with large values. */
+  gsasl_property_set (sctx, GSASL_AUTHID, "a");
+  check (sctx, GSASL_AUTHID, "a");
+  gsasl_property_set (sctx, GSASL_AUTHID, "a much longer authid value");
+  check (sctx, GSASL_AUTHID, "a much longer authid value");
+  gsasl_property_set (sctx, GSASL_PASSWORD, big);
+  check (sctx, GSASL_PASSWORD, big);
+  gsasl_property_set (sctx, GSASL_PASSWORD, "short");
+  check (sctx, GSASL_PASSWORD, "short");
+  gsasl_property_set_raw (sctx, GSASL_REALM, "realm\0junk", 5);
+  check (sctx, GSASL_REALM, "realm");
+
+  /* Setting a property from its own current value. */
+  gsasl_property_set (sctx, GSASL_AUTHID,
+		      gsasl_property_fast (sctx, GSASL_AUTHID));
+  check (sctx, GSASL_AUTHID, "a much longer authid value");
+  gsasl_property_set (sctx, GSASL_AUTHID,
+		      gsasl_property_fast (sctx, GSASL_AUTHID) + 7);
+  check (sctx, GSASL_AUTHID, "longer authid value");
+
+  /* Clearing. */
+  gsasl_property_set (sctx, GSASL_AUTHID, NULL);
+  check (sctx, GSASL_AUTHID, NULL);
+  check (sctx, GSASL_AUTHZID, "value of property 2");
+
+  gsasl_finish (sctx);
+  gsasl_done (ctx);
+}
@@ -0,0 +1,344 @@
+/* resume.c --- Test server steps waiting for an asynchronous callback.
+ * Copyright (C) 2012 Simon Josefsson
+ *
+ * This file is part of GNU SASL.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdio.h>
+#include <stdarg.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "utils.h"
+
+#define NCONN 50
+
+/* An authentication driven by the loop in run(). */
+struct conn
+{
+  size_t id;
+  Gsasl_session *client;
+  Gsasl_session *server;
+  char *c;
+  size_t clen;
+  int cres;
+  int sres;
+  /* Property the server callback is waiting for, or 0. */
+  Gsasl_property pending;
+  int done;
+};
+
+static size_t suspended;
+
+static int
+client_callback (Gsasl * ctx, Gsasl_session * sctx, Gsasl_property prop)
+{
+  switch (prop)
+    {
+    case GSASL_AUTHID:
+      gsasl_property_set (sctx, prop, "user");
+      return GSASL_OK;
+
+    case GSASL_PASSWORD:
+      gsasl_property_set (sctx, prop, "pencil");
+      return GSASL_OK;
+
+    case GSASL_SERVICE:
+      gsasl_property_set (sctx, prop, "imap");
+      return GSASL_OK;
+
+    case GSASL_HOSTNAME:
+      gsasl_property_set (sctx, prop, "localhost");
+      return GSASL_OK;
+
+    default:
+      return GSASL_NO_CALLBACK;
+    }
+}
+
+/* Every lookup of the server is answered later by answer(). */
+static int
+server_callback (Gsasl * ctx, Gsasl_session * sctx, Gsasl_property prop)
+{
+  struct conn *conn = gsasl_session_hook_get (sctx);
+
+  switch (prop)
+    {
+    case GSASL_PASSWORD:
+    case GSASL_VALIDATE_SIMPLE:
+    case GSASL_REALM:
+    case GSASL_QOPS:
+    case GSASL_DIGEST_MD5_HASHED_PASSWORD:
+    case GSASL_SCRAM_ITER:
+    case GSASL_SCRAM_SALT:
+    case GSASL_SCRAM_SALTED_PASSWORD:
+    case GSASL_SCRAM_SERVERKEY:
+    case GSASL_SCRAM_STOREDKEY:
+      if (conn->pending)
+	fail ("callback %d made while %d is pending\n", prop, conn->pending);
+      conn->pending = prop;
+      return GSASL_CALLBACK_PENDING;
+
+    default:
+      return GSASL_NO_CALLBACK;
+    }
+}
+
+/* Complete the lookup the server of CONN waits for, and return the
+   result of the callback. */
+static int
+answer (struct conn *conn)
+{
+  Gsasl_session *sctx = conn->server;
+  Gsasl_property prop = conn->pending;
+
+  conn->pending = 0;
+
+  switch (prop)
+    {
+    case GSASL_PASSWORD:
+      gsasl_property_set (sctx, prop, "pencil");
+      return GSASL_OK;
+
+    case GSASL_SCRAM_ITER:
+      gsasl_property_set (sctx, prop, "512");
+      return GSASL_OK;
+
+    case GSASL_SCRAM_SALT:
+      gsasl_property_set (sctx, prop, "c2FsdA==");
+      return GSASL_OK;
+
+    case GSASL_VALIDATE_SIMPLE:
+      /* Half of the connections check the password here, the others
+         let the mechanism ask for it. */
+      if (conn->id % 2)
+	return GSASL_NO_CALLBACK;
+      if (strcmp (gsasl_property_fast (sctx, GSASL_AUTHID), "user") != 0
+	  || strcmp (gsasl_property_fast (sctx, GSASL_PASSWORD),
+		     "pencil") != 0)
+	return GSASL_AUTHENTICATION_ERROR;
+      return GSASL_OK;
+
+    default:
+      return GSASL_NO_CALLBACK;
+    }
+}
+
+/* Do the next server step of CONN, and the client step after it. */
+static void
+advance (struct conn *conn)
+{
+  char *s;
+  size_t slen;
+
+  if (conn->pending)
+    {
+      int rc = answer (conn);
+      conn->sres = gsasl_step_resume (conn->server, rc, &s, &slen);
+    }
+  else
+    conn->sres = gsasl_step (conn->server, conn->c, conn->clen, &s, &slen);
+
+  /* The input is kept by the session while the step waits. */
+  free (conn->c);
+  conn->c = NULL;
+  conn->clen = 0;
+
+  if (conn->sres == GSASL_CALLBACK_PENDING)
+    {
+      if (!conn->pending)
+	fail ("pending step without callback\n");
+      suspended++;
+      return;
+    }
+  if (conn->sres != GSASL_OK && conn->sres != GSASL_NEEDS_MORE)
+    {
+      fail ("server step %lu (%d)\n", (unsigned long) conn->id, conn->sres);
+      conn->done = 1;
+      return;
+    }
+  if (conn->sres == GSASL_OK && conn->cres == GSASL_OK && slen == 0)
+    {
+      free (s);
+      conn->done = 1;
+      return;
+    }
+
+  conn->cres = gsasl_step (conn->client, s, slen, &conn->c, &conn->clen);
+  free (s);
+  if (conn->cres != GSASL_OK && conn->cres != GSASL_NEEDS_MORE)
+    {
+      fail ("client step %lu (%d)\n", (unsigned long) conn->id, conn->cres);
+      conn->done = 1;
+    }
+  else if (conn->sres == GSASL_OK)
+    {
+      if (conn->cres != GSASL_OK)
+	fail ("client not done %lu (%d)\n", (unsigned long) conn->id,
+	      conn->cres);
+      conn->done = 1;
+    }
+}
+
+/* Run NCONN authentications with MECH at once, taking turns between
+   them as an event loop would.  Unless PRESET is 0, it is set to
+   VALUE in the server sessions before they start. */
+static void
+run (Gsasl * cctx, Gsasl * sctx, const char *mech,
+     Gsasl_property preset, const char *value)
+{
+  static struct conn conns[NCONN];
+  size_t i, left = NCONN, rounds = 0;
+  int res;
+
+  suspended = 0;
+  memset (conns, 0, sizeof (conns));
+  for (i = 0; i < NCONN; i++)
+    {
+      conns[i].id = i;
+      conns[i].cres = GSASL_NEEDS_MORE;
+      res = gsasl_client_start (cctx, mech, &conns[i].client);
+      if (res != GSASL_OK)
+	fail ("gsasl_client_start (%d)\n", res);
+      res = gsasl_server_start (sctx, mech, &conns[i].server);
+      if (res != GSASL_OK)
+	fail ("gsasl_server_start (%d)\n", res);
+      gsasl_session_hook_set (conns[i].server, &conns[i]);
+      if (preset)
+	gsasl_property_set (conns[i].server, preset, value);
+    }
+
+  while (left > 0 && rounds++ < 100)
+    for (i = 0; i < NCONN; i++)
+      if (!conns[i].done)
+	{
+	  advance (&conns[i]);
+	  if (conns[i].done)
+	    left--;
+	}
+
+  if (left > 0)
+    fail ("%s: %lu authentications did not finish\n", mech,
+	  (unsigned long) left);
+  if (suspended < NCONN)
+    fail ("%s: only %lu steps were suspended\n", mech,
+	  (unsigned long) suspended);
+  if (debug)
+    printf ("%s: %lu steps suspended\n", mech, (unsigned long) suspended);
+
+  for (i = 0; i < NCONN; i++)
+    {
+      free (conns[i].c);
+      gsasl_finish (conns[i].client);
+      gsasl_finish (conns[i].server);
+    }
+}
+
+void
+doit (void)
+{
+  static const char *mechs[] = {
+    "PLAIN", "LOGIN", "CRAM-MD5", "DIGEST-MD5", "SCRAM-SHA-1"
+  };
+  Gsasl *cctx = NULL, *sctx = NULL;
+  Gsasl_session *client, *server;
+  struct conn conn;
+  char *out;
+  size_t i, len;
+  int res;
+
+  if (gsasl_init (&cctx) != GSASL_OK || gsasl_init (&sctx) != GSASL_OK)
+    {
+      fail ("gsasl_init() failed\n");
+      return;
+    }
+
+  gsasl_callback_set (cctx, client_callback);
+  gsasl_callback_set (sctx, server_callback);
+
+  for (i = 0; i < sizeof (mechs) / sizeof (mechs[0]); i++)
+    if (gsasl_client_support_p (cctx, mechs[i])
+	&& gsasl_server_support_p (sctx, mechs[i]))
+      run (cctx, sctx, mechs[i], 0, NULL);
+
+  /* A credential set beforehand must not be used while the callback
+     for the one asked for first is pending, or the step would finish
+     before it is run again.  DIGEST-MD5 falls back to the password
+     when there is no hashed password, and the SCRAM server to the
+     salted password, here of "pencil" with salt "salt" and 512
+     iterations, when there is no password. */
+  if (gsasl_client_support_p (cctx, "DIGEST-MD5")
+      && gsasl_server_support_p (sctx, "DIGEST-MD5"))
+    run (cctx, sctx, "DIGEST-MD5", GSASL_PASSWORD, "pencil");
+  if (gsasl_client_support_p (cctx, "SCRAM-SHA-1")
+      && gsasl_server_support_p (sctx, "SCRAM-SHA-1"))
+    run (cctx, sctx, "SCRAM-SHA-1", GSASL_SCRAM_SALTED_PASSWORD,
+	 "448864c30499d4a1c9407b2205a3f4720c3da416");
+
+  if (!gsasl_client_support_p (cctx, "PLAIN")
+      || !gsasl_server_support_p (sctx, "PLAIN"))
+    {
+      gsasl_done (cctx);
+      gsasl_done (sctx);
+      return;
+    }
+
+  /* Nothing to resume, and no step while one is suspended. */
+  memset (&conn, 0, sizeof (conn));
+  conn.id = 1;
+  res = gsasl_server_start (sctx, "PLAIN", &server);
+  if (res != GSASL_OK)
+    fail ("gsasl_server_start (%d)\n", res);
+  gsasl_session_hook_set (server, &conn);
+  res = gsasl_step_resume (server, GSASL_OK, &out, &len);
+  if (res != GSASL_MECHANISM_CALLED_TOO_MANY_TIMES)
+    fail ("resume without pending step (%d)\n", res);
+  res = gsasl_step (server, "\0user\0pencil", 12, &out, &len);
+  if (res != GSASL_CALLBACK_PENDING || conn.pending != GSASL_VALIDATE_SIMPLE)
+    fail ("step not suspended (%d)\n", res);
+  res = gsasl_step (server, "\0user\0pencil", 12, &out, &len);
+  if (res != GSASL_CALLBACK_PENDING)
+    fail ("step while suspended (%d)\n", res);
+  conn.pending = 0;
+  res = gsasl_step_resume (server, GSASL_NO_CALLBACK, &out, &len);
+  if (res != GSASL_CALLBACK_PENDING || conn.pending != GSASL_PASSWORD)
+    fail ("step not suspended on password (%d)\n", res);
+  conn.pending = 0;
+  res = gsasl_step_resume (server, GSASL_NO_CALLBACK, &out, &len);
+  if (res != GSASL_NO_PASSWORD)
+    fail ("missing password accepted (%d)\n", res);
+  gsasl_finish (server);
+
+  /* Clients cannot wait, a pending callback is a missing one. */
+  gsasl_callback_set (cctx, server_callback);
+  res = gsasl_client_start (cctx, "PLAIN", &client);
+  if (res != GSASL_OK)
+    fail ("gsasl_client_start (%d)\n", res);
+  gsasl_session_hook_set (client, &conn);
+  gsasl_property_set (client, GSASL_AUTHID, "user");
+  res = gsasl_step (client, NULL, 0, &out, &len);
+  if (res != GSASL_NO_PASSWORD)
+    fail ("client step (%d)\n", res);
+  gsasl_finish (client);
+
+  gsasl_done (cctx);
+  gsasl_done (sctx);
+}
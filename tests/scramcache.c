@@ -0,0 +1,234 @@
+/* scramcache.c --- Test the SCRAM server key cache.
+ * Copyright (C) 2012 Simon Josefsson
+ *
+ * This file is part of GNU SASL.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdio.h>
+#include <stdarg.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "utils.h"
+
+static const char *authid;
+static const char *client_password;
+static const char *server_password;
+
+static int
+callback (Gsasl * ctx, Gsasl_session * sctx, Gsasl_property prop)
+{
+  int rc = GSASL_NO_CALLBACK;
+
+  switch (prop)
+    {
+    case GSASL_AUTHID:
+      gsasl_property_set (sctx, prop, authid);
+      rc = GSASL_OK;
+      break;
+
+    case GSASL_PASSWORD:
+      /* The client and server share the callback, only the server
+         session carries a hook. */
+      if (gsasl_session_hook_get (sctx))
+	gsasl_property_set (sctx, prop, server_password);
+      else
+	gsasl_property_set (sctx, prop, client_password);
+      rc = GSASL_OK;
+      break;
+
+    case GSASL_SCRAM_SALT:
+      gsasl_property_set (sctx, prop, "c2FsdA==");
+      rc = GSASL_OK;
+      break;
+
+    case GSASL_AUTHZID:
+    case GSASL_SCRAM_ITER:
+    case GSASL_SCRAM_SALTED_PASSWORD:
+    case GSASL_CB_TLS_UNIQUE:
+      break;
+
+    default:
+      fail ("Unknown callback property %d\n", prop);
+      break;
+    }
+
+  return rc;
+}
+
+/* Run a complete SCRAM-SHA-1 exchange and return the result of the
+   final server step. */
+static int
+login (Gsasl * ctx)
+{
+  Gsasl_session *server = NULL, *client = NULL;
+  char *s1 = NULL, *s2 = NULL;
+  size_t s1len, s2len;
+  int res;
+
+  res = gsasl_server_start (ctx, "SCRAM-SHA-1", &server);
+  if (res != GSASL_OK)
+    {
+      fail ("gsasl_server_start() failed (%d):\n%s\n",
+	    res, gsasl_strerror (res));
+      return res;
+    }
+  gsasl_session_hook_set (server, server);
+
+  res = gsasl_client_start (ctx, "SCRAM-SHA-1", &client);
+  if (res != GSASL_OK)
+    {
+      fail ("gsasl_client_start() failed (%d):\n%s\n",
+	    res, gsasl_strerror (res));
+      gsasl_finish (server);
+      return res;
+    }
+
+  res = gsasl_step (client, NULL, 0, &s1, &s1len);
+  if (res != GSASL_NEEDS_MORE)
+    goto done;
+
+  res = gsasl_step (server, s1, s1len, &s2, &s2len);
+  gsasl_free (s1);
+  s1 = NULL;
+  if (res != GSASL_NEEDS_MORE)
+    goto done;
+
+  res = gsasl_step (client, s2, s2len, &s1, &s1len);
+  gsasl_free (s2);
+  s2 = NULL;
+  if (res != GSASL_NEEDS_MORE)
+    goto done;
+
+  res = gsasl_step (server, s1, s1len, &s2, &s2len);
+
+done:
+  gsasl_free (s1);
+  gsasl_free (s2);
+  gsasl_finish (client);
+  gsasl_finish (server);
+
+  return res;
+}
+
+static void
+check_stats (Gsasl * ctx, size_t hits, size_t misses)
+{
+  size_t h, m;
+
+  gsasl_scram_cache_stats (ctx, &h, &m);
+  if (h != hits || m != misses)
+    fail ("cache stats %lu/%lu, expected %lu/%lu\n",
+	  (unsigned long) h, (unsigned long) m,
+	  (unsigned long) hits, (unsigned long) misses);
+  else if (debug)
+    printf ("hits %lu misses %lu\n", (unsigned long) h, (unsigned long) m);
+}
+
+void
+doit (void)
+{
+  Gsasl *ctx = NULL;
+  int res;
+
+  res = gsasl_init (&ctx);
+  if (res != GSASL_OK)
+    {
+      fail ("gsasl_init() failed (%d):\n%s\n", res, gsasl_strerror (res));
+      return;
+    }
+
+  if (!gsasl_client_support_p (ctx, "SCRAM-SHA-1")
+      || !gsasl_server_support_p (ctx, "SCRAM-SHA-1"))
+    {
+      gsasl_done (ctx);
+      fail ("No support for SCRAM-SHA-1.\n");
+      exit (77);
+    }
+
+  gsasl_callback_set (ctx, callback);
+
+  authid = "user";
+  client_password = server_password = "Open, Sesame";
+
+  /* Disabled by default. */
+  res = login (ctx);
+  if (res != GSASL_OK)
+    fail ("login without cache failed (%d): %s\n", res, gsasl_strerror (res));
+  check_stats (ctx, 0, 0);
+
+  res = gsasl_scram_cache_set (ctx, 2, 0);
+  if (res != GSASL_OK)
+    fail ("gsasl_scram_cache_set() failed (%d): %s\n",
+	  res, gsasl_strerror (res));
+
+  /* First login populates the cache, the next ones hit it. */
+  res = login (ctx);
+  if (res != GSASL_OK)
+    fail ("login 1 failed (%d): %s\n", res, gsasl_strerror (res));
+  check_stats (ctx, 0, 1);
+
+  res = login (ctx);
+  if (res != GSASL_OK)
+    fail ("login 2 failed (%d): %s\n", res, gsasl_strerror (res));
+  res = login (ctx);
+  if (res != GSASL_OK)
+    fail ("login 3 failed (%d): %s\n", res, gsasl_strerror (res));
+  check_stats (ctx, 2, 1);
+
+  /* Changing the password on the server must not reuse stale keys. */
+  server_password = "Close, Sesame";
+  res = login (ctx);
+  if (res != GSASL_AUTHENTICATION_ERROR)
+    fail ("login with old password succeeded (%d)\n", res);
+  check_stats (ctx, 2, 2);
+
+  client_password = server_password;
+  res = login (ctx);
+  if (res != GSASL_OK)
+    fail ("login with new password failed (%d): %s\n",
+	  res, gsasl_strerror (res));
+  check_stats (ctx, 3, 2);
+
+  /* Two more users push the first one out of the cache. */
+  authid = "user2";
+  res = login (ctx);
+  if (res != GSASL_OK)
+    fail ("login user2 failed (%d): %s\n", res, gsasl_strerror (res));
+  authid = "user3";
+  res = login (ctx);
+  if (res != GSASL_OK)
+    fail ("login user3 failed (%d): %s\n", res, gsasl_strerror (res));
+  authid = "user";
+  res = login (ctx);
+  if (res != GSASL_OK)
+    fail ("login user failed (%d): %s\n", res, gsasl_strerror (res));
+  check_stats (ctx, 3, 5);
+
+  /* Disabling the cache resets the counters. */
+  res = gsasl_scram_cache_set (ctx, 0, 0);
+  if (res != GSASL_OK)
+    fail ("gsasl_scram_cache_set() failed (%d): %s\n",
+	  res, gsasl_strerror (res));
+  check_stats (ctx, 0, 0);
+
+  gsasl_done (ctx);
+}
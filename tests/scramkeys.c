@@ -0,0 +1,129 @@
+/* scramkeys.c --- Test SCRAM key derivation functions.
+ * Copyright (C) 2012 Simon Josefsson
+ *
+ * This file is part of GNU SASL.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdio.h>
+#include <stdarg.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <sys/time.h>
+
+#include "utils.h"
+
+/* RFC 5802 example: password "pencil", salt QSXCR+Q6sek8bf92. */
+#define SALT "\x41\x25\xc2\x47\xe4\x3a\xb1\xe9\x3c\x6d\xff\x76"
+#define ITER 4096
+#define SALTEDPASSWORD "\x1d\x96\xee\x3a\x52\x9b\x5a\x5f\x9e\x47" \
+  "\xc0\x1f\x22\x9a\x2c\xb8\xa6\xe1\x5f\x7d"
+#define STOREDKEY "\xe9\xd9\x46\x60\xc3\x9d\x65\xc3\x8f\xba" \
+  "\xd9\x1c\x35\x8f\x14\xda\x0e\xef\x2b\xd6"
+#define SERVERKEY "\x0f\xe0\x92\x58\xb3\xac\x85\x2b\xa5\x02" \
+  "\xcc\x62\xba\x90\x3e\xaa\xcd\xbf\x7d\x31"
+
+#define NKEYS 64
+
+static double
+now (void)
+{
+  struct timeval tv;
+
+  gettimeofday (&tv, NULL);
+  return tv.tv_sec + tv.tv_usec / 1e6;
+}
+
+void
+doit (void)
+{
+  Gsasl_scram_keys keys[NKEYS];
+  char passwords[NKEYS][16];
+  char saltedpassword[20], storedkey[20], serverkey[20];
+  double t0, t1, t2;
+  size_t i;
+  int rc;
+
+  rc = gsasl_scram_derive ("pencil", SALT, strlen (SALT), ITER,
+			   saltedpassword, storedkey, serverkey);
+  if (rc != GSASL_OK)
+    fail ("gsasl_scram_derive() failed (%d): %s\n", rc, gsasl_strerror (rc));
+  if (memcmp (saltedpassword, SALTEDPASSWORD, 20) != 0)
+    fail ("SaltedPassword mismatch\n");
+  if (memcmp (storedkey, STOREDKEY, 20) != 0)
+    fail ("StoredKey mismatch\n");
+  if (memcmp (serverkey, SERVERKEY, 20) != 0)
+    fail ("ServerKey mismatch\n");
+
+  memset (keys, 0, sizeof (keys));
+  for (i = 0; i < NKEYS; i++)
+    {
+      sprintf (passwords[i], "password%lu", (unsigned long) i);
+      keys[i].password = passwords[i];
+      keys[i].salt = SALT;
+      keys[i].saltlen = strlen (SALT);
+      keys[i].iter = ITER;
+    }
+  strcpy (passwords[0], "pencil");
+
+  t0 = now ();
+  rc = gsasl_scram_derive_batch (keys, NKEYS, 0);
+  t1 = now ();
+  if (rc != GSASL_OK)
+    fail ("gsasl_scram_derive_batch() failed (%d): %s\n",
+	  rc, gsasl_strerror (rc));
+
+  /* Compare against the scalar function. */
+  for (i = 0; i < NKEYS; i++)
+    {
+      rc = gsasl_scram_derive (keys[i].password, SALT, strlen (SALT),
+			       ITER, saltedpassword, storedkey, serverkey);
+      if (rc != GSASL_OK || keys[i].rc != GSASL_OK)
+	fail ("entry %lu failed (%d/%d)\n", (unsigned long) i,
+	      rc, keys[i].rc);
+      if (memcmp (saltedpassword, keys[i].saltedpassword, 20) != 0
+	  || memcmp (storedkey, keys[i].storedkey, 20) != 0
+	  || memcmp (serverkey, keys[i].serverkey, 20) != 0)
+	fail ("entry %lu differs from gsasl_scram_derive\n",
+	      (unsigned long) i);
+    }
+  t2 = now ();
+
+  if (memcmp (keys[0].storedkey, STOREDKEY, 20) != 0)
+    fail ("batch StoredKey mismatch\n");
+
+  if (debug)
+    printf ("%d keys: batch %.3fs, sequential %.3fs\n",
+	    NKEYS, t1 - t0, t2 - t1);
+
+  /* Errors are reported per entry. */
+  keys[1].iter = 0;
+  rc = gsasl_scram_derive_batch (keys, 3, 2);
+  if (rc != keys[1].rc || keys[0].rc != GSASL_OK
+      || keys[1].rc == GSASL_OK || keys[2].rc != GSASL_OK)
+    fail ("batch error reporting failed (%d: %d %d %d)\n", rc,
+	  keys[0].rc, keys[1].rc, keys[2].rc);
+
+  /* Empty batch. */
+  rc = gsasl_scram_derive_batch (NULL, 0, 4);
+  if (rc != GSASL_OK)
+    fail ("empty batch failed (%d)\n", rc);
+}
@@ -0,0 +1,254 @@
+/* scramstored.c --- Test SCRAM server with stored verifiers.
+ * Copyright (C) 2012 Simon Josefsson
+ *
+ * This file is part of GNU SASL.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdio.h>
+#include <stdarg.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "utils.h"
+
+#define PASSWORD "pencil"
+#define SALT "salt"
+#define ITER 4096
+
+enum
+{
+  STORED_KEYS,
+  SALTED_PASSWORD,
+  WRONG_KEYS,
+  SHORT_KEYS,
+  N_MODES
+};
+
+static int mode;
+static char *storedkey;
+static char *serverkey;
+static char *wrong_storedkey;
+static char *wrong_serverkey;
+static char saltedpassword[41];
+
+static int
+callback (Gsasl * ctx, Gsasl_session * sctx, Gsasl_property prop)
+{
+  int server = gsasl_session_hook_get (sctx) != NULL;
+  int rc = GSASL_NO_CALLBACK;
+
+  switch (prop)
+    {
+    case GSASL_AUTHID:
+      gsasl_property_set (sctx, prop, "user");
+      rc = GSASL_OK;
+      break;
+
+    case GSASL_PASSWORD:
+      /* The server asks for the password first, and falls back to
+         the stored keys without it. */
+      if (server)
+	break;
+      gsasl_property_set (sctx, prop, PASSWORD);
+      rc = GSASL_OK;
+      break;
+
+    case GSASL_SCRAM_SALT:
+      gsasl_property_set (sctx, prop, "c2FsdA==");
+      rc = GSASL_OK;
+      break;
+
+    case GSASL_SCRAM_SERVERKEY:
+    case GSASL_SCRAM_STOREDKEY:
+      {
+	const char *value = NULL;
+
+	if (!server)
+	  fail ("Client asked for property %d\n", prop);
+	else if (mode == STORED_KEYS)
+	  value = prop == GSASL_SCRAM_SERVERKEY ? serverkey : storedkey;
+	else if (mode == WRONG_KEYS)
+	  value = prop == GSASL_SCRAM_SERVERKEY
+	    ? wrong_serverkey : wrong_storedkey;
+	else if (mode == SHORT_KEYS)
+	  value = "c2FsdA==";
+
+	if (value)
+	  {
+	    gsasl_property_set (sctx, prop, value);
+	    rc = GSASL_OK;
+	  }
+      }
+      break;
+
+    case GSASL_SCRAM_SALTED_PASSWORD:
+      if (server && mode == SALTED_PASSWORD)
+	{
+	  gsasl_property_set (sctx, prop, saltedpassword);
+	  rc = GSASL_OK;
+	}
+      break;
+
+    case GSASL_AUTHZID:
+    case GSASL_SCRAM_ITER:
+    case GSASL_CB_TLS_UNIQUE:
+      break;
+
+    default:
+      fail ("Unknown callback property %d\n", prop);
+      break;
+    }
+
+  return rc;
+}
+
+/* Run a complete SCRAM-SHA-1 exchange and return the result of the
+   final server step. */
+static int
+login (Gsasl * ctx)
+{
+  Gsasl_session *server = NULL, *client = NULL;
+  char *s1 = NULL, *s2 = NULL;
+  size_t s1len, s2len;
+  int res;
+
+  res = gsasl_server_start (ctx, "SCRAM-SHA-1", &server);
+  if (res != GSASL_OK)
+    {
+      fail ("gsasl_server_start() failed (%d):\n%s\n",
+	    res, gsasl_strerror (res));
+      return res;
+    }
+  gsasl_session_hook_set (server, server);
+
+  res = gsasl_client_start (ctx, "SCRAM-SHA-1", &client);
+  if (res != GSASL_OK)
+    {
+      fail ("gsasl_client_start() failed (%d):\n%s\n",
+	    res, gsasl_strerror (res));
+      gsasl_finish (server);
+      return res;
+    }
+
+  res = gsasl_step (client, NULL, 0, &s1, &s1len);
+  if (res != GSASL_NEEDS_MORE)
+    goto done;
+
+  res = gsasl_step (server, s1, s1len, &s2, &s2len);
+  gsasl_free (s1);
+  s1 = NULL;
+  if (res != GSASL_NEEDS_MORE)
+    goto done;
+
+  res = gsasl_step (client, s2, s2len, &s1, &s1len);
+  gsasl_free (s2);
+  s2 = NULL;
+  if (res != GSASL_NEEDS_MORE)
+    goto done;
+
+  res = gsasl_step (server, s1, s1len, &s2, &s2len);
+  if (res != GSASL_OK)
+    goto done;
+
+  gsasl_free (s1);
+  s1 = NULL;
+  res = gsasl_step (client, s2, s2len, &s1, &s1len);
+
+done:
+  gsasl_free (s1);
+  gsasl_free (s2);
+  gsasl_finish (client);
+  gsasl_finish (server);
+
+  return res;
+}
+
+static void
+make_keys (const char *password, char **stored, char **server)
+{
+  char sp[20], stk[20], svk[20];
+  size_t i;
+  int rc;
+
+  rc = gsasl_scram_derive (password, SALT, strlen (SALT), ITER,
+			   sp, stk, svk);
+  if (rc != GSASL_OK)
+    fail ("gsasl_scram_derive() failed (%d): %s\n", rc, gsasl_strerror (rc));
+
+  rc = gsasl_base64_to (stk, 20, stored, NULL);
+  if (rc == GSASL_OK)
+    rc = gsasl_base64_to (svk, 20, server, NULL);
+  if (rc != GSASL_OK)
+    fail ("gsasl_base64_to() failed (%d): %s\n", rc, gsasl_strerror (rc));
+
+  for (i = 0; i < 20; i++)
+    sprintf (saltedpassword + 2 * i, "%02x", (unsigned char) sp[i]);
+}
+
+void
+doit (void)
+{
+  static const int expected[N_MODES] = {
+    GSASL_OK,
+    GSASL_OK,
+    GSASL_AUTHENTICATION_ERROR,
+    GSASL_MECHANISM_PARSE_ERROR
+  };
+  Gsasl *ctx = NULL;
+  int res;
+
+  res = gsasl_init (&ctx);
+  if (res != GSASL_OK)
+    {
+      fail ("gsasl_init() failed (%d):\n%s\n", res, gsasl_strerror (res));
+      return;
+    }
+
+  if (!gsasl_client_support_p (ctx, "SCRAM-SHA-1")
+      || !gsasl_server_support_p (ctx, "SCRAM-SHA-1"))
+    {
+      gsasl_done (ctx);
+      fail ("No support for SCRAM-SHA-1.\n");
+      exit (77);
+    }
+
+  gsasl_callback_set (ctx, callback);
+
+  make_keys ("not " PASSWORD, &wrong_storedkey, &wrong_serverkey);
+  make_keys (PASSWORD, &storedkey, &serverkey);
+
+  for (mode = 0; mode < N_MODES; mode++)
+    {
+      res = login (ctx);
+      if (res != expected[mode])
+	fail ("mode %d: got %d (%s), expected %d\n", mode, res,
+	      gsasl_strerror_name (res), expected[mode]);
+      else if (debug)
+	printf ("mode %d: %s\n", mode, gsasl_strerror_name (res));
+    }
+
+  gsasl_free (storedkey);
+  gsasl_free (serverkey);
+  gsasl_free (wrong_storedkey);
+  gsasl_free (wrong_serverkey);
+
+  gsasl_done (ctx);
+}
@@ -0,0 +1,220 @@
+/* sessionpool.c --- Test session reuse and the session pool.
+ * Copyright (C) 2012 Simon Josefsson
+ *
+ * This file is part of GNU SASL.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdio.h>
+#include <stdarg.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "utils.h"
+
+static int
+callback (Gsasl * ctx, Gsasl_session * sctx, Gsasl_property prop)
+{
+  int rc = GSASL_NO_CALLBACK;
+
+  switch (prop)
+    {
+    case GSASL_AUTHID:
+      gsasl_property_set (sctx, prop, "user");
+      rc = GSASL_OK;
+      break;
+
+    case GSASL_PASSWORD:
+      gsasl_property_set (sctx, prop, "pencil");
+      rc = GSASL_OK;
+      break;
+
+    case GSASL_VALIDATE_SIMPLE:
+      if (strcmp (gsasl_property_fast (sctx, GSASL_PASSWORD), "pencil") == 0)
+	rc = GSASL_OK;
+      else
+	rc = GSASL_AUTHENTICATION_ERROR;
+      break;
+
+    case GSASL_AUTHZID:
+    case GSASL_HOSTNAME:
+    case GSASL_SERVICE:
+      break;
+
+    default:
+      fail ("Unknown callback property %d\n", prop);
+      break;
+    }
+
+  return rc;
+}
+
+/* Run an exchange between CLIENT and SERVER, returning the result of
+   the last server step.  LOGIN is a server-first mechanism. */
+static int
+exchange (Gsasl_session * client, Gsasl_session * server)
+{
+  char *in = NULL, *out = NULL;
+  size_t inlen = 0, outlen;
+  int cres, sres = GSASL_NEEDS_MORE;
+
+  if (strcmp (gsasl_mechanism_name (server), "LOGIN") == 0)
+    {
+      sres = gsasl_step (server, NULL, 0, &in, &inlen);
+      if (sres != GSASL_NEEDS_MORE)
+	return sres;
+    }
+
+  do
+    {
+      cres = gsasl_step (client, in, inlen, &out, &outlen);
+      gsasl_free (in);
+      in = NULL;
+      if (cres != GSASL_OK && cres != GSASL_NEEDS_MORE)
+	{
+	  gsasl_free (out);
+	  return cres;
+	}
+
+      sres = gsasl_step (server, out, outlen, &in, &inlen);
+      gsasl_free (out);
+      out = NULL;
+      if (sres != GSASL_OK && sres != GSASL_NEEDS_MORE)
+	break;
+    }
+  while (sres == GSASL_NEEDS_MORE);
+
+  gsasl_free (in);
+
+  return sres;
+}
+
+void
+doit (void)
+{
+  Gsasl *ctx = NULL;
+  Gsasl_session *client = NULL, *server = NULL, *first;
+  int res;
+  int i;
+
+  res = gsasl_init (&ctx);
+  if (res != GSASL_OK)
+    {
+      fail ("gsasl_init() failed (%d):\n%s\n", res, gsasl_strerror (res));
+      return;
+    }
+
+  if (!gsasl_client_support_p (ctx, "PLAIN")
+      || !gsasl_server_support_p (ctx, "PLAIN")
+      || !gsasl_client_support_p (ctx, "LOGIN")
+      || !gsasl_server_support_p (ctx, "LOGIN"))
+    {
+      gsasl_done (ctx);
+      fail ("No support for PLAIN and LOGIN.\n");
+      exit (77);
+    }
+
+  gsasl_callback_set (ctx, callback);
+
+  /* Reuse the same pair of handles for several authentications. */
+  res = gsasl_client_start (ctx, "PLAIN", &client);
+  if (res == GSASL_OK)
+    res = gsasl_server_start (ctx, "PLAIN", &server);
+  if (res != GSASL_OK)
+    {
+      fail ("start failed (%d): %s\n", res, gsasl_strerror (res));
+      return;
+    }
+
+  for (i = 0; i < 4; i++)
+    {
+      /* NULL keeps the current mechanism. */
+      static const char *mech[] = { NULL, "LOGIN", NULL, "PLAIN" };
+      static const char *expect[] = { "PLAIN", "LOGIN", "LOGIN", "PLAIN" };
+
+      if (i > 0)
+	{
+	  gsasl_session_hook_set (server, server);
+	  gsasl_property_set (server, GSASL_REALM, "realm");
+
+	  res = gsasl_session_reset (client, mech[i]);
+	  if (res == GSASL_OK)
+	    res = gsasl_session_reset (server, mech[i]);
+	  if (res != GSASL_OK)
+	    fail ("gsasl_session_reset() failed (%d): %s\n",
+		  res, gsasl_strerror (res));
+
+	  if (gsasl_session_hook_get (server) != NULL)
+	    fail ("session hook survived reset\n");
+	  if (gsasl_property_fast (server, GSASL_REALM) != NULL)
+	    fail ("property survived reset\n");
+	  if (gsasl_property_fast (server, GSASL_AUTHID) != NULL)
+	    fail ("authid survived reset\n");
+	}
+
+      if (strcmp (gsasl_mechanism_name (server), expect[i]) != 0)
+	fail ("unexpected mechanism %s\n", gsasl_mechanism_name (server));
+
+      res = exchange (client, server);
+      if (res != GSASL_OK)
+	fail ("exchange %d failed (%d): %s\n", i, res, gsasl_strerror (res));
+      if (debug)
+	printf ("%d: %s %s\n", i, gsasl_mechanism_name (server),
+		gsasl_strerror_name (res));
+    }
+
+  res = gsasl_session_reset (server, "NO-SUCH-MECH");
+  if (res != GSASL_UNKNOWN_MECHANISM)
+    fail ("reset to unknown mechanism returned %d\n", res);
+
+  gsasl_finish (client);
+  gsasl_finish (server);
+
+  /* With a pool, finished handles are handed out again. */
+  gsasl_session_pool_set (ctx, 1);
+
+  res = gsasl_server_start (ctx, "PLAIN", &first);
+  if (res != GSASL_OK)
+    fail ("gsasl_server_start() failed (%d): %s\n", res, gsasl_strerror (res));
+  gsasl_property_set (first, GSASL_AUTHID, "stale");
+  gsasl_finish (first);
+
+  res = gsasl_server_start (ctx, "LOGIN", &server);
+  if (res != GSASL_OK)
+    fail ("gsasl_server_start() failed (%d): %s\n", res, gsasl_strerror (res));
+  if (server != first)
+    fail ("pooled handle was not reused\n");
+  if (gsasl_property_fast (server, GSASL_AUTHID) != NULL)
+    fail ("pooled handle kept its properties\n");
+
+  res = gsasl_client_start (ctx, "LOGIN", &client);
+  if (res != GSASL_OK)
+    fail ("gsasl_client_start() failed (%d): %s\n", res, gsasl_strerror (res));
+
+  res = exchange (client, server);
+  if (res != GSASL_OK)
+    fail ("pooled exchange failed (%d): %s\n", res, gsasl_strerror (res));
+
+  /* Only one handle fits in the pool, the other is freed. */
+  gsasl_finish (client);
+  gsasl_finish (server);
+
+  gsasl_done (ctx);
+}
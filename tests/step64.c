@@ -0,0 +1,208 @@
+/* step64.c --- Test and time stepping with base64 data.
+ * Copyright (C) 2012 Simon Josefsson
+ *
+ * This file is part of GNU SASL.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdio.h>
+#include <stdarg.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "utils.h"
+
+#define MAXAUTHZID 3000
+#define LOOPS 20000
+
+static char authzid[MAXAUTHZID + 1];
+
+static int
+callback (Gsasl * ctx, Gsasl_session * sctx, Gsasl_property prop)
+{
+  switch (prop)
+    {
+    case GSASL_AUTHZID:
+      gsasl_property_set (sctx, prop, authzid);
+      return GSASL_OK;
+
+    case GSASL_AUTHID:
+      gsasl_property_set (sctx, prop, "user");
+      return GSASL_OK;
+
+    case GSASL_PASSWORD:
+      gsasl_property_set (sctx, prop, "pencil");
+      return GSASL_OK;
+
+    case GSASL_VALIDATE_SIMPLE:
+      return GSASL_OK;
+
+    default:
+      return GSASL_NO_CALLBACK;
+    }
+}
+
+/* What gsasl_step64 used to do. */
+static int
+step64_unfused (Gsasl_session * sctx, const char *b64input, char **b64output)
+{
+  size_t input_len = 0, output_len = 0;
+  char *input = NULL, *output = NULL;
+  int res;
+
+  if (b64input)
+    {
+      res = gsasl_base64_from (b64input, strlen (b64input),
+			       &input, &input_len);
+      if (res != GSASL_OK)
+	return GSASL_BASE64_ERROR;
+    }
+
+  res = gsasl_step (sctx, input, input_len, &output, &output_len);
+  free (input);
+
+  if (res == GSASL_OK || res == GSASL_NEEDS_MORE)
+    {
+      int tmpres = gsasl_base64_to (output, output_len, b64output, NULL);
+
+      free (output);
+      if (tmpres != GSASL_OK)
+	return tmpres;
+    }
+
+  return res;
+}
+
+/* Run PLAIN with STEP64 through a client and a server session, and
+   return the base64 token of the client. */
+static char *
+plain (Gsasl * ctx, int (*step64) (Gsasl_session *, const char *, char **))
+{
+  Gsasl_session *client, *server;
+  char *c, *s;
+  int res;
+
+  res = gsasl_client_start (ctx, "PLAIN", &client);
+  if (res != GSASL_OK)
+    fail ("gsasl_client_start() failed (%d):\n%s\n", res,
+	  gsasl_strerror (res));
+  res = gsasl_server_start (ctx, "PLAIN", &server);
+  if (res != GSASL_OK)
+    fail ("gsasl_server_start() failed (%d):\n%s\n", res,
+	  gsasl_strerror (res));
+
+  res = step64 (server, "", &s);
+  if (res != GSASL_NEEDS_MORE || strcmp (s, "") != 0)
+    fail ("server first step (%d)\n", res);
+  free (s);
+
+  res = step64 (client, NULL, &c);
+  if (res != GSASL_OK)
+    fail ("client step (%d)\n", res);
+
+  res = step64 (server, c, &s);
+  if (res != GSASL_OK || strcmp (s, "") != 0)
+    fail ("server step (%d)\n", res);
+  free (s);
+
+  gsasl_finish (client);
+  gsasl_finish (server);
+
+  return c;
+}
+
+static void
+report (const char *what, clock_t start)
+{
+  double secs = (double) (clock () - start) / CLOCKS_PER_SEC;
+
+  if (debug)
+    printf ("%-16s %d exchanges in %.3f s, %.0f ns/exchange\n", what, LOOPS,
+	    secs, secs * 1e9 / LOOPS);
+}
+
+void
+doit (void)
+{
+  Gsasl *ctx = NULL;
+  Gsasl_session *server;
+  char *a, *b;
+  clock_t start;
+  size_t i;
+  int res;
+
+  res = gsasl_init (&ctx);
+  if (res != GSASL_OK)
+    {
+      fail ("gsasl_init() failed (%d):\n%s\n", res, gsasl_strerror (res));
+      return;
+    }
+
+  if (!gsasl_client_support_p (ctx, "PLAIN")
+      || !gsasl_server_support_p (ctx, "PLAIN"))
+    {
+      gsasl_done (ctx);
+      return;
+    }
+
+  gsasl_callback_set (ctx, callback);
+
+  /* The tokens agree for every length modulo 3, up to large ones. */
+  for (i = 0; i < MAXAUTHZID; i += i < 10 ? 1 : 97)
+    {
+      memset (authzid, 'a' + i % 26, i);
+      authzid[i] = '\0';
+
+      a = plain (ctx, gsasl_step64);
+      b = plain (ctx, step64_unfused);
+      if (strcmp (a, b) != 0)
+	fail ("tokens differ for authzid length %lu\n", (unsigned long) i);
+      free (a);
+      free (b);
+    }
+
+  /* Invalid input is reported before the mechanism runs. */
+  res = gsasl_server_start (ctx, "PLAIN", &server);
+  if (res != GSASL_OK)
+    fail ("gsasl_server_start() failed (%d)\n", res);
+  res = gsasl_step64 (server, "AHVzZXIAcGVuY2ls=", &a);
+  if (res != GSASL_BASE64_ERROR)
+    fail ("invalid base64 accepted (%d)\n", res);
+  res = gsasl_step64 (server, "AHVzZXIAcGVuY2ls", &a);
+  if (res != GSASL_OK || strcmp (a, "") != 0)
+    fail ("server step after invalid input (%d)\n", res);
+  free (a);
+  gsasl_finish (server);
+
+  strcpy (authzid, "admin");
+
+  start = clock ();
+  for (i = 0; i < LOOPS; i++)
+    free (plain (ctx, step64_unfused));
+  report ("unfused", start);
+
+  start = clock ();
+  for (i = 0; i < LOOPS; i++)
+    free (plain (ctx, gsasl_step64));
+  report ("gsasl_step64", start);
+
+  gsasl_done (ctx);
+}
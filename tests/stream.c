@@ -0,0 +1,333 @@
+/* stream.c --- Test framing security layer messages on a byte stream.
+ * Copyright (C) 2012 Simon Josefsson
+ *
+ * This file is part of GNU SASL.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdio.h>
+#include <stdarg.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "utils.h"
+
+#define DATA_LEN 5000
+
+static char data[DATA_LEN];
+static const char *qop;
+
+static int
+callback (Gsasl * ctx, Gsasl_session * sctx, Gsasl_property prop)
+{
+  switch (prop)
+    {
+    case GSASL_AUTHID:
+      gsasl_property_set (sctx, prop, "user");
+      return GSASL_OK;
+
+    case GSASL_PASSWORD:
+      gsasl_property_set (sctx, prop, "pencil");
+      return GSASL_OK;
+
+    case GSASL_SERVICE:
+      gsasl_property_set (sctx, prop, "imap");
+      return GSASL_OK;
+
+    case GSASL_HOSTNAME:
+      gsasl_property_set (sctx, prop, "hostname");
+      return GSASL_OK;
+
+    case GSASL_QOPS:
+      gsasl_property_set (sctx, prop, "qop-auth, qop-int, qop-conf");
+      return GSASL_OK;
+
+    case GSASL_QOP:
+      gsasl_property_set (sctx, prop, qop);
+      return GSASL_OK;
+
+    case GSASL_VALIDATE_SIMPLE:
+      return GSASL_OK;
+
+    default:
+      return GSASL_NO_CALLBACK;
+    }
+}
+
+/* Authenticate CLIENT to SERVER, telling the client that the server
+   accepts messages of at most MAXBUF bytes unless it is 0.  Returns
+   false if the confidentiality layer is asked for but no ciphers are
+   offered. */
+static int
+authenticate (Gsasl_session * client, Gsasl_session * server,
+	      unsigned long maxbuf)
+{
+  char *s1, *s2;
+  size_t s1len, s2len;
+  int res;
+
+  res = gsasl_step (server, NULL, 0, &s1, &s1len);
+  if (res != GSASL_NEEDS_MORE)
+    fail ("server step 1 (%d)\n", res);
+  if (strcmp (qop, "qop-conf") == 0 && !strstr (s1, "cipher="))
+    {
+      free (s1);
+      return 0;
+    }
+  if (maxbuf)
+    {
+      s2 = malloc (s1len + 20);
+      if (!s2)
+	fail ("malloc\n");
+      sprintf (s2, "%.*s,maxbuf=%lu", (int) s1len, s1, maxbuf);
+      free (s1);
+      s1 = s2;
+      s1len = strlen (s1);
+    }
+  if (debug)
+    printf ("S: %.*s\n", (int) s1len, s1);
+
+  res = gsasl_step (client, s1, s1len, &s2, &s2len);
+  free (s1);
+  if (res != GSASL_NEEDS_MORE)
+    fail ("client step 1 (%d)\n", res);
+  if (debug)
+    printf ("C: %.*s\n", (int) s2len, s2);
+
+  res = gsasl_step (server, s2, s2len, &s1, &s1len);
+  free (s2);
+  if (res != GSASL_OK)
+    fail ("server step 2 (%d)\n", res);
+
+  res = gsasl_step (client, s1, s1len, &s2, &s2len);
+  free (s1);
+  free (s2);
+  if (res != GSASL_OK)
+    fail ("client step 2 (%d)\n", res);
+
+  return 1;
+}
+
+/* Check that the LEN bytes at P are messages of at most MAXBUF bytes,
+   return how many there are. */
+static size_t
+count_messages (const char *p, size_t len, unsigned long maxbuf)
+{
+  size_t n = 0;
+
+  while (len > 0)
+    {
+      unsigned long l;
+
+      if (len < 4)
+	fail ("truncated length prefix\n");
+      l = (p[0] & 0xFFUL) << 24 | (p[1] & 0xFFUL) << 16
+	| (p[2] & 0xFFUL) << 8 | (p[3] & 0xFFUL);
+      if (l > maxbuf || l > len - 4)
+	fail ("bad message length %lu\n", l);
+      p += 4 + l;
+      len -= 4 + l;
+      n++;
+    }
+
+  return n;
+}
+
+/* Send LEN bytes of data from FROM to TO, reading them CHUNK bytes at
+   a time, and check that they arrive. */
+static void
+transfer (Gsasl_stream * from, Gsasl_stream * to, size_t len,
+	  size_t chunk, unsigned long maxbuf)
+{
+  static char got[DATA_LEN];
+  const char *enc, *dec;
+  size_t enclen, declen, gotlen = 0, off, n;
+  int res;
+
+  res = gsasl_stream_encode (from, data, len, &enc, &enclen);
+  if (res != GSASL_OK)
+    fail ("gsasl_stream_encode (%d)\n", res);
+
+  n = count_messages (enc, enclen, maxbuf);
+  if (maxbuf < 1000 && len > maxbuf && n < len / maxbuf + 1)
+    fail ("%lu bytes sent in only %lu messages\n", (unsigned long) len,
+	  (unsigned long) n);
+
+  for (off = 0; off < enclen; off += n)
+    {
+      n = enclen - off < chunk ? enclen - off : chunk;
+      res = gsasl_stream_decode (to, enc + off, n, &dec, &declen);
+      while (res == GSASL_OK)
+	{
+	  if (gotlen + declen > len)
+	    fail ("too much data decoded\n");
+	  memcpy (got + gotlen, dec, declen);
+	  gotlen += declen;
+	  res = gsasl_stream_decode (to, NULL, 0, &dec, &declen);
+	}
+      if (res != GSASL_NEEDS_MORE)
+	fail ("gsasl_stream_decode (%d)\n", res);
+    }
+
+  if (gotlen != len || memcmp (got, data, len) != 0)
+    fail ("data of %lu bytes in chunks of %lu corrupted\n",
+	  (unsigned long) len, (unsigned long) chunk);
+}
+
+static void
+digest_md5 (Gsasl * ctx, const char *q, unsigned long maxbuf)
+{
+  static const size_t chunks[] = { 1, 3, 17, 64, 1000, 4096, 100000 };
+  static const size_t lens[] = { 1, 47, 48, 49, 1000, DATA_LEN };
+  Gsasl_session *client, *server;
+  Gsasl_stream *cs, *ss;
+  const char *p;
+  size_t i, j, len;
+  int res;
+
+  res = gsasl_server_start (ctx, "DIGEST-MD5", &server);
+  if (res != GSASL_OK)
+    fail ("gsasl_server_start() failed (%d):\n%s\n", res,
+	  gsasl_strerror (res));
+  res = gsasl_client_start (ctx, "DIGEST-MD5", &client);
+  if (res != GSASL_OK)
+    fail ("gsasl_client_start() failed (%d):\n%s\n", res,
+	  gsasl_strerror (res));
+
+  qop = q;
+  if (!authenticate (client, server, maxbuf))
+    {
+      if (debug)
+	printf ("No ciphers offered, skipping %s\n", q);
+      gsasl_finish (client);
+      gsasl_finish (server);
+      return;
+    }
+
+  if (gsasl_stream_init (client, &cs) != GSASL_OK
+      || gsasl_stream_init (server, &ss) != GSASL_OK)
+    fail ("gsasl_stream_init\n");
+
+  for (i = 0; i < sizeof (chunks) / sizeof (chunks[0]); i++)
+    for (j = 0; j < sizeof (lens) / sizeof (lens[0]); j++)
+      {
+	transfer (cs, ss, lens[j], chunks[i], maxbuf ? maxbuf : 65536);
+	transfer (ss, cs, lens[j], chunks[i], 65536);
+      }
+
+  /* Nothing comes out of an empty stream. */
+  res = gsasl_stream_decode (ss, NULL, 0, &p, &len);
+  if (res != GSASL_NEEDS_MORE || len != 0)
+    fail ("decode of nothing (%d)\n", res);
+
+  /* Messages larger than the server accepts are refused. */
+  res = gsasl_stream_decode (ss, "\x00\x01\x00\x01", 4, &p, &len);
+  if (res != GSASL_INTEGRITY_ERROR)
+    fail ("oversized message accepted (%d)\n", res);
+
+  gsasl_stream_done (cs);
+  gsasl_stream_done (ss);
+  gsasl_finish (client);
+  gsasl_finish (server);
+}
+
+static void
+plain (Gsasl * ctx)
+{
+  Gsasl_session *client, *server;
+  Gsasl_stream *cs, *ss;
+  char *s1, *s2;
+  const char *p;
+  size_t s1len, s2len, len;
+  int res;
+
+  res = gsasl_client_start (ctx, "PLAIN", &client);
+  if (res != GSASL_OK)
+    fail ("gsasl_client_start() failed (%d):\n%s\n", res,
+	  gsasl_strerror (res));
+  res = gsasl_server_start (ctx, "PLAIN", &server);
+  if (res != GSASL_OK)
+    fail ("gsasl_server_start() failed (%d):\n%s\n", res,
+	  gsasl_strerror (res));
+
+  res = gsasl_step (client, NULL, 0, &s1, &s1len);
+  if (res != GSASL_OK)
+    fail ("client step (%d)\n", res);
+  res = gsasl_step (server, s1, s1len, &s2, &s2len);
+  if (res != GSASL_OK)
+    fail ("server step (%d)\n", res);
+  free (s1);
+  free (s2);
+
+  if (gsasl_stream_init (client, &cs) != GSASL_OK
+      || gsasl_stream_init (server, &ss) != GSASL_OK)
+    fail ("gsasl_stream_init\n");
+
+  /* Without a security layer the data passes through. */
+  res = gsasl_stream_encode (cs, data, DATA_LEN, &p, &len);
+  if (res != GSASL_OK || p != data || len != DATA_LEN)
+    fail ("encode did not pass through (%d)\n", res);
+  res = gsasl_stream_decode (ss, data, 10, &p, &len);
+  if (res != GSASL_OK || p != data || len != 10)
+    fail ("decode did not pass through (%d)\n", res);
+  res = gsasl_stream_decode (ss, NULL, 0, &p, &len);
+  if (res != GSASL_NEEDS_MORE)
+    fail ("decode of nothing (%d)\n", res);
+
+  gsasl_stream_done (cs);
+  gsasl_stream_done (ss);
+  gsasl_finish (client);
+  gsasl_finish (server);
+}
+
+void
+doit (void)
+{
+  Gsasl *ctx = NULL;
+  size_t i;
+  int res;
+
+  res = gsasl_init (&ctx);
+  if (res != GSASL_OK)
+    {
+      fail ("gsasl_init() failed (%d):\n%s\n", res, gsasl_strerror (res));
+      return;
+    }
+
+  gsasl_callback_set (ctx, callback);
+
+  for (i = 0; i < DATA_LEN; i++)
+    data[i] = i * 7 + i / 251;
+
+  if (gsasl_client_support_p (ctx, "DIGEST-MD5")
+      && gsasl_server_support_p (ctx, "DIGEST-MD5"))
+    {
+      digest_md5 (ctx, "qop-int", 0);
+      digest_md5 (ctx, "qop-int", 64);
+      digest_md5 (ctx, "qop-conf", 0);
+      digest_md5 (ctx, "qop-conf", 64);
+    }
+
+  if (gsasl_client_support_p (ctx, "PLAIN")
+      && gsasl_server_support_p (ctx, "PLAIN"))
+    plain (ctx);
+
+  gsasl_done (ctx);
+}
@@ -106,5 +106,43 @@ doit (void)
 	fail ("FAIL: not cram-md5?!\n");
     }
 
+  if (gsasl_client_support_p (ctx, "PLAIN")
+      && gsasl_client_support_p (ctx, "CRAM-MD5")
+      && gsasl_client_support_p (ctx, "DIGEST-MD5"))
+    {
+      const char *out[4];
+      size_t n;
+
+      str = "FOO PLAIN CRAM-MD5 DIGEST-MD5 PLAIN FOO CRAM-MD5";
+      n = gsasl_client_suggest_mechanisms (ctx, str, out, 4);
+      if (debug)
+	printf ("gsasl_client_suggest_mechanisms(%s) = %lu\n", str,
+		(unsigned long) n);
+      if (n != 3 || strcmp (out[0], "CRAM-MD5") != 0
+	  || strcmp (out[1], "DIGEST-MD5") != 0
+	  || strcmp (out[2], "PLAIN") != 0)
+	fail ("FAIL: unexpected ranking?!\n");
+
+      n = gsasl_client_suggest_mechanisms (ctx, str, out, 2);
+      if (n != 2 || strcmp (out[0], "CRAM-MD5") != 0
+	  || strcmp (out[1], "DIGEST-MD5") != 0)
+	fail ("FAIL: unexpected truncated ranking?!\n");
+
+      n = gsasl_client_suggest_mechanisms (ctx, str, out, 0);
+      if (n != 0)
+	fail ("FAIL: stored into empty array?!\n");
+    }
+
+  if (gsasl_client_support_p (ctx, "SCRAM-SHA-1-PLUS"))
+    {
+      /* No callback, so no channel bindings. */
+      str = "SCRAM-SHA-1-PLUS SCRAM-SHA-1";
+      p = gsasl_client_suggest_mechanism (ctx, str);
+      if (debug)
+	printf ("gsasl_client_suggest_mechanism(%s) = %s\n", str, p);
+      if (!p || strcmp (p, "SCRAM-SHA-1") != 0)
+	fail ("FAIL: not scram-sha-1?!\n");
+    }
+
   gsasl_done (ctx);
 }
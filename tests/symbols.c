@@ -39,7 +39,9 @@ doit (void)
   /* LIBGSASL_1.1 */
   assert_symbol_exists ((const void *) GSASL_VALID_MECHANISM_CHARACTERS);
   assert_symbol_exists ((const void *) gsasl_base64_from);
+  assert_symbol_exists ((const void *) gsasl_base64_from_buffer);
   assert_symbol_exists ((const void *) gsasl_base64_to);
+  assert_symbol_exists ((const void *) gsasl_base64_to_buffer);
   assert_symbol_exists ((const void *) gsasl_callback);
   assert_symbol_exists ((const void *) gsasl_callback_hook_get);
   assert_symbol_exists ((const void *) gsasl_callback_hook_set);
@@ -48,17 +50,33 @@ doit (void)
   assert_symbol_exists ((const void *) gsasl_client_mechlist);
   assert_symbol_exists ((const void *) gsasl_client_start);
   assert_symbol_exists ((const void *) gsasl_client_suggest_mechanism);
+  assert_symbol_exists ((const void *) gsasl_client_suggest_mechanisms);
   assert_symbol_exists ((const void *) gsasl_client_support_p);
   assert_symbol_exists ((const void *) gsasl_decode);
+  assert_symbol_exists ((const void *) gsasl_decode_buffer);
+  assert_symbol_exists ((const void *) gsasl_decode_ref);
+  assert_symbol_exists ((const void *) gsasl_decodev);
+  assert_symbol_exists ((const void *) gsasl_digest_md5_cache_forget);
+  assert_symbol_exists ((const void *) gsasl_digest_md5_cache_set);
+  assert_symbol_exists ((const void *) gsasl_digest_md5_cache_stats);
+  assert_symbol_exists ((const void *) gsasl_digest_md5_hash);
+  assert_symbol_exists ((const void *) gsasl_digest_md5_hash_batch);
   assert_symbol_exists ((const void *) gsasl_done);
   assert_symbol_exists ((const void *) gsasl_encode);
+  assert_symbol_exists ((const void *) gsasl_encode_buffer);
+  assert_symbol_exists ((const void *) gsasl_encode_ref);
+  assert_symbol_exists ((const void *) gsasl_encodev);
   assert_symbol_exists ((const void *) gsasl_finish);
   assert_symbol_exists ((const void *) gsasl_free);
+  assert_symbol_exists ((const void *) gsasl_freeze);
   assert_symbol_exists ((const void *) gsasl_hmac_md5);
   assert_symbol_exists ((const void *) gsasl_init);
   assert_symbol_exists ((const void *) gsasl_md5);
   assert_symbol_exists ((const void *) gsasl_mechanism_name);
   assert_symbol_exists ((const void *) gsasl_nonce);
+  assert_symbol_exists ((const void *) gsasl_nonce_pool_set);
+  assert_symbol_exists ((const void *) gsasl_prefetch_properties);
+  assert_symbol_exists ((const void *) gsasl_prefetch_set);
   assert_symbol_exists ((const void *) gsasl_property_fast);
   assert_symbol_exists ((const void *) gsasl_property_get);
   assert_symbol_exists ((const void *) gsasl_property_set);
@@ -74,6 +92,12 @@ doit (void)
   assert_symbol_exists ((const void *) gsasl_simple_getpass);
   assert_symbol_exists ((const void *) gsasl_step64);
   assert_symbol_exists ((const void *) gsasl_step);
+  assert_symbol_exists ((const void *) gsasl_step_buffer);
+  assert_symbol_exists ((const void *) gsasl_step_resume);
+  assert_symbol_exists ((const void *) gsasl_stream_decode);
+  assert_symbol_exists ((const void *) gsasl_stream_done);
+  assert_symbol_exists ((const void *) gsasl_stream_encode);
+  assert_symbol_exists ((const void *) gsasl_stream_init);
   assert_symbol_exists ((const void *) gsasl_strerror);
   assert_symbol_exists ((const void *) gsasl_strerror_name);
 